@@ -5,10 +5,43 @@
  * Just for debug purposes - instead of reading ticks from desk movement, could be generated by MCU
  */
 #define USE_TICK_GENERATOR false
+
+/**
+ * Optional motor current sensing with ADC on a shunt (with amplifier giving CURRENT_SENSE_MV_PER_A at the ADC input).
+ * Samples are taken every CURRENT_SENSE_PERIOD_US and processed in batches of CURRENT_SENSE_BATCH. Current over
+ * CURRENT_SENSE_LIMIT_MA during exact movement is handled as an obstruction, except for the first
+ * CURRENT_SENSE_BLANKING batches after the motor start. Uses TIMER1, so excludes the tick generator.
+ */
+#define USE_CURRENT_SENSE false
+#define CURRENT_SENSE_ADC_INPUT NRF_ADC_CONFIG_INPUT_2
+#define CURRENT_SENSE_MV_PER_A 500
+#define CURRENT_SENSE_LIMIT_MA 2000
+#define CURRENT_SENSE_PERIOD_US 1000
+#define CURRENT_SENSE_BATCH 16
+#define CURRENT_SENSE_BLANKING 20
 #define DEBUG 0
 
+/**
+ * Optional phase B of quadrature tick sensors (pins in controller.c). Direction of each tick is then decoded from
+ * the phase B level latched on the tick edge, instead of assumed from the driven direction. CTRL_MISWIRING_TICKS
+ * consecutive ticks opposite to the driven direction (swapped motor leads or sensor phases) stop the desk. It should
+ * exceed the ticks coasted after reversal. CTRL_TICK_PHASE_B_INVERTED swaps the decoded direction.
+ */
+#define USE_TICK_PHASE_B false
+#define CTRL_TICK_PHASE_B_INVERTED false
+#define CTRL_MISWIRING_TICKS 5
+
+/**
+ * Optional decoding of the quadrature tick sensor by the QDEC peripheral, with phase B on the USE_TICK_PHASE_B pin.
+ * Transitions of both phases are accumulated by hardware and read by the controller poll, so coasting and backdriving
+ * are counted in the right direction with no interrupt per edge. There is single QDEC, so only one column is supported.
+ * Replaces the GPIOTE phase B latching and the tick glitch filter (QDEC has own debounce filter).
+ */
+#define USE_QDEC false
+
 /** Value used to convert ticks count to more recognizable unit, broadcasted by status service.
  * In this case, it's fraction 1*10e-6, where one unit of multiplied ticks equals 1um.
+ * Geometry values below are defaults only, used until the desk is calibrated over the calibration characteristic.
  */
 #define TICK_TO_HEIGHT_MULTI 525
 
@@ -23,4 +56,164 @@
 #define TICKS_UPPER_LIMIT 816
 #define TICK_LOWER_LIMIT 0
 
+/**
+ * Default gear backlash, in subticks (1/256 of tick), taken up by the motor after each direction reversal
+ * before the column follows. Limited to CTRL_BACKLASH_MAX.
+ */
+#define CTRL_BACKLASH_DEFAULT 0
+#define CTRL_BACKLASH_MAX 1024
+
+/**
+ * Position uncertainty budget, in subticks. It grows with ticks travelled (a subtick per CTRL_UNCERTAINTY_TICKS_PER_SUBTICK
+ * ticks, hall sensor does not miss edges by itself), each direction reversal and rejected glitch,
+ * and is cleared when the desk reaches an end stop: by extremum movement, or by stall closer to the limit than
+ * the uncertainty (at least CTRL_REHOME_WINDOW_MIN). Target at the lower limit is driven into the end stop, when
+ * the uncertainty is over CTRL_REHOME_WINDOW_MIN. Over CTRL_UNCERTAINTY_LIMIT, homing is requested from the client.
+ */
+#define CTRL_UNCERTAINTY_TICKS_PER_SUBTICK 16
+#define CTRL_UNCERTAINTY_PER_REVERSAL 32
+#define CTRL_UNCERTAINTY_PER_GLITCH 64
+#define CTRL_UNCERTAINTY_LIMIT 1280
+#define CTRL_REHOME_WINDOW_MIN 256
+
+/**
+ * Motor thermal model. Motor rated for THERMAL_DUTY_PERCENT duty cycle may run THERMAL_BUDGET_S seconds from cold,
+ * then new movements are refused until it cools down. Movement in progress is stopped THERMAL_GRACE_S over the budget.
+ */
+#define THERMAL_DUTY_PERCENT 10
+#define THERMAL_BUDGET_S 120
+#define THERMAL_GRACE_S 30
+
+/**
+ * Usage statistics. Time is counted in USAGE_BAND_COUNT (up to 7, limited by flash space) height bands splitting the range between desk limits evenly,
+ * countertop at USAGE_STAND_HEIGHT_UM or higher counts to the standing streak. Day rolls over at local midnight, or
+ * after 24 h of uptime until the clock is synced. Statistics are written to flash every USAGE_CHECKPOINT_S, so up to that time is lost on power loss.
+ */
+#define USAGE_BAND_COUNT 4
+#define USAGE_STAND_HEIGHT_UM 1000000
+#define USAGE_CHECKPOINT_S 3600
+
+/**
+ * Movement history ring log in the external flash, HISTORY_PAGE_COUNT pages of 256 bytes from HISTORY_FIRST_PAGE
+ * (page 0 keeps settings). Records take around 8 bytes, so one sector (256 pages) holds about 7000 movements.
+ * Up to HISTORY_QUEUE_SIZE finished movements wait for the main loop to be written.
+ */
+#define HISTORY_FIRST_PAGE 256
+#define HISTORY_PAGE_COUNT 256
+#define HISTORY_QUEUE_SIZE 4
+
+/**
+ * Lifetime counters (motor starts, travel, end stop hits) in the external flash, each in a ring of
+ * LIFETIME_PAGES_PER_COUNTER pages from LIFETIME_FIRST_PAGE. Every increment only clears one bit, a page is erased
+ * once per ~2000 increments of its ring, i.e. once per ~30000 increments of the counter with 16 pages.
+ */
+#define LIFETIME_FIRST_PAGE 512
+#define LIFETIME_PAGES_PER_COUNTER 16
+
+/**
+ * Wall clock kept by RTC1, set by the phone through the time characteristic. RTC rate is corrected by the drift
+ * measured between syncs at least CLOCK_SYNC_INTERVAL_MIN_S apart, drift over CLOCK_DRIFT_MAX_PPM is ignored.
+ */
+#define CLOCK_SYNC_INTERVAL_MIN_S 3600
+#define CLOCK_DRIFT_MAX_PPM 500
+
+/**
+ * Number of lifting columns, each with own motor and tick input (up to 2).
+ * With more columns, the leading one is slowed down by CTRL_SYNC_GAIN percent of duty per tick it leads
+ * the trailing column over CTRL_SYNC_TOLERANCE (in subticks, 1/256 of tick), so the level error stays near it.
+ */
+#define CTRL_CHANNEL_COUNT 1
+#define CTRL_SYNC_TOLERANCE 256
+#define CTRL_SYNC_GAIN 20
+
+/**
+ * Number of height preset slots, stored in external flash (up to 4, the tables of 7 bonded peers fill the flash
+ * space reserved for them).
+ */
+#define PRESETS_COUNT 4
+
+/**
+ * Motion sequencer. Capacity of the queue of steps (targets and dwells) executed back to back,
+ * and maximal distance of the stop position from the step target, in ticks, to continue with the next step.
+ */
+#define SEQUENCER_QUEUE_SIZE 8
+#define SEQUENCER_TARGET_TOLERANCE 2
+
+/**
+ * Jog (hold-to-move) stops, when no heartbeat arrives within this time, in ms.
+ */
+#define CTRL_JOG_TIMEOUT_MS 300
+
+/**
+ * Local buttons, indexes of board buttons (0 and 1 are used by bsp_btn_ble). Hold longer than long press time jogs,
+ * single and double press (within double press time) recall presets. Times in ms.
+ */
+#define BUTTON_CTRL_UP 2
+#define BUTTON_CTRL_DOWN 3
+#define BUTTON_CTRL_LONG_PRESS_MS 500
+#define BUTTON_CTRL_DOUBLE_PRESS_MS 300
+
+/**
+ * Stall detection. While the motor is driven, movement is considered as stopped when no tick arrived
+ * for CTRL_STALL_PERIOD_MULTIPLIER times the measured tick period, but not sooner than CTRL_STALL_MIN_TIME_MS.
+ * Until CTRL_STALL_MIN_SAMPLES tick periods are measured (motor spin-up), the fixed 1200 ms timeout applies.
+ */
+#define CTRL_STALL_PERIOD_MULTIPLIER 3
+#define CTRL_STALL_MIN_TIME_MS 30
+#define CTRL_STALL_MIN_SAMPLES 3
+
+/**
+ * Dead reckoning. When CTRL_DEAD_RECKONING_FAILURES consecutive driven movements see no tick on any column, tick sensor
+ * is considered failed and position is estimated from motor duty and on-time with the speed learned for each direction.
+ * Estimated travel grows the uncertainty by CTRL_DEAD_RECKONING_UNCERTAINTY percent. Extremum movement is driven
+ * CTRL_DEAD_RECKONING_OVERRUN percent of the full travel past the limit. Tick counting resumes on the first edge.
+ */
+#define CTRL_DEAD_RECKONING_FAILURES 2
+#define CTRL_DEAD_RECKONING_UNCERTAINTY 10
+#define CTRL_DEAD_RECKONING_OVERRUN 20
+
+/**
+ * Obstruction is detected, when time since the last tick exceeds CTRL_OBSTRUCTION_RATIO percent of the period
+ * learned for the direction and height zone (2^CTRL_OBSTRUCTION_ZONE_SHIFT ticks), scaled to the current duty.
+ * Desk then backs off by CTRL_OBSTRUCTION_BACKOFF subticks (1/256 of tick), or only stops when it is zero.
+ * Learned periods are kept in the external flash page CTRL_OBSTRUCTION_PAGE, rewritten after a movement which changed them.
+ */
+#define CTRL_OBSTRUCTION_RATIO 250
+#define CTRL_OBSTRUCTION_ZONE_SHIFT 7
+#define CTRL_OBSTRUCTION_BACKOFF 2560
+#define CTRL_OBSTRUCTION_PAGE 1
+
+/**
+ * Tick input glitch filter. Level change has to last at least TICK_FILTER_MIN_PULSE_MS from its edge (timestamped in
+ * the GPIOTE handler) to be counted as a tick.
+ * Tick arriving sooner than TICK_FILTER_PERIOD_RATIO percents of the measured tick period is rejected as implausible.
+ */
+#define TICK_FILTER_MIN_PULSE_MS 5
+#define TICK_FILTER_PERIOD_RATIO 40
+
+/**
+ * Motor soft-start and soft-stop. Enable pin is driven by PWM, which duty starts at MOTOR_DUTY_MIN
+ * and is changed by ramp steps every controller poll (10 ms) towards the duty requested by trajectory planner.
+ * On reversal, the opposite direction pin is set only MOTOR_DEAD_TIME_MS after the previous one was released with
+ * zero duty, so the driver never switches its legs under load (checked by the controller poll, so rounded up to 10 ms).
+ */
+#define MOTOR_PWM_PERIOD_US 50
+#define MOTOR_DUTY_MIN 35
+#define MOTOR_RAMP_ACCEL_STEP 5
+#define MOTOR_RAMP_DECEL_STEP 10
+#define MOTOR_DEAD_TIME_MS 50
+
+/**
+ * Trajectory planner. Velocities are in subticks (1/256 of tick) per second, accelerations in subticks per second squared.
+ * Full duty speed and coasting distance are learned per direction, starting from the defaults.
+ * TRAJECTORY_KP is a duty change in percents per one percent of velocity error.
+ */
+#define TRAJECTORY_ACCEL 40000
+#define TRAJECTORY_DECEL 30000
+#define TRAJECTORY_SPEED_DEFAULT 14000
+#define TRAJECTORY_SPEED_RATIO 90
+#define TRAJECTORY_COAST_DEFAULT 256
+#define TRAJECTORY_KP 1
+#define TRAJECTORY_LEARN_MIN_DUTY 60
+
 #endif
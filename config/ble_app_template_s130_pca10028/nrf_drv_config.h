@@ -13,6 +13,9 @@
 #ifndef NRF_DRV_CONFIG_H
 #define NRF_DRV_CONFIG_H
 
+#include <stdbool.h>
+#include "acromegaly_config.h"
+
 /**
  * Provide a non-zero value here in applications that need to use several
  * peripherals with the same ID that are sharing certain resources
@@ -67,7 +70,7 @@
 #define TIMER1_INSTANCE_INDEX      (TIMER0_ENABLED)
 #endif
  
-#define TIMER2_ENABLED 0
+#define TIMER2_ENABLED 1 /* Used by motor PWM */
 
 #if (TIMER2_ENABLED == 1)
 #define TIMER2_CONFIG_FREQUENCY    NRF_TIMER_FREQ_16MHz
@@ -361,7 +364,11 @@
 #define TWIS_NO_SYNC_MODE 0
 
 /* QDEC */
+#if USE_QDEC /* Used by tick decoding, see acromegaly_config.h */
+#define QDEC_ENABLED 1
+#else
 #define QDEC_ENABLED 0
+#endif
 
 #if (QDEC_ENABLED == 1)
 #define QDEC_CONFIG_REPORTPER    NRF_QDEC_REPORTPER_10
@@ -377,7 +384,11 @@
 #endif
 
 /* ADC */
+#if USE_CURRENT_SENSE /* Used by current sense, see acromegaly_config.h */
+#define ADC_ENABLED 1
+#else
 #define ADC_ENABLED 0
+#endif
 
 #if (ADC_ENABLED == 1)
 #define ADC_CONFIG_IRQ_PRIORITY APP_IRQ_PRIORITY_LOW
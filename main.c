@@ -32,6 +32,7 @@
 #include "app_error.h"
 #include "app_timer.h"
 #include "app_trace.h"
+#include "app_util_platform.h"
 #include "ble.h"
 #include "ble_advdata.h"
 #include "ble_advertising.h"
@@ -41,19 +42,30 @@
 #include "boards.h"
 #include "bsp.h"
 #include "bsp_btn_ble.h"
+#include "button_ctrl.h"
+#include "calibration.h"
+#include "clock.h"
 #include "controller.h"
 #include "ctrl_service.h"
 #include "device_manager.h"
+#include "history.h"
+#include "lifetime.h"
 #include "m45pe_drv.h"
 #include "m45pe_keys.h"
 #include "nordic_common.h"
 #include "nrf.h"
 #include "nrf_gpio.h"
 #include "nrf_log.h"
+#include "obstruction.h"
+#include "presets.h"
 #include "pstorage.h"
 #include "sensorsim.h"
+#include "sequencer.h"
 #include "softdevice_handler.h"
 #include "status_service.h"
+#include "thermal.h"
+#include "trajectory.h"
+#include "usage.h"
 
 #define SPI_CS_PIN 4 /**< SPI CS Pin.*/
 
@@ -67,7 +79,7 @@
 #define APP_ADV_TIMEOUT_IN_SECONDS 10 /**< The advertising timeout in units of seconds. */
 
 #define APP_TIMER_PRESCALER 0 /**< Value of the RTC1 PRESCALER register. */
-#define APP_TIMER_OP_QUEUE_SIZE 4 /**< Size of timer operation queues. */
+#define APP_TIMER_OP_QUEUE_SIZE 8 /**< Size of timer operation queues, shared by the timers of all modules. */
 
 #define MIN_CONN_INTERVAL MSEC_TO_UNITS(100, UNIT_1_25_MS) /**< Minimum acceptable connection interval (0.1 seconds). */
 #define MAX_CONN_INTERVAL MSEC_TO_UNITS(500, UNIT_1_25_MS) /**< Maximum acceptable connection interval (0.2 second). */
@@ -99,7 +111,12 @@ static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID; /**< Handle of the curr
 static ble_status_service_t m_status_service;
 static ble_ctrl_service_t m_ctrl_service;
 controller_state_t ctrl_state;
-uint8_t ctrl_state_changed = 0x00;
+controller_state_t pending_ctrl_state; /* Latest state from the controller callback, not processed by the main loop yet */
+volatile uint8_t ctrl_state_changed = 0x00;
+controller_state_t notified_state;
+int16_t stored_positions[CTRL_CHANNEL_COUNT];
+uint16_t stored_uncertainty; /* Column positions last written to flash, interpolated updates do not require write */
+uint32_t reported_rejected_ticks; /* Rejected tick edges last published in the usage characteristic */
 
 /**@brief Callback function for asserts in the SoftDevice.
  *
@@ -119,7 +136,23 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t* p_file_name)
 
 static void update_status_service()
 {
-    status_characteristic_update(&m_status_service, ctrl_state.position, ctrl_state.target, ctrl_state.target_type, ctrl_state.movement);
+    memcpy(&notified_state, &ctrl_state, sizeof(controller_state_t));
+    status_characteristic_update(&m_status_service, ctrl_state.position, ctrl_state.subtick, ctrl_state.target, ctrl_state.target_type, ctrl_state.movement, ctrl_state.level_error, ctrl_state.flags, thermal_budget_get());
+}
+
+/**@brief Function checking if controller state change should be notified, according to peer preferences.
+ */
+static bool status_change_notifiable()
+{
+    if (presets_prefs_get() & PRESETS_PREF_NOTIFY_INTERPOLATED) {
+        return true;
+    }
+
+    return ctrl_state.position != notified_state.position
+        || ctrl_state.target != notified_state.target
+        || ctrl_state.target_type != notified_state.target_type
+        || ctrl_state.movement != notified_state.movement
+        || ctrl_state.flags != notified_state.flags;
 }
 
 static void timer_timeout_handler(void* p_context)
@@ -412,6 +445,7 @@ void bsp_event_handler(bsp_event_t event)
         break;
 
     default:
+        button_ctrl_on_bsp_evt(event);
         break;
     }
 }
@@ -432,6 +466,20 @@ static uint32_t device_manager_evt_handler(dm_handle_t const* p_handle,
     }
 #endif // BLE_DFU_APP_SUPPORT
 
+    switch (p_event->event_id) {
+    case DM_EVT_LINK_SECURED:
+        presets_peer_select(p_handle->device_id);
+        break;
+    case DM_EVT_DISCONNECTION:
+        presets_peer_deselect();
+        break;
+    case DM_EVT_DEVICE_CONTEXT_DELETED:
+        presets_peer_erase(p_handle->device_id);
+        break;
+    default:
+        break;
+    }
+
     return NRF_SUCCESS;
 }
 
@@ -548,17 +596,32 @@ static void power_manage(void)
 
 void controller_cb(controller_state_t* state)
 {    
-    if (ctrl_state_changed == 0x00) {
-        memcpy(&ctrl_state, state, sizeof(controller_state_t));
-        ctrl_state_changed = 0x01;
-    }
+    sequencer_on_controller_state(state);
+    usage_on_controller_state(state);
+
+    /* Latest state replaces the pending one, so the final state of a movement is never dropped */
+    CRITICAL_REGION_ENTER();
+    memcpy(&pending_ctrl_state, state, sizeof(controller_state_t));
+    ctrl_state_changed = 0x01;
+    CRITICAL_REGION_EXIT();
 }
 
-void system_init()
+void system_init(bool erase_bonds)
 {
-    int16_t tmp = 0;
-    m45pe_read(FLASH_CTRL_POS_KEY, (uint8_t*)&tmp, sizeof(int16_t));
-    controller_init(tmp);
+    memset(stored_positions, 0, sizeof(stored_positions));
+    m45pe_read(FLASH_CTRL_POS_KEY, (uint8_t*)stored_positions, sizeof(stored_positions));
+    stored_uncertainty = UINT16_MAX; /* Erased flash, never homed */
+    m45pe_read(FLASH_CTRL_UNCERTAINTY_KEY, (uint8_t*)&stored_uncertainty, sizeof(stored_uncertainty));
+    calibration_init();
+    clock_init();
+    thermal_init();
+    usage_init();
+    history_init();
+    lifetime_init();
+    controller_init(stored_positions, stored_uncertainty);
+    presets_init(erase_bonds);
+    sequencer_init();
+    button_ctrl_init();
     // controller_init(0);
 }
 
@@ -584,7 +647,7 @@ int main(void)
     device_manager_init(erase_bonds);
     gap_params_init();
     m45_init();
-    system_init();
+    system_init(erase_bonds);
     services_init();
     advertising_init();
     conn_params_init();
@@ -596,12 +659,47 @@ int main(void)
     APP_ERROR_CHECK(err_code);   
 
     for (;;) {
-        if (ctrl_state_changed == 0x01) {    
-            m45pe_write(FLASH_CTRL_POS_KEY, (uint8_t*)&ctrl_state.position, sizeof(int16_t));
-            update_status_service();
+        if (ctrl_state_changed == 0x01) {
+            CRITICAL_REGION_ENTER();
+            memcpy(&ctrl_state, &pending_ctrl_state, sizeof(controller_state_t));
             ctrl_state_changed = 0x00;
+            CRITICAL_REGION_EXIT();
+
+            /* Written only at rest, each write blocks the main loop and wears the page */
+            if (ctrl_state.movement == MOVE_DIRECTION_NONE) {
+                if (memcmp(ctrl_state.channel_position, stored_positions, sizeof(stored_positions)) != 0) {
+                    m45pe_write(FLASH_CTRL_POS_KEY, (uint8_t*)ctrl_state.channel_position, sizeof(stored_positions));
+                    memcpy(stored_positions, ctrl_state.channel_position, sizeof(stored_positions));
+                }
+                if (ctrl_state.uncertainty != stored_uncertainty) {
+                    m45pe_write(FLASH_CTRL_UNCERTAINTY_KEY, (uint8_t*)&ctrl_state.uncertainty, sizeof(stored_uncertainty));
+                    stored_uncertainty = ctrl_state.uncertainty;
+                }
+            }
+            if (status_change_notifiable()) {
+                update_status_service();
+            }
         }
 
+        presets_flush();
+        calibration_flush();
+        thermal_flush();
+        trajectory_flush();
+        obstruction_flush();
+        clock_flush();
+        usage_flush();
+        lifetime_flush();
+
+        uint32_t rejected_ticks = controller_rejected_ticks_get();
+
+        if (usage_is_changed() | lifetime_is_changed() | (rejected_ticks != reported_rejected_ticks)) {
+            reported_rejected_ticks = rejected_ticks;
+            status_usage_update(&m_status_service);
+        }
+
+        history_flush();
+        status_history_pump(&m_status_service);
+
         power_manage();
     }
 }
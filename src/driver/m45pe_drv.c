@@ -20,8 +20,11 @@
 #define ERASE_PAGE 0xDB
 #define ERASE_SECTOR 0xD8
 
+#define STATUS_WIP 0x01 /* Write in progress bit of the status register */
+
 #define SPI_INSTANCE 0
 #define TX_LENGTH 12
+#define ADDRESS_LENGTH 4 /* Instruction and 24 bit address */
 
 static const nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(SPI_INSTANCE); /**< SPI instance. */
 static volatile bool spi_xfer_done; /**< Flag used to indicate that SPI instance completed the transfer. */
@@ -29,6 +32,9 @@ static volatile bool spi_xfer_done; /**< Flag used to indicate that SPI instance
 static uint8_t m_rx_buf[TX_LENGTH + 1]; /**< RX buffer. */
 static uint8_t m_tx_buf[TX_LENGTH]; /**< Address of RX buffer used as read operation result. */
 
+static uint8_t m_bulk_tx_buf[ADDRESS_LENGTH + M45PE_BULK_LENGTH]; /**< Instruction, address and data to program. */
+static uint8_t m_bulk_rx_buf[ADDRESS_LENGTH + M45PE_BULK_LENGTH]; /**< Read data, after ADDRESS_LENGTH bytes clocked during the address. */
+
 /**
  * @brief SPI user event handler.
  * @param event
@@ -62,8 +68,58 @@ void m45pe_transfer_blocking(uint8_t tx_len, uint8_t rx_len)
     nrf_delay_ms(10);
 }
 
+/**
+ * @brief   Transfers instruction with 24 bit address, followed by tx_len bytes of m_bulk_tx_buf, and receives rx_len bytes.
+ *          Waits for the transfer end, so it has to be called from the main loop, not from an interrupt context.
+ */
+static void m45pe_bulk_transfer(uint8_t instruction, uint32_t address, uint8_t tx_len, uint8_t rx_len)
+{
+    m_bulk_tx_buf[0] = instruction;
+    m_bulk_tx_buf[1] = (uint8_t)(address >> 16);
+    m_bulk_tx_buf[2] = (uint8_t)(address >> 8);
+    m_bulk_tx_buf[3] = (uint8_t)address;
+
+    spi_xfer_done = false;
+    APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, m_bulk_tx_buf, ADDRESS_LENGTH + tx_len, m_bulk_rx_buf, ADDRESS_LENGTH + tx_len + rx_len));
+
+    while (!spi_xfer_done) {
+        __WFE();
+    }
+}
+
+/**
+ * @brief   Transfers single byte instruction, and receives rx_len bytes to m_bulk_rx_buf.
+ */
+static void m45pe_instruction(uint8_t instruction, uint8_t rx_len)
+{
+    m_bulk_tx_buf[0] = instruction;
+
+    spi_xfer_done = false;
+    APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, m_bulk_tx_buf, 1, m_bulk_rx_buf, 1 + rx_len));
+
+    while (!spi_xfer_done) {
+        __WFE();
+    }
+}
+
+/**
+ * @brief   Polls the status register until program or erase in progress (also started by m45pe_write) is finished.
+ */
+static void m45pe_wait_ready(void)
+{
+    do {
+        m45pe_instruction(READ_STATUS, 1);
+    } while (m_bulk_rx_buf[1] & STATUS_WIP);
+}
+
+/**
+ * @brief   Writes len bytes (up to 8) at the key address of the settings page. Waits until previous write, program or
+ *          erase is finished, as the device ignores instructions while it is busy.
+ */
 void m45pe_write(uint8_t key, uint8_t* val, uint8_t len)
 {
+    m45pe_wait_ready();
+
     if (!spi_xfer_done)
         return;
 
@@ -83,6 +139,8 @@ void m45pe_write(uint8_t key, uint8_t* val, uint8_t len)
 
 void m45pe_read(uint8_t key, uint8_t* val, uint8_t len)
 {
+    m45pe_wait_ready();
+
     if (!spi_xfer_done)
         return;
 
@@ -118,4 +176,39 @@ void m45_init()
     spi_xfer_done = true;
 
     APP_ERROR_CHECK(nrf_drv_spi_init(&spi, &spi_config, spi_event_handler));
-}
\ No newline at end of file
+}
+
+/**
+ * @brief   Reads len bytes from 24 bit address, len up to M45PE_BULK_LENGTH. Unlike m45pe_read, waits for the transfer
+ *          instead of the fixed delay, so it has to be called from the main loop.
+ */
+void m45pe_read_at(uint32_t address, uint8_t* val, uint8_t len)
+{
+    m45pe_wait_ready();
+    m45pe_bulk_transfer(READ_BYTES, address, 0, len);
+
+    memcpy(val, m_bulk_rx_buf + ADDRESS_LENGTH, len);
+}
+
+/**
+ * @brief   Programs len bytes at 24 bit address, without erase. Programming can only clear bits, so the area is expected
+ *          to be erased, or the value to clear more bits of the stored one. Data can not cross the page boundary.
+ */
+void m45pe_program(uint32_t address, uint8_t const* val, uint8_t len)
+{
+    m45pe_wait_ready();
+    m45pe_instruction(WRITE_ENABLED, 0);
+
+    memcpy(m_bulk_tx_buf + ADDRESS_LENGTH, val, len);
+    m45pe_bulk_transfer(PROGRAM_PAGE, address, len, 0);
+}
+
+/**
+ * @brief   Erases page at 24 bit address, setting all its bytes to 0xFF.
+ */
+void m45pe_erase_page(uint32_t address)
+{
+    m45pe_wait_ready();
+    m45pe_instruction(WRITE_ENABLED, 0);
+    m45pe_bulk_transfer(ERASE_PAGE, address, 0, 0);
+}
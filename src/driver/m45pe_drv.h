@@ -2,4 +2,11 @@
 
 void m45_init();
 void m45pe_write(uint8_t key, uint8_t* val, uint8_t len);
-void m45pe_read(uint8_t key, uint8_t* val, uint8_t len);
\ No newline at end of file
+void m45pe_read(uint8_t key, uint8_t* val, uint8_t len);
+
+#define M45PE_PAGE_SIZE 256
+#define M45PE_BULK_LENGTH 128 /* Longest read or program by address */
+
+void m45pe_read_at(uint32_t address, uint8_t* val, uint8_t len);
+void m45pe_program(uint32_t address, uint8_t const* val, uint8_t len);
+void m45pe_erase_page(uint32_t address);
@@ -1,6 +1,15 @@
 #ifndef M45PE_KEYS__
 #define M45PE_KEYS__
 
-#define FLASH_CTRL_POS_KEY  0x08
+#define FLASH_CTRL_POS_KEY  0x08 /* int16 position of each column */
+#define FLASH_CTRL_UNCERTAINTY_KEY 0x0C /* uint16 position uncertainty, in subticks */
+#define FLASH_PRESETS_KEY   0x10 /* int32 target of each preset slot, shared by peers without bond */
+#define FLASH_PEER_PRESETS_KEY 0x20 /* Preset slots of each bonded peer, indexed by device manager device id */
+#define FLASH_PRESETS_PREFS_KEY 0x90 /* uint8 notification preferences of each bonded peer, then shared one */
+#define FLASH_CALIBRATION_KEY 0xA0 /* Desk geometry, calibration_t */
+#define FLASH_THERMAL_KEY 0xB0 /* uint32 motor heat, in ms of run at full duty */
+#define FLASH_TRAJECTORY_KEY 0xB4 /* Learned speed and coasting of each direction, uint16 subticks per second and int16 subticks */
+#define FLASH_USAGE_KEY 0xC0 /* Usage statistics, usage_stats_t */
+#define FLASH_CLOCK_KEY 0xF0 /* int32 RTC drift correction, in parts per 2^20 */
 
 #endif
@@ -0,0 +1,244 @@
+#include "button_ctrl.h"
+#include "acromegaly_config.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "bsp.h"
+#include "controller.h"
+#include "nrf_log.h"
+#include "presets.h"
+#include "sequencer.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Button control local definitions.                                         */
+/*===========================================================================*/
+
+#define APP_BTN_TIMER_PRESCALER 0 /* Same as of the controller timer, RTC1 is shared */
+#define APP_BTN_TIMER_INTERVAL APP_TIMER_TICKS(50, APP_BTN_TIMER_PRESCALER) /* Gesture timing resolution, also jog heartbeat period */
+#define APP_BTN_TICKS_LONG_PRESS APP_TIMER_TICKS(BUTTON_CTRL_LONG_PRESS_MS, APP_BTN_TIMER_PRESCALER)
+#define APP_BTN_TICKS_DOUBLE_PRESS APP_TIMER_TICKS(BUTTON_CTRL_DOUBLE_PRESS_MS, APP_BTN_TIMER_PRESCALER)
+
+/* BSP events assigned to button actions, keys 4+ are not present on the board */
+#define BTN_EVT_UP_PUSH BSP_EVENT_KEY_2
+#define BTN_EVT_DOWN_PUSH BSP_EVENT_KEY_3
+#define BTN_EVT_UP_RELEASE BSP_EVENT_KEY_4
+#define BTN_EVT_DOWN_RELEASE BSP_EVENT_KEY_5
+
+#define BTN_UP 0
+#define BTN_DOWN 1
+#define BTN_COUNT 2
+
+/* Preset slots recalled by gestures, indexed by button */
+#define BTN_SINGLE_PRESS_SLOTS { 1, 0 }
+#define BTN_DOUBLE_PRESS_SLOTS { 3, 2 }
+
+typedef enum {
+    BTN_STATE_IDLE,
+    BTN_STATE_PRESSED, /* Waiting for release or long press */
+    BTN_STATE_RELEASED, /* Short press done, waiting for the second press */
+    BTN_STATE_JOGGING, /* Long press, desk moves until release */
+    BTN_STATE_SUPPRESSED /* Gesture is consumed, waiting for release */
+} button_state_t;
+
+/*===========================================================================*/
+/* Button control local variables and types.                                 */
+/*===========================================================================*/
+
+typedef struct
+{
+    button_state_t state;
+    uint32_t event_time; /* RTC counter value of the last push or release */
+} button_t;
+
+APP_TIMER_DEF(m_app_btn_timer_id);
+
+static button_t m_buttons[BTN_COUNT];
+static bool m_timer_running;
+
+static const uint8_t m_directions[BTN_COUNT] = { MOVE_DIRECTION_UP, MOVE_DIRECTION_DOWN };
+static const uint8_t m_single_slots[BTN_COUNT] = BTN_SINGLE_PRESS_SLOTS;
+static const uint8_t m_double_slots[BTN_COUNT] = BTN_DOUBLE_PRESS_SLOTS;
+
+/*===========================================================================*/
+/* Button control local functions.                                           */
+/*===========================================================================*/
+
+static void timer_start()
+{
+    if (!m_timer_running) {
+        m_timer_running = true;
+        app_timer_start(m_app_btn_timer_id, APP_BTN_TIMER_INTERVAL, NULL);
+    }
+}
+
+static void preset_recall(uint8_t slot)
+{
+    int32_t target;
+
+    NRF_LOG_PRINTF("Button preset %d\r\n", slot);
+
+    if (presets_target_get(slot, &target)) {
+        controller_target_subtick_set(target);
+    }
+}
+
+/**
+ * @brief   Stops any movement. Gestures in progress are consumed, so no other action follows the stop.
+ */
+static void stop_all()
+{
+    sequencer_clear();
+    controller_stop();
+
+    for (uint8_t i = 0; i < BTN_COUNT; i++) {
+        if (m_buttons[i].state == BTN_STATE_RELEASED) {
+            m_buttons[i].state = BTN_STATE_IDLE;
+        } else if (m_buttons[i].state != BTN_STATE_IDLE) {
+            m_buttons[i].state = BTN_STATE_SUPPRESSED;
+        }
+    }
+}
+
+static void on_push(uint8_t btn, uint32_t now)
+{
+    button_t* p_button = &m_buttons[btn];
+
+    if (controller_is_moving() || sequencer_is_running()) {
+        NRF_LOG_PRINTF("Button stop\r\n");
+        stop_all();
+        p_button->state = BTN_STATE_SUPPRESSED;
+        return;
+    }
+
+    switch (p_button->state) {
+    case BTN_STATE_RELEASED:
+        p_button->state = BTN_STATE_SUPPRESSED;
+        sequencer_clear();
+        preset_recall(m_double_slots[btn]);
+        break;
+    default:
+        p_button->state = BTN_STATE_PRESSED;
+        p_button->event_time = now;
+        timer_start();
+        break;
+    }
+}
+
+static void on_release(uint8_t btn, uint32_t now)
+{
+    button_t* p_button = &m_buttons[btn];
+
+    switch (p_button->state) {
+    case BTN_STATE_PRESSED:
+        p_button->state = BTN_STATE_RELEASED;
+        p_button->event_time = now;
+        timer_start();
+        break;
+    case BTN_STATE_JOGGING:
+        controller_stop();
+        p_button->state = BTN_STATE_IDLE;
+        break;
+    default:
+        p_button->state = BTN_STATE_IDLE;
+        break;
+    }
+}
+
+static void timer_timeout_handler(void* p_context)
+{
+    uint32_t now;
+    bool active = false;
+
+    app_timer_cnt_get(&now);
+
+    for (uint8_t i = 0; i < BTN_COUNT; i++) {
+        button_t* p_button = &m_buttons[i];
+        uint32_t elapsed;
+
+        app_timer_cnt_diff_compute(now, p_button->event_time, &elapsed);
+
+        switch (p_button->state) {
+        case BTN_STATE_PRESSED:
+            if (elapsed >= APP_BTN_TICKS_LONG_PRESS) {
+                p_button->state = BTN_STATE_JOGGING;
+                sequencer_clear();
+                controller_jog(m_directions[i]);
+            }
+            active = true;
+            break;
+        case BTN_STATE_JOGGING:
+            controller_jog(m_directions[i]); /* Heartbeat */
+            active = true;
+            break;
+        case BTN_STATE_RELEASED:
+            if (elapsed >= APP_BTN_TICKS_DOUBLE_PRESS) {
+                p_button->state = BTN_STATE_IDLE;
+                sequencer_clear();
+                preset_recall(m_single_slots[i]);
+            } else {
+                active = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (!active) {
+        m_timer_running = false;
+        app_timer_stop(m_app_btn_timer_id);
+    }
+}
+
+/*===========================================================================*/
+/* Button control exported functions.                                        */
+/*===========================================================================*/
+
+/**
+ * @brief   Assigns push and release of the up and down buttons to BSP events. Should be called after bsp_init
+ *          and controller_init.
+ */
+void button_ctrl_init(void)
+{
+    uint32_t err_code;
+
+    err_code = bsp_event_to_button_action_assign(BUTTON_CTRL_UP, BSP_BUTTON_ACTION_PUSH, BTN_EVT_UP_PUSH);
+    APP_ERROR_CHECK(err_code);
+    err_code = bsp_event_to_button_action_assign(BUTTON_CTRL_UP, BSP_BUTTON_ACTION_RELEASE, BTN_EVT_UP_RELEASE);
+    APP_ERROR_CHECK(err_code);
+    err_code = bsp_event_to_button_action_assign(BUTTON_CTRL_DOWN, BSP_BUTTON_ACTION_PUSH, BTN_EVT_DOWN_PUSH);
+    APP_ERROR_CHECK(err_code);
+    err_code = bsp_event_to_button_action_assign(BUTTON_CTRL_DOWN, BSP_BUTTON_ACTION_RELEASE, BTN_EVT_DOWN_RELEASE);
+    APP_ERROR_CHECK(err_code);
+
+    app_timer_create(&m_app_btn_timer_id, APP_TIMER_MODE_REPEATED, timer_timeout_handler);
+}
+
+/**
+ * @brief   Handles button events, not consumed by the BSP BLE buttons module.
+ * @note    Press while the desk moves stops it. Short press recalls preset 1 (up) or 0 (down), double press preset 3 or 2,
+ *          long press moves in the button direction until release.
+ */
+void button_ctrl_on_bsp_evt(bsp_event_t event)
+{
+    uint32_t now;
+    app_timer_cnt_get(&now);
+
+    switch (event) {
+    case BTN_EVT_UP_PUSH:
+        on_push(BTN_UP, now);
+        break;
+    case BTN_EVT_DOWN_PUSH:
+        on_push(BTN_DOWN, now);
+        break;
+    case BTN_EVT_UP_RELEASE:
+        on_release(BTN_UP, now);
+        break;
+    case BTN_EVT_DOWN_RELEASE:
+        on_release(BTN_DOWN, now);
+        break;
+    default:
+        break;
+    }
+}
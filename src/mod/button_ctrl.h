@@ -0,0 +1,9 @@
+#ifndef BUTTON_CTRL_H__
+#define BUTTON_CTRL_H__
+
+#include "bsp.h"
+
+void button_ctrl_init(void);
+void button_ctrl_on_bsp_evt(bsp_event_t event);
+
+#endif
@@ -0,0 +1,219 @@
+#include "calibration.h"
+#include "acromegaly_config.h"
+#include "controller.h"
+#include "height_lut.h"
+#include "m45pe_drv.h"
+#include "m45pe_keys.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Calibration local definitions.                                            */
+/*===========================================================================*/
+
+#define RECIPROCAL_SHIFT 23 /* Fraction bits of the fixed point reciprocal of tick height, it fits 32 bits for any tick height */
+#define FLASH_CHUNK 8 /* Longest single m45pe write */
+
+#define SUBTICK_SHIFT 8 /* log2 of CTRL_SUBTICK_SCALE */
+#define LUT_NODE_SHIFT (HEIGHT_LUT_SHIFT + SUBTICK_SHIFT) /* Nodes spacing, in subticks */
+#define LUT_INVERSE_ITERATIONS 2 /* Deviation changes slowly, so inverse converges within a subtick */
+
+#if (1 << SUBTICK_SHIFT) != CTRL_SUBTICK_SCALE
+#error "SUBTICK_SHIFT does not match CTRL_SUBTICK_SCALE"
+#endif
+
+/*===========================================================================*/
+/* Calibration local variables and types.                                    */
+/*===========================================================================*/
+
+static calibration_t m_calibration;
+static uint32_t m_subtick_per_um; /* CTRL_SUBTICK_SCALE / tick_to_height, with RECIPROCAL_SHIFT fraction bits */
+static bool m_dirty;
+static bool m_lut_active; /* Calibration matches the linear part the table was generated against */
+
+/*===========================================================================*/
+/* Calibration local functions.                                              */
+/*===========================================================================*/
+
+/**
+ * @brief   Bounds result of 64 bit arithmetic to int32. Any int16 position multiplied by any valid tick height does not
+ *          fit in int32, so conversions are computed in 64 bits.
+ */
+static int32_t saturate(int64_t value)
+{
+    return value > INT32_MAX ? INT32_MAX : (value < INT32_MIN ? INT32_MIN : (int32_t)value);
+}
+
+static bool is_valid(calibration_t const* p_calibration)
+{
+    return p_calibration->tick_to_height != 0
+        && p_calibration->tick_to_height != UINT16_MAX
+        && p_calibration->ticks_lower_limit < p_calibration->ticks_upper_limit
+        && p_calibration->backlash <= CTRL_BACKLASH_MAX;
+}
+
+/**
+ * @brief   Recomputes reciprocal of tick height, so conversions of BLE packets need no division,
+ *          which nRF51 has no instruction for.
+ */
+static void update_reciprocal()
+{
+    m_subtick_per_um = (uint32_t)((((uint64_t)CTRL_SUBTICK_SCALE << RECIPROCAL_SHIFT) + m_calibration.tick_to_height / 2) / m_calibration.tick_to_height);
+}
+
+/**
+ * @brief   Enables the table only when its linear part matches the calibration. Deviations are measured against that
+ *          line, so on top of a different one they would move heights by the difference of both lines.
+ */
+static void update_lut_basis(void)
+{
+    m_lut_active = m_calibration.base_height == HEIGHT_LUT_BASE_HEIGHT && m_calibration.tick_to_height == HEIGHT_LUT_TICK_HEIGHT;
+
+    if (!m_lut_active) {
+        NRF_LOG_PRINTF("Calib: height table ignored, generated for base %d, tick %d\r\n", HEIGHT_LUT_BASE_HEIGHT, HEIGHT_LUT_TICK_HEIGHT);
+    }
+}
+
+/**
+ * @brief   Returns deviation of the measured height from the linear geometry, interpolated between nodes of the
+ *          generated table. Position out of the table uses its edge node.
+ * 
+ * @param[in] subtick   Position in subticks
+ * 
+ * @return Deviation in um, zero when the table does not match the calibration
+ */
+static int32_t lut_deviation(int32_t subtick)
+{
+    if (!m_lut_active) {
+        return 0;
+    }
+
+    if (subtick <= 0) {
+        return m_height_lut[0];
+    }
+
+    uint32_t index = (uint32_t)subtick >> LUT_NODE_SHIFT;
+
+    if (index >= HEIGHT_LUT_COUNT - 1) {
+        return m_height_lut[HEIGHT_LUT_COUNT - 1];
+    }
+
+    int32_t fraction = subtick & ((1 << LUT_NODE_SHIFT) - 1);
+    return m_height_lut[index] + (((m_height_lut[index + 1] - m_height_lut[index]) * fraction) >> LUT_NODE_SHIFT);
+}
+
+/*===========================================================================*/
+/* Calibration exported functions.                                           */
+/*===========================================================================*/
+
+/**
+ * @brief   Loads desk geometry from external flash. Defaults from the config are used, when the desk was never calibrated.
+ */
+void calibration_init(void)
+{
+    for (uint8_t offset = 0; offset < sizeof(calibration_t); offset += FLASH_CHUNK) {
+        uint8_t len = sizeof(calibration_t) - offset < FLASH_CHUNK ? sizeof(calibration_t) - offset : FLASH_CHUNK;
+        m45pe_read(FLASH_CALIBRATION_KEY + offset, (uint8_t*)&m_calibration + offset, len);
+    }
+
+    if (!is_valid(&m_calibration)) {
+        m_calibration.base_height = BASE_HEIGHT;
+        m_calibration.tick_to_height = TICK_TO_HEIGHT_MULTI;
+        m_calibration.ticks_upper_limit = TICKS_UPPER_LIMIT;
+        m_calibration.ticks_lower_limit = TICK_LOWER_LIMIT;
+        m_calibration.backlash = CTRL_BACKLASH_DEFAULT;
+    }
+
+    m_dirty = false;
+    update_reciprocal();
+    update_lut_basis();
+
+    NRF_LOG_PRINTF("Calib: base %d, tick %d, limits %d - %d, backlash %d\r\n", m_calibration.base_height, m_calibration.tick_to_height,
+        m_calibration.ticks_lower_limit, m_calibration.ticks_upper_limit, m_calibration.backlash);
+}
+
+calibration_t const* calibration_get(void)
+{
+    return &m_calibration;
+}
+
+/**
+ * @brief   Replaces desk geometry. Value is applied immediately and written to flash on calibration_flush.
+ * @note    Positions and presets are kept in ticks. Caller erases presets when tick height changes.
+ * 
+ * @return false if geometry is invalid and was not applied
+ */
+bool calibration_set(calibration_t const* p_calibration)
+{
+    if (!is_valid(p_calibration)) {
+        return false;
+    }
+
+    m_calibration = *p_calibration;
+    m_dirty = true;
+    update_reciprocal();
+    update_lut_basis();
+
+    return true;
+}
+
+/**
+ * @brief   Writes changed geometry to flash. Should be called from the main loop, not from an interrupt context.
+ */
+void calibration_flush(void)
+{
+    if (!m_dirty) {
+        return;
+    }
+
+    m_dirty = false;
+
+    for (uint8_t offset = 0; offset < sizeof(calibration_t); offset += FLASH_CHUNK) {
+        uint8_t len = sizeof(calibration_t) - offset < FLASH_CHUNK ? sizeof(calibration_t) - offset : FLASH_CHUNK;
+        m45pe_write(FLASH_CALIBRATION_KEY + offset, (uint8_t*)&m_calibration + offset, len);
+    }
+}
+
+/**
+ * @brief   Converts height of the countertop, in um, to position in subticks.
+ * @note    Inverse of the table deviation is found by fixed point iteration starting at the linear estimate.
+ */
+int32_t calibration_height_to_subtick(int32_t height)
+{
+    int32_t distance = saturate((int64_t)height - m_calibration.base_height);
+    int32_t subtick = calibration_distance_to_subtick(distance);
+
+    for (uint8_t i = 0; i < LUT_INVERSE_ITERATIONS; i++) {
+        subtick = calibration_distance_to_subtick(saturate((int64_t)distance - lut_deviation(subtick)));
+    }
+
+    return subtick;
+}
+
+/**
+ * @brief   Converts signed distance, in um, to subticks. Only linear geometry is applied.
+ */
+int32_t calibration_distance_to_subtick(int32_t distance)
+{
+    int64_t scaled = (int64_t)distance * m_subtick_per_um;
+    int64_t half = (int64_t)1 << (RECIPROCAL_SHIFT - 1);
+
+    return saturate(scaled >= 0 ? (scaled + half) >> RECIPROCAL_SHIFT : -((-scaled + half) >> RECIPROCAL_SHIFT));
+}
+
+/**
+ * @brief   Converts position in subticks to height of the countertop, in um.
+ */
+int32_t calibration_subtick_to_height(int32_t subtick)
+{
+    return saturate((int64_t)calibration_subtick_to_distance(subtick) + m_calibration.base_height + lut_deviation(subtick));
+}
+
+/**
+ * @brief   Converts signed distance in subticks to um. Only linear geometry is applied.
+ */
+int32_t calibration_subtick_to_distance(int32_t subtick)
+{
+    return saturate(((int64_t)subtick * m_calibration.tick_to_height) / CTRL_SUBTICK_SCALE);
+}
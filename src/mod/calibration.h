@@ -0,0 +1,25 @@
+#ifndef CALIBRATION_H__
+#define CALIBRATION_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    int32_t base_height; /* Height of the countertop at the lower limit, in um */
+    uint16_t tick_to_height; /* Height of one tick, in um */
+    int16_t ticks_upper_limit;
+    int16_t ticks_lower_limit;
+    uint16_t backlash; /* Motor travel after direction reversal before the column follows, in subticks */
+} calibration_t;
+
+void calibration_init(void);
+calibration_t const* calibration_get(void);
+bool calibration_set(calibration_t const* p_calibration);
+void calibration_flush(void);
+int32_t calibration_height_to_subtick(int32_t height);
+int32_t calibration_distance_to_subtick(int32_t distance);
+int32_t calibration_subtick_to_height(int32_t subtick);
+int32_t calibration_subtick_to_distance(int32_t subtick);
+
+#endif
@@ -0,0 +1,243 @@
+#include "clock.h"
+#include "acromegaly_config.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "m45pe_drv.h"
+#include "m45pe_keys.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Clock local definitions.                                                  */
+/*===========================================================================*/
+
+#define APP_CLOCK_TIMER_PRESCALER 0 /* Same as of the controller timer, RTC1 is shared */
+#define APP_CLOCK_TIMER_INTERVAL APP_TIMER_TICKS(64000, APP_CLOCK_TIMER_PRESCALER) /* Well within the RTC counter wrap */
+
+#define CLOCK_TICKS_PER_SECOND APP_TIMER_TICKS(1000, APP_CLOCK_TIMER_PRESCALER)
+#define RTC_COUNTER_MASK 0x00FFFFFF
+
+#define DRIFT_SCALE (1L << 20) /* Drift correction is in parts per 2^20, about ppm */
+#define DRIFT_MAX ((int32_t)(((int64_t)CLOCK_DRIFT_MAX_PPM * DRIFT_SCALE) / 1000000))
+
+#define DRIFT_ERASED 0xFFFFFFFF /* Value of erased flash, as int32 it would be a valid drift of -1 */
+
+/*===========================================================================*/
+/* Clock local variables and types.                                          */
+/*===========================================================================*/
+
+APP_TIMER_DEF(m_app_clock_timer_id);
+
+/* Clock is kept as time at the anchor, RTC counter value moved forward by the timer before the counter wraps. */
+static uint32_t m_anchor_rtc;
+static uint32_t m_anchor_seconds; /* Epoch time, or time since boot until synced */
+static uint32_t m_anchor_ticks; /* Fraction of the second, in RTC ticks */
+static int32_t m_drift_rest; /* Correction below one tick, in 1/DRIFT_SCALE of tick */
+static uint64_t m_uptime_ticks; /* RTC ticks since boot at the anchor, without correction */
+
+static int32_t m_drift; /* Rate correction of the RTC, in parts per DRIFT_SCALE */
+static int32_t m_stored_drift;
+
+static bool m_synced;
+static uint8_t m_sync_count;
+static int16_t m_offset; /* Local time offset from UTC, in minutes */
+static uint64_t m_reference_uptime; /* Uptime of the sync the drift is measured from, in RTC ticks */
+static uint64_t m_reference_time; /* Epoch time of that sync, in RTC ticks */
+
+/*===========================================================================*/
+/* Clock local functions.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief   Returns RTC ticks elapsed since the anchor, and the same interval corrected by the drift.
+ */
+static uint32_t elapsed_get(uint32_t* p_corrected)
+{
+    uint32_t now;
+    uint32_t elapsed;
+
+    app_timer_cnt_get(&now);
+    elapsed = (now - m_anchor_rtc) & RTC_COUNTER_MASK;
+    *p_corrected = elapsed + (int32_t)(((int64_t)elapsed * m_drift) / DRIFT_SCALE);
+
+    return elapsed;
+}
+
+/**
+ * @brief   Moves the anchor to the current RTC counter value, keeping the drift correction remainder.
+ */
+static void anchor_advance(void)
+{
+    uint32_t now;
+    uint32_t elapsed;
+    int64_t corrected;
+
+    app_timer_cnt_get(&now);
+    elapsed = (now - m_anchor_rtc) & RTC_COUNTER_MASK;
+    corrected = (int64_t)elapsed * (DRIFT_SCALE + m_drift) + m_drift_rest;
+
+    m_anchor_rtc = now;
+    m_anchor_ticks += (uint32_t)(corrected / DRIFT_SCALE);
+    m_drift_rest = (int32_t)(corrected % DRIFT_SCALE);
+    m_anchor_seconds += m_anchor_ticks / CLOCK_TICKS_PER_SECOND;
+    m_anchor_ticks %= CLOCK_TICKS_PER_SECOND;
+    m_uptime_ticks += elapsed;
+}
+
+static void timer_timeout_handler(void* p_context)
+{
+    CRITICAL_REGION_ENTER();
+    anchor_advance();
+    CRITICAL_REGION_EXIT();
+}
+
+/**
+ * @brief   Measures RTC drift from the uptime and epoch time elapsed since the reference sync. Short intervals are not
+ *          precise enough (sync itself is off by the connection latency), so they keep the reference. Implausible
+ *          drift, i.e. the phone time was changed, restarts the measurement.
+ */
+static void drift_update(uint64_t time)
+{
+    uint64_t uptime_elapsed = m_uptime_ticks - m_reference_uptime;
+    int64_t time_elapsed = (int64_t)(time - m_reference_time);
+
+    if (m_synced && uptime_elapsed < (uint64_t)CLOCK_SYNC_INTERVAL_MIN_S * CLOCK_TICKS_PER_SECOND) {
+        return;
+    }
+
+    if (m_synced) {
+        int64_t drift = ((time_elapsed - (int64_t)uptime_elapsed) * DRIFT_SCALE) / (int64_t)uptime_elapsed;
+
+        if (drift >= -DRIFT_MAX && drift <= DRIFT_MAX) {
+            m_drift = (int32_t)drift;
+            NRF_LOG_PRINTF("Clock drift %d / 2^20\r\n", m_drift);
+        }
+    }
+
+    m_reference_uptime = m_uptime_ticks;
+    m_reference_time = time;
+}
+
+/*===========================================================================*/
+/* Clock exported functions.                                                 */
+/*===========================================================================*/
+
+/**
+ * @brief   Starts the clock from zero, restoring the drift correction from external flash.
+ */
+void clock_init(void)
+{
+    uint32_t stored = DRIFT_ERASED;
+    m45pe_read(FLASH_CLOCK_KEY, (uint8_t*)&stored, sizeof(stored));
+
+    int32_t drift = (int32_t)stored;
+
+    m_drift = stored != DRIFT_ERASED && drift >= -DRIFT_MAX && drift <= DRIFT_MAX ? drift : 0;
+    m_stored_drift = m_drift;
+
+    m_anchor_seconds = 0;
+    m_anchor_ticks = 0;
+    m_drift_rest = 0;
+    m_uptime_ticks = 0;
+    m_synced = false;
+    m_sync_count = 0;
+    m_offset = 0;
+    app_timer_cnt_get(&m_anchor_rtc);
+
+    app_timer_create(&m_app_clock_timer_id, APP_TIMER_MODE_REPEATED, timer_timeout_handler);
+    app_timer_start(m_app_clock_timer_id, APP_CLOCK_TIMER_INTERVAL, NULL);
+}
+
+/**
+ * @brief   Sets the clock to the time sent by the phone, and corrects its rate.
+ * 
+ * @param[in] epoch         Seconds since 1970-01-01 UTC
+ * @param[in] milliseconds  Fraction of the second
+ * @param[in] offset        Local time offset from UTC, in minutes
+ */
+void clock_sync(uint32_t epoch, uint16_t milliseconds, int16_t offset)
+{
+    uint32_t ticks = ((uint32_t)(milliseconds % 1000) * CLOCK_TICKS_PER_SECOND) / 1000;
+
+    CRITICAL_REGION_ENTER();
+    anchor_advance();
+    drift_update((uint64_t)epoch * CLOCK_TICKS_PER_SECOND + ticks);
+
+    m_anchor_seconds = epoch;
+    m_anchor_ticks = ticks;
+    m_drift_rest = 0;
+    m_offset = offset;
+    m_synced = true;
+    m_sync_count++;
+    CRITICAL_REGION_EXIT();
+
+    NRF_LOG_PRINTF("Clock synced to %d\r\n", epoch);
+}
+
+/**
+ * @brief   Returns current time in seconds, since 1970-01-01 UTC, or since boot until the clock is synced. It costs
+ *          a read of the RTC counter and a multiplication, so it can be used to timestamp any event.
+ */
+uint32_t clock_get(void)
+{
+    uint32_t seconds;
+    uint32_t corrected;
+
+    CRITICAL_REGION_ENTER();
+    elapsed_get(&corrected);
+    seconds = m_anchor_seconds + (m_anchor_ticks + corrected) / CLOCK_TICKS_PER_SECOND;
+    CRITICAL_REGION_EXIT();
+
+    return seconds;
+}
+
+/**
+ * @brief   Returns time since boot in seconds, not affected by syncs.
+ */
+uint32_t clock_uptime_get(void)
+{
+    uint64_t uptime;
+    uint32_t corrected;
+
+    CRITICAL_REGION_ENTER();
+    uptime = m_uptime_ticks + elapsed_get(&corrected);
+    CRITICAL_REGION_EXIT();
+
+    return (uint32_t)(uptime / CLOCK_TICKS_PER_SECOND);
+}
+
+bool clock_is_synced(void)
+{
+    return m_synced;
+}
+
+/**
+ * @brief   Returns number of syncs since boot, to detect steps of the clock.
+ */
+uint8_t clock_sync_count_get(void)
+{
+    return m_sync_count;
+}
+
+/**
+ * @brief   Returns local time offset from UTC, in seconds.
+ */
+int32_t clock_local_offset_get(void)
+{
+    return (int32_t)m_offset * 60;
+}
+
+/**
+ * @brief   Writes measured drift to flash, so it is used since boot. Should be called from the main loop, not from an
+ *          interrupt context.
+ */
+void clock_flush(void)
+{
+    int32_t drift = m_drift;
+
+    if (drift != m_stored_drift) {
+        m45pe_write(FLASH_CLOCK_KEY, (uint8_t*)&drift, sizeof(drift));
+        m_stored_drift = drift;
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef CLOCK_H__
+#define CLOCK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void clock_init(void);
+void clock_sync(uint32_t epoch, uint16_t milliseconds, int16_t offset);
+uint32_t clock_get(void);
+uint32_t clock_uptime_get(void);
+bool clock_is_synced(void);
+uint8_t clock_sync_count_get(void);
+int32_t clock_local_offset_get(void);
+void clock_flush(void);
+
+#endif
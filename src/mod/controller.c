@@ -4,11 +4,21 @@
 #include "app_timer.h"
 #include "acromegaly_config.h"
 #include "boards.h"
+#include "calibration.h"
+#include "current_sense.h"
+#include "history.h"
+#include "lifetime.h"
+#include "motor.h"
 #include "nrf.h"
 #include "nrf_drv_gpiote.h"
 #include "nrf_gpio.h"
 #include "nrf_log.h"
+#include "obstruction.h"
+#include "quadrature.h"
+#include "thermal.h"
+#include "tick_filter.h"
 #include "tick_generator.h"
+#include "trajectory.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
@@ -17,181 +27,1259 @@
 /* Controller local definitions.                                             */
 /*===========================================================================*/
 
-#define GPIO_MOTOR_ENABLED_PIN 28
-#define GPIO_MOTOR_UP_PIN 16
-#define GPIO_MOTOR_DOWN_PIN 15
-#define GPIO_TICK_INPUT 29
+#define GPIO_TICK_INPUTS { 29, 30 } /* Indexed by channel */
+#define GPIO_TICK_PHASE_B_INPUTS { 5, 6 } /* Indexed by channel, used with USE_TICK_PHASE_B */
 #define GPIO_TICK_OUTPUT 01 /* Tick PWM generator, fo testing purpoese */
 
+#if USE_QDEC && (USE_TICK_PHASE_B || CTRL_CHANNEL_COUNT > 1)
+#error "QDEC decodes single column and replaces phase B latching"
+#endif
+
 #define NIL_POSITION -1 /* Marks target as unset */
+#define RTC_COUNTER_MASK 0x00FFFFFF /* RTC1 counter is 24 bit */
+
+#define SUBTICK_MAX (CTRL_SUBTICK_SCALE - 1) /* Interpolation never reaches the next tick before its edge arrives */
+#define SUBTICK_REPORT_STEP (CTRL_SUBTICK_SCALE / 4) /* Minimal change of interpolated position reported to the callback */
+#define SPEED_LEARN_STEADY_TICKS 6 /* Ticks at unchanged duty before the speed is learned, the desk lags duty changes */
+#define SPEED_LEARN_DEVIATION_DIVISOR 32 /* Speed is learned only from periods within 1/32 of their running average */
+
+#define DIRECTION_DEBUG(direction) direction == MOVE_DIRECTION_UP ? "UP" : (direction == MOVE_DIRECTION_DOWN ? "DOWN" : "NONE")
+#define controller_call_cb() \
+    if (m_cb)                \
+    m_cb(&m_state)
+
+#define APP_CTRL_TIMER_INTERVAL_MS 10
+#define APP_CTRL_TIMER_PRESCALER 0 /**< Value of the RTC1 PRESCALER register. */
+#define APP_CTRL_TIMER_INTERVAL APP_TIMER_TICKS(APP_CTRL_TIMER_INTERVAL_MS, APP_CTRL_TIMER_PRESCALER) // 10 ms intervals
+
+#define CTR_TIMER_TICKS_STOP_THRESHOLD APP_TIMER_TICKS(1200, APP_CTRL_TIMER_PRESCALER) /* RTC ticks without position change required to decide that movement has stopped, when tick period is unknown */
+#define CTR_TIMER_TICKS_PER_SECOND APP_TIMER_TICKS(1000, APP_CTRL_TIMER_PRESCALER)
+#define CTR_TIMER_TICKS_STALL_MIN APP_TIMER_TICKS(CTRL_STALL_MIN_TIME_MS, APP_CTRL_TIMER_PRESCALER) /* Lower bound of the adaptive stall threshold */
+#define CTR_TIMER_TICKS_JOG_TIMEOUT APP_TIMER_TICKS(CTRL_JOG_TIMEOUT_MS, APP_CTRL_TIMER_PRESCALER)
+
+/*===========================================================================*/
+/* Controller exported variables.                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Controller local variables and types.                                     */
+/*===========================================================================*/
+
+typedef struct
+{
+    tick_filter_t tick_filter;
+    int16_t position;
+    int16_t subtick; /* Position interpolated between ticks, as offset from position in subticks */
+    uint32_t last_tick_time; /* RTC counter value of the last position change, or of the motor start */
+    uint32_t tick_period; /* Running average of the inter-tick period, in RTC ticks */
+    uint8_t tick_samples; /* Number of periods measured since the motor start */
+    bool stalled; /* Channel reached its end stop during extremum movement and was released */
+    bool throttled; /* Channel is slowed down or paused by the sync correction, so its ticks can stop */
+    int16_t lash; /* Motor travel up not passed to the column yet, in subticks, from 0 (after moving down) to the backlash */
+    uint8_t reversed_ticks; /* Consecutive ticks opposite to the driven direction */
+    uint8_t steady_duty; /* Motor duty at the previous tick */
+    uint8_t steady_ticks; /* Consecutive ticks at steady_duty */
+    uint32_t reckoning_rest; /* Remainder of the estimated travel, below one subtick, in 1/CTR_TIMER_TICKS_PER_SECOND of subtick */
+} controller_channel_t;
+
+APP_TIMER_DEF(m_app_ctrl_timer_id);
+
+static controller_cb_t m_cb; /* Current state of controller */
+static controller_state_t m_state; /* COntroller state callback method. Optional */
+
+static const uint8_t m_tick_pins[] = GPIO_TICK_INPUTS;
+#if USE_TICK_PHASE_B || USE_QDEC
+static const uint8_t m_phase_b_pins[] = GPIO_TICK_PHASE_B_INPUTS;
+#endif
+#if USE_TICK_PHASE_B
+static volatile bool m_phase_b_up[CTRL_CHANNEL_COUNT]; /* Direction decoded on the last tick edge, latched in the GPIOTE handler */
+#endif
+static controller_channel_t m_channels[CTRL_CHANNEL_COUNT];
+
+uint8_t m_inert_movement = MOVE_DIRECTION_NONE;
+
+int32_t m_target_subtick = 0; /* Target position in subticks, m_state.target is its rounded value */
+int16_t m_reported_subtick = 0;
+
+int32_t m_stop_position = 0; /* Position in subticks at which motor was stopped on the target, used to learn coasting */
+bool m_coast_pending = false;
+
+uint8_t m_last_direction = MOVE_DIRECTION_NONE; /* Last driven direction, to count reversals */
+uint8_t m_uncertain_ticks = 0; /* Ticks counted since the uncertainty last grew by a subtick */
+
+bool m_jogging = false; /* Movement towards the limit lasts only while heartbeats arrive */
+uint8_t m_jog_direction = MOVE_DIRECTION_NONE; /* Held jog direction, kept after the limit is reached until release or heartbeat loss */
+uint32_t m_jog_heartbeat_time = 0; /* RTC counter value of the last jog heartbeat */
+
+#if USE_QDEC
+int32_t m_quadrature_count = 0; /* QDEC transitions already counted as ticks */
+bool m_backdriven = false; /* Poll was restarted at rest, because the desk is moved by hand */
+#endif
+
+bool m_move_active = false; /* Movement is recorded from the first motor start to the final stop */
+uint32_t m_move_start_time = 0; /* RTC counter value of the motor start */
+uint32_t m_move_stop_time = 0; /* RTC counter value of the last motor stop */
+int16_t m_move_start_position = 0;
+int32_t m_move_target = 0; /* Exact target reached, in subticks, to measure overshoot */
+uint8_t m_stop_reason = 0; /* CTRL_STOP_* of the active movement, first one is kept */
+
+bool m_dead_reckoning = false; /* Tick sensor failed, position is estimated from motor on-time */
+uint8_t m_silent_moves = 0; /* Consecutive driven movements without any tick */
+uint32_t m_poll_time = 0; /* RTC counter value of the last timer poll */
+
+/*===========================================================================*/
+/* Controller local functions.                                               */
+/*===========================================================================*/
+
+void set_reset(uint8_t reset);
+
+/**
+ * @brief   Returns position counted from motor ticks, in subticks.
+ */
+int32_t channel_motor_position(controller_channel_t const* p_channel)
+{
+    return ((int32_t)p_channel->position * CTRL_SUBTICK_SCALE) + p_channel->subtick;
+}
+
+/**
+ * @brief   Returns position of the column, that is motor position reduced by the gear backlash not taken up yet.
+ */
+int32_t channel_fine_position(controller_channel_t const* p_channel)
+{
+    return channel_motor_position(p_channel) - p_channel->lash;
+}
+
+/**
+ * @brief   Takes up the gear backlash with motor travel. After direction reversal, motor has to travel the backlash
+ *          before the column follows, so the same tick refers to different heights when moving up and down.
+ * 
+ * @param[in] p_channel   Channel which motor moved
+ * @param[in] travel      Signed motor travel, in subticks
+ */
+void update_lash(controller_channel_t* p_channel, int32_t travel)
+{
+    int32_t lash = p_channel->lash + travel;
+    int32_t backlash = calibration_get()->backlash;
+
+    p_channel->lash = (int16_t)(lash < 0 ? 0 : (lash > backlash ? backlash : lash));
+}
+
+/**
+ * @brief   Returns combined position of all columns in subticks.
+ */
+int32_t fine_position()
+{
+    return ((int32_t)m_state.position * CTRL_SUBTICK_SCALE) + m_state.subtick;
+}
+
+/**
+ * @brief   Returns interpolated position, at which the desk should come to rest, so it rests in the middle of the target
+ *          tick. Moving down, interpolated position lags the desk by the tick counted on the edge of the next one.
+ */
+int32_t rest_target(uint8_t direction)
+{
+    int32_t middle = (int32_t)m_state.target * CTRL_SUBTICK_SCALE + CTRL_SUBTICK_SCALE / 2;
+
+    return direction == MOVE_DIRECTION_DOWN ? middle - CTRL_SUBTICK_SCALE : middle;
+}
+
+/**
+ * @brief   Grows the uncertainty budget, saturating, and raises the homing request over the limit.
+ * 
+ * @param[in] amount   Uncertainty to add, in subticks. Zero clears the budget, after the position is homed.
+ */
+void add_uncertainty(uint32_t amount)
+{
+    uint32_t uncertainty = amount == 0 ? 0 : m_state.uncertainty + amount;
+
+    m_state.uncertainty = uncertainty > UINT16_MAX ? UINT16_MAX : (uint16_t)uncertainty;
+
+    if (m_state.uncertainty > CTRL_UNCERTAINTY_LIMIT) {
+        m_state.flags |= CTRL_FLAG_HOMING_REQUIRED;
+    } else {
+        m_state.flags &= ~CTRL_FLAG_HOMING_REQUIRED;
+    }
+}
+
+/**
+ * @brief   Updates combined state with the average of channel positions and the level error.
+ */
+void update_combined_position()
+{
+    int32_t sum = 0;
+    int32_t min = INT32_MAX;
+    int32_t max = INT32_MIN;
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        int32_t position = channel_fine_position(&m_channels[i]);
+
+        sum += position;
+        min = position < min ? position : min;
+        max = position > max ? position : max;
+
+        m_state.channel_position[i] = m_channels[i].position;
+    }
+
+    int32_t average = sum / CTRL_CHANNEL_COUNT;
+
+    m_state.position = (int16_t)(average / CTRL_SUBTICK_SCALE);
+    m_state.subtick = (int16_t)(average % CTRL_SUBTICK_SCALE);
+    m_state.level_error = max - min > INT16_MAX ? INT16_MAX : (int16_t)(max - min);
+}
+
+/**
+ * @brief   Sets reason of the movement stop, unless it is already known. Obstruction backoff, or the stop following
+ *          any internal reason, does not replace it.
+ */
+void set_stop_reason(uint8_t reason)
+{
+    if (m_stop_reason == 0) {
+        m_stop_reason = reason;
+    }
+}
+
+void set_movement_dir(uint8_t direction)
+{
+    uint32_t now;
+
+    NRF_LOG_PRINTF("Ctrl dir set to %s\r\n", DIRECTION_DEBUG(direction));
+
+    if (direction != MOVE_DIRECTION_NONE && direction != m_state.movement) {
+        lifetime_count(LIFETIME_MOTOR_STARTS, 1);
+    }
+    m_state.movement = direction;
+
+    motor_drive(direction);
+    app_timer_cnt_get(&now);
+
+    if (direction == MOVE_DIRECTION_NONE) {
+        m_move_stop_time = now;
+    } else if (!m_move_active) {
+        m_move_active = true;
+        m_move_start_time = now;
+        m_move_start_position = m_state.position;
+        m_stop_reason = 0;
+    }
+
+    if (direction != MOVE_DIRECTION_NONE) {
+
+        m_state.flags &= ~CTRL_FLAG_SETTLED;
+        m_inert_movement = direction;
+        m_coast_pending = false;
+        m_poll_time = now;
+#if USE_QDEC
+        m_backdriven = false;
+#endif
+
+        if (m_last_direction != MOVE_DIRECTION_NONE && m_last_direction != direction) {
+            add_uncertainty(CTRL_UNCERTAINTY_PER_REVERSAL);
+        }
+        m_last_direction = direction;
+
+        for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+            m_channels[i].tick_samples = 0;
+            m_channels[i].last_tick_time = now;
+            m_channels[i].stalled = false;
+            m_channels[i].throttled = false;
+            m_channels[i].reckoning_rest = 0;
+            m_channels[i].reversed_ticks = 0;
+        }
+
+        if (m_state.target_type == CTRL_TARGET_TYPE_EXACT) {
+            trajectory_plan(fine_position(), rest_target(direction), now);
+        }
+
+        app_timer_start(m_app_ctrl_timer_id, APP_CTRL_TIMER_INTERVAL, NULL);
+    }
+
+#if USE_CURRENT_SENSE
+    if (direction != MOVE_DIRECTION_NONE) {
+        current_sense_start();
+    } else {
+        current_sense_stop();
+    }
+#endif
+
+#if USE_TICK_GENERATOR
+    update_tick_generator();
+#endif
+
+    controller_call_cb();
+}
+
+int16_t subtick_to_ticks(int32_t subtick)
+{
+    if (subtick < 0) {
+        return -(int16_t)((-subtick + CTRL_SUBTICK_SCALE / 2) / CTRL_SUBTICK_SCALE);
+    }
+
+    return (int16_t)((subtick + CTRL_SUBTICK_SCALE / 2) / CTRL_SUBTICK_SCALE);
+}
+
+/**
+ * @brief   Counts detected tick in the given direction.
+ * 
+ * @param[in] p_channel   Channel on which the tick was detected
+ * @param[in] direction   Direction of the tick, MOVE_DIRECTION_NONE if unknown
+ */
+void update_position(controller_channel_t* p_channel, uint8_t direction)
+{
+    switch (direction) {
+    case MOVE_DIRECTION_DOWN:
+        p_channel->position--;
+        break;
+    case MOVE_DIRECTION_UP:
+        p_channel->position++;
+        break;
+    case MOVE_DIRECTION_NONE:
+    default:
+        add_uncertainty(CTRL_SUBTICK_SCALE); /* Edge of unknown direction is not counted */
+        break;
+    }
+
+    p_channel->subtick = 0;
+
+    if (++m_uncertain_ticks >= CTRL_UNCERTAINTY_TICKS_PER_SUBTICK) {
+        m_uncertain_ticks = 0;
+        add_uncertainty(1);
+    }
+}
+
+/**
+ * @brief   Interpolates position between ticks from time elapsed since the last tick and the measured tick period.
+ * @note    Interpolation is done only while the motor is driven. After the motor stop the last value is kept until next tick.
+ * 
+ * @param[in] p_channel   Channel to interpolate
+ * @param[in] now         Current RTC counter value
+ */
+void update_subtick(controller_channel_t* p_channel, uint32_t now)
+{
+    if (m_state.movement == MOVE_DIRECTION_NONE || p_channel->stalled || p_channel->tick_samples < 2 || p_channel->tick_period == 0) {
+        return;
+    }
+
+    uint32_t elapsed;
+    app_timer_cnt_diff_compute(now, p_channel->last_tick_time, &elapsed);
+
+    uint32_t subtick = (elapsed * CTRL_SUBTICK_SCALE) / p_channel->tick_period;
+
+    if (subtick > SUBTICK_MAX) {
+        subtick = SUBTICK_MAX;
+    }
+
+    p_channel->subtick = m_state.movement == MOVE_DIRECTION_DOWN ? -(int16_t)subtick : (int16_t)subtick;
+}
+
+/**
+ * @brief   Returns velocity derived from tick period, in subticks per second.
+ * @note    When time since the last tick exceeds the period, it is used instead, so slowing down is observed before next tick.
+ * 
+ * @param[in] p_channel   Channel to measure
+ * @param[in] now         Current RTC counter value
+ */
+uint32_t channel_velocity(controller_channel_t const* p_channel, uint32_t now)
+{
+    if (p_channel->tick_samples < 2 || p_channel->tick_period == 0) {
+        return 0;
+    }
+
+    uint32_t elapsed;
+    app_timer_cnt_diff_compute(now, p_channel->last_tick_time, &elapsed);
+
+    return (CTRL_SUBTICK_SCALE * CTR_TIMER_TICKS_PER_SECOND) / (elapsed > p_channel->tick_period ? elapsed : p_channel->tick_period);
+}
+
+/**
+ * @brief   Returns tick period against which the glitch filter checks plausibility of edges, 0 if unknown.
+ * @note    Average of the accepted periods lags behind when the desk speeds up, e.g. after a slow spin-up at the end
+ *          stop, and then rejects every real tick. It is capped by the period at the learned full duty speed.
+ */
+uint32_t expected_tick_period(controller_channel_t const* p_channel)
+{
+    if (p_channel->tick_samples < 2) {
+        return 0;
+    }
+
+    if (m_state.movement != MOVE_DIRECTION_UP && m_state.movement != MOVE_DIRECTION_DOWN) {
+        return p_channel->tick_period;
+    }
+
+    uint32_t full_speed_period = (CTRL_SUBTICK_SCALE * CTR_TIMER_TICKS_PER_SECOND) / trajectory_speed_get(m_state.movement);
+
+    return p_channel->tick_period < full_speed_period ? p_channel->tick_period : full_speed_period;
+}
+
+/**
+ * @brief   Returns average velocity of all columns, in subticks per second.
+ */
+uint32_t measured_velocity(uint32_t now)
+{
+    uint32_t sum = 0;
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        sum += channel_velocity(&m_channels[i], now);
+    }
+
+    return sum / CTRL_CHANNEL_COUNT;
+}
+
+/**
+ * @brief   Returns velocity of the channel estimated from its motor duty and the learned speed, in subticks per second.
+ * @note    Speed is linear with duty above MOTOR_DUTY_MIN, like in the trajectory speed learning.
+ */
+uint32_t reckoned_velocity(uint8_t channel)
+{
+    uint8_t duty = motor_duty_get(channel);
+
+    if (m_state.movement == MOVE_DIRECTION_NONE || duty <= MOTOR_DUTY_MIN) {
+        return 0;
+    }
+
+    return (trajectory_speed_get(m_state.movement) * (duty - MOTOR_DUTY_MIN)) / (MOTOR_DUTY_MAX - MOTOR_DUTY_MIN);
+}
+
+/**
+ * @brief   Moves channel position by the motor travel not counted from ticks.
+ * 
+ * @param[in] p_channel   Channel which motor moved
+ * @param[in] travel      Signed motor travel, in subticks
+ */
+void reckon_channel(controller_channel_t* p_channel, int32_t travel)
+{
+    int32_t position = channel_motor_position(p_channel) + travel;
+    int32_t ticks = position >= 0 ? position / CTRL_SUBTICK_SCALE : -((-position + SUBTICK_MAX) / CTRL_SUBTICK_SCALE);
+
+    p_channel->position = (int16_t)ticks;
+    p_channel->subtick = (int16_t)(position - ticks * CTRL_SUBTICK_SCALE);
+}
+
+/**
+ * @brief   Integrates channel position from its motor duty over time elapsed since the last poll, while the tick sensor
+ *          is failed. Estimated travel grows the uncertainty.
+ * 
+ * @param[in] p_channel   Channel to estimate
+ * @param[in] channel     Index of the channel, used to read its motor duty
+ * @param[in] interval    RTC ticks since the last poll
+ */
+void update_reckoning(controller_channel_t* p_channel, uint8_t channel, uint32_t interval)
+{
+    uint64_t travel = p_channel->reckoning_rest + (uint64_t)reckoned_velocity(channel) * interval;
+
+    p_channel->reckoning_rest = travel % CTR_TIMER_TICKS_PER_SECOND;
+    travel /= CTR_TIMER_TICKS_PER_SECOND;
+
+    if (travel == 0) {
+        return;
+    }
+
+    reckon_channel(p_channel, m_state.movement == MOVE_DIRECTION_DOWN ? -(int32_t)travel : (int32_t)travel);
+    add_uncertainty(((uint32_t)travel * CTRL_DEAD_RECKONING_UNCERTAINTY + 99) / 100);
+}
+
+/**
+ * @brief   Switches position tracking to dead reckoning after repeated movements without ticks.
+ */
+void enter_dead_reckoning()
+{
+    NRF_LOG_PRINTF("%sTick sensor failed, dead reckoning%s\r\n", NRF_LOG_COLOR_RED, NRF_LOG_COLOR_DEFAULT);
+    m_dead_reckoning = true;
+    m_state.flags |= CTRL_FLAG_DEAD_RECKONING;
+}
+
+/**
+ * @brief   Returns to tick counting, when an edge appears. Position estimated so far is the base for counting.
+ */
+void leave_dead_reckoning()
+{
+    NRF_LOG_PRINTF("Tick sensor restored at pos %d\r\n", m_state.position);
+    m_dead_reckoning = false;
+    m_state.flags &= ~CTRL_FLAG_DEAD_RECKONING;
+}
+
+/**
+ * @brief   Counts driven movements which finished without any tick on all columns, and enters dead reckoning when
+ *          the sensor stays silent for CTRL_DEAD_RECKONING_FAILURES movements in a row.
+ * @note    Desk might have moved blind for the whole stall threshold, what is added to the uncertainty.
+ * 
+ * @param[in] silent   Movement was driven and no tick arrived
+ */
+void update_sensor_health(bool silent)
+{
+    if (!silent) {
+        m_silent_moves = 0;
+        return;
+    }
+
+    add_uncertainty((trajectory_speed_get(m_state.movement) * CTR_TIMER_TICKS_STOP_THRESHOLD) / CTR_TIMER_TICKS_PER_SECOND);
+
+    if (m_silent_moves < 0xFF) {
+        m_silent_moves++;
+    }
+
+    NRF_LOG_PRINTF("No ticks in driven movement (%d)\r\n", m_silent_moves);
+
+    if (m_silent_moves >= CTRL_DEAD_RECKONING_FAILURES) {
+        enter_dead_reckoning();
+    }
+}
+
+/**
+ * @brief   Checks if movement estimated by dead reckoning has finished. Exact movement finishes with the motor stop,
+ *          extremum movement when the estimate passes the limit by CTRL_DEAD_RECKONING_OVERRUN of the full travel.
+ */
+bool is_reckoning_finished()
+{
+    calibration_t const* p_calibration = calibration_get();
+    int32_t overrun = (((int32_t)p_calibration->ticks_upper_limit - p_calibration->ticks_lower_limit) * CTRL_SUBTICK_SCALE * CTRL_DEAD_RECKONING_OVERRUN) / 100;
+
+    switch (m_state.target_type) {
+    case CTRL_TARGET_TYPE_EXTREMUM_MIN:
+        return fine_position() <= (int32_t)p_calibration->ticks_lower_limit * CTRL_SUBTICK_SCALE - overrun;
+    case CTRL_TARGET_TYPE_EXTREMUM_MAX:
+        return fine_position() >= (int32_t)p_calibration->ticks_upper_limit * CTRL_SUBTICK_SCALE + overrun;
+    default:
+        return m_state.movement == MOVE_DIRECTION_NONE;
+    }
+}
+
+/**
+ * @brief   Returns duty reduction of the channel leading the trailing column by more than CTRL_SYNC_TOLERANCE.
+ */
+int32_t sync_correction(controller_channel_t const* p_channel)
+{
+    int32_t sign = m_state.movement == MOVE_DIRECTION_DOWN ? -1 : 1;
+    int32_t trailing = sign * channel_fine_position(&m_channels[0]);
+
+    for (uint8_t i = 1; i < CTRL_CHANNEL_COUNT; i++) {
+        int32_t position = sign * channel_fine_position(&m_channels[i]);
+
+        trailing = position < trailing ? position : trailing;
+    }
+
+    int32_t lead = sign * channel_fine_position(p_channel) - trailing;
+
+    lead -= CTRL_SYNC_TOLERANCE;
+
+    if (lead <= 0) {
+        return 0;
+    }
+
+    return (lead * CTRL_SYNC_GAIN) / CTRL_SUBTICK_SCALE;
+}
+
+/**
+ * @brief   Updates motor duties with the trajectory planner output, slows down leading columns and advances the motor ramp.
+ * @note    Leading column, which duty would drop below MOTOR_DUTY_MIN, is paused until others catch up. Stall detection
+ *          of the throttled column is suspended, and restarts from the release like after the motor start.
+ * 
+ * @param[in] now   Current RTC counter value
+ */
+void update_motor_ramp(uint32_t now)
+{
+    if (m_state.movement == MOVE_DIRECTION_NONE) {
+        return;
+    }
+
+    int32_t duty = MOTOR_DUTY_MAX;
+
+    if (m_state.target_type == CTRL_TARGET_TYPE_EXACT) {
+        uint32_t velocity = measured_velocity(now);
+
+        if (m_dead_reckoning) {
+            velocity = 0;
+
+            for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+                velocity += reckoned_velocity(i);
+            }
+            velocity /= CTRL_CHANNEL_COUNT;
+        }
+
+        duty = trajectory_duty_get(fine_position(), velocity, now);
+    }
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        int32_t correction = CTRL_CHANNEL_COUNT > 1 ? sync_correction(&m_channels[i]) : 0;
+        int32_t channel_duty = duty - correction;
+
+        if (correction > 0 && channel_duty < MOTOR_DUTY_MIN) {
+            channel_duty = 0;
+        }
+
+        if (correction > 0) {
+            m_channels[i].throttled = true;
+        } else if (m_channels[i].throttled) {
+            m_channels[i].throttled = false;
+            m_channels[i].last_tick_time = now;
+            m_channels[i].tick_samples = 0;
+        }
+
+        motor_duty_limit_set(i, (uint8_t)channel_duty);
+    }
+
+    motor_ramp_step();
+}
+
+bool is_target_reached()
+{
+    switch (m_state.target_type) {
+    case CTRL_TARGET_TYPE_EXACT:
+        break;
+    default:
+        return false; /* Extremum movements are finished by stall detection */
+    }
+
+    int32_t lead = trajectory_stop_lead_get(m_state.movement);
+
+    switch (m_state.movement) {
+    case MOVE_DIRECTION_DOWN:
+        return fine_position() <= rest_target(MOVE_DIRECTION_DOWN) + lead;
+    case MOVE_DIRECTION_UP:
+        return fine_position() >= rest_target(MOVE_DIRECTION_UP) - lead;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief   Sets new target and starts movement in its direction, regardless of the thermal budget.
+ * @note    Target closer than half of tick to current interpolated position is considered as reached.
+ * 
+ * @param[in] target        Target position in subticks
+ * @param[in] target_type   One of CTRL_TARGET_TYPE_*
+ */
+void start_target(int32_t target, uint8_t target_type)
+{
+    m_jogging = false;
+    m_target_subtick = target;
+    m_state.target = subtick_to_ticks(target);
+    m_state.target_type = target_type;
+
+    NRF_LOG_PRINTF("%sSet target to %d (t: %x)%s\r\n", NRF_LOG_COLOR_GREEN, m_state.target, target_type, NRF_LOG_COLOR_DEFAULT);
+
+    int32_t distance = target - fine_position();
+
+    if (target_type == CTRL_TARGET_TYPE_NONE || (distance > -CTRL_SUBTICK_SCALE / 2 && distance < CTRL_SUBTICK_SCALE / 2)) {
+        set_movement_dir(MOVE_DIRECTION_NONE);
+    } else if (distance < 0) {
+        set_movement_dir(MOVE_DIRECTION_DOWN);
+    } else {
+        set_movement_dir(MOVE_DIRECTION_UP);
+    }
+}
+
+/**
+ * @brief   Bounds exact target to the calibrated desk limits, target beyond them could only end as a stall.
+ */
+int32_t clamp_target(int32_t target)
+{
+    calibration_t const* p_calibration = calibration_get();
+    int32_t lower = (int32_t)p_calibration->ticks_lower_limit * CTRL_SUBTICK_SCALE;
+    int32_t upper = (int32_t)p_calibration->ticks_upper_limit * CTRL_SUBTICK_SCALE;
+
+    return target < lower ? lower : (target > upper ? upper : target);
+}
+
+/**
+ * @brief   Sets new target requested by the user. Movement is refused, when the motor thermal budget is exhausted.
+ * 
+ * @param[in] target        Target position in subticks
+ * @param[in] target_type   One of CTRL_TARGET_TYPE_*
+ */
+void set_target_subtick(int32_t target, uint8_t target_type)
+{
+    if (target_type != CTRL_TARGET_TYPE_NONE) {
+        m_state.flags &= ~(CTRL_FLAG_OBSTRUCTED | CTRL_FLAG_THERMAL_LIMIT | CTRL_FLAG_MISWIRED);
+    }
+
+    if (target_type != CTRL_TARGET_TYPE_NONE && thermal_is_exhausted()) {
+        NRF_LOG_PRINTF("Move refused, motor cooling down\r\n");
+        m_state.flags |= CTRL_FLAG_THERMAL_LIMIT;
+        set_stop_reason(CTRL_STOP_THERMAL);
+        start_target(NIL_POSITION * CTRL_SUBTICK_SCALE, CTRL_TARGET_TYPE_NONE);
+        return;
+    }
+
+    if (target_type == CTRL_TARGET_TYPE_EXACT && target <= (int32_t)calibration_get()->ticks_lower_limit * CTRL_SUBTICK_SCALE
+        && m_state.uncertainty > CTRL_REHOME_WINDOW_MIN) {
+        /* Desk goes down to its end stop anyway, so it is homed there by extremum movement instead of a homing request */
+        NRF_LOG_PRINTF("Rehoming at the lower limit, uncertainty %d\r\n", m_state.uncertainty);
+        start_target((int32_t)INT16_MIN * CTRL_SUBTICK_SCALE, CTRL_TARGET_TYPE_EXTREMUM_MIN);
+        return;
+    }
+
+    start_target(target_type == CTRL_TARGET_TYPE_EXACT ? clamp_target(target) : target, target_type);
+}
+
+void set_target_pos(int16_t target, uint8_t target_type)
+{
+    set_target_subtick((int32_t)target * CTRL_SUBTICK_SCALE, target_type);
+}
+
+/**
+ * @brief   Stops movement for an internal reason. Unlike controller_stop, held jog stays latched, so its heartbeats
+ *          do not restart the motor.
+ */
+void stop_movement(void)
+{
+    if (m_state.movement != MOVE_DIRECTION_NONE) {
+        set_stop_reason(CTRL_STOP_USER);
+    }
+    set_target_pos(NIL_POSITION, CTRL_TARGET_TYPE_NONE);
+}
+
+/**
+ * @brief   Homes position opportunistically, when the driven motor stalls closer to the limit than the position is uncertain.
+ *          Desk most likely reached its end stop, so the position is set to the limit like after extremum movement.
+ */
+void rehome_at_end_stop()
+{
+    calibration_t const* p_calibration = calibration_get();
+    int32_t window = m_state.uncertainty > CTRL_REHOME_WINDOW_MIN ? m_state.uncertainty : CTRL_REHOME_WINDOW_MIN;
+    int32_t position = fine_position();
+
+    if (m_state.movement == MOVE_DIRECTION_DOWN && position - (int32_t)p_calibration->ticks_lower_limit * CTRL_SUBTICK_SCALE <= window) {
+        m_state.target_type = CTRL_TARGET_TYPE_EXTREMUM_MIN;
+    } else if (m_state.movement == MOVE_DIRECTION_UP && (int32_t)p_calibration->ticks_upper_limit * CTRL_SUBTICK_SCALE - position <= window) {
+        m_state.target_type = CTRL_TARGET_TYPE_EXTREMUM_MAX;
+    } else {
+        return;
+    }
+
+    NRF_LOG_PRINTF("Rehomed at pos %d, uncertainty %d\r\n", m_state.position, m_state.uncertainty);
+}
+
+/**
+ * @brief   Bounds channel positions to the desk limits. After extremum movement, all columns are set to the extremum,
+ *          what also levels them.
+ */
+void sanitize_position()
+{
+    calibration_t const* p_calibration = calibration_get();
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        controller_channel_t* p_channel = &m_channels[i];
+
+        p_channel->subtick = 0;
+
+        if (p_channel->position > p_calibration->ticks_upper_limit || m_state.target_type == CTRL_TARGET_TYPE_EXTREMUM_MAX) {
+            p_channel->position = p_calibration->ticks_upper_limit;
+            p_channel->lash = p_calibration->backlash;
+        } else if (p_channel->position < p_calibration->ticks_lower_limit || m_state.target_type == CTRL_TARGET_TYPE_EXTREMUM_MIN) {
+            p_channel->position = p_calibration->ticks_lower_limit;
+            p_channel->lash = 0;
+        }
+    }
+
+    if (m_state.target_type == CTRL_TARGET_TYPE_EXTREMUM_MIN || m_state.target_type == CTRL_TARGET_TYPE_EXTREMUM_MAX) {
+        add_uncertainty(0);
+    }
+
+    update_combined_position();
+    NRF_LOG_PRINTF("Sanitized pos %d\r\n", m_state.position);
+}
 
-#define DIRECTION_DEBUG(direction) direction == MOVE_DIRECTION_UP ? "UP" : (direction == MOVE_DIRECTION_DOWN ? "DOWN" : "NONE")
-#define controller_call_cb() \
-    if (m_cb)                \
-    m_cb(&m_state)
+/**
+ * @brief   Timestamps the tick edge for the glitch filter, so pulse width is measured from the edge, not from the poll.
+ *          Latches phase B on the tick edge, as it changes a quarter of period later and polling could miss it.
+ *          Phase A leads phase B while moving up, so the levels differ just after the edge.
+ */
+void in_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+#if !USE_QDEC
+    uint32_t now;
 
-#define APP_CTRL_TIMER_INTERVAL_MS 50
-#define APP_CTRL_TIMER_OP_QUEUE_SIZE 4 /**< Size of timer operation queues. */
-#define APP_CTRL_TIMER_PRESCALER 0 /**< Value of the RTC1 PRESCALER register. */
-#define APP_CTRL_TIMER_INTERVAL APP_TIMER_TICKS(APP_CTRL_TIMER_INTERVAL_MS, APP_CTRL_TIMER_PRESCALER) // 1000 ms intervals
+    app_timer_cnt_get(&now);
 
-#define CTR_TIMER_TICKS_STOP_THRESHOLD 1200 / APP_CTRL_TIMER_INTERVAL_MS /* How many ticks without position change is required to decide that movement has stopped */
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        if (m_tick_pins[i] == pin) {
+            uint32_t level = nrf_gpio_pin_read(pin);
 
-/*===========================================================================*/
-/* Controller exported variables.                                            */
-/*===========================================================================*/
+            tick_filter_edge(&m_channels[i].tick_filter, level, now);
+#if USE_TICK_PHASE_B
+            m_phase_b_up[i] = (level != nrf_gpio_pin_read(m_phase_b_pins[i])) != CTRL_TICK_PHASE_B_INVERTED;
+#endif
+        }
+    }
+#endif
+}
 
-/*===========================================================================*/
-/* Controller local variables and types.                                     */
-/*===========================================================================*/
+/**
+ * @brief   Returns direction of the tick detected on the channel. Without phase B it is assumed from the last driven direction.
+ */
+uint8_t tick_direction(uint8_t channel)
+{
+#if USE_TICK_PHASE_B
+    return m_phase_b_up[channel] ? MOVE_DIRECTION_UP : MOVE_DIRECTION_DOWN;
+#else
+    return m_inert_movement;
+#endif
+}
 
-APP_TIMER_DEF(m_app_ctrl_timer_id);
+/**
+ * @brief   Checks if the driven channel keeps moving opposite to the driven direction, what means swapped motor leads
+ *          or sensor phases. Ticks coasted after reversal are tolerated by CTRL_MISWIRING_TICKS.
+ * 
+ * @param[in] p_channel   Channel on which the tick was detected
+ * @param[in] direction   Decoded direction of the tick
+ */
+bool is_miswired(controller_channel_t* p_channel, uint8_t direction)
+{
+    if (m_state.movement == MOVE_DIRECTION_NONE || direction == m_state.movement) {
+        p_channel->reversed_ticks = 0;
+        return false;
+    }
 
-static controller_cb_t m_cb; /* Current state of controller */
-static controller_state_t m_state; /* COntroller state callback method. Optional */
+    if (p_channel->reversed_ticks < 0xFF) {
+        p_channel->reversed_ticks++;
+    }
 
-uint32_t m_previous_inpin_state = 0;
-int16_t m_previous_position = 0; /* Used to detect a premature end of movement */
-uint8_t m_inert_movement = MOVE_DIRECTION_NONE;
-uint8_t m_idle_counter = 0;
+    return p_channel->reversed_ticks >= CTRL_MISWIRING_TICKS;
+}
 
-/*===========================================================================*/
-/* Controller local functions.                                               */
-/*===========================================================================*/
+/**
+ * @brief   Updates running average of the inter-tick period with a newly detected tick.
+ * 
+ * @param[in] p_channel   Channel on which the tick was detected
+ * @param[in] channel     Index of the channel, used to read its motor duty
+ * @param[in] now         RTC counter value at which the tick was detected
+ */
+void update_tick_period(controller_channel_t* p_channel, uint8_t channel, uint32_t now)
+{
+    uint32_t interval;
+    app_timer_cnt_diff_compute(now, p_channel->last_tick_time, &interval);
+    p_channel->last_tick_time = now;
 
-void set_reset(uint8_t reset);
+    if (m_state.movement == MOVE_DIRECTION_NONE) {
+        return; /* Coasting ticks are not representative for driven movement */
+    }
 
-void set_movement_dir(uint8_t direction)
+    /* First interval is counted from the motor start and includes spin-up, so it is skipped */
+    if (p_channel->tick_samples == 1) {
+        p_channel->tick_period = interval;
+    } else if (p_channel->tick_samples > 1) {
+        p_channel->tick_period = (3 * p_channel->tick_period + interval) / 4;
+    }
+
+    if (p_channel->tick_samples < 0xFF) {
+        p_channel->tick_samples++;
+    }
+
+    uint8_t duty = motor_duty_get(channel);
+
+    if (duty != p_channel->steady_duty) {
+        p_channel->steady_duty = duty;
+        p_channel->steady_ticks = 0;
+    } else if (p_channel->steady_ticks < 0xFF) {
+        p_channel->steady_ticks++;
+    }
+
+    if (p_channel->tick_samples > 1) {
+        uint32_t deviation = interval > p_channel->tick_period ? interval - p_channel->tick_period : p_channel->tick_period - interval;
+
+        /* Speed lags behind a duty change and keeps rising at saturated duty on the start, samples taken before it
+         * settles would skew the full duty speed of the linear model */
+        if (p_channel->steady_ticks >= SPEED_LEARN_STEADY_TICKS && deviation * SPEED_LEARN_DEVIATION_DIVISOR <= p_channel->tick_period) {
+            trajectory_speed_learn(m_state.movement, (CTRL_SUBTICK_SCALE * CTR_TIMER_TICKS_PER_SECOND) / p_channel->tick_period, duty);
+        }
+        obstruction_learn(m_state.movement, p_channel->position, interval, duty);
+    }
+}
+
+/**
+ * @brief   Counts the detected tick in its direction and checks the direction against the driven one.
+ * 
+ * @param[in] p_channel   Channel on which the tick was detected
+ * @param[in] channel     Index of the channel
+ * @param[in] edge_time   RTC counter value at which the tick was detected
+ * @param[in] direction   Direction of the tick
+ * 
+ * @return true if the channel moves opposite to the driven direction
+ */
+bool count_tick(controller_channel_t* p_channel, uint8_t channel, uint32_t edge_time, uint8_t direction)
 {
-    NRF_LOG_PRINTF("Ctrl dir set to %s\r\n", DIRECTION_DEBUG(direction));
-    m_state.movement = direction;
+    bool miswired = is_miswired(p_channel, direction);
+
+    update_tick_period(p_channel, channel, edge_time);
+    update_position(p_channel, direction);
 
-    nrf_drv_gpiote_out_clear(GPIO_MOTOR_UP_PIN);
-    nrf_drv_gpiote_out_clear(GPIO_MOTOR_DOWN_PIN);
-    nrf_drv_gpiote_out_clear(GPIO_MOTOR_ENABLED_PIN);
+    return miswired;
+}
 
-    uint8_t motor = 0x00;
+#if USE_QDEC
+/**
+ * @brief   Counts ticks decoded by QDEC since the last poll. Ticks arrived within the poll are spread evenly over the time
+ *          since the previous tick, to keep the tick period average right. Double transitions are counted as rejected edges.
+ * 
+ * @param[in]  p_channel    Channel to update
+ * @param[in]  channel      Index of the channel
+ * @param[in]  now          Current RTC counter value
+ * @param[out] p_miswired   Set, when the channel moves opposite to the driven direction
+ * 
+ * @return Number of counted ticks
+ */
+uint32_t update_quadrature(controller_channel_t* p_channel, uint8_t channel, uint32_t now, bool* p_miswired)
+{
+    int32_t transitions = quadrature_count_get();
+    /* Rounded down, so the tick changes on the phase A edge in both directions, not on the phase B one moving down */
+    int32_t decoded = (transitions >= 0 ? transitions : transitions - (QUADRATURE_COUNTS_PER_TICK - 1)) / QUADRATURE_COUNTS_PER_TICK;
+    int32_t ticks = decoded - m_quadrature_count / QUADRATURE_COUNTS_PER_TICK;
 
-    switch (direction) {
-    case MOVE_DIRECTION_DOWN:
-        motor = GPIO_MOTOR_DOWN_PIN;
-        break;
-    case MOVE_DIRECTION_UP:
-        motor = GPIO_MOTOR_UP_PIN;
-        break;
-    case MOVE_DIRECTION_NONE:
-    default:
-        break;
+    p_channel->tick_filter.rejected = quadrature_errors_get();
+
+    if (ticks == 0) {
+        return 0;
     }
 
-    NRF_LOG_PRINTF("Motor is %d\r\n", motor);
+    m_quadrature_count += ticks * QUADRATURE_COUNTS_PER_TICK;
 
-    if (motor != 0x00) {
-        m_inert_movement = direction;
-        m_idle_counter = 0;
+    uint8_t direction = (ticks > 0) != CTRL_TICK_PHASE_B_INVERTED ? MOVE_DIRECTION_UP : MOVE_DIRECTION_DOWN;
+    uint32_t count = ticks > 0 ? (uint32_t)ticks : (uint32_t)-ticks;
+    uint32_t start = p_channel->last_tick_time;
+    uint32_t interval;
 
-        nrf_drv_gpiote_out_set(motor);
-        nrf_drv_gpiote_out_set(GPIO_MOTOR_ENABLED_PIN);
+    app_timer_cnt_diff_compute(now, start, &interval);
 
-        app_timer_start(m_app_ctrl_timer_id, APP_CTRL_TIMER_INTERVAL, NULL);
+    for (uint32_t i = 1; i <= count; i++) {
+        *p_miswired |= count_tick(p_channel, channel, (start + (interval * i) / count) & RTC_COUNTER_MASK, direction);
     }
 
-#if USE_TICK_GENERATOR
-    update_tick_generator();
+    return count;
+}
+
+/**
+ * @brief   Restarts the poll when QDEC reports motion at rest, so the position follows the desk backdriven by hand
+ *          instead of being caught up only by the next movement. The poll stops again like after coasting.
+ */
+void quadrature_motion_cb(void)
+{
+    uint32_t now;
+
+    if (m_inert_movement != MOVE_DIRECTION_NONE || m_backdriven) {
+        return; /* Poll is running */
+    }
+
+    app_timer_cnt_get(&now);
+    m_backdriven = true;
+    m_poll_time = now;
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        m_channels[i].last_tick_time = now;
+    }
+
+    app_timer_start(m_app_ctrl_timer_id, APP_CTRL_TIMER_INTERVAL, NULL);
+}
 #endif
 
-    controller_call_cb();
+/**
+ * @brief   Checks if any driven column is slowed down by an obstacle, compared to its learned speed profile,
+ *          or motor current exceeds the limit.
+ * 
+ * @param[in] now   Current RTC counter value
+ */
+bool is_obstructed(uint32_t now)
+{
+    if (m_state.movement == MOVE_DIRECTION_NONE || m_state.target_type != CTRL_TARGET_TYPE_EXACT) {
+        return false;
+    }
+
+#if USE_CURRENT_SENSE
+    if (current_sense_is_overloaded()) {
+        return true; /* Current rises well before ticks slow down */
+    }
+#endif
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        controller_channel_t const* p_channel = &m_channels[i];
+        uint32_t elapsed;
+
+        if (p_channel->tick_samples <= CTRL_STALL_MIN_SAMPLES || p_channel->throttled) {
+            continue;
+        }
+
+        app_timer_cnt_diff_compute(now, p_channel->last_tick_time, &elapsed);
+
+        if (elapsed >= CTR_TIMER_TICKS_STALL_MIN && obstruction_check(m_state.movement, p_channel->position, elapsed, motor_duty_get(i))) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-void update_position()
+/**
+ * @brief   Records finished movement to the history.
+ * 
+ * @param[in] now   Current RTC counter value
+ */
+void record_move(uint32_t now)
 {
-    bool stop = m_state.target != NIL_POSITION;
+    history_move_t move;
+    uint32_t duration;
 
-    switch (m_inert_movement) {
-    case MOVE_DIRECTION_DOWN:
-        m_state.position--;
-        stop &= m_state.position <= m_state.target;
-        break;
-    case MOVE_DIRECTION_UP:
-        m_state.position++;
-        stop &= m_state.position >= m_state.target;
-        break;
-    case MOVE_DIRECTION_NONE:
-        stop = true;
-        return;
-    default:
-        break;
+    app_timer_cnt_diff_compute(m_state.movement != MOVE_DIRECTION_NONE ? now : m_move_stop_time, m_move_start_time, &duration);
+    set_stop_reason(CTRL_STOP_STALL);
+
+    move.start_position = m_move_start_position;
+    move.end_position = m_state.position;
+    move.duration_ms = ((uint64_t)duration * 1000) / CTR_TIMER_TICKS_PER_SECOND;
+    move.reason = m_stop_reason;
+    move.estimated = m_dead_reckoning;
+    move.overshoot = 0;
+
+    if (m_stop_reason == CTRL_STOP_TARGET) {
+        int32_t overshoot = m_inert_movement == MOVE_DIRECTION_DOWN ? m_move_target - fine_position() : fine_position() - m_move_target;
+        move.overshoot = overshoot > INT16_MAX ? INT16_MAX : (overshoot < INT16_MIN ? INT16_MIN : (int16_t)overshoot);
     }
 
-    if (stop) {
-        controller_stop();
+    history_record(&move);
+    m_move_active = false;
+
+    lifetime_count(LIFETIME_TRAVEL, move.end_position > move.start_position ? move.end_position - move.start_position : move.start_position - move.end_position);
+    if (m_state.target_type == CTRL_TARGET_TYPE_EXTREMUM_MIN || m_state.target_type == CTRL_TARGET_TYPE_EXTREMUM_MAX) {
+        lifetime_count(LIFETIME_END_STOPS, 1); /* Extremum movement, or the stall rehomed at the end stop */
     }
 }
 
-void set_target_pos(int16_t target, uint8_t target_type)
+/**
+ * @brief   Stops movement blocked by an obstacle and backs off in the opposite direction by CTRL_OBSTRUCTION_BACKOFF.
+ */
+void handle_obstruction()
 {
-    NRF_LOG_PRINTF("%sSet target to %d (t: %x)%s\r\n", NRF_LOG_COLOR_GREEN, target, target_type, NRF_LOG_COLOR_DEFAULT);
+    uint8_t direction = m_state.movement;
 
-    m_state.target = target;
-    m_state.target_type = target_type;
+    NRF_LOG_PRINTF("%sObstruction at pos %d%s\r\n", NRF_LOG_COLOR_RED, m_state.position, NRF_LOG_COLOR_DEFAULT);
+    m_state.flags |= CTRL_FLAG_OBSTRUCTED;
+    set_stop_reason(CTRL_STOP_OBSTRUCTED);
 
-    if (target == NIL_POSITION || target == m_state.position) {
-        set_movement_dir(MOVE_DIRECTION_NONE);
-    } else if (target < m_state.position) {
-        set_movement_dir(MOVE_DIRECTION_DOWN);
-    } else if (target > m_state.position) {
-        set_movement_dir(MOVE_DIRECTION_UP);
+    if (CTRL_OBSTRUCTION_BACKOFF > 0) {
+        start_target(clamp_target(fine_position() + (direction == MOVE_DIRECTION_UP ? -CTRL_OBSTRUCTION_BACKOFF : CTRL_OBSTRUCTION_BACKOFF)), CTRL_TARGET_TYPE_EXACT);
+    } else {
+        stop_movement();
     }
 }
 
-void sanitize_position()
+/**
+ * @brief   Checks if time elapsed since the last tick indicates that channel movement has stopped.
+ * @note    While the motor is driven and tick period is known, threshold is a multiple of the period.
+ *          Otherwise (spin-up or coasting after motor stop) fixed threshold is used.
+ * 
+ * @param[in] p_channel   Channel to check
+ * @param[in] now         Current RTC counter value
+ */
+bool is_channel_stalled(controller_channel_t const* p_channel, uint32_t now)
 {
-    if (m_state.position > TICKS_UPPER_LIMIT || m_state.target_type == CTRL_TARGET_TYPE_EXTREMUM_MAX) {
-        m_state.position = TICKS_UPPER_LIMIT;
-    } else if (m_state.position < TICK_LOWER_LIMIT || m_state.target_type == CTRL_TARGET_TYPE_EXTREMUM_MIN) {
-        m_state.position = TICK_LOWER_LIMIT;
+    uint32_t elapsed;
+    uint32_t threshold = CTR_TIMER_TICKS_STOP_THRESHOLD;
+
+    if (p_channel->throttled && m_state.movement != MOVE_DIRECTION_NONE) {
+        return false; /* Leading column paused to let others catch up, not blocked */
     }
-    NRF_LOG_PRINTF("Sanitized pos %d\r\n", m_state.position);
+
+    app_timer_cnt_diff_compute(now, p_channel->last_tick_time, &elapsed);
+
+    if (m_state.movement != MOVE_DIRECTION_NONE && p_channel->tick_samples > CTRL_STALL_MIN_SAMPLES) {
+        threshold = p_channel->tick_period * CTRL_STALL_PERIOD_MULTIPLIER;
+
+        if (threshold < CTR_TIMER_TICKS_STALL_MIN) {
+            threshold = CTR_TIMER_TICKS_STALL_MIN;
+        }
+    }
+
+    return elapsed >= threshold;
 }
 
-void in_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action) {}
+/**
+ * @brief   Checks if movement of the desk has stopped.
+ * @note    Exact movement is stopped when any column stalls, as it indicates an obstacle. During extremum movement
+ *          each column is released at its end stop and movement is finished when all of them are stalled. Column paused
+ *          by the sync correction waits for others, so it does not hold the finish once they all stalled.
+ * 
+ * @param[in] now   Current RTC counter value
+ */
+bool is_stalled(uint32_t now)
+{
+    bool any = false;
+    bool all = true;
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        controller_channel_t* p_channel = &m_channels[i];
+        bool stalled = is_channel_stalled(p_channel, now);
+
+        if (stalled && !p_channel->stalled && m_state.movement != MOVE_DIRECTION_NONE && m_state.target_type != CTRL_TARGET_TYPE_EXACT) {
+            p_channel->stalled = true;
+            motor_release(i);
+        }
+
+        any |= stalled;
+        all &= stalled || p_channel->throttled;
+    }
+
+    return m_state.target_type == CTRL_TARGET_TYPE_EXACT ? any : all;
+}
+
+bool is_heartbeat_lost(uint32_t now)
+{
+    uint32_t elapsed;
+
+    app_timer_cnt_diff_compute(now, m_jog_heartbeat_time, &elapsed);
+    return elapsed > CTR_TIMER_TICKS_JOG_TIMEOUT;
+}
+
+bool is_jog_expired(uint32_t now)
+{
+    return m_jogging && is_heartbeat_lost(now);
+}
 
 static void timer_timeout_handler(void* p_context)
 {
-    uint32_t in_pin_state = nrf_gpio_pin_read(GPIO_TICK_INPUT);
+    uint32_t now;
+    app_timer_cnt_get(&now);
+
+    uint32_t interval;
+    app_timer_cnt_diff_compute(now, m_poll_time, &interval);
+    m_poll_time = now;
+
+    bool moved = false;
+    bool miswired = false;
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        controller_channel_t* p_channel = &m_channels[i];
+        int32_t motor_position = channel_motor_position(p_channel);
+        uint32_t rejected = p_channel->tick_filter.rejected;
+        uint32_t ticks = 0;
+
+#if USE_QDEC
+        ticks = update_quadrature(p_channel, i, now, &miswired);
+#else
+        uint32_t edge_time;
+        tick_filter_poll(&p_channel->tick_filter, nrf_gpio_pin_read(m_tick_pins[i]), now, expected_tick_period(p_channel));
+
+        while (tick_filter_get(&p_channel->tick_filter, &edge_time)) {
+            miswired |= count_tick(p_channel, i, edge_time, tick_direction(i));
+            ticks++;
+        }
+#endif
+
+        if (ticks > 0) {
+            if (m_dead_reckoning) {
+                leave_dead_reckoning();
+            }
+            m_silent_moves = 0;
+            moved = true;
+        }
 
-    if (in_pin_state != m_previous_inpin_state) {
-        m_previous_inpin_state = in_pin_state;
-        update_position();
+        /* Counted tick was timestamped at its edge, the desk moved on since then */
+        if (m_dead_reckoning) {
+            update_reckoning(p_channel, i, interval);
+        } else {
+            update_subtick(p_channel, now);
+        }
+
+        update_lash(p_channel, channel_motor_position(p_channel) - motor_position);
+
+        if (p_channel->tick_filter.rejected != rejected) {
+            add_uncertainty(CTRL_UNCERTAINTY_PER_GLITCH);
+        }
+    }
+
+    update_combined_position();
+
+    if (is_target_reached()) {
+        m_stop_position = fine_position();
+        m_coast_pending = true;
+        m_move_target = m_target_subtick;
+        set_stop_reason(CTRL_STOP_TARGET);
+        stop_movement();
+    } else if (miswired) {
+        NRF_LOG_PRINTF("%sMoving opposite to %s, check wiring%s\r\n", NRF_LOG_COLOR_RED, DIRECTION_DEBUG(m_state.movement), NRF_LOG_COLOR_DEFAULT);
+        m_state.flags |= CTRL_FLAG_MISWIRED;
+        set_stop_reason(CTRL_STOP_MISWIRED);
+        stop_movement();
+    } else if (is_obstructed(now)) {
+        handle_obstruction();
+    } else if (m_state.movement != MOVE_DIRECTION_NONE && thermal_is_overrun()) {
+        NRF_LOG_PRINTF("Motor overheated\r\n");
+        m_state.flags |= CTRL_FLAG_THERMAL_LIMIT;
+        set_stop_reason(CTRL_STOP_THERMAL);
+        stop_movement();
+    } else if (is_jog_expired(now)) {
+        NRF_LOG_PRINTF("Jog heartbeat lost\r\n");
+        set_stop_reason(CTRL_STOP_JOG_TIMEOUT);
+        stop_movement();
+    } else {
+        update_motor_ramp(now);
     }
 
-    if (m_previous_position != m_state.position) {
-        m_idle_counter = 0;
-    } else if (m_idle_counter >= CTR_TIMER_TICKS_STOP_THRESHOLD) {
-        NRF_LOG_PRINTF("No mov. Stopping at pos %d, idle counter %d\r\n", m_state.position, m_idle_counter);
+    if (moved) {
+        m_reported_subtick = m_state.subtick;
+        controller_call_cb();
+    } else if (m_dead_reckoning ? is_reckoning_finished() : is_stalled(now)) {
+        NRF_LOG_PRINTF("No mov. Stopping at pos %d, level err %d, rejected %d\r\n", m_state.position, m_state.level_error, controller_rejected_ticks_get());
         app_timer_stop(m_app_ctrl_timer_id);
+
+        bool silent = !m_dead_reckoning && m_state.movement != MOVE_DIRECTION_NONE;
+
+        for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+            controller_channel_t* p_channel = &m_channels[i];
+
+            silent &= p_channel->tick_samples == 0;
+
+            if (m_dead_reckoning) {
+                /* Desk coasts by the learned distance, estimate is rounded to the nearest tick */
+                int32_t coast = trajectory_stop_lead_get(m_inert_movement);
+                coast = m_inert_movement == MOVE_DIRECTION_DOWN ? -coast : coast;
+                reckon_channel(p_channel, coast);
+                update_lash(p_channel, coast);
+                p_channel->position = subtick_to_ticks(channel_motor_position(p_channel));
+            }
+
+            p_channel->subtick = 0;
+        }
+        update_combined_position();
+
+        if (m_coast_pending && !m_dead_reckoning) {
+            /* Desk rests between the stop (or the last counted edge past it) and the next edge, middle is the estimate */
+            int32_t sign = m_inert_movement == MOVE_DIRECTION_DOWN ? -1 : 1;
+            int32_t stop = sign * m_stop_position;
+            int32_t edge = sign * fine_position();
+            int32_t rest = ((stop > edge ? stop : edge) + edge + CTRL_SUBTICK_SCALE) / 2;
+            trajectory_coast_learn(m_inert_movement, rest - stop);
+        }
+        m_coast_pending = false;
+#if USE_QDEC
+        m_backdriven = false;
+#endif
+
+        rehome_at_end_stop();
+
+        if (!m_dead_reckoning) {
+            update_sensor_health(silent && m_state.target_type == CTRL_TARGET_TYPE_EXACT); /* Silent stall at the end stop is not a failure */
+        }
+
         sanitize_position();
-        set_target_pos(NIL_POSITION, CTRL_TARGET_TYPE_NONE);        
 
-        m_previous_position = -10;
-        m_inert_movement = MOVE_DIRECTION_NONE;
-    }
+        if (m_move_active) {
+            record_move(now);
+        }
 
-    m_idle_counter++;
-    m_previous_position = m_state.position;
+        /* Set before the target is cleared, so its state callback already reports the final position */
+        m_inert_movement = MOVE_DIRECTION_NONE;
+        m_state.flags |= CTRL_FLAG_SETTLED;
 
-    controller_call_cb();
+        set_target_pos(NIL_POSITION, CTRL_TARGET_TYPE_NONE);
+    } else if (m_state.subtick - m_reported_subtick >= SUBTICK_REPORT_STEP || m_reported_subtick - m_state.subtick >= SUBTICK_REPORT_STEP) {
+        m_reported_subtick = m_state.subtick;
+        controller_call_cb();
+    }
 }
 
 /**@brief Function for the Timer initialization.
  *
- * @details Initializes the timer module. This creates and starts application timers.
+ * @details Creates the controller timer. The timer module itself is initialized once in main, initializing it again
+ *          would stop the timers already started by other modules.
  */
 static void timers_init(void)
 {
-    // Initialize timer module.
-    APP_TIMER_INIT(APP_CTRL_TIMER_PRESCALER, APP_CTRL_TIMER_OP_QUEUE_SIZE, false);
-
     app_timer_create(&m_app_ctrl_timer_id, APP_TIMER_MODE_REPEATED, timer_timeout_handler);
 }
 
@@ -212,41 +1300,78 @@ void update_tick_generator()
 /* Controller exported functions.                                            */
 /*===========================================================================*/
 
-void controller_init(int position)
+/**
+ * @brief   Initializes controller hardware and state.
+ * 
+ * @param[in] p_positions   Initial positions of CTRL_CHANNEL_COUNT columns, in ticks
+ * @param[in] uncertainty   Initial position uncertainty, in subticks
+ */
+void controller_init(int16_t const* p_positions, uint16_t uncertainty)
 {
+    uint32_t now;
+
     m_state.movement = MOVE_DIRECTION_NONE;
-    m_state.position = position;
     m_state.target = NIL_POSITION;
     m_state.target_type = CTRL_TARGET_TYPE_NONE;
-
-    ret_code_t err_code;
+    m_state.flags |= CTRL_FLAG_SETTLED;
 
     nrf_drv_gpiote_init();
 
+#if !USE_QDEC
     /* TICK Input pins config */
+    ret_code_t err_code;
     nrf_drv_gpiote_in_config_t tick_in_config = GPIOTE_CONFIG_IN_SENSE_TOGGLE(true);
     tick_in_config.pull = NRF_GPIO_PIN_PULLUP;
+#endif
+
+    app_timer_cnt_get(&now);
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+#if USE_QDEC
+        /* Both phases are sampled by QDEC, only pull-ups are configured */
+        nrf_gpio_cfg_input(m_tick_pins[i], NRF_GPIO_PIN_PULLUP);
+        nrf_gpio_cfg_input(m_phase_b_pins[i], NRF_GPIO_PIN_PULLUP);
+#else
+        err_code = nrf_drv_gpiote_in_init(m_tick_pins[i], &tick_in_config, in_pin_handler);
+        APP_ERROR_CHECK(err_code);
+#endif
+
+#if USE_TICK_PHASE_B
+        nrf_gpio_cfg_input(m_phase_b_pins[i], NRF_GPIO_PIN_PULLUP);
+#endif
 
-    err_code = nrf_drv_gpiote_in_init(GPIO_TICK_INPUT, &tick_in_config, in_pin_handler);
-    APP_ERROR_CHECK(err_code);
+        memset(&m_channels[i], 0, sizeof(controller_channel_t));
+        m_channels[i].position = p_positions[i];
+        m_channels[i].lash = 0;
+        tick_filter_init(&m_channels[i].tick_filter, nrf_gpio_pin_read(m_tick_pins[i]), now);
 
-    m_previous_inpin_state = nrf_gpio_pin_read(GPIO_TICK_INPUT);
+#if !USE_QDEC
+        nrf_drv_gpiote_in_event_enable(m_tick_pins[i], true); /* Edges are timestamped for the glitch filter */
+#endif
+    }
 
-    /* Output Pins config */
-    nrf_drv_gpiote_out_config_t out_config = GPIOTE_CONFIG_OUT_SIMPLE(false);
+    update_combined_position();
+    add_uncertainty(uncertainty);
 
-    err_code = nrf_drv_gpiote_out_init(GPIO_MOTOR_UP_PIN, &out_config);
-    APP_ERROR_CHECK(err_code);
+#if USE_QDEC
+    m_quadrature_count = 0; /* Counting starts over with the peripheral, parity of the transitions has to match */
+    m_backdriven = false;
+    quadrature_init(m_tick_pins[0], m_phase_b_pins[0], quadrature_motion_cb);
+#endif
 
-    err_code = nrf_drv_gpiote_out_init(GPIO_MOTOR_DOWN_PIN, &out_config);
-    APP_ERROR_CHECK(err_code);
+    /* Motor outputs config */
+    motor_init();
+    trajectory_init();
+    obstruction_init();
 
-    err_code = nrf_drv_gpiote_out_init(GPIO_MOTOR_ENABLED_PIN, &out_config);
-    APP_ERROR_CHECK(err_code);
+    NRF_LOG_PRINTF("Ctrl init pos %d, level err %d\r\n", m_state.position, m_state.level_error);
 
-    NRF_LOG_PRINTF("Ctrl init pos %d\r\n", position);
+#if USE_CURRENT_SENSE
+    current_sense_init();
+#endif
 
 /* Tick generator init */
+
 #if USE_TICK_GENERATOR
     tick_generator_init(GPIO_TICK_OUTPUT);
     NRF_LOG_PRINTF("Init tick generator");
@@ -263,7 +1388,8 @@ void controller_register_cb(controller_cb_t cb)
 
 void controller_stop()
 {
-    set_target_pos(NIL_POSITION, CTRL_TARGET_TYPE_NONE);
+    m_jog_direction = MOVE_DIRECTION_NONE;
+    stop_movement();
 }
 
 /**
@@ -275,6 +1401,7 @@ void controller_stop()
  */
 void controller_extremum_position_set(uint8_t extremum)
 {
+    m_jog_direction = MOVE_DIRECTION_NONE;
     switch (extremum) {
     case CTRL_EXTREMUM_POS_BOTTOM:
         set_target_pos(-(int16_t)((uint16_t)~0 >> 1) - 1, CTRL_TARGET_TYPE_EXTREMUM_MIN);
@@ -287,7 +1414,93 @@ void controller_extremum_position_set(uint8_t extremum)
     }
 }
 
+/**
+ * @brief   Returns number of tick input edges rejected by the glitch filters since init. For diagnostics.
+ */
+uint32_t controller_rejected_ticks_get(void)
+{
+    uint32_t rejected = 0;
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        rejected += m_channels[i].tick_filter.rejected;
+    }
+
+    return rejected;
+}
+
 void controller_target_position_set(int16_t target)
 {
+    m_jog_direction = MOVE_DIRECTION_NONE;
     set_target_pos(target, CTRL_TARGET_TYPE_EXACT);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief   Sets target position with precision finer than one tick.
+ * 
+ * @param[in] target   Target position in 1/CTRL_SUBTICK_SCALE of tick
+ */
+void controller_target_subtick_set(int32_t target)
+{
+    m_jog_direction = MOVE_DIRECTION_NONE;
+    set_target_subtick(target, CTRL_TARGET_TYPE_EXACT);
+}
+
+/**
+ * @brief   Moves by the distance from the current target, or from the current position when there is no exact target,
+ *          so repeated commands accumulate.
+ * 
+ * @param[in] distance   Signed distance in 1/CTRL_SUBTICK_SCALE of tick
+ */
+void controller_target_relative_set(int32_t distance)
+{
+    int32_t base = m_state.target_type == CTRL_TARGET_TYPE_EXACT && !m_jogging ? m_target_subtick : fine_position();
+
+    m_jog_direction = MOVE_DIRECTION_NONE;
+
+    set_target_subtick(base + distance, CTRL_TARGET_TYPE_EXACT);
+}
+
+/**
+ * @brief   Starts or keeps alive hold-to-move movement towards the desk limit. Movement stops, when the command is not
+ *          repeated within CTRL_JOG_TIMEOUT_MS, so lost stop command can not drive the desk to its end stop.
+ * @note    Direction stays latched after the movement ended at the limit (or by an obstacle), so heartbeats of the held
+ *          jog do not restart it. Only release, other command or lost heartbeat clears it.
+ * 
+ * @param[in] direction   MOVE_DIRECTION_UP or MOVE_DIRECTION_DOWN, any other value stops
+ */
+void controller_jog(uint8_t direction)
+{
+    uint32_t now;
+
+    if (direction != MOVE_DIRECTION_UP && direction != MOVE_DIRECTION_DOWN) {
+        controller_stop();
+        return;
+    }
+
+    app_timer_cnt_get(&now);
+    bool latched = m_jog_direction == direction && !is_heartbeat_lost(now);
+    m_jog_heartbeat_time = now;
+
+    if (latched) {
+        return;
+    }
+
+    set_target_pos(direction == MOVE_DIRECTION_UP ? calibration_get()->ticks_upper_limit : calibration_get()->ticks_lower_limit, CTRL_TARGET_TYPE_EXACT);
+    m_jog_direction = direction;
+    m_jogging = m_state.movement == direction;
+}
+
+/**
+ * @brief   Returns current position interpolated between ticks.
+ * 
+ * @return Position in 1/CTRL_SUBTICK_SCALE of tick
+ */
+int32_t controller_position_get(void)
+{
+    return fine_position();
+}
+
+bool controller_is_moving(void)
+{
+    return m_state.movement != MOVE_DIRECTION_NONE;
+}
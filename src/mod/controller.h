@@ -1,6 +1,8 @@
 #ifndef CONTROLLER_H__
 #define CONTROLLER_H__
 
+#include "acromegaly_config.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -16,20 +18,48 @@
 #define CTRL_EXTREMUM_POS_BOTTOM 0xDD
 #define CTRL_EXTREMUM_POS_TOP 0xFF
 
+#define CTRL_SUBTICK_SCALE 256 /* Number of subticks in one tick */
+
+#define CTRL_FLAG_HOMING_REQUIRED (1 << 0) /* Position uncertainty exceeded the budget, extremum movement is advised */
+#define CTRL_FLAG_OBSTRUCTED (1 << 1) /* Last movement was stopped by an obstacle */
+#define CTRL_FLAG_THERMAL_LIMIT (1 << 2) /* Last movement was refused or stopped to let the motor cool down */
+#define CTRL_FLAG_DEAD_RECKONING (1 << 3) /* Tick sensor failed, position is estimated from motor on-time */
+#define CTRL_FLAG_MISWIRED (1 << 4) /* Last movement was stopped, because columns moved opposite to the driven direction */
+#define CTRL_FLAG_SETTLED (1 << 5) /* Desk stopped coasting after the motor was cut, position is final */
+
+#define CTRL_STOP_TARGET 1 /* Exact target reached */
+#define CTRL_STOP_USER 2 /* Stopped by command */
+#define CTRL_STOP_STALL 3 /* No movement, i.e. at the end stop */
+#define CTRL_STOP_OBSTRUCTED 4
+#define CTRL_STOP_THERMAL 5
+#define CTRL_STOP_JOG_TIMEOUT 6
+#define CTRL_STOP_MISWIRED 7
+
 typedef struct
 {
     int16_t position;
     int16_t target;
     uint8_t movement;
     uint8_t target_type;
+    int16_t subtick; /* Position interpolated between ticks, as offset from position in 1/CTRL_SUBTICK_SCALE of tick */
+    int16_t level_error; /* Difference between the highest and the lowest column, in subticks */
+    int16_t channel_position[CTRL_CHANNEL_COUNT]; /* Positions of particular columns, position is their average */
+    uint16_t uncertainty; /* Accumulated position uncertainty since last homing, in subticks */
+    uint8_t flags; /* CTRL_FLAG_* */
 } controller_state_t;
 
 typedef void (*controller_cb_t)(controller_state_t* block);
 
-void controller_init(int position);
+void controller_init(int16_t const* p_positions, uint16_t uncertainty);
 void controller_register_cb(controller_cb_t cb);
 void controller_target_position_set(int16_t position);
+void controller_target_subtick_set(int32_t target);
+void controller_target_relative_set(int32_t distance);
+void controller_jog(uint8_t direction);
+int32_t controller_position_get(void);
+bool controller_is_moving(void);
 void controller_stop();
 void controller_extremum_position_set(uint8_t extremum);
+uint32_t controller_rejected_ticks_get(void);
 
 #endif
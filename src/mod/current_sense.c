@@ -0,0 +1,159 @@
+#include "current_sense.h"
+#include "acromegaly_config.h"
+#include "app_error.h"
+#include "nrf_drv_ppi.h"
+#include "nrf_drv_timer.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#if USE_CURRENT_SENSE
+
+#include "nrf_drv_adc.h"
+
+#if USE_TICK_GENERATOR
+#error "Current sense and tick generator both use TIMER1"
+#endif
+
+/*===========================================================================*/
+/* Current sense local definitions.                                          */
+/*===========================================================================*/
+
+#define ADC_REFERENCE_MV 1200 /* Internal band gap reference */
+#define ADC_MAX 1023 /* 10 bit resolution */
+
+/* Limit converted to raw ADC value at compile time, so samples are compared without conversion */
+#define CURRENT_LIMIT_RAW (((uint32_t)CURRENT_SENSE_LIMIT_MA * CURRENT_SENSE_MV_PER_A * ADC_MAX) / (ADC_REFERENCE_MV * 1000UL))
+
+/*===========================================================================*/
+/* Current sense local variables and types.                                  */
+/*===========================================================================*/
+
+static const nrf_drv_timer_t m_timer = NRF_DRV_TIMER_INSTANCE(1);
+static nrf_drv_adc_channel_t m_channel = NRF_DRV_ADC_DEFAULT_CHANNEL(CURRENT_SENSE_ADC_INPUT);
+static nrf_ppi_channel_t m_ppi_channel;
+
+static nrf_adc_value_t m_buffers[2][CURRENT_SENSE_BATCH]; /* One is filled by the driver, while the other is processed */
+static uint8_t m_buffer_index;
+
+static volatile uint16_t m_average; /* Average of the last batch, raw ADC value */
+static volatile bool m_overloaded;
+static uint8_t m_blanking; /* Batches left to ignore after the motor start, for its inrush current */
+
+/*===========================================================================*/
+/* Current sense local functions.                                            */
+/*===========================================================================*/
+
+static void timer_event_handler(nrf_timer_event_t event_type, void* p_context)
+{
+    /* Compare event only triggers the ADC through PPI */
+}
+
+/**
+ * @brief   Consumes a full batch of samples and queues the other buffer, so conversions continue without gaps.
+ */
+static void adc_event_handler(nrf_drv_adc_evt_t const* p_event)
+{
+    if (p_event->type != NRF_DRV_ADC_EVT_DONE) {
+        return;
+    }
+
+    m_buffer_index ^= 1;
+    APP_ERROR_CHECK(nrf_drv_adc_buffer_convert(m_buffers[m_buffer_index], CURRENT_SENSE_BATCH));
+
+    uint32_t sum = 0;
+    uint16_t peak = 0;
+
+    for (uint16_t i = 0; i < p_event->data.done.size; i++) {
+        uint16_t sample = p_event->data.done.p_buffer[i] < 0 ? 0 : (uint16_t)p_event->data.done.p_buffer[i];
+
+        sum += sample;
+        peak = sample > peak ? sample : peak;
+    }
+
+    m_average = (uint16_t)(sum / p_event->data.done.size);
+
+    if (m_blanking > 0) {
+        m_blanking--;
+    } else if (peak > CURRENT_LIMIT_RAW) {
+        m_overloaded = true;
+    }
+}
+
+/*===========================================================================*/
+/* Current sense exported functions.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Configures sampling of the motor current: TIMER1 compare triggers single ADC conversion through PPI
+ *          every CURRENT_SENSE_PERIOD_US, and results are processed in batches of CURRENT_SENSE_BATCH.
+ */
+void current_sense_init(void)
+{
+    ret_code_t err_code;
+
+    nrf_drv_adc_config_t adc_config = NRF_DRV_ADC_DEFAULT_CONFIG;
+    err_code = nrf_drv_adc_init(&adc_config, adc_event_handler);
+    APP_ERROR_CHECK(err_code);
+    nrf_drv_adc_channel_enable(&m_channel);
+
+    err_code = nrf_drv_timer_init(&m_timer, NULL, timer_event_handler);
+    APP_ERROR_CHECK(err_code);
+    nrf_drv_timer_extended_compare(&m_timer, NRF_TIMER_CC_CHANNEL0, nrf_drv_timer_us_to_ticks(&m_timer, CURRENT_SENSE_PERIOD_US),
+        NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, false);
+
+    err_code = nrf_drv_ppi_init();
+    if (err_code != MODULE_ALREADY_INITIALIZED) {
+        APP_ERROR_CHECK(err_code);
+    }
+
+    err_code = nrf_drv_ppi_channel_alloc(&m_ppi_channel);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrf_drv_ppi_channel_assign(m_ppi_channel,
+        nrf_drv_timer_compare_event_address_get(&m_timer, NRF_TIMER_CC_CHANNEL0),
+        nrf_drv_adc_start_task_get());
+    APP_ERROR_CHECK(err_code);
+}
+
+/**
+ * @brief   Starts sampling. Should be called when the motor starts, first CURRENT_SENSE_BLANKING batches are not checked
+ *          against the limit, because of the inrush current.
+ */
+void current_sense_start(void)
+{
+    m_overloaded = false;
+    m_blanking = CURRENT_SENSE_BLANKING;
+
+    /* Batch left unfinished by the previous movement is continued, and ignored within blanking */
+    ret_code_t err_code = nrf_drv_adc_buffer_convert(m_buffers[m_buffer_index], CURRENT_SENSE_BATCH);
+    if (err_code != NRF_ERROR_BUSY) {
+        APP_ERROR_CHECK(err_code);
+    }
+
+    APP_ERROR_CHECK(nrf_drv_ppi_channel_enable(m_ppi_channel));
+    nrf_drv_timer_enable(&m_timer);
+}
+
+void current_sense_stop(void)
+{
+    nrf_drv_timer_disable(&m_timer);
+    APP_ERROR_CHECK(nrf_drv_ppi_channel_disable(m_ppi_channel));
+}
+
+/**
+ * @brief   Returns average motor current of the last batch, in mA.
+ */
+uint16_t current_sense_get(void)
+{
+    return (uint16_t)(((uint32_t)m_average * ADC_REFERENCE_MV * 1000UL) / ((uint32_t)ADC_MAX * CURRENT_SENSE_MV_PER_A));
+}
+
+/**
+ * @brief   Checks if any sample since the start exceeded CURRENT_SENSE_LIMIT_MA.
+ */
+bool current_sense_is_overloaded(void)
+{
+    return m_overloaded;
+}
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef CURRENT_SENSE_H__
+#define CURRENT_SENSE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void current_sense_init(void);
+void current_sense_start(void);
+void current_sense_stop(void);
+uint16_t current_sense_get(void);
+bool current_sense_is_overloaded(void);
+
+#endif
@@ -0,0 +1,328 @@
+#include "history.h"
+#include "acromegaly_config.h"
+#include "app_util_platform.h"
+#include "clock.h"
+#include "m45pe_drv.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*===========================================================================*/
+/* History local definitions.                                                */
+/*===========================================================================*/
+
+#define PAGE_ADDRESS(index) (((uint32_t)HISTORY_FIRST_PAGE + (index)) * M45PE_PAGE_SIZE)
+#define PAGE_HEADER_LENGTH 4 /* uint32 sequence number, the highest one marks the page being appended */
+#define SEQUENCE_ERASED 0xFFFFFFFF
+
+#define RECORD_MAX_LENGTH 20 /* Header and varints: time 5, start 3, travel 3, duration 5, overshoot 3 bytes */
+#define VARINT_MAX_LENGTH 5
+
+#define HEADER_REASON_MASK 0x07 /* CTRL_STOP_*, never zero */
+#define HEADER_BOOT 0x08 /* First record after power up, time is counted from the boot unless HEADER_EPOCH is set */
+#define HEADER_ESTIMATED 0x10 /* Positions were estimated by dead reckoning */
+#define HEADER_ABSOLUTE 0x20 /* Start position is absolute, otherwise relative to the previous end position */
+#define HEADER_EPOCH 0x40 /* Start time is absolute, in seconds since 1970-01-01 UTC */
+#define HEADER_END 0xFF /* Erased flash after the last record of the page, also ends the download stream */
+
+/*===========================================================================*/
+/* History local variables and types.                                        */
+/*===========================================================================*/
+
+typedef struct
+{
+    history_move_t move;
+    uint32_t start_time; /* Clock at the movement start, in seconds */
+    uint32_t start_uptime;
+    uint8_t sync_count; /* Clock syncs before the movement, time is a delta only without sync in between */
+    bool synced;
+} history_entry_t;
+
+static history_entry_t m_queue[HISTORY_QUEUE_SIZE]; /* Moves recorded in the controller context, waiting for the main loop */
+static uint8_t m_queue_head;
+static volatile uint8_t m_queue_count;
+
+static uint16_t m_head_page; /* Index of the page being appended */
+static uint16_t m_head_offset; /* First free byte of the head page */
+static uint32_t m_head_sequence;
+
+static bool m_booted; /* No record was written since boot */
+static uint32_t m_last_start; /* Clock at the start of the last recorded movement */
+static uint32_t m_last_start_uptime;
+static uint8_t m_last_sync_count;
+static int16_t m_last_end; /* End position of the last recorded movement */
+
+static uint8_t m_page[M45PE_PAGE_SIZE]; /* Page being downloaded */
+static uint16_t m_page_offset;
+static uint16_t m_page_length; /* End of records in m_page */
+static uint16_t m_download_page;
+static uint16_t m_download_pages; /* Pages left to download */
+static uint8_t m_prefix[VARINT_MAX_LENGTH]; /* Age of the last record, sent before records */
+static uint8_t m_prefix_offset;
+static uint8_t m_prefix_length;
+static bool m_end_sent = true;
+
+/*===========================================================================*/
+/* History local functions.                                                  */
+/*===========================================================================*/
+
+static uint8_t varint_encode(uint8_t* p_buffer, uint32_t value)
+{
+    uint8_t len = 0;
+
+    while (value >= 0x80) {
+        p_buffer[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    p_buffer[len++] = (uint8_t)value;
+
+    return len;
+}
+
+/**
+ * @brief   Maps signed value to unsigned one, so small magnitudes of both signs have short varints.
+ */
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/**
+ * @brief   Returns length of the record at the beginning of the buffer, or zero if it is not complete.
+ */
+static uint16_t record_length(uint8_t const* p_record, uint16_t available)
+{
+    uint16_t len = 1;
+
+    for (uint8_t field = 0; field < 5; field++) {
+        do {
+            if (len >= available) {
+                return 0;
+            }
+        } while (p_record[len++] & 0x80);
+    }
+
+    return len;
+}
+
+/**
+ * @brief   Returns offset of the first free byte in the page, after the last complete record.
+ */
+static uint16_t page_end(uint8_t const* p_page)
+{
+    uint16_t offset = PAGE_HEADER_LENGTH;
+
+    while (offset < M45PE_PAGE_SIZE && p_page[offset] != HEADER_END) {
+        uint16_t len = record_length(p_page + offset, M45PE_PAGE_SIZE - offset);
+
+        if (len == 0) {
+            break;
+        }
+        offset += len;
+    }
+
+    return offset;
+}
+
+static void page_load(uint16_t index)
+{
+    for (uint16_t offset = 0; offset < M45PE_PAGE_SIZE; offset += M45PE_BULK_LENGTH) {
+        m45pe_read_at(PAGE_ADDRESS(index) + offset, m_page + offset, M45PE_BULK_LENGTH);
+    }
+}
+
+/**
+ * @brief   Encodes the move. Time and start position are deltas from the previous record, so a typical record takes 8 bytes.
+ *          Time is absolute after boot and after the clock was synced, as the clock steps then.
+ * 
+ * @return Record length
+ */
+static uint8_t record_encode(uint8_t* p_record, history_entry_t const* p_entry, bool absolute)
+{
+    history_move_t const* p_move = &p_entry->move;
+    bool epoch = p_entry->synced && (m_booted || p_entry->sync_count != m_last_sync_count);
+    uint8_t len = 1;
+
+    p_record[0] = (p_move->reason & HEADER_REASON_MASK) | (m_booted ? HEADER_BOOT : 0) | (p_move->estimated ? HEADER_ESTIMATED : 0)
+        | (absolute ? HEADER_ABSOLUTE : 0) | (epoch ? HEADER_EPOCH : 0);
+
+    len += varint_encode(p_record + len, m_booted || epoch ? p_entry->start_time : p_entry->start_time - m_last_start);
+    len += varint_encode(p_record + len, zigzag(absolute ? p_move->start_position : p_move->start_position - m_last_end));
+    len += varint_encode(p_record + len, zigzag(p_move->end_position - p_move->start_position));
+    len += varint_encode(p_record + len, (p_move->duration_ms + 50) / 100);
+    len += varint_encode(p_record + len, zigzag(p_move->overshoot));
+
+    return len;
+}
+
+/**
+ * @brief   Moves the head to the next page, erasing the oldest records.
+ */
+static void page_start(void)
+{
+    m_head_page = (m_head_page + 1) % HISTORY_PAGE_COUNT;
+    m_head_sequence++;
+    m_head_offset = PAGE_HEADER_LENGTH;
+
+    m45pe_erase_page(PAGE_ADDRESS(m_head_page));
+    m45pe_program(PAGE_ADDRESS(m_head_page), (uint8_t const*)&m_head_sequence, PAGE_HEADER_LENGTH);
+}
+
+/**
+ * @brief   Appends the record to the head page. Records do not cross pages, first record of each page and the first
+ *          after boot have absolute start position, so every page can be decoded on its own.
+ */
+static void record_append(history_entry_t const* p_entry)
+{
+    uint8_t record[RECORD_MAX_LENGTH];
+    uint8_t len = record_encode(record, p_entry, m_booted);
+
+    if (m_head_offset + len > M45PE_PAGE_SIZE) {
+        page_start();
+        len = record_encode(record, p_entry, true);
+    }
+
+    m45pe_program(PAGE_ADDRESS(m_head_page) + m_head_offset, record, len);
+    m_head_offset += len;
+
+    m_booted = false;
+    m_last_start = p_entry->start_time;
+    m_last_start_uptime = p_entry->start_uptime;
+    m_last_sync_count = p_entry->sync_count;
+    m_last_end = p_entry->move.end_position;
+}
+
+/*===========================================================================*/
+/* History exported functions.                                               */
+/*===========================================================================*/
+
+/**
+ * @brief   Finds the head of the ring, the page with the highest sequence number. Should be called after clock_init.
+ */
+void history_init(void)
+{
+    bool found = false;
+    uint32_t sequence;
+
+    m_head_page = HISTORY_PAGE_COUNT - 1;
+    m_head_sequence = SEQUENCE_ERASED; /* First page gets sequence 0 */
+    m_head_offset = M45PE_PAGE_SIZE;
+
+    for (uint16_t i = 0; i < HISTORY_PAGE_COUNT; i++) {
+        m45pe_read_at(PAGE_ADDRESS(i), (uint8_t*)&sequence, PAGE_HEADER_LENGTH);
+
+        if (sequence != SEQUENCE_ERASED && (!found || (int32_t)(sequence - m_head_sequence) > 0)) {
+            m_head_page = i;
+            m_head_sequence = sequence;
+            found = true;
+        }
+    }
+
+    if (found) {
+        page_load(m_head_page);
+        m_head_offset = page_end(m_page);
+    }
+
+    m_booted = true;
+
+    NRF_LOG_PRINTF("History head page %d, offset %d\r\n", m_head_page, m_head_offset);
+}
+
+/**
+ * @brief   Queues finished movement to be written by history_flush. Can be called from an interrupt context.
+ */
+void history_record(history_move_t const* p_move)
+{
+    uint32_t duration = (p_move->duration_ms + 500) / 1000;
+    uint32_t time = clock_get();
+    uint32_t uptime = clock_uptime_get();
+    uint8_t sync_count = clock_sync_count_get();
+    bool synced = clock_is_synced();
+
+    CRITICAL_REGION_ENTER();
+    if (m_queue_count < HISTORY_QUEUE_SIZE) {
+        history_entry_t* p_entry = &m_queue[(m_queue_head + m_queue_count) % HISTORY_QUEUE_SIZE];
+        p_entry->move = *p_move;
+        p_entry->start_time = time > duration ? time - duration : 0;
+        p_entry->start_uptime = uptime > duration ? uptime - duration : 0;
+        p_entry->sync_count = sync_count;
+        p_entry->synced = synced;
+        m_queue_count++;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+/**
+ * @brief   Writes queued movements to flash. Should be called from the main loop, not from an interrupt context.
+ */
+void history_flush(void)
+{
+    history_entry_t entry;
+
+    while (m_queue_count > 0) {
+        CRITICAL_REGION_ENTER();
+        entry = m_queue[m_queue_head];
+        m_queue_head = (m_queue_head + 1) % HISTORY_QUEUE_SIZE;
+        m_queue_count--;
+        CRITICAL_REGION_EXIT();
+
+        record_append(&entry);
+    }
+}
+
+/**
+ * @brief   Starts the download stream: age of the last record (uvarint, seconds + 1, zero if it was recorded before
+ *          the boot), then records from the oldest to the newest, then HEADER_END.
+ */
+void history_download_start(void)
+{
+    m_prefix_length = varint_encode(m_prefix, m_booted ? 0 : clock_uptime_get() - m_last_start_uptime + 1);
+    m_prefix_offset = 0;
+
+    m_page_offset = 0;
+    m_page_length = 0;
+    m_download_page = (m_head_page + 1) % HISTORY_PAGE_COUNT;
+    m_download_pages = HISTORY_PAGE_COUNT;
+    m_end_sent = false;
+}
+
+/**
+ * @brief   Fills the buffer with next bytes of the download stream. Should be called from the main loop, as pages are
+ *          read from flash on demand.
+ * 
+ * @return Number of bytes, zero when the stream is finished
+ */
+uint8_t history_download_read(uint8_t* p_buffer, uint8_t max_len)
+{
+    uint8_t len = 0;
+
+    while (len < max_len) {
+        if (m_prefix_offset < m_prefix_length) {
+            p_buffer[len++] = m_prefix[m_prefix_offset++];
+        } else if (m_page_offset < m_page_length) {
+            uint16_t chunk = m_page_length - m_page_offset < max_len - len ? m_page_length - m_page_offset : max_len - len;
+
+            memcpy(p_buffer + len, m_page + m_page_offset, chunk);
+            m_page_offset += chunk;
+            len += chunk;
+        } else if (m_download_pages > 0) {
+            uint32_t sequence;
+
+            page_load(m_download_page);
+            memcpy(&sequence, m_page, PAGE_HEADER_LENGTH);
+
+            m_page_offset = PAGE_HEADER_LENGTH;
+            m_page_length = sequence == SEQUENCE_ERASED ? 0 : page_end(m_page);
+            m_download_page = (m_download_page + 1) % HISTORY_PAGE_COUNT;
+            m_download_pages--;
+        } else if (!m_end_sent) {
+            p_buffer[len++] = HEADER_END;
+            m_end_sent = true;
+        } else {
+            break;
+        }
+    }
+
+    return len;
+}
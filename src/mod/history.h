@@ -0,0 +1,23 @@
+#ifndef HISTORY_H__
+#define HISTORY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    int16_t start_position; /* In ticks */
+    int16_t end_position; /* In ticks */
+    uint32_t duration_ms; /* Time of the motor run */
+    int16_t overshoot; /* Distance passed beyond the exact target in the movement direction, in subticks */
+    uint8_t reason; /* CTRL_STOP_* */
+    bool estimated; /* Position was estimated by dead reckoning */
+} history_move_t;
+
+void history_init(void);
+void history_record(history_move_t const* p_move);
+void history_flush(void);
+void history_download_start(void);
+uint8_t history_download_read(uint8_t* p_buffer, uint8_t max_len);
+
+#endif
@@ -0,0 +1,226 @@
+#include "lifetime.h"
+#include "acromegaly_config.h"
+#include "app_util_platform.h"
+#include "m45pe_drv.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*===========================================================================*/
+/* Lifetime local definitions.                                               */
+/*===========================================================================*/
+
+#define PAGE_ADDRESS(counter, index) (((uint32_t)LIFETIME_FIRST_PAGE + (counter) * LIFETIME_PAGES_PER_COUNTER + (index)) * M45PE_PAGE_SIZE)
+#define PAGE_HEADER_LENGTH 8 /* uint32 base value, count of all bits of the previous pages, and its complement */
+#define PAGE_BITS ((M45PE_PAGE_SIZE - PAGE_HEADER_LENGTH) * 8)
+
+/*===========================================================================*/
+/* Lifetime local variables and types.                                       */
+/*===========================================================================*/
+
+/**
+ * Each counter owns a ring of LIFETIME_PAGES_PER_COUNTER pages. The active page keeps the base value in its header,
+ * followed by unary bits, every increment clears the next one (programming without erase). Full page is folded into
+ * the base of the next page, which is erased and programmed before the full one is abandoned, so the count survives
+ * power loss at any moment. The active page is the one with the highest valid base, the complement invalidates header
+ * programmed only partially.
+ */
+typedef struct
+{
+    uint8_t page; /* Index of the active page in the ring */
+    uint32_t base;
+    uint16_t used; /* Cleared bits of the active page */
+    volatile uint32_t pending; /* Increments waiting for lifetime_flush */
+} lifetime_counter_t;
+
+static lifetime_counter_t m_counters[LIFETIME_COUNTER_COUNT];
+static uint8_t m_page[M45PE_BULK_LENGTH];
+static bool m_changed = false;
+
+/*===========================================================================*/
+/* Lifetime local functions.                                                 */
+/*===========================================================================*/
+
+static bool page_base_read(uint8_t counter, uint8_t index, uint32_t* p_base)
+{
+    uint32_t header[2];
+
+    m45pe_read_at(PAGE_ADDRESS(counter, index), (uint8_t*)header, PAGE_HEADER_LENGTH);
+    *p_base = header[0];
+
+    return header[0] == ~header[1];
+}
+
+static void page_start(uint8_t counter, uint8_t index, uint32_t base)
+{
+    uint32_t header[2] = { base, ~base };
+
+    m45pe_erase_page(PAGE_ADDRESS(counter, index));
+    m45pe_program(PAGE_ADDRESS(counter, index), (uint8_t const*)header, PAGE_HEADER_LENGTH);
+}
+
+/**
+ * @brief   Counts cleared bits of the page body. Bits are cleared in order, so counting stops at the first erased byte.
+ */
+static uint16_t page_used_bits(uint8_t counter, uint8_t index)
+{
+    uint16_t used = 0;
+
+    for (uint16_t offset = PAGE_HEADER_LENGTH; offset < M45PE_PAGE_SIZE; offset += M45PE_BULK_LENGTH) {
+        uint8_t len = M45PE_PAGE_SIZE - offset < M45PE_BULK_LENGTH ? M45PE_PAGE_SIZE - offset : M45PE_BULK_LENGTH;
+
+        m45pe_read_at(PAGE_ADDRESS(counter, index) + offset, m_page, len);
+
+        for (uint8_t i = 0; i < len; i++) {
+            uint8_t value = m_page[i];
+
+            while (value != 0xFF) {
+                used++;
+                value = (value >> 1) | 0x80; /* Cleared from the least significant bit */
+            }
+
+            if (m_page[i] != 0x00) {
+                return used;
+            }
+        }
+    }
+
+    return used;
+}
+
+static void counter_load(uint8_t counter)
+{
+    lifetime_counter_t* p_counter = &m_counters[counter];
+    bool found = false;
+    uint32_t base;
+
+    p_counter->page = 0;
+    p_counter->base = 0;
+    p_counter->used = 0;
+    p_counter->pending = 0;
+
+    for (uint8_t i = 0; i < LIFETIME_PAGES_PER_COUNTER; i++) {
+        if (page_base_read(counter, i, &base) && (!found || base > p_counter->base)) {
+            p_counter->page = i;
+            p_counter->base = base;
+            found = true;
+        }
+    }
+
+    if (found) {
+        p_counter->used = page_used_bits(counter, p_counter->page);
+    } else {
+        /* Never used, initialize the first page */
+        page_start(counter, 0, 0);
+    }
+}
+
+/**
+ * @brief   Moves the counter to the next page of its ring, with base including all bits of the full page.
+ */
+static void counter_fold(uint8_t counter)
+{
+    lifetime_counter_t* p_counter = &m_counters[counter];
+    uint8_t page = (p_counter->page + 1) % LIFETIME_PAGES_PER_COUNTER;
+    uint32_t base = p_counter->base + p_counter->used;
+
+    page_start(counter, page, base);
+
+    p_counter->page = page;
+    p_counter->base = base;
+    p_counter->used = 0;
+}
+
+/**
+ * @brief   Clears next bits of the active page, up to the end of the page or M45PE_BULK_LENGTH bytes.
+ * 
+ * @return Number of bits cleared
+ */
+static uint32_t counter_program(uint8_t counter, uint32_t amount)
+{
+    lifetime_counter_t* p_counter = &m_counters[counter];
+    uint16_t first = p_counter->used / 8;
+    uint32_t free = PAGE_BITS - p_counter->used;
+    uint32_t bits = amount < free ? amount : free;
+    uint16_t last;
+    uint8_t len;
+
+    if ((p_counter->used + bits + 7) / 8 - first > M45PE_BULK_LENGTH) {
+        bits = (uint32_t)(first + M45PE_BULK_LENGTH) * 8 - p_counter->used;
+    }
+
+    last = (p_counter->used + bits - 1) / 8;
+    len = (uint8_t)(last - first + 1);
+
+    memset(m_page, 0x00, len);
+    m_page[len - 1] = (uint8_t)(0xFF << ((p_counter->used + bits - 1) % 8 + 1));
+
+    m45pe_program(PAGE_ADDRESS(counter, p_counter->page) + PAGE_HEADER_LENGTH + first, m_page, len);
+    p_counter->used += bits;
+
+    return bits;
+}
+
+/*===========================================================================*/
+/* Lifetime exported functions.                                              */
+/*===========================================================================*/
+
+void lifetime_init(void)
+{
+    for (uint8_t i = 0; i < LIFETIME_COUNTER_COUNT; i++) {
+        counter_load(i);
+        NRF_LOG_PRINTF("Lifetime counter %d: %d\r\n", i, lifetime_get(i));
+    }
+}
+
+/**
+ * @brief   Adds amount to the counter, it is written by lifetime_flush. Can be called from an interrupt context.
+ */
+void lifetime_count(uint8_t counter, uint32_t amount)
+{
+    CRITICAL_REGION_ENTER();
+    m_counters[counter].pending += amount;
+    CRITICAL_REGION_EXIT();
+}
+
+uint32_t lifetime_get(uint8_t counter)
+{
+    lifetime_counter_t const* p_counter = &m_counters[counter];
+
+    return p_counter->base + p_counter->used + p_counter->pending;
+}
+
+bool lifetime_is_changed(void)
+{
+    bool changed = m_changed;
+
+    m_changed = false;
+    return changed;
+}
+
+/**
+ * @brief   Writes pending increments to flash. Should be called from the main loop, not from an interrupt context.
+ */
+void lifetime_flush(void)
+{
+    for (uint8_t i = 0; i < LIFETIME_COUNTER_COUNT; i++) {
+        lifetime_counter_t* p_counter = &m_counters[i];
+
+        while (p_counter->pending > 0) {
+            uint32_t bits;
+
+            if (p_counter->used == PAGE_BITS) {
+                counter_fold(i);
+            }
+
+            bits = counter_program(i, p_counter->pending);
+
+            CRITICAL_REGION_ENTER();
+            p_counter->pending -= bits;
+            CRITICAL_REGION_EXIT();
+
+            m_changed = true;
+        }
+    }
+}
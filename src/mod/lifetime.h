@@ -0,0 +1,18 @@
+#ifndef LIFETIME_H__
+#define LIFETIME_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LIFETIME_MOTOR_STARTS 0 /* Each motor drive start, including reversals */
+#define LIFETIME_TRAVEL 1 /* Travel of the countertop, in ticks */
+#define LIFETIME_END_STOPS 2 /* Movements finished at an end stop */
+#define LIFETIME_COUNTER_COUNT 3
+
+void lifetime_init(void);
+void lifetime_count(uint8_t counter, uint32_t amount);
+uint32_t lifetime_get(uint8_t counter);
+bool lifetime_is_changed(void);
+void lifetime_flush(void);
+
+#endif
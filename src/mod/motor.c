@@ -0,0 +1,265 @@
+#include "motor.h"
+#include "acromegaly_config.h"
+#include "app_error.h"
+#include "app_pwm.h"
+#include "app_timer.h"
+#include "controller.h"
+#include "nrf_drv_gpiote.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Motor local definitions.                                                  */
+/*===========================================================================*/
+
+#define GPIO_MOTOR_ENABLED_PINS { 28, 12 } /* Indexed by channel */
+#define GPIO_MOTOR_UP_PINS { 16, 13 }
+#define GPIO_MOTOR_DOWN_PINS { 15, 14 }
+
+#define APP_MOTOR_TIMER_PRESCALER 0 /* Same as of the controller timer, RTC1 is shared */
+#define MOTOR_DEAD_TIME APP_TIMER_TICKS(MOTOR_DEAD_TIME_MS, APP_MOTOR_TIMER_PRESCALER)
+
+#if CTRL_CHANNEL_COUNT == 1
+#define MOTOR_PWM_CONFIG(pins) APP_PWM_DEFAULT_CONFIG_1CH(MOTOR_PWM_PERIOD_US, pins[0])
+#elif CTRL_CHANNEL_COUNT == 2
+#define MOTOR_PWM_CONFIG(pins) APP_PWM_DEFAULT_CONFIG_2CH(MOTOR_PWM_PERIOD_US, pins[0], pins[1])
+#else
+#error "Motor PWM instance supports up to 2 channels"
+#endif
+
+/*===========================================================================*/
+/* Motor local variables and types.                                          */
+/*===========================================================================*/
+
+APP_PWM_INSTANCE(PWM_MOTOR, 2);
+
+static const uint8_t m_enabled_pins[] = GPIO_MOTOR_ENABLED_PINS;
+static const uint8_t m_up_pins[] = GPIO_MOTOR_UP_PINS;
+static const uint8_t m_down_pins[] = GPIO_MOTOR_DOWN_PINS;
+
+static bool m_driven[CTRL_CHANNEL_COUNT]; /* Channel is driven, its direction pin is set or waits for the dead time */
+static uint8_t m_leg[CTRL_CHANNEL_COUNT]; /* Direction of the set pin, MOVE_DIRECTION_NONE when none is set */
+static uint8_t m_pending_leg[CTRL_CHANNEL_COUNT]; /* Direction to set after the dead time */
+static uint8_t m_released_leg[CTRL_CHANNEL_COUNT]; /* Direction of the pin released last */
+static uint32_t m_release_time[CTRL_CHANNEL_COUNT]; /* RTC counter value of its release */
+static uint8_t m_duty[CTRL_CHANNEL_COUNT]; /* Duty cycle currently applied to the enable pin */
+static uint8_t m_duty_limit[CTRL_CHANNEL_COUNT]; /* Duty cycle the ramp is heading to */
+
+/*===========================================================================*/
+/* Motor local functions.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief   Applies duty cycle to the channel enable pin.
+ * @note    PWM can be busy with a previous update, in such case duty stays unchanged until next ramp step.
+ */
+static void duty_apply(uint8_t channel, uint8_t duty)
+{
+    if (app_pwm_channel_duty_set(&PWM_MOTOR, channel, duty) == NRF_SUCCESS) {
+        m_duty[channel] = duty;
+    }
+}
+
+static void duty_apply_blocking(uint8_t channel, uint8_t duty)
+{
+    while (app_pwm_channel_duty_set(&PWM_MOTOR, channel, duty) == NRF_ERROR_BUSY)
+        ;
+    m_duty[channel] = duty;
+}
+
+/**
+ * @brief   Cuts the duty and clears both direction pins of the channel.
+ */
+static void leg_release(uint8_t channel, uint32_t now)
+{
+    duty_apply_blocking(channel, 0);
+    nrf_drv_gpiote_out_clear(m_up_pins[channel]);
+    nrf_drv_gpiote_out_clear(m_down_pins[channel]);
+
+    if (m_leg[channel] != MOVE_DIRECTION_NONE) {
+        m_released_leg[channel] = m_leg[channel];
+        m_release_time[channel] = now;
+    }
+
+    m_leg[channel] = MOVE_DIRECTION_NONE;
+    m_pending_leg[channel] = MOVE_DIRECTION_NONE;
+}
+
+/**
+ * @brief   Sets direction pin of the channel and starts the ramp from MOTOR_DUTY_MIN.
+ */
+static void leg_set(uint8_t channel, uint8_t direction)
+{
+    nrf_drv_gpiote_out_set(direction == MOVE_DIRECTION_UP ? m_up_pins[channel] : m_down_pins[channel]);
+
+    m_leg[channel] = direction;
+    m_pending_leg[channel] = MOVE_DIRECTION_NONE;
+    duty_apply(channel, MOTOR_DUTY_MIN);
+}
+
+/**
+ * @brief   Checks if setting the direction pin has to wait, because the opposite one was released less than
+ *          MOTOR_DEAD_TIME ago.
+ */
+static bool is_dead_time(uint8_t channel, uint8_t direction, uint32_t now)
+{
+    uint32_t elapsed;
+
+    if (m_released_leg[channel] == MOVE_DIRECTION_NONE || m_released_leg[channel] == direction) {
+        return false;
+    }
+
+    app_timer_cnt_diff_compute(now, m_release_time[channel], &elapsed);
+    return elapsed < MOTOR_DEAD_TIME;
+}
+
+/*===========================================================================*/
+/* Motor exported functions.                                                 */
+/*===========================================================================*/
+
+void motor_init(void)
+{
+    ret_code_t err_code;
+
+    nrf_drv_gpiote_out_config_t out_config = GPIOTE_CONFIG_OUT_SIMPLE(false);
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        m_leg[i] = MOVE_DIRECTION_NONE;
+        m_pending_leg[i] = MOVE_DIRECTION_NONE;
+        m_released_leg[i] = MOVE_DIRECTION_NONE;
+
+        err_code = nrf_drv_gpiote_out_init(m_up_pins[i], &out_config);
+        APP_ERROR_CHECK(err_code);
+
+        err_code = nrf_drv_gpiote_out_init(m_down_pins[i], &out_config);
+        APP_ERROR_CHECK(err_code);
+    }
+
+    /* Enable pins are driven by PWM, one PWM channel per motor */
+    app_pwm_config_t pwm_cfg = MOTOR_PWM_CONFIG(m_enabled_pins);
+
+    err_code = app_pwm_init(&PWM_MOTOR, &pwm_cfg, NULL);
+    APP_ERROR_CHECK(err_code);
+
+    app_pwm_enable(&PWM_MOTOR);
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        duty_apply_blocking(i, 0);
+    }
+}
+
+/**
+ * @brief   Sets direction pins of all channels. Movement starts with soft-start ramp from MOTOR_DUTY_MIN.
+ * @note    Stop (MOVE_DIRECTION_NONE) cuts the power immediately. Soft-stop is achieved by lowering
+ *          duty limit while approaching the target. On reversal, the new direction pin is set by motor_ramp_step
+ *          after the dead time.
+ * 
+ * @param[in] direction   One of MOVE_DIRECTION_*
+ */
+void motor_drive(uint8_t direction)
+{
+    uint32_t now;
+    app_timer_cnt_get(&now);
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        leg_release(i, now);
+        m_duty_limit[i] = 0;
+        m_driven[i] = false;
+
+        if (direction != MOVE_DIRECTION_UP && direction != MOVE_DIRECTION_DOWN) {
+            continue;
+        }
+
+        m_driven[i] = true;
+        m_duty_limit[i] = MOTOR_DUTY_MAX;
+
+        if (is_dead_time(i, direction, now)) {
+            m_pending_leg[i] = direction;
+        } else {
+            leg_set(i, direction);
+        }
+    }
+}
+
+/**
+ * @brief   Limits duty cycle the channel ramp is heading to. Takes effect only while channel is driven.
+ * 
+ * @param[in] channel   Motor channel
+ * @param[in] duty      Duty cycle in percents, bounded to <MOTOR_DUTY_MIN, MOTOR_DUTY_MAX>. 0 pauses the channel.
+ */
+void motor_duty_limit_set(uint8_t channel, uint8_t duty)
+{
+    if (!m_driven[channel]) {
+        return;
+    }
+
+    if (duty == 0) {
+        duty_apply(channel, 0);
+    } else if (duty < MOTOR_DUTY_MIN) {
+        duty = MOTOR_DUTY_MIN;
+    } else if (duty > MOTOR_DUTY_MAX) {
+        duty = MOTOR_DUTY_MAX;
+    }
+
+    m_duty_limit[channel] = duty;
+}
+
+/**
+ * @brief   Stops single channel until next motor_drive call.
+ */
+void motor_release(uint8_t channel)
+{
+    uint32_t now;
+    app_timer_cnt_get(&now);
+
+    leg_release(channel, now);
+
+    m_driven[channel] = false;
+    m_duty_limit[channel] = 0;
+}
+
+/**
+ * @brief   Moves applied duty cycles one step towards the limits, and sets direction pins delayed by the dead time.
+ *          Should be called periodically while motor is driven.
+ */
+void motor_ramp_step(void)
+{
+    uint32_t now;
+    app_timer_cnt_get(&now);
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        uint8_t duty = m_duty[i];
+        uint8_t limit = m_duty_limit[i];
+
+        if (!m_driven[i]) {
+            continue;
+        }
+
+        if (m_pending_leg[i] != MOVE_DIRECTION_NONE) {
+            if (!is_dead_time(i, m_pending_leg[i], now)) {
+                leg_set(i, m_pending_leg[i]);
+            }
+            continue;
+        }
+
+        if (duty == limit) {
+            continue;
+        }
+
+        if (duty < limit) {
+            if (duty < MOTOR_DUTY_MIN) {
+                duty_apply(i, MOTOR_DUTY_MIN); /* Resuming after pause */
+            } else {
+                duty_apply(i, limit - duty > MOTOR_RAMP_ACCEL_STEP ? duty + MOTOR_RAMP_ACCEL_STEP : limit);
+            }
+        } else {
+            duty_apply(i, duty - limit > MOTOR_RAMP_DECEL_STEP ? duty - MOTOR_RAMP_DECEL_STEP : limit);
+        }
+    }
+}
+
+uint8_t motor_duty_get(uint8_t channel)
+{
+    return m_duty[channel];
+}
@@ -0,0 +1,15 @@
+#ifndef MOTOR_H__
+#define MOTOR_H__
+
+#include <stdint.h>
+
+#define MOTOR_DUTY_MAX 100
+
+void motor_init(void);
+void motor_drive(uint8_t direction);
+void motor_duty_limit_set(uint8_t channel, uint8_t duty);
+void motor_release(uint8_t channel);
+void motor_ramp_step(void);
+uint8_t motor_duty_get(uint8_t channel);
+
+#endif
@@ -0,0 +1,142 @@
+#include "obstruction.h"
+#include "acromegaly_config.h"
+#include "controller.h"
+#include "m45pe_drv.h"
+#include "motor.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*===========================================================================*/
+/* Obstruction local definitions.                                            */
+/*===========================================================================*/
+
+#define DIRECTION_INDEX(direction) (direction == MOVE_DIRECTION_DOWN ? 1 : 0)
+#define ZONE_COUNT 8
+
+#define PROFILE_ADDRESS ((uint32_t)CTRL_OBSTRUCTION_PAGE * M45PE_PAGE_SIZE)
+#define PROFILE_STORE_DIVISOR 16 /* Relative change of a zone period, which is worth a flash write */
+#define PERIOD_ERASED 0xFFFFFFFF
+
+#if CTRL_OBSTRUCTION_PAGE == 0 || CTRL_OBSTRUCTION_PAGE >= HISTORY_FIRST_PAGE
+#error "Obstruction profile page overlaps settings or history"
+#endif
+
+/*===========================================================================*/
+/* Obstruction local variables and types.                                    */
+/*===========================================================================*/
+
+/* Learned tick period at full duty, in RTC ticks, indexed by DIRECTION_INDEX and height zone. Zero until learned. */
+static uint32_t m_profile[2][ZONE_COUNT];
+static uint32_t m_stored_profile[2][ZONE_COUNT];
+
+/*===========================================================================*/
+/* Obstruction local functions.                                              */
+/*===========================================================================*/
+
+static uint8_t zone_index(int16_t position)
+{
+    if (position < 0) {
+        return 0;
+    }
+
+    uint16_t zone = (uint16_t)position >> CTRL_OBSTRUCTION_ZONE_SHIFT;
+    return zone < ZONE_COUNT ? zone : ZONE_COUNT - 1;
+}
+
+/*===========================================================================*/
+/* Obstruction exported functions.                                           */
+/*===========================================================================*/
+
+/**
+ * @brief   Restores learned speed profile from external flash, so obstructions are detected right after power up.
+ */
+void obstruction_init(void)
+{
+    m45pe_read_at(PROFILE_ADDRESS, (uint8_t*)m_profile, sizeof(m_profile));
+
+    for (uint8_t i = 0; i < 2; i++) {
+        for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+            if (m_profile[i][zone] == PERIOD_ERASED) {
+                m_profile[i][zone] = 0;
+            }
+        }
+    }
+
+    memcpy(m_stored_profile, m_profile, sizeof(m_profile));
+}
+
+/**
+ * @brief   Updates speed profile of the height zone with a tick period measured during driven movement.
+ * @note    Period is normalized to full duty with the same linear model as the trajectory planner uses.
+ * 
+ * @param[in] direction   Movement direction
+ * @param[in] position    Position in ticks
+ * @param[in] period      Measured tick period, in RTC ticks
+ * @param[in] duty        Motor duty during the period
+ */
+void obstruction_learn(uint8_t direction, int16_t position, uint32_t period, uint8_t duty)
+{
+    if (duty < TRAJECTORY_LEARN_MIN_DUTY || direction == MOVE_DIRECTION_NONE) {
+        return;
+    }
+
+    uint32_t* p_profile = &m_profile[DIRECTION_INDEX(direction)][zone_index(position)];
+    uint32_t full_period = (period * (duty - MOTOR_DUTY_MIN)) / (MOTOR_DUTY_MAX - MOTOR_DUTY_MIN);
+
+    *p_profile = *p_profile == 0 ? full_period : (3 * *p_profile + full_period) / 4;
+}
+
+/**
+ * @brief   Checks if time since the last tick is too long for the learned speed at the height and duty, what indicates
+ *          an obstacle. Without learned profile, or at low duty of acceleration and braking, obstruction is not detected.
+ * 
+ * @param[in] direction   Movement direction
+ * @param[in] position    Position in ticks
+ * @param[in] elapsed     Time since the last tick, in RTC ticks
+ * @param[in] duty        Current motor duty
+ */
+bool obstruction_check(uint8_t direction, int16_t position, uint32_t elapsed, uint8_t duty)
+{
+    if (duty < TRAJECTORY_LEARN_MIN_DUTY || direction == MOVE_DIRECTION_NONE) {
+        return false;
+    }
+
+    uint32_t full_period = m_profile[DIRECTION_INDEX(direction)][zone_index(position)];
+
+    if (full_period == 0) {
+        return false;
+    }
+
+    /* elapsed > full_period * (MAX - MIN) / (duty - MIN) * RATIO / 100, without division */
+    return elapsed * (duty - MOTOR_DUTY_MIN) * 100 > full_period * (MOTOR_DUTY_MAX - MOTOR_DUTY_MIN) * CTRL_OBSTRUCTION_RATIO;
+}
+
+/**
+ * @brief   Writes learned profile to flash, when any zone changed noticeably. Profile changes with every tick, so it is
+ *          written only after the movement. Should be called from the main loop, not from an interrupt context.
+ */
+void obstruction_flush(void)
+{
+    bool changed = false;
+
+    if (controller_is_moving()) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < 2; i++) {
+        for (uint8_t zone = 0; zone < ZONE_COUNT; zone++) {
+            uint32_t period = m_profile[i][zone];
+            uint32_t stored = m_stored_profile[i][zone];
+            uint32_t change = period > stored ? period - stored : stored - period;
+
+            changed |= change * PROFILE_STORE_DIVISOR > stored;
+        }
+    }
+
+    if (changed) {
+        memcpy(m_stored_profile, m_profile, sizeof(m_profile));
+        m45pe_erase_page(PROFILE_ADDRESS);
+        m45pe_program(PROFILE_ADDRESS, (uint8_t*)m_stored_profile, sizeof(m_stored_profile));
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef OBSTRUCTION_H__
+#define OBSTRUCTION_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void obstruction_init(void);
+void obstruction_learn(uint8_t direction, int16_t position, uint32_t period, uint8_t duty);
+bool obstruction_check(uint8_t direction, int16_t position, uint32_t elapsed, uint8_t duty);
+void obstruction_flush(void);
+
+#endif
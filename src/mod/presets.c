@@ -0,0 +1,212 @@
+#include "presets.h"
+#include "acromegaly_config.h"
+#include "device_manager_cnfg.h"
+#include "m45pe_drv.h"
+#include "m45pe_keys.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Presets local definitions.                                                */
+/*===========================================================================*/
+
+#define PRESET_EMPTY ((int32_t)0xFFFFFFFF) /* Value of erased flash */
+#define PREFS_DEFAULT 0xFF /* Value of erased flash, all preferences enabled */
+
+/* Tables of bonded peers are indexed by device manager device id, shared table is used by other peers */
+#define TABLE_SHARED DEVICE_MANAGER_MAX_BONDS
+#define TABLE_COUNT (DEVICE_MANAGER_MAX_BONDS + 1)
+#define TABLE_SIZE (PRESETS_COUNT * sizeof(int32_t))
+
+#define PRESET_KEY(table, slot) ((table) == TABLE_SHARED ? FLASH_PRESETS_KEY + (slot) * sizeof(int32_t) \
+                                                         : FLASH_PEER_PRESETS_KEY + (table) * TABLE_SIZE + (slot) * sizeof(int32_t))
+#define PREFS_KEY(table) (FLASH_PRESETS_PREFS_KEY + (table))
+
+#if PRESETS_COUNT > 8
+#error "Presets dirty mask supports up to 8 slots"
+#endif
+
+#if FLASH_PEER_PRESETS_KEY + DEVICE_MANAGER_MAX_BONDS * PRESETS_COUNT * 4 > FLASH_PRESETS_PREFS_KEY
+#error "Peer presets overlap preferences in flash"
+#endif
+
+/*===========================================================================*/
+/* Presets local variables and types.                                        */
+/*===========================================================================*/
+
+typedef struct
+{
+    int32_t targets[PRESETS_COUNT]; /* Preset targets, in subticks */
+    uint8_t prefs;
+    uint8_t dirty_mask; /* Slots changed since last flush */
+    bool prefs_dirty;
+} presets_table_t;
+
+static presets_table_t m_tables[TABLE_COUNT]; /* RAM cache of all tables, so peer selection needs no flash access */
+static presets_table_t* m_p_active = &m_tables[TABLE_SHARED];
+
+/*===========================================================================*/
+/* Presets local functions.                                                  */
+/*===========================================================================*/
+
+static void table_erase(presets_table_t* p_table)
+{
+    for (uint8_t slot = 0; slot < PRESETS_COUNT; slot++) {
+        p_table->targets[slot] = PRESET_EMPTY;
+    }
+
+    p_table->prefs = PREFS_DEFAULT;
+    p_table->dirty_mask = (1 << PRESETS_COUNT) - 1;
+    p_table->prefs_dirty = true;
+}
+
+/*===========================================================================*/
+/* Presets exported functions.                                               */
+/*===========================================================================*/
+
+/**
+ * @brief   Loads preset tables of all peers from external flash into the RAM cache.
+ * 
+ * @param[in] erase_peers   Bonds were cleared, so tables of bonded peers are erased as well
+ */
+void presets_init(bool erase_peers)
+{
+    for (uint8_t table = 0; table < TABLE_COUNT; table++) {
+        presets_table_t* p_table = &m_tables[table];
+
+        if (erase_peers && table != TABLE_SHARED) {
+            table_erase(p_table);
+            continue;
+        }
+
+        for (uint8_t slot = 0; slot < PRESETS_COUNT; slot++) {
+            p_table->targets[slot] = PRESET_EMPTY;
+            m45pe_read(PRESET_KEY(table, slot), (uint8_t*)&p_table->targets[slot], sizeof(int32_t));
+        }
+
+        p_table->prefs = PREFS_DEFAULT;
+        m45pe_read(PREFS_KEY(table), &p_table->prefs, sizeof(uint8_t));
+
+        p_table->dirty_mask = 0;
+        p_table->prefs_dirty = false;
+    }
+
+    m_p_active = &m_tables[TABLE_SHARED];
+}
+
+/**
+ * @brief   Activates table of the bonded peer. Should be called when link with the peer is secured.
+ * 
+ * @param[in] device_id   Device manager device id. Peers without bond use shared table.
+ */
+void presets_peer_select(uint8_t device_id)
+{
+    m_p_active = device_id < DEVICE_MANAGER_MAX_BONDS ? &m_tables[device_id] : &m_tables[TABLE_SHARED];
+    NRF_LOG_PRINTF("Presets of peer %d\r\n", device_id);
+}
+
+/**
+ * @brief   Activates shared table. Should be called on peer disconnection.
+ */
+void presets_peer_deselect(void)
+{
+    m_p_active = &m_tables[TABLE_SHARED];
+}
+
+/**
+ * @brief   Erases table of the peer, which bond was deleted, so it is not inherited by next peer bonded with the same id.
+ */
+void presets_peer_erase(uint8_t device_id)
+{
+    if (device_id < DEVICE_MANAGER_MAX_BONDS) {
+        table_erase(&m_tables[device_id]);
+    }
+}
+
+/**
+ * @brief   Erases tables of all peers. Should be called when tick height changed, as saved ticks then no longer match
+ *          the heights the user saved them at.
+ */
+void presets_erase_all(void)
+{
+    for (uint8_t table = 0; table < TABLE_COUNT; table++) {
+        table_erase(&m_tables[table]);
+    }
+
+    NRF_LOG_PRINTF("Presets erased\r\n");
+}
+
+/**
+ * @brief   Returns cached target of the preset of active peer.
+ * 
+ * @param[in]  slot       Preset slot
+ * @param[out] p_target   Target position in subticks
+ * 
+ * @return false if slot is out of range or was never saved
+ */
+bool presets_target_get(uint8_t slot, int32_t* p_target)
+{
+    if (slot >= PRESETS_COUNT || m_p_active->targets[slot] == PRESET_EMPTY) {
+        return false;
+    }
+
+    *p_target = m_p_active->targets[slot];
+    return true;
+}
+
+/**
+ * @brief   Saves position to the preset of active peer. Value is cached immediately and written to flash on presets_flush.
+ * 
+ * @param[in] slot       Preset slot
+ * @param[in] position   Position in subticks
+ */
+bool presets_save(uint8_t slot, int32_t position)
+{
+    if (slot >= PRESETS_COUNT || position == PRESET_EMPTY) {
+        return false;
+    }
+
+    NRF_LOG_PRINTF("Preset %d saved at %d\r\n", slot, position);
+
+    m_p_active->targets[slot] = position;
+    m_p_active->dirty_mask |= 1 << slot;
+
+    return true;
+}
+
+/**
+ * @brief   Returns notification preferences (PRESETS_PREF_*) of active peer.
+ */
+uint8_t presets_prefs_get(void)
+{
+    return m_p_active->prefs;
+}
+
+void presets_prefs_set(uint8_t prefs)
+{
+    m_p_active->prefs = prefs;
+    m_p_active->prefs_dirty = true;
+}
+
+/**
+ * @brief   Writes changed presets to flash. Should be called from the main loop, not from an interrupt context.
+ */
+void presets_flush(void)
+{
+    for (uint8_t table = 0; table < TABLE_COUNT; table++) {
+        presets_table_t* p_table = &m_tables[table];
+
+        for (uint8_t slot = 0; p_table->dirty_mask != 0 && slot < PRESETS_COUNT; slot++) {
+            if (p_table->dirty_mask & (1 << slot)) {
+                p_table->dirty_mask &= ~(1 << slot);
+                m45pe_write(PRESET_KEY(table, slot), (uint8_t*)&p_table->targets[slot], sizeof(int32_t));
+            }
+        }
+
+        if (p_table->prefs_dirty) {
+            p_table->prefs_dirty = false;
+            m45pe_write(PREFS_KEY(table), &p_table->prefs, sizeof(uint8_t));
+        }
+    }
+}
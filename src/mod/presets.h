@@ -0,0 +1,20 @@
+#ifndef PRESETS_H__
+#define PRESETS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PRESETS_PREF_NOTIFY_INTERPOLATED 1 << 0 /* Notify status on position changes finer than a tick */
+
+void presets_init(bool erase_peers);
+void presets_peer_select(uint8_t device_id);
+void presets_peer_deselect(void);
+void presets_peer_erase(uint8_t device_id);
+void presets_erase_all(void);
+bool presets_target_get(uint8_t slot, int32_t* p_target);
+bool presets_save(uint8_t slot, int32_t position);
+uint8_t presets_prefs_get(void);
+void presets_prefs_set(uint8_t prefs);
+void presets_flush(void);
+
+#endif
@@ -0,0 +1,99 @@
+#include "quadrature.h"
+#include "acromegaly_config.h"
+#include "app_error.h"
+#include "nrf_log.h"
+#include <stdint.h>
+
+#if USE_QDEC
+
+#include "nrf_drv_qdec.h"
+
+/*===========================================================================*/
+/* Quadrature local definitions.                                             */
+/*===========================================================================*/
+
+#define QDEC_PIN_DISCONNECTED 0xFFFFFFFF /* LED output is not used, sensors are powered all the time */
+
+/*===========================================================================*/
+/* Quadrature local variables and types.                                     */
+/*===========================================================================*/
+
+static volatile int32_t m_count; /* Transitions reported by the hardware, signed with direction */
+static volatile uint32_t m_errors; /* Double transitions, which direction is unknown */
+static quadrature_motion_cb_t m_motion_cb;
+
+/*===========================================================================*/
+/* Quadrature local functions.                                               */
+/*===========================================================================*/
+
+/**
+ * @brief   Takes transitions reported after REPORTPER samples with motion. This is the only path reading the accumulator:
+ *          REPORTRDY clears it in hardware through the READCLRACC short, which a read from the thread could not mask.
+ *          Report comes only with motion, so it also tells the controller the desk moves while its poll is stopped.
+ */
+static void qdec_event_handler(nrf_drv_qdec_event_t event)
+{
+    if (event.type != NRF_QDEC_EVENT_REPORTRDY) {
+        return;
+    }
+
+    m_count += event.data.report.acc;
+    m_errors += event.data.report.accdbl;
+
+    if (m_motion_cb != NULL) {
+        m_motion_cb();
+    }
+}
+
+/*===========================================================================*/
+/* Quadrature exported functions.                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Starts decoding of the two-phase tick sensor by the QDEC peripheral. Transitions are accumulated by hardware
+ *          and sampled every 128 us, so no interrupt is taken per edge.
+ * 
+ * @param[in] pin_a       Phase A input, leading while moving up
+ * @param[in] pin_b       Phase B input
+ * @param[in] motion_cb   Called from the interrupt with each report of motion
+ */
+void quadrature_init(uint32_t pin_a, uint32_t pin_b, quadrature_motion_cb_t motion_cb)
+{
+    m_count = 0;
+    m_errors = 0;
+    m_motion_cb = motion_cb;
+
+    nrf_drv_qdec_config_t config = NRF_DRV_QDEC_DEFAULT_CONFIG;
+
+    config.psela = pin_a;
+    config.pselb = pin_b;
+    config.pselled = QDEC_PIN_DISCONNECTED;
+    config.sampleper = NRF_QDEC_SAMPLEPER_128us;
+    config.reportper = NRF_QDEC_REPORTPER_80; /* Report every 10 ms while moving, same as the controller poll */
+    config.dbfen = true;
+    config.sample_inten = false;
+
+    APP_ERROR_CHECK(nrf_drv_qdec_init(&config, qdec_event_handler));
+    nrf_drv_qdec_enable();
+
+    NRF_LOG_PRINTF("QDEC on pins %d, %d\r\n", pin_a, pin_b);
+}
+
+/**
+ * @brief   Returns transitions reported since init, positive while moving up. Transitions of the report period in progress
+ *          are not included yet.
+ */
+int32_t quadrature_count_get(void)
+{
+    return m_count;
+}
+
+/**
+ * @brief   Returns number of double transitions since init, as missed edges. For diagnostics.
+ */
+uint32_t quadrature_errors_get(void)
+{
+    return m_errors;
+}
+
+#endif
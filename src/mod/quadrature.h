@@ -0,0 +1,14 @@
+#ifndef QUADRATURE_H__
+#define QUADRATURE_H__
+
+#include <stdint.h>
+
+#define QUADRATURE_COUNTS_PER_TICK 2 /* Transitions of both phases counted per level change of phase A */
+
+typedef void (*quadrature_motion_cb_t)(void);
+
+void quadrature_init(uint32_t pin_a, uint32_t pin_b, quadrature_motion_cb_t motion_cb);
+int32_t quadrature_count_get(void);
+uint32_t quadrature_errors_get(void);
+
+#endif
@@ -0,0 +1,211 @@
+#include "sequencer.h"
+#include "acromegaly_config.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "controller.h"
+#include "nrf_log.h"
+#include "thermal.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Sequencer local definitions.                                              */
+/*===========================================================================*/
+
+#define APP_SEQ_TIMER_PRESCALER 0 /* Same as of the controller timer, RTC1 is shared */
+#define APP_SEQ_STEP_DELAY APP_TIMER_TICKS(10, APP_SEQ_TIMER_PRESCALER) /* Delay before the next step, keeps steps out of the controller callback */
+#define APP_SEQ_DWELL_CHUNK_MS 60000 /* Longest single timer run, RTC counter is only 24 bit */
+#define APP_SEQ_THERMAL_RETRY APP_TIMER_TICKS(5000, APP_SEQ_TIMER_PRESCALER) /* Period of checks if deferred step may start */
+
+#define STEP_NONE 0xFF /* Sequence is not running */
+#define STEP_PENDING 0xFE /* Previous step finished, next one is scheduled */
+
+/*===========================================================================*/
+/* Sequencer local variables and types.                                      */
+/*===========================================================================*/
+
+typedef struct
+{
+    uint8_t type; /* One of SEQUENCER_STEP_* */
+    int32_t value;
+} sequencer_step_t;
+
+APP_TIMER_DEF(m_app_seq_timer_id);
+
+static sequencer_step_t m_queue[SEQUENCER_QUEUE_SIZE];
+static uint8_t m_head;
+static uint8_t m_count;
+
+static uint8_t m_active_type = STEP_NONE; /* Type of the step in progress */
+static int32_t m_active_value; /* Target of the active move, or remaining dwell time in milliseconds */
+
+/*===========================================================================*/
+/* Sequencer local functions.                                                */
+/*===========================================================================*/
+
+static void schedule(uint32_t ticks)
+{
+    app_timer_stop(m_app_seq_timer_id);
+    app_timer_start(m_app_seq_timer_id, ticks, NULL);
+}
+
+static void dwell_continue()
+{
+    uint32_t chunk = m_active_value > APP_SEQ_DWELL_CHUNK_MS ? APP_SEQ_DWELL_CHUNK_MS : (uint32_t)m_active_value;
+
+    m_active_value -= chunk;
+    schedule(APP_TIMER_TICKS(chunk, APP_SEQ_TIMER_PRESCALER) + APP_TIMER_MIN_TIMEOUT_TICKS);
+}
+
+/**
+ * @brief   Starts movement of the active target step. While the motor cools down, the step is deferred, instead of being
+ *          refused by the controller, what would abort the sequence.
+ */
+static void target_start()
+{
+    if (thermal_is_exhausted()) {
+        schedule(APP_SEQ_THERMAL_RETRY);
+        return;
+    }
+
+    NRF_LOG_PRINTF("Seq: target %d\r\n", m_active_value);
+    controller_target_subtick_set(m_active_value);
+}
+
+/**
+ * @brief   Pops the next step from the queue and starts it. Sequence ends when the queue is empty.
+ */
+static void step_next()
+{
+    sequencer_step_t step;
+
+    CRITICAL_REGION_ENTER();
+    if (m_count == 0) {
+        m_active_type = STEP_NONE;
+    } else {
+        step = m_queue[m_head];
+        m_head = (m_head + 1) % SEQUENCER_QUEUE_SIZE;
+        m_count--;
+        m_active_type = step.type;
+        m_active_value = step.value;
+    }
+    CRITICAL_REGION_EXIT();
+
+    switch (m_active_type) {
+    case SEQUENCER_STEP_TARGET:
+        target_start();
+        break;
+    case SEQUENCER_STEP_DWELL:
+        NRF_LOG_PRINTF("Seq: dwell %d ms\r\n", m_active_value);
+        dwell_continue();
+        break;
+    default:
+        NRF_LOG_PRINTF("Seq: done\r\n");
+        break;
+    }
+}
+
+static void timer_timeout_handler(void* p_context)
+{
+    if (m_active_type == SEQUENCER_STEP_DWELL && m_active_value > 0) {
+        dwell_continue();
+    } else if (m_active_type == SEQUENCER_STEP_TARGET) {
+        target_start();
+    } else {
+        step_next();
+    }
+}
+
+/*===========================================================================*/
+/* Sequencer exported functions.                                             */
+/*===========================================================================*/
+
+/**
+ * @brief   Initializes sequencer. Should be called after controller_init, which initializes the timer module.
+ */
+void sequencer_init(void)
+{
+    app_timer_create(&m_app_seq_timer_id, APP_TIMER_MODE_SINGLE_SHOT, timer_timeout_handler);
+    sequencer_clear();
+}
+
+/**
+ * @brief   Appends step to the queue. Sequence starts immediately, when no step is in progress.
+ * 
+ * @param[in] type    One of SEQUENCER_STEP_*
+ * @param[in] value   Target position in subticks or dwell time in milliseconds
+ * 
+ * @return false if the queue is full or step is invalid
+ */
+bool sequencer_enqueue(uint8_t type, int32_t value)
+{
+    bool idle;
+
+    if ((type != SEQUENCER_STEP_TARGET && type != SEQUENCER_STEP_DWELL) || (type == SEQUENCER_STEP_DWELL && value < 0)) {
+        return false;
+    }
+
+    CRITICAL_REGION_ENTER();
+    if (m_count == SEQUENCER_QUEUE_SIZE) {
+        CRITICAL_REGION_EXIT();
+        return false;
+    }
+
+    m_queue[(m_head + m_count) % SEQUENCER_QUEUE_SIZE] = (sequencer_step_t){ .type = type, .value = value };
+    m_count++;
+    idle = m_active_type == STEP_NONE;
+    CRITICAL_REGION_EXIT();
+
+    if (idle) {
+        step_next();
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Drops all queued steps and abandons the step in progress. Movement started by the sequence is not stopped.
+ */
+void sequencer_clear(void)
+{
+    app_timer_stop(m_app_seq_timer_id);
+
+    CRITICAL_REGION_ENTER();
+    m_head = 0;
+    m_count = 0;
+    m_active_type = STEP_NONE;
+    CRITICAL_REGION_EXIT();
+}
+
+bool sequencer_is_running(void)
+{
+    return m_active_type != STEP_NONE;
+}
+
+/**
+ * @brief   Advances the sequence when the controller finishes the active target step. Should be called from the controller callback.
+ * @note    Sequence is aborted, when the controller stops away from the target, e.g. on stall.
+ */
+void sequencer_on_controller_state(controller_state_t const* p_state)
+{
+    if (m_active_type != SEQUENCER_STEP_TARGET) {
+        return;
+    }
+
+    /* Motor is cut before the target, so the step is judged only after coasting settled. Target closer than half of
+       tick is reached immediately, and stays set while the controller is idle. */
+    if (!(p_state->flags & CTRL_FLAG_SETTLED) || (p_state->target_type != CTRL_TARGET_TYPE_NONE && p_state->target_type != CTRL_TARGET_TYPE_EXACT)) {
+        return;
+    }
+
+    int32_t error = controller_position_get() - m_active_value;
+
+    if (error > SEQUENCER_TARGET_TOLERANCE * CTRL_SUBTICK_SCALE || error < -SEQUENCER_TARGET_TOLERANCE * CTRL_SUBTICK_SCALE) {
+        NRF_LOG_PRINTF("Seq: target %d missed by %d, aborted\r\n", m_active_value, error);
+        sequencer_clear();
+        return;
+    }
+
+    m_active_type = STEP_PENDING;
+    schedule(APP_SEQ_STEP_DELAY);
+}
@@ -0,0 +1,17 @@
+#ifndef SEQUENCER_H__
+#define SEQUENCER_H__
+
+#include "controller.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SEQUENCER_STEP_TARGET 0 /* Move to the position, in subticks */
+#define SEQUENCER_STEP_DWELL 1 /* Wait, in milliseconds */
+
+void sequencer_init(void);
+bool sequencer_enqueue(uint8_t type, int32_t value);
+void sequencer_clear(void);
+bool sequencer_is_running(void);
+void sequencer_on_controller_state(controller_state_t const* p_state);
+
+#endif
@@ -0,0 +1,127 @@
+#include "thermal.h"
+#include "acromegaly_config.h"
+#include "app_timer.h"
+#include "m45pe_drv.h"
+#include "m45pe_keys.h"
+#include "motor.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Thermal local definitions.                                                */
+/*===========================================================================*/
+
+#define APP_THERMAL_TIMER_PRESCALER 0 /* Same as of the controller timer, RTC1 is shared */
+#define APP_THERMAL_TIMER_INTERVAL APP_TIMER_TICKS(1000, APP_THERMAL_TIMER_PRESCALER)
+
+#define HEAT_BUDGET ((uint32_t)THERMAL_BUDGET_S * 1000) /* Heat is counted in ms of motor run at full duty */
+#define HEAT_LIMIT (HEAT_BUDGET + (uint32_t)THERMAL_GRACE_S * 1000)
+#define HEAT_STORE_STEP 10000 /* Change of heat, which is worth a flash write */
+
+/* Time constant giving equilibrium at the rated duty cycle: heat of continuous THERMAL_DUTY_PERCENT run equals the budget */
+#define COOLING_TAU_S (((uint32_t)THERMAL_BUDGET_S * 100) / THERMAL_DUTY_PERCENT)
+
+#define HEAT_ERASED 0xFFFFFFFF
+
+/*===========================================================================*/
+/* Thermal local variables and types.                                        */
+/*===========================================================================*/
+
+APP_TIMER_DEF(m_app_thermal_timer_id);
+
+static volatile uint32_t m_heat; /* Motor heat, in ms of run at full duty */
+static uint32_t m_stored_heat;
+
+/*===========================================================================*/
+/* Thermal local functions.                                                  */
+/*===========================================================================*/
+
+static uint8_t max_duty()
+{
+    uint8_t duty = 0;
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        duty = motor_duty_get(i) > duty ? motor_duty_get(i) : duty;
+    }
+
+    return duty;
+}
+
+/**
+ * @brief   Integrates heat of the motor run at the current duty and exponential cooling, once per second.
+ */
+static void timer_timeout_handler(void* p_context)
+{
+    uint32_t heat = m_heat;
+
+    heat -= (heat + COOLING_TAU_S - 1) / COOLING_TAU_S;
+    heat += (1000UL * max_duty()) / MOTOR_DUTY_MAX;
+
+    m_heat = heat;
+}
+
+/*===========================================================================*/
+/* Thermal exported functions.                                               */
+/*===========================================================================*/
+
+/**
+ * @brief   Restores motor heat from external flash and starts the thermal model. As time without power is unknown,
+ *          no cooling is assumed for it.
+ */
+void thermal_init(void)
+{
+    uint32_t heat = HEAT_ERASED;
+    m45pe_read(FLASH_THERMAL_KEY, (uint8_t*)&heat, sizeof(heat));
+
+    m_heat = heat == HEAT_ERASED ? 0 : (heat > HEAT_LIMIT ? HEAT_LIMIT : heat);
+    m_stored_heat = m_heat;
+
+    app_timer_create(&m_app_thermal_timer_id, APP_TIMER_MODE_REPEATED, timer_timeout_handler);
+    app_timer_start(m_app_thermal_timer_id, APP_THERMAL_TIMER_INTERVAL, NULL);
+
+    NRF_LOG_PRINTF("Thermal budget %d%%\r\n", thermal_budget_get());
+}
+
+/**
+ * @brief   Checks if new movement should be refused, to let the motor cool down.
+ */
+bool thermal_is_exhausted(void)
+{
+    return m_heat >= HEAT_BUDGET;
+}
+
+/**
+ * @brief   Checks if movement in progress should be stopped. Movement started within the budget may use THERMAL_GRACE_S
+ *          over it, so it is not stopped halfway in common cases.
+ */
+bool thermal_is_overrun(void)
+{
+    return m_heat >= HEAT_LIMIT;
+}
+
+/**
+ * @brief   Returns remaining thermal budget, in percent.
+ */
+uint8_t thermal_budget_get(void)
+{
+    uint32_t heat = m_heat;
+
+    return heat >= HEAT_BUDGET ? 0 : (uint8_t)(((HEAT_BUDGET - heat) * 100) / HEAT_BUDGET);
+}
+
+/**
+ * @brief   Writes heat to flash, when it changed noticeably, or crossed the budget, so refused movements stay refused after
+ *          a reset. Should be called from the main loop, not from an interrupt context.
+ */
+void thermal_flush(void)
+{
+    uint32_t heat = m_heat;
+    uint32_t change = heat > m_stored_heat ? heat - m_stored_heat : m_stored_heat - heat;
+    bool crossed = (heat >= HEAT_BUDGET) != (m_stored_heat >= HEAT_BUDGET);
+
+    if (change >= HEAT_STORE_STEP || crossed || (heat == 0 && m_stored_heat != 0)) {
+        m45pe_write(FLASH_THERMAL_KEY, (uint8_t*)&heat, sizeof(heat));
+        m_stored_heat = heat;
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef THERMAL_H__
+#define THERMAL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void thermal_init(void);
+bool thermal_is_exhausted(void);
+bool thermal_is_overrun(void);
+uint8_t thermal_budget_get(void);
+void thermal_flush(void);
+
+#endif
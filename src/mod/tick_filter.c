@@ -0,0 +1,169 @@
+#include "tick_filter.h"
+#include "acromegaly_config.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Tick filter local definitions.                                            */
+/*===========================================================================*/
+
+#define TICK_FILTER_TIMER_PRESCALER 0 /* Value of the RTC1 PRESCALER register, same as used by controller */
+#define TICK_FILTER_MIN_PULSE APP_TIMER_TICKS(TICK_FILTER_MIN_PULSE_MS, TICK_FILTER_TIMER_PRESCALER)
+
+/*===========================================================================*/
+/* Tick filter local functions.                                              */
+/*===========================================================================*/
+
+/**
+ * @brief   Accepts the pending level change, which lasted at least TICK_FILTER_MIN_PULSE_MS. Change arriving sooner than
+ *          TICK_FILTER_PERIOD_RATIO percents of the expected period is implausible - level is followed, but the edge is
+ *          not counted.
+ */
+static void accept_pending(tick_filter_t* p_filter)
+{
+    uint32_t elapsed;
+    uint32_t expected_period = p_filter->expected_period;
+
+    p_filter->pending = false;
+    p_filter->interrupted = false;
+    p_filter->level = !p_filter->level;
+
+    app_timer_cnt_diff_compute(p_filter->pending_edge_time, p_filter->last_edge_time, &elapsed);
+    p_filter->last_edge_time = p_filter->pending_edge_time;
+
+    if (expected_period > 0 && elapsed < (expected_period * TICK_FILTER_PERIOD_RATIO) / 100) {
+        p_filter->rejected++;
+        NRF_LOG_PRINTF("Implausible tick after %d, expected %d\r\n", elapsed, expected_period);
+        return;
+    }
+
+    if (p_filter->edge_count < TICK_FILTER_QUEUE_SIZE) {
+        p_filter->edge_times[(p_filter->edge_head + p_filter->edge_count) % TICK_FILTER_QUEUE_SIZE] = p_filter->pending_edge_time;
+        p_filter->edge_count++;
+    } else {
+        p_filter->rejected++; /* Controller poll was not served for several ticks */
+    }
+}
+
+/*===========================================================================*/
+/* Tick filter exported functions.                                           */
+/*===========================================================================*/
+
+void tick_filter_init(tick_filter_t* p_filter, uint32_t level, uint32_t now)
+{
+    p_filter->level = level ? 1 : 0;
+    p_filter->last_edge_time = now;
+    p_filter->pending = false;
+    p_filter->interrupted = false;
+    p_filter->expected_period = 0;
+    p_filter->edge_head = 0;
+    p_filter->edge_count = 0;
+    p_filter->rejected = 0;
+}
+
+/**
+ * @brief   Feeds filter with the input edge, timestamped in the GPIOTE handler.
+ * @details Level change is accepted as a tick when it lasts for at least TICK_FILTER_MIN_PULSE_MS, measured from its
+ *          edge to the next one, or to the poll. Level returning before that time is a glitch and increments rejected
+ *          edges counter. When the level changes again shortly after the glitch, the change keeps the timestamp of the
+ *          edge before the glitch, so a glitch on a real edge does not delay the tick and shorten the next period.
+ * 
+ * @param[in]  p_filter    Filter instance
+ * @param[in]  level       Input level after the edge
+ * @param[in]  edge_time   RTC counter value of the edge
+ */
+void tick_filter_edge(tick_filter_t* p_filter, uint32_t level, uint32_t edge_time)
+{
+    level = level ? 1 : 0;
+
+    if (p_filter->pending) {
+        uint32_t elapsed;
+
+        app_timer_cnt_diff_compute(edge_time, p_filter->pending_time, &elapsed);
+
+        if (elapsed >= TICK_FILTER_MIN_PULSE) {
+            accept_pending(p_filter);
+        } else if (level == p_filter->level) {
+            p_filter->pending = false;
+            p_filter->interrupted = true;
+            p_filter->interrupted_time = edge_time;
+            p_filter->interrupted_edge_time = p_filter->pending_edge_time;
+            p_filter->rejected++;
+            return;
+        } else {
+            return; /* Bounce within the pending level */
+        }
+    }
+
+    if (level != p_filter->level) {
+        uint32_t elapsed;
+
+        app_timer_cnt_diff_compute(edge_time, p_filter->interrupted_time, &elapsed);
+
+        p_filter->pending = true;
+        p_filter->pending_time = edge_time;
+        p_filter->pending_edge_time = p_filter->interrupted && elapsed < TICK_FILTER_MIN_PULSE ? p_filter->interrupted_edge_time : edge_time;
+        p_filter->interrupted = false;
+    }
+}
+
+/**
+ * @brief   Confirms pending level change, which lasted long enough by the time of the poll. Level change without an edge
+ *          (event lost to interrupt latency) is timestamped by the poll.
+ * 
+ * @param[in]  p_filter          Filter instance
+ * @param[in]  level             Input level sampled by the poll
+ * @param[in]  now               RTC counter value of the sample
+ * @param[in]  expected_period   Expected tick period in RTC ticks, 0 if unknown
+ */
+void tick_filter_poll(tick_filter_t* p_filter, uint32_t level, uint32_t now, uint32_t expected_period)
+{
+    uint32_t elapsed;
+
+    level = level ? 1 : 0;
+
+    CRITICAL_REGION_ENTER();
+    p_filter->expected_period = expected_period;
+
+    if (!p_filter->pending && level != p_filter->level) {
+        p_filter->pending = true;
+        p_filter->pending_time = now;
+        p_filter->pending_edge_time = now;
+    }
+
+    if (p_filter->pending && level != p_filter->level) {
+        app_timer_cnt_diff_compute(now, p_filter->pending_time, &elapsed);
+
+        if (elapsed >= TICK_FILTER_MIN_PULSE) {
+            accept_pending(p_filter);
+        }
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+/**
+ * @brief   Takes the oldest accepted tick.
+ * 
+ * @param[in]  p_filter      Filter instance
+ * @param[out] p_edge_time   RTC counter value of the accepted edge
+ * 
+ * @return true if a tick was taken
+ */
+bool tick_filter_get(tick_filter_t* p_filter, uint32_t* p_edge_time)
+{
+    bool taken = false;
+
+    CRITICAL_REGION_ENTER();
+    if (p_filter->edge_count > 0) {
+        *p_edge_time = p_filter->edge_times[p_filter->edge_head];
+        p_filter->edge_head = (p_filter->edge_head + 1) % TICK_FILTER_QUEUE_SIZE;
+        p_filter->edge_count--;
+        taken = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return taken;
+}
@@ -0,0 +1,31 @@
+#ifndef TICK_FILTER_H__
+#define TICK_FILTER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TICK_FILTER_QUEUE_SIZE 4 /* Accepted ticks waiting for the controller poll */
+
+typedef struct
+{
+    uint32_t level; /* Last accepted input level */
+    uint32_t last_edge_time; /* RTC counter value of the last accepted edge */
+    uint32_t pending_time; /* RTC counter value of the edge of not yet confirmed level change */
+    uint32_t pending_edge_time; /* Timestamp the change is accepted with, earlier than pending_time after a glitch */
+    bool pending;
+    uint32_t interrupted_time; /* RTC counter value of the glitch, which returned the level before confirmation */
+    uint32_t interrupted_edge_time; /* Timestamp of the change it interrupted */
+    bool interrupted;
+    uint32_t expected_period; /* Expected tick period in RTC ticks, 0 if unknown */
+    uint32_t edge_times[TICK_FILTER_QUEUE_SIZE]; /* Accepted edges, not taken by tick_filter_get yet */
+    uint8_t edge_head;
+    uint8_t edge_count;
+    uint32_t rejected; /* Number of rejected edges, for diagnostics */
+} tick_filter_t;
+
+void tick_filter_init(tick_filter_t* p_filter, uint32_t level, uint32_t now);
+void tick_filter_edge(tick_filter_t* p_filter, uint32_t level, uint32_t edge_time);
+void tick_filter_poll(tick_filter_t* p_filter, uint32_t level, uint32_t now, uint32_t expected_period);
+bool tick_filter_get(tick_filter_t* p_filter, uint32_t* p_edge_time);
+
+#endif
@@ -0,0 +1,262 @@
+#include "trajectory.h"
+#include "acromegaly_config.h"
+#include "app_timer.h"
+#include "controller.h"
+#include "m45pe_drv.h"
+#include "m45pe_keys.h"
+#include "motor.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*===========================================================================*/
+/* Trajectory local definitions.                                             */
+/*===========================================================================*/
+
+#define RTC_FREQUENCY 32768 /* RTC1 frequency with prescaler 0, used to convert RTC ticks to seconds */
+#define SPEED_LIMIT 0xFFFF /* Keeps squared velocities within 32 bits */
+#define SPEED_STORE_DIVISOR 32 /* Relative change of speed, which is worth a flash write */
+#define COAST_STORE_STEP 32 /* Change of coasting distance, which is worth a flash write, subticks */
+
+#define SPEED_ERASED 0xFFFF
+
+#define DIRECTION_INDEX(direction) (direction == MOVE_DIRECTION_DOWN ? 1 : 0)
+
+/*===========================================================================*/
+/* Trajectory local variables and types.                                     */
+/*===========================================================================*/
+
+typedef struct
+{
+    uint32_t speed; /* Speed at full duty, subticks per second */
+    int32_t coast; /* Distance travelled after motor stop, subticks */
+} trajectory_dynamics_t;
+
+typedef struct
+{
+    uint16_t speed;
+    int16_t coast;
+} trajectory_stored_t; /* Flash image of trajectory_dynamics_t, speed is limited by SPEED_LIMIT */
+
+static trajectory_dynamics_t m_dynamics[2]; /* Learned desk dynamics, indexed by DIRECTION_INDEX */
+static trajectory_stored_t m_stored[2];
+
+static int32_t m_target; /* Planned target, subticks */
+static uint8_t m_direction;
+static uint32_t m_start_time; /* RTC counter value of the movement start */
+static uint32_t m_cruise_speed; /* Cruise speed of the planned profile, subticks per second */
+
+/*===========================================================================*/
+/* Trajectory local functions.                                               */
+/*===========================================================================*/
+
+static uint32_t isqrt(uint32_t value)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+static uint32_t difference(int32_t a, int32_t b)
+{
+    return a > b ? a - b : b - a;
+}
+
+/**
+ * @brief   Computes reference velocity of the trapezoidal profile.
+ * @details Velocity is limited by acceleration since movement start, by cruise speed and by
+ *          deceleration required to reach zero velocity at the target.
+ * 
+ * @param[in] remaining   Distance to the target, subticks
+ * @param[in] elapsed     RTC ticks since the movement start
+ */
+static uint32_t reference_velocity(int32_t remaining, uint32_t elapsed)
+{
+    uint32_t velocity = m_cruise_speed;
+
+    uint64_t accel_velocity = ((uint64_t)TRAJECTORY_ACCEL * elapsed) / RTC_FREQUENCY;
+    if (accel_velocity < velocity) {
+        velocity = (uint32_t)accel_velocity;
+    }
+
+    if (remaining <= 0) {
+        return 0;
+    }
+
+    uint64_t decel_velocity_sq = 2ULL * TRAJECTORY_DECEL * (uint32_t)remaining;
+    if (decel_velocity_sq < (uint64_t)velocity * velocity) {
+        velocity = isqrt((uint32_t)decel_velocity_sq);
+    }
+
+    return velocity;
+}
+
+/*===========================================================================*/
+/* Trajectory exported functions.                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Restores learned desk dynamics from external flash. Defaults from the config are used, until they are learned.
+ */
+void trajectory_init(void)
+{
+    memset(m_stored, 0xFF, sizeof(m_stored));
+    m45pe_read(FLASH_TRAJECTORY_KEY, (uint8_t*)m_stored, sizeof(m_stored));
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (m_stored[i].speed == SPEED_ERASED || m_stored[i].speed == 0 || m_stored[i].coast < 0) {
+            m_stored[i].speed = TRAJECTORY_SPEED_DEFAULT;
+            m_stored[i].coast = TRAJECTORY_COAST_DEFAULT;
+        }
+
+        m_dynamics[i].speed = m_stored[i].speed;
+        m_dynamics[i].coast = m_stored[i].coast;
+    }
+
+    NRF_LOG_PRINTF("Traj speed %d/%d, coast %d/%d\r\n", m_dynamics[0].speed, m_dynamics[1].speed, m_dynamics[0].coast, m_dynamics[1].coast);
+
+    m_direction = MOVE_DIRECTION_NONE;
+}
+
+/**
+ * @brief   Plans trapezoidal velocity profile from current position to the target.
+ * 
+ * @param[in] position   Current position, subticks
+ * @param[in] target     Target position, subticks
+ * @param[in] now        RTC counter value of the movement start
+ */
+void trajectory_plan(int32_t position, int32_t target, uint32_t now)
+{
+    m_target = target;
+    m_direction = target < position ? MOVE_DIRECTION_DOWN : MOVE_DIRECTION_UP;
+    m_start_time = now;
+    m_cruise_speed = (m_dynamics[DIRECTION_INDEX(m_direction)].speed * TRAJECTORY_SPEED_RATIO) / 100;
+
+    NRF_LOG_PRINTF("Traj %d -> %d, cruise %d\r\n", position, target, m_cruise_speed);
+}
+
+/**
+ * @brief   Computes motor duty following the planned profile.
+ * @details Feed-forward duty for the reference velocity is corrected proportionally to the velocity error. Duty does
+ *          not drop below MOTOR_DUTY_MIN until the planned stop.
+ * 
+ * @param[in] position   Current position, subticks
+ * @param[in] velocity   Measured velocity, subticks per second
+ * @param[in] now        Current RTC counter value
+ * 
+ * @return Duty cycle in percents
+ */
+uint8_t trajectory_duty_get(int32_t position, uint32_t velocity, uint32_t now)
+{
+    if (m_direction == MOVE_DIRECTION_NONE) {
+        return MOTOR_DUTY_MAX;
+    }
+
+    uint32_t elapsed;
+    app_timer_cnt_diff_compute(now, m_start_time, &elapsed);
+
+    int32_t remaining = m_direction == MOVE_DIRECTION_UP ? m_target - position : position - m_target;
+    uint32_t full_speed = m_dynamics[DIRECTION_INDEX(m_direction)].speed;
+    uint32_t reference = reference_velocity(remaining, elapsed);
+
+    int32_t duty = MOTOR_DUTY_MIN + (int32_t)(((MOTOR_DUTY_MAX - MOTOR_DUTY_MIN) * reference) / full_speed);
+    duty += (((int32_t)reference - (int32_t)velocity) * 100 * TRAJECTORY_KP) / (int32_t)full_speed;
+
+    if (duty < MOTOR_DUTY_MIN) {
+        duty = MOTOR_DUTY_MIN; /* Zero duty would pause the motor in the middle of the profile */
+    } else if (duty > MOTOR_DUTY_MAX) {
+        duty = MOTOR_DUTY_MAX;
+    }
+
+    return (uint8_t)duty;
+}
+
+/**
+ * @brief   Returns distance before the target at which motor should be stopped, so the desk coasts onto it.
+ */
+int32_t trajectory_stop_lead_get(uint8_t direction)
+{
+    return m_dynamics[DIRECTION_INDEX(direction)].coast;
+}
+
+/**
+ * @brief   Returns learned speed at full duty, in subticks per second.
+ */
+uint32_t trajectory_speed_get(uint8_t direction)
+{
+    return m_dynamics[DIRECTION_INDEX(direction)].speed;
+}
+
+/**
+ * @brief   Updates learned full duty speed with velocity measured at given duty.
+ * @note    Speed is assumed to be linear with duty above MOTOR_DUTY_MIN. Measurements at low duty are skipped.
+ */
+void trajectory_speed_learn(uint8_t direction, uint32_t velocity, uint8_t duty)
+{
+    if (duty < TRAJECTORY_LEARN_MIN_DUTY || direction == MOVE_DIRECTION_NONE) {
+        return;
+    }
+
+    uint32_t speed = (velocity * (MOTOR_DUTY_MAX - MOTOR_DUTY_MIN)) / (duty - MOTOR_DUTY_MIN);
+
+    if (speed > SPEED_LIMIT) {
+        speed = SPEED_LIMIT;
+    }
+
+    trajectory_dynamics_t* p_dynamics = &m_dynamics[DIRECTION_INDEX(direction)];
+    p_dynamics->speed = (7 * p_dynamics->speed + speed) / 8;
+}
+
+/**
+ * @brief   Updates learned coasting distance with distance measured after motor stop.
+ */
+void trajectory_coast_learn(uint8_t direction, int32_t distance)
+{
+    if (direction == MOVE_DIRECTION_NONE || distance < 0) {
+        return;
+    }
+
+    trajectory_dynamics_t* p_dynamics = &m_dynamics[DIRECTION_INDEX(direction)];
+    p_dynamics->coast = (3 * p_dynamics->coast + distance) / 4;
+
+    NRF_LOG_PRINTF("Coast %d, learned %d\r\n", distance, p_dynamics->coast);
+}
+
+/**
+ * @brief   Writes learned dynamics to flash, when they changed noticeably. Should be called from the main loop, not from
+ *          an interrupt context.
+ */
+void trajectory_flush(void)
+{
+    bool changed = false;
+    trajectory_stored_t stored[2];
+
+    for (uint8_t i = 0; i < 2; i++) {
+        stored[i].speed = (uint16_t)(m_dynamics[i].speed < SPEED_ERASED ? m_dynamics[i].speed : SPEED_ERASED - 1);
+        stored[i].coast = (int16_t)(m_dynamics[i].coast > INT16_MAX ? INT16_MAX : m_dynamics[i].coast);
+
+        changed |= difference(stored[i].speed, m_stored[i].speed) * SPEED_STORE_DIVISOR > m_stored[i].speed;
+        changed |= difference(stored[i].coast, m_stored[i].coast) >= COAST_STORE_STEP;
+    }
+
+    if (changed) {
+        m45pe_write(FLASH_TRAJECTORY_KEY, (uint8_t*)stored, sizeof(stored));
+        memcpy(m_stored, stored, sizeof(stored));
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef TRAJECTORY_H__
+#define TRAJECTORY_H__
+
+#include <stdint.h>
+
+void trajectory_init(void);
+void trajectory_plan(int32_t position, int32_t target, uint32_t now);
+uint8_t trajectory_duty_get(int32_t position, uint32_t velocity, uint32_t now);
+int32_t trajectory_stop_lead_get(uint8_t direction);
+uint32_t trajectory_speed_get(uint8_t direction);
+void trajectory_speed_learn(uint8_t direction, uint32_t velocity, uint8_t duty);
+void trajectory_coast_learn(uint8_t direction, int32_t distance);
+void trajectory_flush(void);
+
+#endif
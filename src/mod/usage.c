@@ -0,0 +1,215 @@
+#include "usage.h"
+#include "acromegaly_config.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "calibration.h"
+#include "clock.h"
+#include "controller.h"
+#include "m45pe_drv.h"
+#include "m45pe_keys.h"
+#include "nrf_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*===========================================================================*/
+/* Usage local definitions.                                                  */
+/*===========================================================================*/
+
+#define APP_USAGE_TIMER_PRESCALER 0 /* Same as of the controller timer, RTC1 is shared */
+#define APP_USAGE_TIMER_INTERVAL APP_TIMER_TICKS(1000, APP_USAGE_TIMER_PRESCALER)
+
+#define FLASH_CHUNK 8 /* Longest single m45pe write */
+#define DAY_SECONDS 86400UL
+
+#define MOVES_ERASED 0xFFFFFFFF
+
+/* Size of usage_stats_t (bands, four uint32 and two uint16 counters), the preprocessor can not evaluate sizeof */
+#if FLASH_USAGE_KEY + (USAGE_BAND_COUNT + 4) * 4 + 2 * 2 > FLASH_CLOCK_KEY
+#error "Usage statistics overlap the clock drift in flash"
+#endif
+
+/*===========================================================================*/
+/* Usage local variables and types.                                          */
+/*===========================================================================*/
+
+APP_TIMER_DEF(m_app_usage_timer_id);
+
+static usage_stats_t m_stats;
+static uint32_t m_streak; /* Current standing streak, in seconds */
+static uint32_t m_checkpoint_seconds; /* Time since statistics were written to flash */
+static volatile bool m_changed;
+
+static int16_t m_position; /* Last position reported by the controller, in ticks */
+static bool m_position_known; /* Initial position is not a travel */
+static uint8_t m_movement = MOVE_DIRECTION_NONE;
+static uint32_t m_day; /* Local day number of the synced clock, 0 if not seen yet */
+
+/*===========================================================================*/
+/* Usage local functions.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief   Returns index of the height band of the position. Bands split the range between desk limits evenly.
+ */
+static uint8_t band_index(int16_t position)
+{
+    calibration_t const* p_calibration = calibration_get();
+    int32_t range = (int32_t)p_calibration->ticks_upper_limit - p_calibration->ticks_lower_limit + 1;
+    int32_t offset = (int32_t)position - p_calibration->ticks_lower_limit;
+
+    if (offset <= 0) {
+        return 0;
+    }
+
+    int32_t band = (offset * USAGE_BAND_COUNT) / range;
+
+    return band >= USAGE_BAND_COUNT ? USAGE_BAND_COUNT - 1 : (uint8_t)band;
+}
+
+static void day_rollover(void)
+{
+    m_stats.moves_yesterday = m_stats.moves_today;
+    m_stats.moves_today = 0;
+}
+
+/**
+ * @brief   Follows local time of the synced clock, the day rolls over at midnight. Without the clock, day lasts 24 h
+ *          of uptime.
+ */
+static void day_update(void)
+{
+    if (clock_is_synced()) {
+        uint32_t local = clock_get() + clock_local_offset_get();
+        uint32_t day = local / DAY_SECONDS;
+
+        if (m_day != 0 && day != m_day) {
+            day_rollover();
+            if (day != m_day + 1) {
+                day_rollover(); /* No movement yesterday, e.g. after power off */
+            }
+        }
+        m_day = day;
+        m_stats.day_seconds = local % DAY_SECONDS;
+    } else if (++m_stats.day_seconds >= DAY_SECONDS) {
+        m_stats.day_seconds = 0;
+        day_rollover();
+    }
+}
+
+/**
+ * @brief   Counts one second spent at the current position: its band time, standing streak and day rollover.
+ */
+static void timer_timeout_handler(void* p_context)
+{
+    int16_t position = m_position;
+
+    m_stats.band_seconds[band_index(position)]++;
+
+    if (calibration_subtick_to_height((int32_t)position * CTRL_SUBTICK_SCALE) >= USAGE_STAND_HEIGHT_UM) {
+        m_streak++;
+        m_stats.streak_max = m_streak > m_stats.streak_max ? m_streak : m_stats.streak_max;
+    } else {
+        m_streak = 0;
+    }
+
+    day_update();
+
+    m_checkpoint_seconds++;
+    m_changed = true;
+}
+
+/*===========================================================================*/
+/* Usage exported functions.                                                 */
+/*===========================================================================*/
+
+/**
+ * @brief   Restores statistics from external flash and starts counting time. Should be called after calibration_init.
+ * @note    Time without power is unknown, so it is not counted and the day continues where it was stopped, until the
+ *          clock is synced.
+ */
+void usage_init(void)
+{
+    for (uint8_t offset = 0; offset < sizeof(usage_stats_t); offset += FLASH_CHUNK) {
+        uint8_t len = sizeof(usage_stats_t) - offset < FLASH_CHUNK ? sizeof(usage_stats_t) - offset : FLASH_CHUNK;
+        m45pe_read(FLASH_USAGE_KEY + offset, (uint8_t*)&m_stats + offset, len);
+    }
+
+    if (m_stats.moves == MOVES_ERASED) {
+        memset(&m_stats, 0, sizeof(usage_stats_t));
+    }
+
+    m_checkpoint_seconds = 0;
+    m_changed = true;
+
+    app_timer_create(&m_app_usage_timer_id, APP_TIMER_MODE_REPEATED, timer_timeout_handler);
+    app_timer_start(m_app_usage_timer_id, APP_USAGE_TIMER_INTERVAL, NULL);
+
+    NRF_LOG_PRINTF("Usage: %d moves, travel %d\r\n", m_stats.moves, m_stats.travel);
+}
+
+/**
+ * @brief   Updates movement count and travel with the controller state. Should be called from the controller callback.
+ * @note    Movement is counted at its start, also when the direction is reversed without stop.
+ */
+void usage_on_controller_state(controller_state_t const* p_state)
+{
+    int32_t travel = m_position_known ? (int32_t)p_state->position - m_position : 0;
+
+    m_stats.travel += travel < 0 ? (uint32_t)-travel : (uint32_t)travel;
+    m_position = p_state->position;
+    m_position_known = true;
+
+    if (p_state->movement != MOVE_DIRECTION_NONE && p_state->movement != m_movement) {
+        m_stats.moves++;
+        m_stats.moves_today++;
+    }
+
+    m_movement = p_state->movement;
+}
+
+usage_stats_t const* usage_get(void)
+{
+    return &m_stats;
+}
+
+/**
+ * @brief   Returns current standing streak, in seconds. It is not kept over power loss.
+ */
+uint32_t usage_streak_get(void)
+{
+    return m_streak;
+}
+
+/**
+ * @brief   Returns true once after statistics changed, to refresh their characteristic.
+ */
+bool usage_is_changed(void)
+{
+    bool changed = m_changed;
+
+    m_changed = false;
+    return changed;
+}
+
+/**
+ * @brief   Writes statistics to flash every USAGE_CHECKPOINT_S. Should be called from the main loop, not from an interrupt context.
+ */
+void usage_flush(void)
+{
+    usage_stats_t stats;
+
+    if (m_checkpoint_seconds < USAGE_CHECKPOINT_S) {
+        return;
+    }
+
+    CRITICAL_REGION_ENTER();
+    stats = m_stats;
+    m_checkpoint_seconds = 0;
+    CRITICAL_REGION_EXIT();
+
+    for (uint8_t offset = 0; offset < sizeof(usage_stats_t); offset += FLASH_CHUNK) {
+        uint8_t len = sizeof(usage_stats_t) - offset < FLASH_CHUNK ? sizeof(usage_stats_t) - offset : FLASH_CHUNK;
+        m45pe_write(FLASH_USAGE_KEY + offset, (uint8_t*)&stats + offset, len);
+    }
+}
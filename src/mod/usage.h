@@ -0,0 +1,27 @@
+#ifndef USAGE_H__
+#define USAGE_H__
+
+#include "acromegaly_config.h"
+#include "controller.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t band_seconds[USAGE_BAND_COUNT]; /* Time spent in each height band, from the lowest */
+    uint32_t moves; /* Movements since the first use */
+    uint32_t travel; /* Total travel of the countertop, in ticks */
+    uint32_t streak_max; /* Longest standing streak, in seconds */
+    uint32_t day_seconds; /* Time elapsed in the current day */
+    uint16_t moves_today;
+    uint16_t moves_yesterday;
+} usage_stats_t;
+
+void usage_init(void);
+void usage_on_controller_state(controller_state_t const* p_state);
+usage_stats_t const* usage_get(void);
+uint32_t usage_streak_get(void);
+bool usage_is_changed(void);
+void usage_flush(void);
+
+#endif
@@ -2,15 +2,33 @@
 #include "app_error.h"
 #include "acromegaly_config.h"
 #include "ble_srv_common.h"
+#include "calibration.h"
 #include "controller.h"
+#include "presets.h"
+#include "sequencer.h"
 #include <stdint.h>
 #include <string.h>
 
 #define CTRL_COMMAND_FORCE_STOP 0xAA
 #define CTRL_COMMAND_SET_TARGET_POS 0x60
 #define CTRL_COMMAND_RESET 0x88
+#define CTRL_COMMAND_SET_PREFS 0x9F
+#define CTRL_COMMAND_SEQ_TARGET 0x61
+#define CTRL_COMMAND_SEQ_DWELL 0x62
+#define CTRL_COMMAND_SEQ_CLEAR 0x6F
+#define CTRL_COMMAND_MOVE_BY 0x63
+#define CTRL_COMMAND_JOG 0x64
+#define CTRL_COMMAND_PRESET_SAVE 0x50 /* Lower nibble is a preset slot */
+#define CTRL_COMMAND_PRESET_RECALL 0x70 /* Lower nibble is a preset slot */
+
+#define CTRL_COMMAND_MASK 0xF0
+#define CTRL_COMMAND_SLOT_MASK 0x0F
 
 #define CTRL_CHAR_LENGTH 3
+#define CALIB_CHAR_LENGTH 12
+#define CALIB_CHAR_LENGTH_NO_BACKLASH 10 /* Shorter write keeps the current backlash */
+
+#define CTRL_DWELL_UNIT_MS 100
 
 static uint32_t ctrl_char_add(ble_ctrl_service_t* p_ctrl_service)
 {
@@ -68,6 +86,66 @@ static uint32_t ctrl_char_add(ble_ctrl_service_t* p_ctrl_service)
     return NRF_SUCCESS;
 }
 
+/**
+ * @brief   Serializes calibration to the characteristic value: base height (int32, um), tick height (uint16, um),
+ *          upper and lower limit (int16, ticks), backlash (uint16, subticks), little endian.
+ */
+static void calib_value_encode(uint8_t* p_value)
+{
+    calibration_t const* p_calibration = calibration_get();
+
+    memcpy(p_value, &p_calibration->base_height, sizeof(int32_t));
+    memcpy(p_value + 4, &p_calibration->tick_to_height, sizeof(uint16_t));
+    memcpy(p_value + 6, &p_calibration->ticks_upper_limit, sizeof(int16_t));
+    memcpy(p_value + 8, &p_calibration->ticks_lower_limit, sizeof(int16_t));
+    memcpy(p_value + 10, &p_calibration->backlash, sizeof(uint16_t));
+}
+
+static uint32_t calib_char_add(ble_ctrl_service_t* p_ctrl_service)
+{
+    uint32_t err_code;
+    ble_uuid_t char_uuid;
+    ble_uuid128_t base_uuid = BLE_UUID_CTRL_BASE_UUID;
+    char_uuid.uuid = BLE_UUID_CALIB_CHARACTERISTC_UUID;
+
+    err_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(err_code);
+
+    ble_gatts_char_md_t char_md;
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.read = 1;
+    char_md.char_props.write = 1;
+
+    ble_gatts_attr_md_t attr_md;
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen = 1;
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value;
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    uint8_t value[CALIB_CHAR_LENGTH];
+    calib_value_encode(value);
+
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.max_len = CALIB_CHAR_LENGTH;
+    attr_char_value.init_len = CALIB_CHAR_LENGTH;
+    attr_char_value.p_value = value;
+
+    err_code = sd_ble_gatts_characteristic_add(p_ctrl_service->service_handle,
+        &char_md,
+        &attr_char_value,
+        &p_ctrl_service->calib_handles);
+    APP_ERROR_CHECK(err_code);
+
+    return NRF_SUCCESS;
+}
+
 void control_service_init(ble_ctrl_service_t* p_ctrl_service)
 {
     p_ctrl_service->conn_handle = BLE_CONN_HANDLE_INVALID;
@@ -87,34 +165,151 @@ void control_service_init(ble_ctrl_service_t* p_ctrl_service)
     APP_ERROR_CHECK(err_code);
 
     ctrl_char_add(p_ctrl_service);
+    calib_char_add(p_ctrl_service);
 }
 
-void ble_ctrl_service_on_cmd_set_target_pos(uint8_t* target)
+static int32_t target_mm_to_subtick(uint8_t* target)
 {
     int16_t targetMm = 0;
     memcpy(&targetMm, target, sizeof(targetMm));    
 
-    int32_t targetUm = targetMm * 1000;
-    int16_t targetPos = ROUNDED_DIV(targetUm - BASE_HEIGHT, TICK_TO_HEIGHT_MULTI);
+    return calibration_height_to_subtick(targetMm * 1000);
+}
 
-    controller_target_position_set(targetPos);
+void ble_ctrl_service_on_cmd_set_target_pos(uint8_t* target)
+{
+    controller_target_subtick_set(target_mm_to_subtick(target));
+}
+
+void ble_ctrl_service_on_cmd_move_by(uint8_t* distance)
+{
+    int16_t distanceMm = 0;
+    memcpy(&distanceMm, distance, sizeof(distanceMm));
+
+    controller_target_relative_set(calibration_distance_to_subtick(distanceMm * 1000));
+}
+
+void ble_ctrl_service_on_cmd_seq_dwell(uint8_t* dwell)
+{
+    uint16_t dwellUnits = 0;
+    memcpy(&dwellUnits, dwell, sizeof(dwellUnits));
+
+    sequencer_enqueue(SEQUENCER_STEP_DWELL, (int32_t)dwellUnits * CTRL_DWELL_UNIT_MS);
+}
+
+void ble_ctrl_service_on_cmd_preset_recall(uint8_t slot)
+{
+    int32_t target;
+
+    if (presets_target_get(slot, &target)) {
+        controller_target_subtick_set(target);
+    }
+}
+
+/**
+ * @brief   Handles single byte commands addressing preset slot in the lower nibble.
+ */
+void ble_ctrl_service_on_cmd_slot(uint8_t command)
+{
+    uint8_t slot = command & CTRL_COMMAND_SLOT_MASK;
+
+    switch (command & CTRL_COMMAND_MASK) {
+    case CTRL_COMMAND_PRESET_SAVE:
+        presets_save(slot, controller_position_get());
+        break;
+    case CTRL_COMMAND_PRESET_RECALL:
+        sequencer_clear();
+        ble_ctrl_service_on_cmd_preset_recall(slot);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief   Applies calibration written by the peer. Value is then replaced with the complete current calibration,
+ *          so invalid or shortened write is not kept.
+ */
+void ble_ctrl_service_on_calib_write(ble_ctrl_service_t* p_ctrl_service, ble_gatts_evt_write_t* p_evt_write)
+{
+    calibration_t calibration;
+    uint8_t value[CALIB_CHAR_LENGTH];
+
+    if (p_evt_write->len == CALIB_CHAR_LENGTH || p_evt_write->len == CALIB_CHAR_LENGTH_NO_BACKLASH) {
+        calibration = *calibration_get();
+
+        memcpy(&calibration.base_height, p_evt_write->data, sizeof(int32_t));
+        memcpy(&calibration.tick_to_height, p_evt_write->data + 4, sizeof(uint16_t));
+        memcpy(&calibration.ticks_upper_limit, p_evt_write->data + 6, sizeof(int16_t));
+        memcpy(&calibration.ticks_lower_limit, p_evt_write->data + 8, sizeof(int16_t));
+
+        if (p_evt_write->len == CALIB_CHAR_LENGTH) {
+            memcpy(&calibration.backlash, p_evt_write->data + 10, sizeof(uint16_t));
+        }
+
+        uint16_t tick_to_height = calibration_get()->tick_to_height;
+
+        if (calibration_set(&calibration) && calibration.tick_to_height != tick_to_height) {
+            presets_erase_all();
+        }
+    }
+
+    ble_gatts_value_t gatts_value;
+    memset(&gatts_value, 0, sizeof(gatts_value));
+
+    calib_value_encode(value);
+    gatts_value.len = CALIB_CHAR_LENGTH;
+    gatts_value.offset = 0;
+    gatts_value.p_value = value;
+
+    sd_ble_gatts_value_set(p_ctrl_service->conn_handle, p_ctrl_service->calib_handles.value_handle, &gatts_value);
 }
 
 void ble_ctrl_service_on_write(ble_ctrl_service_t* p_ctrl_service, ble_evt_t* p_ble_evt)
 {
     ble_gatts_evt_write_t* p_evt_write = &p_ble_evt->evt.gatts_evt.params.write;
 
+    if (p_evt_write->handle == p_ctrl_service->calib_handles.value_handle) {
+        ble_ctrl_service_on_calib_write(p_ctrl_service, p_evt_write);
+        return;
+    }
+
     if (p_evt_write->handle == p_ctrl_service->char_handles.value_handle && p_evt_write->len > 0) {
         switch (p_evt_write->data[0]) {
         case CTRL_COMMAND_FORCE_STOP:
+            sequencer_clear();
             controller_stop();
             break;
         case CTRL_COMMAND_SET_TARGET_POS:
+            sequencer_clear();
             ble_ctrl_service_on_cmd_set_target_pos(&(p_evt_write->data[1]));
             break;
         case CTRL_COMMAND_RESET:
+            sequencer_clear();
             controller_extremum_position_set(p_evt_write->data[1]);
+            break;
+        case CTRL_COMMAND_MOVE_BY:
+            sequencer_clear();
+            ble_ctrl_service_on_cmd_move_by(&(p_evt_write->data[1]));
+            break;
+        case CTRL_COMMAND_JOG:
+            sequencer_clear();
+            controller_jog(p_evt_write->data[1]);
+            break;
+        case CTRL_COMMAND_SEQ_TARGET:
+            sequencer_enqueue(SEQUENCER_STEP_TARGET, target_mm_to_subtick(&(p_evt_write->data[1])));
+            break;
+        case CTRL_COMMAND_SEQ_DWELL:
+            ble_ctrl_service_on_cmd_seq_dwell(&(p_evt_write->data[1]));
+            break;
+        case CTRL_COMMAND_SEQ_CLEAR:
+            sequencer_clear();
+            break;
+        case CTRL_COMMAND_SET_PREFS:
+            presets_prefs_set(p_evt_write->data[1]);
+            break;
         default:
+            ble_ctrl_service_on_cmd_slot(p_evt_write->data[0]);
             break;
         }
     }
@@ -13,12 +13,14 @@
 	} // 128-bit base UUID
 #define BLE_UUID_CTRL_SERVICE 0x1EAD
 #define BLE_UUID_CTRL_CHARACTERISTC_UUID 0x5010
+#define BLE_UUID_CALIB_CHARACTERISTC_UUID 0xCA1B
 
 typedef struct
 {
 	uint16_t conn_handle;
 	uint16_t service_handle;
 	ble_gatts_char_handles_t char_handles;
+	ble_gatts_char_handles_t calib_handles;
 } ble_ctrl_service_t;
 
 void control_service_init(ble_ctrl_service_t *p_ctrl_service);
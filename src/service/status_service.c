@@ -2,11 +2,19 @@
 #include "app_error.h"
 #include "acromegaly_config.h"
 #include "ble_srv_common.h"
+#include "calibration.h"
+#include "clock.h"
+#include "controller.h"
+#include "history.h"
+#include "lifetime.h"
 #include "nrf_gpio.h"
 #include "nrf_log.h"
+#include "usage.h"
 #include <string.h>
 
-#define STATUS_CHAR_LENGTH 9
+#define STATUS_CHAR_LENGTH 10
+#define USAGE_CHAR_LENGTH (USAGE_BAND_COUNT * 4 + 32)
+#define TIME_CHAR_LENGTH 8
 
 static uint32_t status_char_add(ble_status_service_t* p_status_service)
 {
@@ -66,6 +74,230 @@ static uint32_t status_char_add(ble_status_service_t* p_status_service)
     return NRF_SUCCESS;
 }
 
+/**
+ * @brief   Serializes usage statistics to the characteristic value: time in each height band (uint32, min), moves today
+ *          and yesterday (uint16), all moves (uint32), travel (uint32, mm), current and longest standing streak (uint16, min),
+ *          then lifetime counters: motor starts (uint32), travel (uint32, mm) and end stop hits (uint32), and tick edges
+ *          rejected as glitches since power up (uint32).
+ */
+static void usage_value_encode(uint8_t* p_value)
+{
+    usage_stats_t const* p_stats = usage_get();
+    uint8_t offset = 0;
+
+    for (uint8_t i = 0; i < USAGE_BAND_COUNT; i++) {
+        uint32_t minutes = p_stats->band_seconds[i] / 60;
+        memcpy(p_value + offset, &minutes, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+    }
+
+    uint32_t travel = (uint32_t)(((uint64_t)p_stats->travel * calibration_get()->tick_to_height) / 1000);
+    uint32_t streak = usage_streak_get() / 60;
+    uint32_t streak_max = p_stats->streak_max / 60;
+    uint16_t streak_min = streak > UINT16_MAX ? UINT16_MAX : (uint16_t)streak;
+    uint16_t streak_max_min = streak_max > UINT16_MAX ? UINT16_MAX : (uint16_t)streak_max;
+
+    memcpy(p_value + offset, &p_stats->moves_today, sizeof(uint16_t));
+    memcpy(p_value + offset + 2, &p_stats->moves_yesterday, sizeof(uint16_t));
+    memcpy(p_value + offset + 4, &p_stats->moves, sizeof(uint32_t));
+    memcpy(p_value + offset + 8, &travel, sizeof(uint32_t));
+    memcpy(p_value + offset + 12, &streak_min, sizeof(uint16_t));
+    memcpy(p_value + offset + 14, &streak_max_min, sizeof(uint16_t));
+    offset += 16;
+
+    uint32_t starts = lifetime_get(LIFETIME_MOTOR_STARTS);
+    uint32_t lifetime_travel = (uint32_t)(((uint64_t)lifetime_get(LIFETIME_TRAVEL) * calibration_get()->tick_to_height) / 1000);
+    uint32_t end_stops = lifetime_get(LIFETIME_END_STOPS);
+
+    memcpy(p_value + offset, &starts, sizeof(uint32_t));
+    memcpy(p_value + offset + 4, &lifetime_travel, sizeof(uint32_t));
+    memcpy(p_value + offset + 8, &end_stops, sizeof(uint32_t));
+    offset += 12;
+
+    uint32_t rejected = controller_rejected_ticks_get();
+
+    memcpy(p_value + offset, &rejected, sizeof(uint32_t));
+}
+
+static uint32_t usage_char_add(ble_status_service_t* p_status_service)
+{
+    uint32_t err_code;
+    ble_uuid_t char_uuid;
+    ble_uuid128_t base_uuid = BLE_UUID_STATUS_BASE_UUID;
+    char_uuid.uuid = BLE_UUID_USAGE_CHARACTERISTC_UUID;
+
+    err_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(err_code);
+
+    ble_gatts_char_md_t char_md;
+    memset(&char_md, 0, sizeof(char_md));
+    char_md.char_props.read = 1;
+
+    ble_gatts_attr_md_t attr_md;
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value;
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    uint8_t value[USAGE_CHAR_LENGTH];
+    usage_value_encode(value);
+
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.max_len = USAGE_CHAR_LENGTH;
+    attr_char_value.init_len = USAGE_CHAR_LENGTH;
+    attr_char_value.p_value = value;
+
+    err_code = sd_ble_gatts_characteristic_add(p_status_service->service_handle,
+        &char_md,
+        &attr_char_value,
+        &p_status_service->usage_handles);
+    APP_ERROR_CHECK(err_code);
+
+    return NRF_SUCCESS;
+}
+
+static uint32_t history_char_add(ble_status_service_t* p_status_service)
+{
+    uint32_t err_code;
+    ble_uuid_t char_uuid;
+    ble_uuid128_t base_uuid = BLE_UUID_STATUS_BASE_UUID;
+    char_uuid.uuid = BLE_UUID_HISTORY_CHARACTERISTC_UUID;
+
+    err_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(err_code);
+
+    ble_gatts_char_md_t char_md;
+    memset(&char_md, 0, sizeof(char_md));
+    char_md.char_props.write = 1;
+
+    ble_gatts_attr_md_t cccd_md;
+    memset(&cccd_md, 0, sizeof(cccd_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+    cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+    char_md.p_cccd_md = &cccd_md;
+    char_md.char_props.notify = 1;
+
+    ble_gatts_attr_md_t attr_md;
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value;
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    uint8_t value[STATUS_HISTORY_CHUNK_LENGTH] = { 0 };
+
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.max_len = STATUS_HISTORY_CHUNK_LENGTH;
+    attr_char_value.init_len = 1;
+    attr_char_value.p_value = value;
+
+    err_code = sd_ble_gatts_characteristic_add(p_status_service->service_handle,
+        &char_md,
+        &attr_char_value,
+        &p_status_service->history_handles);
+    APP_ERROR_CHECK(err_code);
+
+    return NRF_SUCCESS;
+}
+
+static uint32_t time_char_add(ble_status_service_t* p_status_service)
+{
+    uint32_t err_code;
+    ble_uuid_t char_uuid;
+    ble_uuid128_t base_uuid = BLE_UUID_STATUS_BASE_UUID;
+    char_uuid.uuid = BLE_UUID_TIME_CHARACTERISTC_UUID;
+
+    err_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(err_code);
+
+    ble_gatts_char_md_t char_md;
+    memset(&char_md, 0, sizeof(char_md));
+    char_md.char_props.write = 1;
+    char_md.char_props.write_wo_resp = 1;
+
+    ble_gatts_attr_md_t attr_md;
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen = 1;
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value;
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    uint8_t value[TIME_CHAR_LENGTH] = { 0 };
+
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.max_len = TIME_CHAR_LENGTH;
+    attr_char_value.init_len = TIME_CHAR_LENGTH;
+    attr_char_value.p_value = value;
+
+    err_code = sd_ble_gatts_characteristic_add(p_status_service->service_handle,
+        &char_md,
+        &attr_char_value,
+        &p_status_service->time_handles);
+    APP_ERROR_CHECK(err_code);
+
+    return NRF_SUCCESS;
+}
+
+/**
+ * @brief   Syncs the clock: epoch time (uint32, s), optionally its fraction (uint16, ms) and local time offset from UTC
+ *          (int16, min).
+ */
+static void on_time_write(ble_gatts_evt_write_t* p_evt_write)
+{
+    uint32_t epoch;
+    uint16_t milliseconds = 0;
+    int16_t offset = 0;
+
+    if (p_evt_write->len < sizeof(uint32_t)) {
+        return;
+    }
+
+    memcpy(&epoch, p_evt_write->data, sizeof(uint32_t));
+    if (p_evt_write->len >= 6) {
+        memcpy(&milliseconds, p_evt_write->data + 4, sizeof(uint16_t));
+    }
+    if (p_evt_write->len >= 8) {
+        memcpy(&offset, p_evt_write->data + 6, sizeof(int16_t));
+    }
+
+    clock_sync(epoch, milliseconds, offset);
+}
+
+/**
+ * @brief   Starts (0x01) or cancels (0x00) the history download. Stream is reset by the pump, not here, as the pump may be
+ *          reading it at the moment.
+ */
+static void on_history_write(ble_status_service_t* p_status_service, ble_gatts_evt_write_t* p_evt_write)
+{
+    if (p_evt_write->len < 1) {
+        return;
+    }
+
+    if (p_evt_write->data[0] == 0x01) {
+        p_status_service->history_active = false;
+        p_status_service->history_restart = true;
+    } else {
+        p_status_service->history_restart = false;
+        p_status_service->history_active = false;
+    }
+}
+
 /**@brief Function for initiating our new service.
  *
  * @param[in]   p_our_service        Our Service structure.
@@ -74,6 +306,9 @@ static uint32_t status_char_add(ble_status_service_t* p_status_service)
 void status_service_init(ble_status_service_t* p_status_service)
 {
     p_status_service->conn_handle = BLE_CONN_HANDLE_INVALID;
+    p_status_service->history_active = false;
+    p_status_service->history_restart = false;
+    p_status_service->history_len = 0;
 
     uint32_t err_code;
     ble_uuid_t service_uuid;
@@ -90,6 +325,9 @@ void status_service_init(ble_status_service_t* p_status_service)
     APP_ERROR_CHECK(err_code);
 
     status_char_add(p_status_service);
+    usage_char_add(p_status_service);
+    history_char_add(p_status_service);
+    time_char_add(p_status_service);
 }
 
 void ble_status_service_on_ble_evt(ble_status_service_t* p_status_service, ble_evt_t* p_ble_evt)
@@ -100,8 +338,15 @@ void ble_status_service_on_ble_evt(ble_status_service_t* p_status_service, ble_e
         break;
     case BLE_GAP_EVT_DISCONNECTED:
         p_status_service->conn_handle = BLE_CONN_HANDLE_INVALID;
+        p_status_service->history_active = false;
+        p_status_service->history_restart = false;
         break;
     case BLE_GATTS_EVT_WRITE:
+        if (p_ble_evt->evt.gatts_evt.params.write.handle == p_status_service->history_handles.value_handle) {
+            on_history_write(p_status_service, &p_ble_evt->evt.gatts_evt.params.write);
+        } else if (p_ble_evt->evt.gatts_evt.params.write.handle == p_status_service->time_handles.value_handle) {
+            on_time_write(&p_ble_evt->evt.gatts_evt.params.write);
+        }
         break;
     default:
         // No implementation needed.
@@ -109,7 +354,7 @@ void ble_status_service_on_ble_evt(ble_status_service_t* p_status_service, ble_e
     }
 }
 
-void status_characteristic_update(ble_status_service_t* p_status_service, int16_t pos, int16_t target, uint8_t target_type, uint8_t mov)
+void status_characteristic_update(ble_status_service_t* p_status_service, int16_t pos, int16_t subtick, int16_t target, uint8_t target_type, uint8_t mov, int16_t level_error, uint8_t flags, uint8_t thermal_budget)
 {
     if (p_status_service->conn_handle != BLE_CONN_HANDLE_INVALID) {
         ble_gatts_hvx_params_t hvx_params;
@@ -117,12 +362,15 @@ void status_characteristic_update(ble_status_service_t* p_status_service, int16_
         uint16_t len = STATUS_CHAR_LENGTH;
         uint8_t value[STATUS_CHAR_LENGTH] = { 0 };
 
-        int32_t umPosition = ((int32_t)pos * TICK_TO_HEIGHT_MULTI) + BASE_HEIGHT;
-        int32_t umTarget = target > 0 ? ((int32_t)target * TICK_TO_HEIGHT_MULTI) + BASE_HEIGHT : 0;
+        int32_t umPosition = calibration_subtick_to_height((int32_t)pos * CTRL_SUBTICK_SCALE + subtick);
+        int32_t umTarget = target > 0 ? calibration_subtick_to_height((int32_t)target * CTRL_SUBTICK_SCALE) : 0;
 
         int16_t mmPosition = umPosition / 1000;
         int16_t mmTarget = umTarget / 1000;
 
+        int32_t umLevelError = calibration_subtick_to_distance(level_error);
+        int16_t umLevelErrorSat = umLevelError > INT16_MAX ? INT16_MAX : (int16_t)umLevelError;
+
         // if (mov == 0xA1) {
             // NRF_LOG_PRINTF("Stat: %d (@ %d), type: %x\r\n", umPosition, pos, target_type);
         // }
@@ -132,6 +380,9 @@ void status_characteristic_update(ble_status_service_t* p_status_service, int16_
 
         value[4] = target_type;
         value[5] = mov;
+        memcpy(value + 6, (uint8_t*)&umLevelErrorSat, sizeof(int16_t));
+        value[8] = flags;
+        value[9] = thermal_budget;
 
         hvx_params.handle = p_status_service->char_handles.value_handle;
         hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
@@ -142,3 +393,67 @@ void status_characteristic_update(ble_status_service_t* p_status_service, int16_
         sd_ble_gatts_hvx(p_status_service->conn_handle, &hvx_params);
     }
 }
+
+/**
+ * @brief   Refreshes value of the usage characteristic. It is read-only, so it is not notified.
+ */
+void status_usage_update(ble_status_service_t* p_status_service)
+{
+    ble_gatts_value_t gatts_value;
+    uint8_t value[USAGE_CHAR_LENGTH];
+
+    usage_value_encode(value);
+
+    memset(&gatts_value, 0, sizeof(gatts_value));
+    gatts_value.len = USAGE_CHAR_LENGTH;
+    gatts_value.offset = 0;
+    gatts_value.p_value = value;
+
+    sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_status_service->usage_handles.value_handle, &gatts_value);
+}
+
+void status_history_pump(ble_status_service_t* p_status_service)
+{
+    if (p_status_service->history_restart) {
+        NRF_LOG_PRINTF("History download\r\n");
+        p_status_service->history_restart = false;
+        history_download_start();
+        p_status_service->history_len = 0;
+        p_status_service->history_active = true;
+    }
+
+    while (p_status_service->history_active && p_status_service->conn_handle != BLE_CONN_HANDLE_INVALID) {
+        if (p_status_service->history_len == 0) {
+            p_status_service->history_len = history_download_read(p_status_service->history_chunk, STATUS_HISTORY_CHUNK_LENGTH);
+
+            if (p_status_service->history_len == 0) {
+                NRF_LOG_PRINTF("History download done\r\n");
+                p_status_service->history_active = false;
+                break;
+            }
+        }
+
+        ble_gatts_hvx_params_t hvx_params;
+        uint16_t len = p_status_service->history_len;
+
+        memset(&hvx_params, 0, sizeof(hvx_params));
+        hvx_params.handle = p_status_service->history_handles.value_handle;
+        hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
+        hvx_params.offset = 0;
+        hvx_params.p_len = &len;
+        hvx_params.p_data = p_status_service->history_chunk;
+
+        uint32_t err_code = sd_ble_gatts_hvx(p_status_service->conn_handle, &hvx_params);
+
+        if (err_code == BLE_ERROR_NO_TX_PACKETS) {
+            /* Chunk is kept and sent again after TX complete */
+            break;
+        } else if (err_code != NRF_SUCCESS) {
+            NRF_LOG_PRINTF("History download aborted: %d\r\n", err_code);
+            p_status_service->history_active = false;
+            break;
+        }
+
+        p_status_service->history_len = 0;
+    }
+}
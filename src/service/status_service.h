@@ -3,6 +3,7 @@
 
 #include "ble.h"
 #include "ble_srv_common.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 #define BLE_UUID_STATUS_BASE_UUID                                                                          \
@@ -13,6 +14,11 @@
     }
 #define BLE_UUID_STATUS_SERVICE 0x5E1F
 #define BLE_UUID_STATUS_CHARACTERISTC_UUID 0xFEED
+#define BLE_UUID_USAGE_CHARACTERISTC_UUID 0x57A7
+#define BLE_UUID_HISTORY_CHARACTERISTC_UUID 0x1065
+#define BLE_UUID_TIME_CHARACTERISTC_UUID 0x713E
+
+#define STATUS_HISTORY_CHUNK_LENGTH 20 /* Notification payload with the default ATT MTU */
 
 /**
  * @brief This structure contains various status information for our service. 
@@ -26,6 +32,13 @@ typedef struct
     uint16_t conn_handle;
     uint16_t service_handle;
     ble_gatts_char_handles_t char_handles;
+    ble_gatts_char_handles_t usage_handles;
+    ble_gatts_char_handles_t history_handles;
+    ble_gatts_char_handles_t time_handles;
+    volatile bool history_active; /* History download requested by the connected client */
+    volatile bool history_restart; /* Download (re)start requested, the stream is reset by the pump in the main loop */
+    uint8_t history_chunk[STATUS_HISTORY_CHUNK_LENGTH]; /* Chunk read from flash, waiting for a free TX buffer */
+    uint8_t history_len;
 } ble_status_service_t;
 
 void ble_status_service_on_ble_evt(ble_status_service_t* p_status_service, ble_evt_t* p_ble_evt);
@@ -36,6 +49,13 @@ void ble_status_service_on_ble_evt(ble_status_service_t* p_status_service, ble_e
  */
 void status_service_init(ble_status_service_t* p_status_service);
 
-void status_characteristic_update(ble_status_service_t* p_status_service, int16_t pos, int16_t target, uint8_t target_type, uint8_t mov);
+void status_characteristic_update(ble_status_service_t* p_status_service, int16_t pos, int16_t subtick, int16_t target, uint8_t target_type, uint8_t mov, int16_t level_error, uint8_t flags, uint8_t thermal_budget);
+void status_usage_update(ble_status_service_t* p_status_service);
+
+/**
+ * @brief   Sends pending history download as notifications, until the SoftDevice runs out of TX buffers. Reads flash,
+ *          so it is called from the main loop only.
+ */
+void status_history_pump(ble_status_service_t* p_status_service);
 
 #endif /* _ OUR_SERVICE_H__ */
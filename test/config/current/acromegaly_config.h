@@ -0,0 +1,11 @@
+#ifndef TEST_CURRENT_CONFIG_H__
+#define TEST_CURRENT_CONFIG_H__
+
+/* Firmware configuration with motor current sensing */
+
+#include "../../../config/acromegaly_config.h"
+
+#undef USE_CURRENT_SENSE
+#define USE_CURRENT_SENSE true
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef TEST_DUAL_CONFIG_H__
+#define TEST_DUAL_CONFIG_H__
+
+/* Firmware configuration with two lifting columns */
+
+#include "../../../config/acromegaly_config.h"
+
+#undef CTRL_CHANNEL_COUNT
+#define CTRL_CHANNEL_COUNT 2
+
+#endif
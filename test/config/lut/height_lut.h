@@ -0,0 +1,22 @@
+#ifndef HEIGHT_LUT_H__
+#define HEIGHT_LUT_H__
+
+/*
+ * Generated by tools/gen_height_lut.py from height_lut.csv, do not edit.
+ * Linear part: base height 834000 um, tick height 525 um.
+ */
+
+#include <stdint.h>
+
+#define HEIGHT_LUT_BASE_HEIGHT 834000 /* Linear part the deviations are measured against, in um */
+#define HEIGHT_LUT_TICK_HEIGHT 525
+#define HEIGHT_LUT_SHIFT 6 /* Nodes are spaced every 2^HEIGHT_LUT_SHIFT ticks */
+#define HEIGHT_LUT_COUNT 14
+
+/* Deviation of the measured height from the linear part at each node, in um */
+static const int16_t m_height_lut[HEIGHT_LUT_COUNT] = {
+    0, 635, 1108, 1330, 1324, 1204, 1109, 1124,
+    1237, 1342, 1298, 1012, 486, -166,
+};
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef TEST_PHASE_B_CONFIG_H__
+#define TEST_PHASE_B_CONFIG_H__
+
+/* Firmware configuration with phase B of the quadrature tick sensor */
+
+#include "../../../config/acromegaly_config.h"
+
+#undef USE_TICK_PHASE_B
+#define USE_TICK_PHASE_B true
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef TEST_QDEC_CONFIG_H__
+#define TEST_QDEC_CONFIG_H__
+
+/* Firmware configuration with the tick sensor decoded by QDEC */
+
+#include "../../../config/acromegaly_config.h"
+
+#undef USE_QDEC
+#define USE_QDEC true
+
+#endif
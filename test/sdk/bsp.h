@@ -0,0 +1,39 @@
+#ifndef BSP_H__
+#define BSP_H__
+
+#include "sdk.h"
+
+typedef enum
+{
+    BSP_EVENT_NOTHING = 0,
+    BSP_EVENT_DEFAULT,
+    BSP_EVENT_CLEAR_BONDING_DATA,
+    BSP_EVENT_CLEAR_ALERT,
+    BSP_EVENT_DISCONNECT,
+    BSP_EVENT_ADVERTISING_START,
+    BSP_EVENT_ADVERTISING_STOP,
+    BSP_EVENT_WHITELIST_OFF,
+    BSP_EVENT_BOND,
+    BSP_EVENT_RESET,
+    BSP_EVENT_SLEEP,
+    BSP_EVENT_WAKEUP,
+    BSP_EVENT_DFU,
+    BSP_EVENT_KEY_0,
+    BSP_EVENT_KEY_1,
+    BSP_EVENT_KEY_2,
+    BSP_EVENT_KEY_3,
+    BSP_EVENT_KEY_4,
+    BSP_EVENT_KEY_5,
+    BSP_EVENT_KEY_6,
+    BSP_EVENT_KEY_7
+} bsp_event_t;
+
+typedef uint8_t bsp_button_action_t;
+
+#define BSP_BUTTON_ACTION_PUSH 0
+#define BSP_BUTTON_ACTION_LONG_PUSH 1
+#define BSP_BUTTON_ACTION_RELEASE 2
+
+uint32_t bsp_event_to_button_action_assign(uint32_t button, bsp_button_action_t action, bsp_event_t event);
+
+#endif
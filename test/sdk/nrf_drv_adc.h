@@ -0,0 +1,48 @@
+#ifndef NRF_DRV_ADC_H__
+#define NRF_DRV_ADC_H__
+
+#include "sdk.h"
+
+typedef int16_t nrf_adc_value_t;
+
+typedef enum
+{
+    NRF_DRV_ADC_EVT_DONE,
+    NRF_DRV_ADC_EVT_SAMPLE
+} nrf_drv_adc_evt_type_t;
+
+typedef struct
+{
+    nrf_drv_adc_evt_type_t type;
+    union
+    {
+        struct
+        {
+            nrf_adc_value_t* p_buffer;
+            uint16_t size;
+        } done;
+    } data;
+} nrf_drv_adc_evt_t;
+
+typedef struct
+{
+    uint8_t interrupt_priority;
+} nrf_drv_adc_config_t;
+
+typedef struct
+{
+    uint8_t input;
+} nrf_drv_adc_channel_t;
+
+typedef void (*nrf_drv_adc_event_handler_t)(nrf_drv_adc_evt_t const* p_event);
+
+#define NRF_ADC_CONFIG_INPUT_2 4
+#define NRF_DRV_ADC_DEFAULT_CONFIG { 3 }
+#define NRF_DRV_ADC_DEFAULT_CHANNEL(analog_input) { analog_input }
+
+ret_code_t nrf_drv_adc_init(nrf_drv_adc_config_t const* p_config, nrf_drv_adc_event_handler_t event_handler);
+void nrf_drv_adc_channel_enable(nrf_drv_adc_channel_t* const p_channel);
+ret_code_t nrf_drv_adc_buffer_convert(nrf_adc_value_t* buffer, uint16_t size);
+uint32_t nrf_drv_adc_start_task_get(void);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef NRF_DRV_PPI_H__
+#define NRF_DRV_PPI_H__
+
+#include "sdk.h"
+
+typedef uint8_t nrf_ppi_channel_t;
+
+#define MODULE_ALREADY_INITIALIZED 0x9
+
+ret_code_t nrf_drv_ppi_init(void);
+ret_code_t nrf_drv_ppi_channel_alloc(nrf_ppi_channel_t* p_channel);
+ret_code_t nrf_drv_ppi_channel_assign(nrf_ppi_channel_t channel, uint32_t eep, uint32_t tep);
+ret_code_t nrf_drv_ppi_channel_enable(nrf_ppi_channel_t channel);
+ret_code_t nrf_drv_ppi_channel_disable(nrf_ppi_channel_t channel);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef NRF_DRV_QDEC_H__
+#define NRF_DRV_QDEC_H__
+
+#include "sdk.h"
+
+typedef enum
+{
+    NRF_QDEC_EVENT_SAMPLERDY,
+    NRF_QDEC_EVENT_REPORTRDY,
+    NRF_QDEC_EVENT_ACCOF
+} nrf_qdec_event_t;
+
+typedef enum
+{
+    NRF_QDEC_REPORTPER_10,
+    NRF_QDEC_REPORTPER_40,
+    NRF_QDEC_REPORTPER_80,
+    NRF_QDEC_REPORTPER_120,
+    NRF_QDEC_REPORTPER_160,
+    NRF_QDEC_REPORTPER_200,
+    NRF_QDEC_REPORTPER_240,
+    NRF_QDEC_REPORTPER_280
+} nrf_qdec_reportper_t;
+
+typedef enum
+{
+    NRF_QDEC_SAMPLEPER_128us,
+    NRF_QDEC_SAMPLEPER_256us,
+    NRF_QDEC_SAMPLEPER_512us,
+    NRF_QDEC_SAMPLEPER_1024us
+} nrf_qdec_sampleper_t;
+
+typedef struct
+{
+    nrf_qdec_reportper_t reportper;
+    nrf_qdec_sampleper_t sampleper;
+    uint32_t psela;
+    uint32_t pselb;
+    uint32_t pselled;
+    uint32_t ledpre;
+    int ledpol;
+    bool dbfen;
+    bool sample_inten;
+    uint8_t interrupt_priority;
+} nrf_drv_qdec_config_t;
+
+typedef struct
+{
+    int16_t acc;
+    uint16_t accdbl;
+} nrf_drv_qdec_report_event_t;
+
+typedef struct
+{
+    nrf_qdec_event_t type;
+    union
+    {
+        nrf_drv_qdec_report_event_t report;
+    } data;
+} nrf_drv_qdec_event_t;
+
+typedef void (*qdec_event_handler_t)(nrf_drv_qdec_event_t event);
+
+#define NRF_DRV_QDEC_DEFAULT_CONFIG { NRF_QDEC_REPORTPER_80, NRF_QDEC_SAMPLEPER_128us, 0, 0, 0xFFFFFFFF, 0, 0, true, false, 3 }
+
+ret_code_t nrf_drv_qdec_init(nrf_drv_qdec_config_t const* p_config, qdec_event_handler_t event_handler);
+void nrf_drv_qdec_enable(void);
+void nrf_drv_qdec_disable(void);
+void nrf_drv_qdec_accumulators_read(int16_t* p_acc, int16_t* p_accdbl);
+
+#endif
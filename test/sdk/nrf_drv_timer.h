@@ -0,0 +1,33 @@
+#ifndef NRF_DRV_TIMER_H__
+#define NRF_DRV_TIMER_H__
+
+#include "sdk.h"
+
+typedef struct
+{
+    uint8_t instance_id;
+} nrf_drv_timer_t;
+
+typedef struct
+{
+    uint8_t interrupt_priority;
+} nrf_drv_timer_config_t;
+
+typedef int nrf_timer_event_t;
+typedef int nrf_timer_cc_channel_t;
+typedef int nrf_timer_short_mask_t;
+
+typedef void (*nrf_timer_event_handler_t)(nrf_timer_event_t event_type, void* p_context);
+
+#define NRF_DRV_TIMER_INSTANCE(id) { id }
+#define NRF_TIMER_CC_CHANNEL0 0
+#define NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK 1
+
+ret_code_t nrf_drv_timer_init(nrf_drv_timer_t const* p_instance, nrf_drv_timer_config_t const* p_config, nrf_timer_event_handler_t timer_event_handler);
+uint32_t nrf_drv_timer_us_to_ticks(nrf_drv_timer_t const* p_instance, uint32_t time_us);
+void nrf_drv_timer_extended_compare(nrf_drv_timer_t const* p_instance, nrf_timer_cc_channel_t cc_channel, uint32_t cc_value, nrf_timer_short_mask_t timer_short_mask, bool enable_int);
+uint32_t nrf_drv_timer_compare_event_address_get(nrf_drv_timer_t const* p_instance, nrf_timer_cc_channel_t channel);
+void nrf_drv_timer_enable(nrf_drv_timer_t const* p_instance);
+void nrf_drv_timer_disable(nrf_drv_timer_t const* p_instance);
+
+#endif
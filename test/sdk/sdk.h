@@ -0,0 +1,347 @@
+#ifndef SDK_H__
+#define SDK_H__
+
+/**
+ * Stand-in of the nRF5 SDK 11 and S130 SoftDevice API, just what the firmware modules use. Declarations are
+ * implemented by the simulator in test/sim, the per-header files of this directory only include this one.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*===========================================================================*/
+/* Common.                                                                   */
+/*===========================================================================*/
+
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS 0
+#define NRF_ERROR_NO_MEM 4
+#define NRF_ERROR_INVALID_PARAM 7
+#define NRF_ERROR_INVALID_STATE 8
+#define NRF_ERROR_INVALID_LENGTH 9
+#define NRF_ERROR_BUSY 17
+#define BLE_ERROR_NO_TX_PACKETS 0x3004
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t* p_file_name);
+
+#define APP_ERROR_HANDLER(ERR_CODE) app_error_handler((ERR_CODE), __LINE__, (const uint8_t*)__FILE__)
+#define APP_ERROR_CHECK(ERR_CODE)                                                                                      \
+    do {                                                                                                               \
+        const uint32_t LOCAL_ERR_CODE = (ERR_CODE);                                                                    \
+        if (LOCAL_ERR_CODE != NRF_SUCCESS) {                                                                           \
+            APP_ERROR_HANDLER(LOCAL_ERR_CODE);                                                                         \
+        }                                                                                                              \
+    } while (0)
+
+#define ROUNDED_DIV(A, B) (((A) + ((B) / 2)) / (B))
+
+/* Interrupts are never preempted in the simulation, so critical regions are no-ops */
+#define CRITICAL_REGION_ENTER()
+#define CRITICAL_REGION_EXIT()
+#define __WFE()
+
+#if SIM_LOG
+#include <stdio.h>
+#define NRF_LOG_PRINTF(...) printf(__VA_ARGS__) /* Firmware log on the standard output, build with -DSIM_LOG=1 */
+#else
+#define NRF_LOG_PRINTF(...) (void)0
+#endif
+#define NRF_LOG_INIT() NRF_SUCCESS
+#define NRF_LOG_COLOR_DEFAULT ""
+#define NRF_LOG_COLOR_RED ""
+#define NRF_LOG_COLOR_GREEN ""
+#define NRF_LOG_COLOR_YELLOW ""
+
+/*===========================================================================*/
+/* app_timer, on the simulated RTC1.                                         */
+/*===========================================================================*/
+
+#define APP_TIMER_CLOCK_FREQ 32768
+#define APP_TIMER_MIN_TIMEOUT_TICKS 5
+#define APP_TIMER_TICKS(MS, PRESCALER) ((uint32_t)ROUNDED_DIV((MS) * (uint64_t)APP_TIMER_CLOCK_FREQ, ((PRESCALER) + 1) * 1000))
+#define APP_TIMER_INIT(PRESCALER, OP_QUEUE_SIZE, SCHEDULER_FUNC) (void)0
+
+typedef enum
+{
+    APP_TIMER_MODE_SINGLE_SHOT,
+    APP_TIMER_MODE_REPEATED
+} app_timer_mode_t;
+
+typedef void (*app_timer_timeout_handler_t)(void* p_context);
+
+typedef struct app_timer_t
+{
+    app_timer_timeout_handler_t handler;
+    app_timer_mode_t mode;
+    void* p_context;
+    uint32_t interval; /* RTC ticks between repeated timeouts */
+    uint64_t expiry; /* Simulated time of the next timeout */
+    bool running;
+    struct app_timer_t* p_next; /* Created timers, in the order of creation */
+} app_timer_t;
+
+typedef app_timer_t* app_timer_id_t;
+
+#define APP_TIMER_DEF(timer_id)                                                                                        \
+    static app_timer_t timer_id##_data;                                                                                \
+    static const app_timer_id_t timer_id = &timer_id##_data
+
+uint32_t app_timer_create(app_timer_id_t const* p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler);
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void* p_context);
+uint32_t app_timer_stop(app_timer_id_t timer_id);
+uint32_t app_timer_cnt_get(uint32_t* p_ticks);
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t* p_ticks_diff);
+
+/*===========================================================================*/
+/* GPIO and GPIOTE.                                                          */
+/*===========================================================================*/
+
+typedef uint32_t nrf_drv_gpiote_pin_t;
+
+typedef enum
+{
+    NRF_GPIOTE_POLARITY_LOTOHI = 1,
+    NRF_GPIOTE_POLARITY_HITOLO,
+    NRF_GPIOTE_POLARITY_TOGGLE
+} nrf_gpiote_polarity_t;
+
+typedef enum
+{
+    NRF_GPIO_PIN_NOPULL,
+    NRF_GPIO_PIN_PULLDOWN,
+    NRF_GPIO_PIN_PULLUP = 3
+} nrf_gpio_pin_pull_t;
+
+typedef struct
+{
+    nrf_gpiote_polarity_t sense;
+    nrf_gpio_pin_pull_t pull;
+    bool is_watcher;
+    bool hi_accuracy;
+} nrf_drv_gpiote_in_config_t;
+
+typedef struct
+{
+    int action;
+    int init_state;
+    bool task_pin;
+} nrf_drv_gpiote_out_config_t;
+
+#define GPIOTE_CONFIG_IN_SENSE_TOGGLE(hi_accu) { NRF_GPIOTE_POLARITY_TOGGLE, NRF_GPIO_PIN_NOPULL, false, hi_accu }
+#define GPIOTE_CONFIG_OUT_SIMPLE(init_high) { 0, init_high, false }
+
+typedef void (*nrf_drv_gpiote_evt_handler_t)(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action);
+
+uint32_t nrf_drv_gpiote_init(void);
+uint32_t nrf_drv_gpiote_in_init(nrf_drv_gpiote_pin_t pin, nrf_drv_gpiote_in_config_t const* p_config, nrf_drv_gpiote_evt_handler_t evt_handler);
+void nrf_drv_gpiote_in_event_enable(nrf_drv_gpiote_pin_t pin, bool int_enable);
+void nrf_drv_gpiote_in_event_disable(nrf_drv_gpiote_pin_t pin);
+uint32_t nrf_drv_gpiote_out_init(nrf_drv_gpiote_pin_t pin, nrf_drv_gpiote_out_config_t const* p_config);
+void nrf_drv_gpiote_out_set(nrf_drv_gpiote_pin_t pin);
+void nrf_drv_gpiote_out_clear(nrf_drv_gpiote_pin_t pin);
+uint32_t nrf_gpio_pin_read(uint32_t pin_number);
+void nrf_gpio_cfg_input(uint32_t pin_number, nrf_gpio_pin_pull_t pull_config);
+
+#define LED_2 19
+
+/*===========================================================================*/
+/* app_pwm.                                                                  */
+/*===========================================================================*/
+
+typedef struct
+{
+    uint8_t instance;
+} app_pwm_t;
+
+typedef struct
+{
+    uint32_t pins[2];
+    int pin_polarity[2];
+    uint8_t num_of_channels;
+    uint32_t period_us;
+} app_pwm_config_t;
+
+typedef uint16_t app_pwm_duty_t;
+typedef void (*app_pwm_callback_t)(uint32_t pwm_id);
+
+#define APP_PWM_POLARITY_ACTIVE_HIGH 1
+#define APP_PWM_INSTANCE(name, num) static const app_pwm_t name = { num }
+#define APP_PWM_DEFAULT_CONFIG_1CH(period_in_us, pin) { { pin, 0xFFFFFFFF }, { 1, 1 }, 1, period_in_us }
+#define APP_PWM_DEFAULT_CONFIG_2CH(period_in_us, pin0, pin1) { { pin0, pin1 }, { 1, 1 }, 2, period_in_us }
+
+ret_code_t app_pwm_init(app_pwm_t const* p_instance, app_pwm_config_t const* p_config, app_pwm_callback_t p_ready_callback);
+void app_pwm_enable(app_pwm_t const* p_instance);
+void app_pwm_disable(app_pwm_t const* p_instance);
+ret_code_t app_pwm_channel_duty_set(app_pwm_t const* p_instance, uint8_t channel, app_pwm_duty_t duty);
+app_pwm_duty_t app_pwm_channel_duty_get(app_pwm_t const* p_instance, uint8_t channel);
+
+/*===========================================================================*/
+/* SoftDevice GATT server.                                                   */
+/*===========================================================================*/
+
+typedef struct
+{
+    uint16_t value_handle;
+    uint16_t user_desc_handle;
+    uint16_t cccd_handle;
+    uint16_t sccd_handle;
+} ble_gatts_char_handles_t;
+
+typedef struct
+{
+    uint8_t uuid128[16];
+} ble_uuid128_t;
+
+typedef struct
+{
+    uint16_t uuid;
+    uint8_t type;
+} ble_uuid_t;
+
+typedef struct
+{
+    uint8_t sm : 4;
+    uint8_t lv : 4;
+} ble_gap_conn_sec_mode_t;
+
+typedef struct
+{
+    struct
+    {
+        uint8_t broadcast : 1;
+        uint8_t read : 1;
+        uint8_t write_wo_resp : 1;
+        uint8_t write : 1;
+        uint8_t notify : 1;
+        uint8_t indicate : 1;
+        uint8_t auth_signed_wr : 1;
+    } char_props;
+    void* p_cccd_md;
+} ble_gatts_char_md_t;
+
+typedef struct
+{
+    ble_gap_conn_sec_mode_t read_perm;
+    ble_gap_conn_sec_mode_t write_perm;
+    uint8_t vlen : 1;
+    uint8_t vloc : 2;
+    uint8_t rd_auth : 1;
+    uint8_t wr_auth : 1;
+} ble_gatts_attr_md_t;
+
+typedef struct
+{
+    ble_uuid_t* p_uuid;
+    ble_gatts_attr_md_t* p_attr_md;
+    uint16_t init_len;
+    uint16_t init_offs;
+    uint16_t max_len;
+    uint8_t* p_value;
+} ble_gatts_attr_t;
+
+typedef struct
+{
+    uint16_t handle;
+    uint8_t type;
+    uint16_t offset;
+    uint16_t* p_len;
+    uint8_t* p_data;
+} ble_gatts_hvx_params_t;
+
+typedef struct
+{
+    uint16_t len;
+    uint16_t offset;
+    uint8_t* p_value;
+} ble_gatts_value_t;
+
+typedef struct
+{
+    uint16_t handle;
+    uint8_t op;
+    uint16_t offset;
+    uint16_t len;
+    uint8_t data[1];
+} ble_gatts_evt_write_t;
+
+typedef struct
+{
+    uint16_t evt_id;
+    uint16_t evt_len;
+} ble_evt_hdr_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+} ble_gap_evt_t;
+
+typedef struct
+{
+    uint8_t count;
+} ble_evt_tx_complete_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    union
+    {
+        ble_gatts_evt_write_t write;
+    } params;
+} ble_gatts_evt_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    union
+    {
+        ble_evt_tx_complete_t tx_complete;
+    } params;
+} ble_common_evt_t;
+
+typedef struct
+{
+    ble_evt_hdr_t header;
+    union
+    {
+        ble_common_evt_t common_evt;
+        ble_gap_evt_t gap_evt;
+        ble_gatts_evt_t gatts_evt;
+    } evt;
+} ble_evt_t;
+
+enum
+{
+    BLE_EVT_TX_COMPLETE = 0x01,
+    BLE_GAP_EVT_CONNECTED = 0x10,
+    BLE_GAP_EVT_DISCONNECTED,
+    BLE_GATTS_EVT_WRITE = 0x50
+};
+
+#define BLE_CONN_HANDLE_INVALID 0xFFFF
+#define BLE_GATTS_VLOC_STACK 1
+#define BLE_GATT_HVX_NOTIFICATION 1
+#define BLE_GATTS_SRVC_TYPE_PRIMARY 1
+#define BLE_GAP_CONN_SEC_MODE_SET_OPEN(ptr) do { (ptr)->sm = 1; (ptr)->lv = 1; } while (0)
+#define BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(ptr) do { (ptr)->sm = 0; (ptr)->lv = 0; } while (0)
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const* p_vs_uuid, uint8_t* p_uuid_type);
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const* p_uuid, uint16_t* p_handle);
+uint32_t sd_ble_gatts_characteristic_add(uint16_t service_handle, ble_gatts_char_md_t const* p_char_md, ble_gatts_attr_t const* p_attr_char_value, ble_gatts_char_handles_t* p_handles);
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const* p_hvx_params);
+uint32_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t* p_value);
+
+/*===========================================================================*/
+/* Device manager.                                                           */
+/*===========================================================================*/
+
+typedef struct
+{
+    uint8_t appl_id;
+    uint8_t connection_id;
+    uint8_t device_id;
+    uint8_t service_id;
+} dm_handle_t;
+
+#endif
@@ -0,0 +1,398 @@
+#include "app.h"
+#include "button_ctrl.h"
+#include "calibration.h"
+#include "clock.h"
+#include "controller.h"
+#include "ctrl_service.h"
+#include "desk.h"
+#include "history.h"
+#include "lifetime.h"
+#include "m45pe_drv.h"
+#include "m45pe_keys.h"
+#include "obstruction.h"
+#include "presets.h"
+#include "sequencer.h"
+#include "sim.h"
+#include "status_service.h"
+#include "thermal.h"
+#include "trajectory.h"
+#include "usage.h"
+#include <string.h>
+
+/*===========================================================================*/
+/* Fixture local definitions.                                                */
+/*===========================================================================*/
+
+#define APP_CONN_HANDLE 1
+#define APP_WRITE_LENGTH_MAX 20
+
+#define CTRL_COMMAND_FORCE_STOP 0xAA
+#define CTRL_COMMAND_SET_TARGET_POS 0x60
+#define CTRL_COMMAND_MOVE_BY 0x63
+#define CTRL_COMMAND_JOG 0x64
+
+/*===========================================================================*/
+/* Fixture local variables and types.                                        */
+/*===========================================================================*/
+
+typedef union
+{
+    ble_evt_t evt;
+    uint8_t raw[sizeof(ble_evt_t) + APP_WRITE_LENGTH_MAX];
+} app_evt_buffer_t;
+
+static ble_status_service_t m_status_service;
+static ble_ctrl_service_t m_ctrl_service;
+
+/* Same as main.c */
+static controller_state_t ctrl_state;
+static controller_state_t pending_ctrl_state;
+static volatile uint8_t ctrl_state_changed;
+static controller_state_t notified_state;
+static int16_t stored_positions[CTRL_CHANNEL_COUNT];
+static uint16_t stored_uncertainty;
+static uint32_t reported_rejected_ticks;
+
+static controller_state_t m_last_state; /* Latest state passed to the callback, seen by tests */
+static uint32_t m_state_count;
+
+/*===========================================================================*/
+/* Fixture local functions.                                                  */
+/*===========================================================================*/
+
+static void update_status_service(void)
+{
+    memcpy(&notified_state, &ctrl_state, sizeof(controller_state_t));
+    status_characteristic_update(&m_status_service, ctrl_state.position, ctrl_state.subtick, ctrl_state.target, ctrl_state.target_type, ctrl_state.movement, ctrl_state.level_error, ctrl_state.flags, thermal_budget_get());
+}
+
+static bool status_change_notifiable(void)
+{
+    if (presets_prefs_get() & PRESETS_PREF_NOTIFY_INTERPOLATED) {
+        return true;
+    }
+
+    return ctrl_state.position != notified_state.position
+        || ctrl_state.target != notified_state.target
+        || ctrl_state.target_type != notified_state.target_type
+        || ctrl_state.movement != notified_state.movement
+        || ctrl_state.flags != notified_state.flags;
+}
+
+static void controller_cb(controller_state_t* state)
+{
+    sequencer_on_controller_state(state);
+    usage_on_controller_state(state);
+
+    memcpy(&pending_ctrl_state, state, sizeof(controller_state_t));
+    ctrl_state_changed = 0x01;
+
+    memcpy(&m_last_state, state, sizeof(controller_state_t));
+    m_state_count++;
+}
+
+static void system_init(bool erase_bonds)
+{
+    memset(stored_positions, 0, sizeof(stored_positions));
+    m45pe_read(FLASH_CTRL_POS_KEY, (uint8_t*)stored_positions, sizeof(stored_positions));
+    stored_uncertainty = UINT16_MAX;
+    m45pe_read(FLASH_CTRL_UNCERTAINTY_KEY, (uint8_t*)&stored_uncertainty, sizeof(stored_uncertainty));
+    calibration_init();
+    clock_init();
+    thermal_init();
+    usage_init();
+    history_init();
+    lifetime_init();
+    controller_init(stored_positions, stored_uncertainty);
+    presets_init(erase_bonds);
+    sequencer_init();
+    button_ctrl_init();
+}
+
+/**
+ * @brief   Body of the main loop of main.c, run by the simulator after each wake-up.
+ */
+static void main_loop(void)
+{
+    if (ctrl_state_changed == 0x01) {
+        memcpy(&ctrl_state, &pending_ctrl_state, sizeof(controller_state_t));
+        ctrl_state_changed = 0x00;
+
+        if (ctrl_state.movement == MOVE_DIRECTION_NONE) {
+            if (memcmp(ctrl_state.channel_position, stored_positions, sizeof(stored_positions)) != 0) {
+                m45pe_write(FLASH_CTRL_POS_KEY, (uint8_t*)ctrl_state.channel_position, sizeof(stored_positions));
+                memcpy(stored_positions, ctrl_state.channel_position, sizeof(stored_positions));
+            }
+            if (ctrl_state.uncertainty != stored_uncertainty) {
+                m45pe_write(FLASH_CTRL_UNCERTAINTY_KEY, (uint8_t*)&ctrl_state.uncertainty, sizeof(stored_uncertainty));
+                stored_uncertainty = ctrl_state.uncertainty;
+            }
+        }
+        if (status_change_notifiable()) {
+            update_status_service();
+        }
+    }
+
+    presets_flush();
+    calibration_flush();
+    thermal_flush();
+    trajectory_flush();
+    obstruction_flush();
+    clock_flush();
+    usage_flush();
+    lifetime_flush();
+
+    uint32_t rejected_ticks = controller_rejected_ticks_get();
+
+    if (usage_is_changed() | lifetime_is_changed() | (rejected_ticks != reported_rejected_ticks)) {
+        reported_rejected_ticks = rejected_ticks;
+        status_usage_update(&m_status_service);
+    }
+
+    history_flush();
+    status_history_pump(&m_status_service);
+}
+
+/**
+ * @brief   Delivers the SoftDevice event to the services, like ble_evt_dispatch, and runs the main loop after it.
+ */
+static void dispatch(ble_evt_t* p_ble_evt)
+{
+    ble_ctrl_service_on_ble_evt(&m_ctrl_service, p_ble_evt);
+    ble_status_service_on_ble_evt(&m_status_service, p_ble_evt);
+    main_loop();
+}
+
+static void write(uint16_t handle, uint8_t const* p_data, uint8_t len)
+{
+    app_evt_buffer_t buffer;
+
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.evt.header.evt_id = BLE_GATTS_EVT_WRITE;
+    buffer.evt.evt.gatts_evt.conn_handle = APP_CONN_HANDLE;
+    buffer.evt.evt.gatts_evt.params.write.handle = handle;
+    buffer.evt.evt.gatts_evt.params.write.len = len;
+    memcpy(buffer.evt.evt.gatts_evt.params.write.data, p_data, len);
+
+    dispatch(&buffer.evt);
+}
+
+static bool is_at_rest(void)
+{
+    return app_is_at_rest();
+}
+
+/*===========================================================================*/
+/* Fixture exported functions.                                               */
+/*===========================================================================*/
+
+/**
+ * @brief   Boots the firmware on the simulated board, like main(). Simulator, flash and desk plant have to be set up
+ *          before.
+ */
+void app_boot(bool erase_bonds)
+{
+    memset(&m_status_service, 0, sizeof(ble_status_service_t));
+    memset(&m_ctrl_service, 0, sizeof(ble_ctrl_service_t));
+    memset(&ctrl_state, 0, sizeof(ctrl_state));
+    memset(&pending_ctrl_state, 0, sizeof(pending_ctrl_state));
+    memset(&notified_state, 0, sizeof(notified_state));
+    memset(&m_last_state, 0, sizeof(m_last_state));
+    ctrl_state_changed = 0x00;
+    reported_rejected_ticks = 0;
+    m_state_count = 0;
+
+    m45_init();
+    system_init(erase_bonds);
+    status_service_init(&m_status_service);
+    control_service_init(&m_ctrl_service);
+    controller_register_cb(controller_cb);
+
+    sim_main_loop_set(main_loop);
+}
+
+/**
+ * @brief   Boots with the columns at rest at the position, in ticks, stored as known exactly.
+ */
+void app_boot_at(int16_t position)
+{
+    int16_t positions[CTRL_CHANNEL_COUNT];
+    uint16_t uncertainty = 0;
+
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        positions[i] = position;
+        desk_place(i, (double)position * CTRL_SUBTICK_SCALE);
+    }
+
+    m45pe_write(FLASH_CTRL_POS_KEY, (uint8_t*)positions, sizeof(positions));
+    m45pe_write(FLASH_CTRL_UNCERTAINTY_KEY, (uint8_t*)&uncertainty, sizeof(uncertainty));
+    app_boot(false);
+}
+
+/**
+ * @brief   Restarts the firmware with the flash content kept and the desk where it is. RTC starts from zero.
+ *          Module variables, which are not set by their init functions, are not cleared as by a real reset.
+ */
+void app_reboot(bool erase_bonds)
+{
+    sim_reset();
+    desk_attach();
+    app_boot(erase_bonds);
+}
+
+controller_state_t const* app_state(void)
+{
+    return &m_last_state;
+}
+
+uint32_t app_state_count(void)
+{
+    return m_state_count;
+}
+
+/**
+ * @brief   Checks that the motor is released, the desk stands still and the controller reported its final state.
+ */
+bool app_is_at_rest(void)
+{
+    for (uint8_t i = 0; i < CTRL_CHANNEL_COUNT; i++) {
+        if (desk_is_driven(i)) {
+            return false;
+        }
+    }
+
+    return !desk_is_moving() && !controller_is_moving() && m_last_state.movement == MOVE_DIRECTION_NONE
+        && (m_last_state.flags & CTRL_FLAG_SETTLED);
+}
+
+bool app_wait_rest(uint32_t timeout_ms)
+{
+    return sim_run_until(is_at_rest, timeout_ms);
+}
+
+void app_connect(void)
+{
+    ble_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.header.evt_id = BLE_GAP_EVT_CONNECTED;
+    evt.evt.gap_evt.conn_handle = APP_CONN_HANDLE;
+    dispatch(&evt);
+    update_status_service(); /* ble_on_connected */
+}
+
+void app_disconnect(void)
+{
+    ble_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.header.evt_id = BLE_GAP_EVT_DISCONNECTED;
+    evt.evt.gap_evt.conn_handle = APP_CONN_HANDLE;
+    presets_peer_deselect(); /* DM_EVT_DISCONNECTION */
+    dispatch(&evt);
+}
+
+/**
+ * @brief   Ends the connection event: queued notifications are sent and the TX buffers are free again.
+ */
+void app_tx_complete(void)
+{
+    ble_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.header.evt_id = BLE_EVT_TX_COMPLETE;
+    evt.evt.common_evt.conn_handle = APP_CONN_HANDLE;
+    evt.evt.common_evt.params.tx_complete.count = sim_ble_tx_complete();
+    dispatch(&evt);
+}
+
+/**
+ * @brief   Bonded peer connected and secured the link, like DM_EVT_LINK_SECURED.
+ */
+void app_peer_select(uint8_t device_id)
+{
+    presets_peer_select(device_id);
+    main_loop();
+}
+
+void app_command(uint8_t const* p_data, uint8_t len)
+{
+    write(m_ctrl_service.char_handles.value_handle, p_data, len);
+}
+
+void app_command_target_mm(uint16_t millimeters)
+{
+    uint8_t data[] = { CTRL_COMMAND_SET_TARGET_POS, (uint8_t)millimeters, (uint8_t)(millimeters >> 8) };
+
+    app_command(data, sizeof(data));
+}
+
+void app_command_move_by_mm(int16_t millimeters)
+{
+    uint8_t data[] = { CTRL_COMMAND_MOVE_BY, (uint8_t)millimeters, (uint8_t)((uint16_t)millimeters >> 8) };
+
+    app_command(data, sizeof(data));
+}
+
+void app_command_jog(uint8_t direction)
+{
+    uint8_t data[] = { CTRL_COMMAND_JOG, direction };
+
+    app_command(data, sizeof(data));
+}
+
+void app_command_stop(void)
+{
+    uint8_t data[] = { CTRL_COMMAND_FORCE_STOP };
+
+    app_command(data, sizeof(data));
+}
+
+void app_calib_write(uint8_t const* p_data, uint8_t len)
+{
+    write(m_ctrl_service.calib_handles.value_handle, p_data, len);
+}
+
+void app_history_write(uint8_t value)
+{
+    write(m_status_service.history_handles.value_handle, &value, sizeof(value));
+}
+
+void app_time_write(uint32_t epoch, uint16_t milliseconds, int16_t offset)
+{
+    uint8_t data[8];
+
+    memcpy(data, &epoch, sizeof(epoch));
+    memcpy(data + 4, &milliseconds, sizeof(milliseconds));
+    memcpy(data + 6, &offset, sizeof(offset));
+    write(m_status_service.time_handles.value_handle, data, sizeof(data));
+}
+
+/**
+ * @brief   Button event from the BSP, as dispatched by bsp_event_handler.
+ */
+void app_button(bsp_event_t event)
+{
+    button_ctrl_on_bsp_evt(event);
+    main_loop();
+}
+
+uint16_t app_calib_handle(void)
+{
+    return m_ctrl_service.calib_handles.value_handle;
+}
+
+uint16_t app_status_handle(void)
+{
+    return m_status_service.char_handles.value_handle;
+}
+
+uint16_t app_usage_handle(void)
+{
+    return m_status_service.usage_handles.value_handle;
+}
+
+uint16_t app_history_handle(void)
+{
+    return m_status_service.history_handles.value_handle;
+}
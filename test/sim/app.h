@@ -0,0 +1,44 @@
+#ifndef APP_H__
+#define APP_H__
+
+#include "bsp.h"
+#include "controller.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Firmware fixture: boots the modules and runs the main loop in the same order as main.c, with the SoftDevice,
+ * device manager and BSP replaced by the calls below.
+ */
+
+void app_boot(bool erase_bonds);
+void app_boot_at(int16_t position);
+void app_reboot(bool erase_bonds);
+
+controller_state_t const* app_state(void);
+uint32_t app_state_count(void);
+bool app_is_at_rest(void);
+bool app_wait_rest(uint32_t timeout_ms);
+
+void app_connect(void);
+void app_disconnect(void);
+void app_tx_complete(void);
+void app_peer_select(uint8_t device_id);
+
+void app_command(uint8_t const* p_data, uint8_t len);
+void app_command_target_mm(uint16_t millimeters);
+void app_command_move_by_mm(int16_t millimeters);
+void app_command_jog(uint8_t direction);
+void app_command_stop(void);
+void app_calib_write(uint8_t const* p_data, uint8_t len);
+void app_history_write(uint8_t value);
+void app_time_write(uint32_t epoch, uint16_t milliseconds, int16_t offset);
+
+void app_button(bsp_event_t event);
+
+uint16_t app_calib_handle(void);
+uint16_t app_status_handle(void);
+uint16_t app_usage_handle(void);
+uint16_t app_history_handle(void);
+
+#endif
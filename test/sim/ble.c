@@ -0,0 +1,154 @@
+#include "sim.h"
+#include "ble.h"
+#include <string.h>
+
+/*===========================================================================*/
+/* SoftDevice stand-in local definitions.                                    */
+/*===========================================================================*/
+
+#define BLE_HANDLE_COUNT 64
+#define BLE_VALUE_LENGTH_MAX 512 /* BLE_GATTS_VAR_ATTR_LEN_MAX */
+#define BLE_NOTIFICATION_LENGTH_MAX 20 /* Default ATT_MTU - 3 */
+#define BLE_TX_BUFFERS_DEFAULT 7 /* Application TX buffers of S130 with the high bandwidth configuration */
+
+/*===========================================================================*/
+/* SoftDevice stand-in local variables and types.                            */
+/*===========================================================================*/
+
+static uint16_t m_next_handle;
+static uint8_t m_uuid_types;
+static uint8_t m_values[BLE_HANDLE_COUNT][BLE_VALUE_LENGTH_MAX];
+static uint16_t m_value_lengths[BLE_HANDLE_COUNT];
+static uint8_t m_tx_buffers;
+static uint8_t m_tx_buffers_free;
+static uint32_t m_notifications;
+static sim_ble_notify_handler_t m_notify_handler;
+
+/*===========================================================================*/
+/* SoftDevice stand-in exported functions.                                   */
+/*===========================================================================*/
+
+void sim_ble_reset(void)
+{
+    m_next_handle = 1;
+    m_uuid_types = 0;
+    memset(m_values, 0, sizeof(m_values));
+    memset(m_value_lengths, 0, sizeof(m_value_lengths));
+    m_tx_buffers = BLE_TX_BUFFERS_DEFAULT;
+    m_tx_buffers_free = BLE_TX_BUFFERS_DEFAULT;
+    m_notifications = 0;
+    m_notify_handler = NULL;
+}
+
+void sim_ble_notify_handler_set(sim_ble_notify_handler_t handler)
+{
+    m_notify_handler = handler;
+}
+
+void sim_ble_tx_buffers_set(uint8_t count)
+{
+    m_tx_buffers = count;
+    m_tx_buffers_free = count;
+}
+
+/**
+ * @brief   Sends all queued notifications, as in one connection event.
+ *
+ * @return  Number of packets sent, to be reported by BLE_EVT_TX_COMPLETE.
+ */
+uint8_t sim_ble_tx_complete(void)
+{
+    uint8_t count = m_tx_buffers - m_tx_buffers_free;
+
+    m_tx_buffers_free = m_tx_buffers;
+    return count;
+}
+
+uint32_t sim_ble_notification_count_get(void)
+{
+    return m_notifications;
+}
+
+uint16_t sim_ble_value_get(uint16_t handle, uint8_t* p_data, uint16_t max_len)
+{
+    uint16_t len = m_value_lengths[handle] < max_len ? m_value_lengths[handle] : max_len;
+
+    memcpy(p_data, m_values[handle], len);
+    return len;
+}
+
+/*===========================================================================*/
+/* SoftDevice API.                                                           */
+/*===========================================================================*/
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const* p_vs_uuid, uint8_t* p_uuid_type)
+{
+    *p_uuid_type = 2 + m_uuid_types++;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const* p_uuid, uint16_t* p_handle)
+{
+    *p_handle = m_next_handle++;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_characteristic_add(uint16_t service_handle, ble_gatts_char_md_t const* p_char_md, ble_gatts_attr_t const* p_attr_char_value, ble_gatts_char_handles_t* p_handles)
+{
+    if (m_next_handle + 3 >= BLE_HANDLE_COUNT || p_attr_char_value->max_len > BLE_VALUE_LENGTH_MAX) {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    m_next_handle++; /* Declaration */
+    p_handles->value_handle = m_next_handle++;
+    p_handles->cccd_handle = p_char_md->char_props.notify ? m_next_handle++ : 0;
+    p_handles->user_desc_handle = 0;
+    p_handles->sccd_handle = 0;
+
+    if (p_attr_char_value->p_value != NULL) {
+        memcpy(m_values[p_handles->value_handle], p_attr_char_value->p_value, p_attr_char_value->init_len);
+    }
+    m_value_lengths[p_handles->value_handle] = p_attr_char_value->init_len;
+
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const* p_hvx_params)
+{
+    if (conn_handle == BLE_CONN_HANDLE_INVALID) {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    if (m_tx_buffers_free == 0) {
+        return BLE_ERROR_NO_TX_PACKETS;
+    }
+
+    /* Only ATT_MTU - 3 bytes are sent, the length is updated */
+    if (*p_hvx_params->p_len > BLE_NOTIFICATION_LENGTH_MAX) {
+        *p_hvx_params->p_len = BLE_NOTIFICATION_LENGTH_MAX;
+    }
+
+    m_tx_buffers_free--;
+    m_notifications++;
+
+    memcpy(m_values[p_hvx_params->handle], p_hvx_params->p_data, *p_hvx_params->p_len);
+    m_value_lengths[p_hvx_params->handle] = *p_hvx_params->p_len;
+
+    if (m_notify_handler != NULL) {
+        m_notify_handler(p_hvx_params->handle, p_hvx_params->p_data, *p_hvx_params->p_len);
+    }
+
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t* p_value)
+{
+    if (handle >= BLE_HANDLE_COUNT || p_value->offset + p_value->len > BLE_VALUE_LENGTH_MAX) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    memcpy(&m_values[handle][p_value->offset], p_value->p_value, p_value->len);
+    m_value_lengths[handle] = p_value->offset + p_value->len;
+
+    return NRF_SUCCESS;
+}
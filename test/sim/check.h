@@ -0,0 +1,53 @@
+#ifndef CHECK_H__
+#define CHECK_H__
+
+#include "sim.h"
+#include <math.h>
+#include <stdio.h>
+
+/**
+ * Assertions of the host tests. Failed check is reported and counted, the test goes on, check_result gives the exit
+ * code of the test program.
+ */
+
+static unsigned m_check_count;
+static unsigned m_check_failures;
+
+static inline void check_report(int passed, char const* p_file, int line, char const* p_text)
+{
+    m_check_count++;
+
+    if (!passed) {
+        m_check_failures++;
+        fprintf(stderr, "%s:%d: check failed at %u ms: %s\n", p_file, line, sim_time_ms(), p_text);
+    }
+}
+
+#define CHECK(COND) check_report((COND) ? 1 : 0, __FILE__, __LINE__, #COND)
+
+#define CHECK_NEAR(VALUE, EXPECTED, TOLERANCE)                                                                         \
+    do {                                                                                                               \
+        double check_value = (double)(VALUE);                                                                          \
+        double check_expected = (double)(EXPECTED);                                                                    \
+        check_report(fabs(check_value - check_expected) <= (TOLERANCE), __FILE__, __LINE__, #VALUE " near " #EXPECTED); \
+        if (fabs(check_value - check_expected) > (TOLERANCE)) {                                                        \
+            fprintf(stderr, "    %g, expected %g +- %g\n", check_value, check_expected, (double)(TOLERANCE));          \
+        }                                                                                                              \
+    } while (0)
+
+/** Measured value, printed for the comparison between runs */
+#define REPORT(...)                                                                                                    \
+    do {                                                                                                               \
+        printf("    ");                                                                                                \
+        printf(__VA_ARGS__);                                                                                           \
+        printf("\n");                                                                                                  \
+    } while (0)
+
+static inline int check_result(char const* p_name)
+{
+    m_check_failures += sim_errors_get();
+    printf("%s: %u checks, %u failed\n", p_name, m_check_count, m_check_failures);
+    return m_check_failures == 0 ? 0 : 1;
+}
+
+#endif
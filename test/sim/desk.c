@@ -0,0 +1,363 @@
+#include "desk.h"
+#include "acromegaly_config.h"
+#include "sim.h"
+#include <math.h>
+#include <string.h>
+
+/*===========================================================================*/
+/* Desk plant local definitions.                                             */
+/*===========================================================================*/
+
+/* Pins wired to the controller, same as in motor.c and controller.c */
+static const uint8_t m_up_pins[] = { 16, 13 };
+static const uint8_t m_down_pins[] = { 15, 14 };
+static const uint8_t m_phase_a_pins[] = { 29, 30 };
+static const uint8_t m_phase_b_pins[] = { 5, 6 };
+
+#define DESK_DT (1.0 / SIM_RTC_FREQ)
+#define DESK_STICTION_SPEED 50.0 /* Slower run-down stops by friction, subticks per second */
+#define DESK_NOISE_PERIOD_US 50000
+#define DESK_FREE_CURRENT_MA 600.0 /* Motor current at full duty, unloaded */
+#define DESK_STALL_CURRENT_MA 5000.0 /* Motor current at full duty, stalled */
+#define DESK_ADC_REFERENCE_MV 1200
+#define DESK_ADC_MAX 1023
+
+/*===========================================================================*/
+/* Desk plant local variables and types.                                     */
+/*===========================================================================*/
+
+typedef struct
+{
+    desk_params_t params;
+    desk_state_t state;
+    double noise; /* Speed factor of the current noise period */
+    uint64_t glitch_end_us; /* End of the spurious pulse in progress, 0 if none */
+    bool phase_a;
+    bool phase_b;
+} column_t;
+
+static column_t m_columns[DESK_COLUMNS_MAX];
+static uint8_t m_column_count;
+static uint64_t m_next_noise_us;
+static uint32_t m_random = 12345;
+
+/*===========================================================================*/
+/* Desk plant local functions.                                               */
+/*===========================================================================*/
+
+/**
+ * @brief   Returns uniform random number in [0, 1), repeatable between runs.
+ */
+static double random_unit(void)
+{
+    m_random = m_random * 1103515245u + 12345u;
+    return (double)(m_random >> 8) / (double)(1u << 24);
+}
+
+static int8_t drive_direction(uint8_t index)
+{
+    bool up = sim_pin_get(m_up_pins[index]);
+    bool down = sim_pin_get(m_down_pins[index]);
+
+    if (m_columns[index].params.swapped) {
+        bool swap = up;
+        up = down;
+        down = swap;
+    }
+
+    if (up == down) {
+        return 0; /* Released, or braked with both legs */
+    }
+
+    return up ? 1 : -1;
+}
+
+/**
+ * @brief   Speed the motor would settle at with the current drive, signed. Unloaded speed leaves out the load and its
+ *          variation, it is the speed at which back EMF of the motor leaves only the free running current.
+ */
+static double drive_speed(uint8_t index, bool loaded)
+{
+    column_t* p_column = &m_columns[index];
+    int8_t direction = drive_direction(index);
+    double duty = sim_pwm_duty_get(index);
+
+    if (direction == 0 || duty <= p_column->params.dead_duty) {
+        return 0.0;
+    }
+
+    double speed = direction > 0 ? p_column->params.speed_up : p_column->params.speed_down;
+
+    if (loaded) {
+        speed *= (direction > 0 ? 1.0 - p_column->params.load : 1.0) * p_column->noise;
+    }
+
+    return direction * speed * (duty - p_column->params.dead_duty) / (100.0 - p_column->params.dead_duty);
+}
+
+static double free_speed(uint8_t index)
+{
+    return drive_speed(index, true);
+}
+
+/**
+ * @brief   Limits the motor speed against the obstacle, which stops the desk after obstacle_depth of compression.
+ */
+static double obstacle_limit(column_t* p_column, double velocity)
+{
+    desk_params_t* p_params = &p_column->params;
+
+    if (isnan(p_params->obstacle) || velocity * p_params->obstacle_dir <= 0) {
+        return velocity;
+    }
+
+    double compression = (p_column->state.column - p_params->obstacle) * p_params->obstacle_dir;
+    if (compression <= 0) {
+        return velocity;
+    }
+
+    double depth = p_params->obstacle_depth > 1.0 ? p_params->obstacle_depth : 1.0;
+    double factor = compression >= depth ? 0.0 : 1.0 - compression / depth;
+    double limit = factor * (p_params->obstacle_dir > 0 ? p_params->speed_up : p_params->speed_down);
+
+    return fabs(velocity) > limit ? p_params->obstacle_dir * limit : velocity;
+}
+
+/**
+ * @brief   Moves the column after the motor within the backlash, and stops both at the end stops.
+ */
+static void update_column(column_t* p_column)
+{
+    desk_params_t* p_params = &p_column->params;
+    desk_state_t* p_state = &p_column->state;
+
+    if (p_state->column > p_state->motor) {
+        p_state->column = p_state->motor;
+    } else if (p_state->column < p_state->motor - p_params->backlash) {
+        p_state->column = p_state->motor - p_params->backlash;
+    }
+
+    if (p_state->column > p_params->upper) {
+        p_state->column = p_params->upper;
+        p_state->motor = p_params->upper + p_params->backlash;
+        if (p_state->velocity > 0) {
+            p_state->velocity = 0;
+            p_state->stop_hits++;
+        }
+    } else if (p_state->column < p_params->lower) {
+        p_state->column = p_params->lower;
+        p_state->motor = p_params->lower;
+        if (p_state->velocity < 0) {
+            p_state->velocity = 0;
+            p_state->stop_hits++;
+        }
+    }
+}
+
+static void update_sensor(uint8_t index)
+{
+    column_t* p_column = &m_columns[index];
+    uint64_t now = sim_time_us();
+
+    if (!p_column->params.sensor_dead) {
+        bool phase_a = ((int64_t)floor(p_column->state.motor / DESK_SUBTICKS_PER_TICK)) & 1;
+        bool phase_b = ((int64_t)floor((p_column->state.motor - DESK_SUBTICKS_PER_TICK / 2) / DESK_SUBTICKS_PER_TICK)) & 1;
+
+        if (phase_a != p_column->phase_a) {
+            p_column->state.edges++;
+        }
+        p_column->phase_a = phase_a;
+        p_column->phase_b = phase_b;
+    }
+
+    if (p_column->glitch_end_us == 0 && p_column->params.glitch_rate > 0 && p_column->state.velocity != 0
+        && random_unit() < p_column->params.glitch_rate * DESK_DT) {
+        p_column->glitch_end_us = now + p_column->params.glitch_us;
+        p_column->state.glitches++;
+    }
+
+    if (p_column->glitch_end_us != 0 && now >= p_column->glitch_end_us) {
+        p_column->glitch_end_us = 0;
+    }
+
+    sim_pin_input_set(m_phase_b_pins[index], p_column->phase_b);
+    sim_pin_input_set(m_phase_a_pins[index], p_column->phase_a != (p_column->glitch_end_us != 0));
+}
+
+static bool desk_active(void)
+{
+    for (uint8_t i = 0; i < m_column_count; i++) {
+        if (m_columns[i].state.velocity != 0 || m_columns[i].glitch_end_us != 0 || desk_is_driven(i)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void desk_step(void)
+{
+    uint64_t now = sim_time_us();
+
+    if (now >= m_next_noise_us) {
+        m_next_noise_us = now + DESK_NOISE_PERIOD_US;
+        for (uint8_t i = 0; i < m_column_count; i++) {
+            m_columns[i].noise = 1.0 + m_columns[i].params.load_noise * (2.0 * random_unit() - 1.0);
+        }
+    }
+
+    for (uint8_t i = 0; i < m_column_count; i++) {
+        column_t* p_column = &m_columns[i];
+        desk_state_t* p_state = &p_column->state;
+        double target = free_speed(i);
+
+        if (target != 0.0 || (drive_direction(i) == 0 && desk_is_driven(i))) {
+            p_state->velocity += (target - p_state->velocity) * DESK_DT * 1000.0 / p_column->params.tau_ms;
+        } else {
+            p_state->velocity -= p_state->velocity * DESK_DT * 1000.0 / p_column->params.coast_tau_ms;
+        }
+
+        if (target == 0.0 && fabs(p_state->velocity) < DESK_STICTION_SPEED) {
+            p_state->velocity = 0;
+        }
+
+        p_state->velocity = obstacle_limit(p_column, p_state->velocity);
+        p_state->motor += p_state->velocity * DESK_DT;
+        update_column(p_column);
+        update_sensor(i);
+    }
+}
+
+static uint16_t adc_source(void)
+{
+    double mv = desk_current_ma(0) * CURRENT_SENSE_MV_PER_A / 1000.0;
+    double raw = mv * DESK_ADC_MAX / DESK_ADC_REFERENCE_MV;
+
+    return raw > DESK_ADC_MAX ? DESK_ADC_MAX : (uint16_t)raw;
+}
+
+static const sim_device_t m_device = { desk_active, desk_step };
+
+/*===========================================================================*/
+/* Desk plant exported functions.                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Sets up columns of a typical desk at the lower end stop, and connects the plant to the simulator.
+ *          Should be called after sim_reset, before the firmware init.
+ */
+void desk_init(uint8_t column_count)
+{
+    memset(m_columns, 0, sizeof(m_columns));
+    m_column_count = column_count;
+    m_next_noise_us = 0;
+    m_random = 12345;
+
+    for (uint8_t i = 0; i < column_count; i++) {
+        desk_params_t* p_params = &m_columns[i].params;
+
+        p_params->speed_up = 13500;
+        p_params->speed_down = 14500;
+        p_params->dead_duty = 15;
+        p_params->tau_ms = 60;
+        p_params->coast_tau_ms = 25;
+        p_params->backlash = 0;
+        p_params->lower = TICK_LOWER_LIMIT * DESK_SUBTICKS_PER_TICK;
+        p_params->upper = TICKS_UPPER_LIMIT * DESK_SUBTICKS_PER_TICK;
+        p_params->obstacle = NAN;
+        p_params->obstacle_depth = 256;
+        p_params->obstacle_dir = -1;
+        p_params->glitch_us = 500;
+
+        m_columns[i].noise = 1.0;
+        desk_place(i, p_params->lower);
+    }
+
+    desk_attach();
+}
+
+/**
+ * @brief   Connects the plant to the simulator again after sim_reset, with the desk left where it was.
+ */
+void desk_attach(void)
+{
+    for (uint8_t i = 0; i < m_column_count; i++) {
+        sim_pin_input_set(m_phase_b_pins[i], m_columns[i].phase_b);
+        sim_pin_input_set(m_phase_a_pins[i], m_columns[i].phase_a);
+    }
+
+    sim_device_add(&m_device);
+    sim_adc_source_set(adc_source);
+}
+
+desk_params_t* desk_params(uint8_t column)
+{
+    return &m_columns[column].params;
+}
+
+desk_state_t const* desk_state(uint8_t column)
+{
+    return &m_columns[column].state;
+}
+
+/**
+ * @brief   Puts the column at rest at the position, with the backlash taken up downwards.
+ */
+void desk_place(uint8_t column, double position)
+{
+    column_t* p_column = &m_columns[column];
+
+    p_column->state.motor = position;
+    p_column->state.column = position;
+    p_column->state.velocity = 0;
+    p_column->phase_a = ((int64_t)floor(position / DESK_SUBTICKS_PER_TICK)) & 1;
+    p_column->phase_b = ((int64_t)floor((position - DESK_SUBTICKS_PER_TICK / 2) / DESK_SUBTICKS_PER_TICK)) & 1;
+
+    sim_pin_input_set(m_phase_b_pins[column], p_column->phase_b);
+    sim_pin_input_set(m_phase_a_pins[column], p_column->phase_a);
+}
+
+double desk_height(uint8_t column)
+{
+    return m_columns[column].state.column;
+}
+
+bool desk_is_moving(void)
+{
+    for (uint8_t i = 0; i < m_column_count; i++) {
+        if (m_columns[i].state.velocity != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief   Checks if any direction pin of the column is set, with any duty.
+ */
+bool desk_is_driven(uint8_t column)
+{
+    return sim_pin_get(m_up_pins[column]) || sim_pin_get(m_down_pins[column]);
+}
+
+/**
+ * @brief   Average supply current of the motor, rising from the free running to the stall current as back EMF falls
+ *          with the speed behind the unloaded one. Load, its variation and acceleration all draw current.
+ */
+double desk_current_ma(uint8_t column)
+{
+    column_t* p_column = &m_columns[column];
+    double duty = sim_pwm_duty_get(column) / 100.0;
+
+    if (drive_direction(column) == 0 || duty == 0) {
+        return 0;
+    }
+
+    double speed = fabs(drive_speed(column, false));
+    double slip = speed > 0 ? 1.0 - fabs(p_column->state.velocity) / speed : 1.0;
+
+    slip = slip < 0 ? 0 : (slip > 1 ? 1 : slip);
+
+    return duty * (DESK_FREE_CURRENT_MA + (DESK_STALL_CURRENT_MA - DESK_FREE_CURRENT_MA) * slip);
+}
@@ -0,0 +1,59 @@
+#ifndef DESK_H__
+#define DESK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Plant model of the desk: per column a DC motor with first order speed response to the PWM duty, run-down when
+ * released, gearbox backlash between the motor (with the tick sensor) and the column, end stops and compliant
+ * obstacles. Positions are in subticks (1/256 of tick), as in the controller, 0 at the lower end stop.
+ * Tick sensor phase A changes its level every tick, phase B lags it by a quarter of tick while moving up.
+ */
+
+#define DESK_COLUMNS_MAX 2
+#define DESK_SUBTICKS_PER_TICK 256
+
+typedef struct
+{
+    double speed_up; /* Speed at full duty, subticks per second */
+    double speed_down;
+    double dead_duty; /* Duty in percent, which only overcomes friction */
+    double tau_ms; /* Time constant of the speed while driven */
+    double coast_tau_ms; /* Time constant of the run-down, when the motor is released */
+    double backlash; /* Motor travel taken up after reversal before the column follows, subticks */
+    double lower; /* End stops of the column, subticks */
+    double upper;
+    double obstacle; /* Column position where an obstacle is met, NAN without one */
+    double obstacle_depth; /* Compression of the obstacle which stops the desk, subticks */
+    int8_t obstacle_dir; /* Direction of movement against the obstacle, 1 up, -1 down */
+    double load; /* Fraction of the speed lost while moving up */
+    double load_noise; /* Random variation of the speed, as fraction, changed every 50 ms */
+    bool swapped; /* Motor leads swapped */
+    bool sensor_dead; /* Tick sensor outputs are stuck */
+    double glitch_rate; /* Spurious pulses on phase A per second, while moving */
+    uint32_t glitch_us; /* Width of the spurious pulses */
+} desk_params_t;
+
+typedef struct
+{
+    double motor; /* Position of the motor side, seen by the tick sensor */
+    double column; /* Position of the countertop */
+    double velocity; /* Motor speed, subticks per second */
+    uint32_t edges; /* Real edges of phase A */
+    uint32_t glitches; /* Spurious pulses injected on phase A */
+    uint32_t stop_hits; /* Times the column was driven into an end stop */
+} desk_state_t;
+
+void desk_init(uint8_t column_count);
+void desk_attach(void);
+desk_params_t* desk_params(uint8_t column);
+desk_state_t const* desk_state(uint8_t column);
+
+void desk_place(uint8_t column, double position);
+double desk_height(uint8_t column);
+bool desk_is_moving(void);
+bool desk_is_driven(uint8_t column);
+double desk_current_ma(uint8_t column);
+
+#endif
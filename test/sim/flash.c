@@ -0,0 +1,141 @@
+#include "sim.h"
+#include "m45pe_drv.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*===========================================================================*/
+/* Flash emulator local definitions.                                         */
+/*===========================================================================*/
+
+#define FLASH_PAGE_COUNT (SIM_FLASH_SIZE / M45PE_PAGE_SIZE)
+#define FLASH_KEY_LENGTH_MAX 8 /* Longest m45pe_write, the driver has 8 bytes of data in its buffer */
+
+/*===========================================================================*/
+/* Flash emulator local variables and types.                                 */
+/*===========================================================================*/
+
+static uint8_t m_data[SIM_FLASH_SIZE];
+static uint32_t m_erase_counts[FLASH_PAGE_COUNT];
+static uint32_t m_program_count;
+static uint32_t m_key_write_count;
+
+/*===========================================================================*/
+/* Flash emulator local functions.                                           */
+/*===========================================================================*/
+
+/**
+ * @brief   Access out of the chip or longer than the driver buffers is a firmware bug, so it ends the test.
+ */
+static void check_range(uint32_t address, uint32_t len, uint32_t limit, char const* p_operation)
+{
+    if (address >= SIM_FLASH_SIZE || address + len > SIM_FLASH_SIZE || len > limit) {
+        fprintf(stderr, "flash: %s of %u bytes at 0x%06x out of range\n", p_operation, len, address);
+        exit(2);
+    }
+}
+
+/*===========================================================================*/
+/* Flash emulator exported functions.                                        */
+/*===========================================================================*/
+
+/**
+ * @brief   Erases whole memory and clears the wear counters, as a new chip.
+ */
+void sim_flash_reset(void)
+{
+    memset(m_data, 0xFF, sizeof(m_data));
+    memset(m_erase_counts, 0, sizeof(m_erase_counts));
+    m_program_count = 0;
+    m_key_write_count = 0;
+}
+
+uint8_t* sim_flash_data(void)
+{
+    return m_data;
+}
+
+uint32_t sim_flash_erase_count_get(uint32_t page)
+{
+    return m_erase_counts[page];
+}
+
+uint32_t sim_flash_total_erase_count_get(void)
+{
+    uint32_t total = 0;
+
+    for (uint32_t i = 0; i < FLASH_PAGE_COUNT; i++) {
+        total += m_erase_counts[i];
+    }
+
+    return total;
+}
+
+uint32_t sim_flash_program_count_get(void)
+{
+    return m_program_count;
+}
+
+uint32_t sim_flash_key_write_count_get(void)
+{
+    return m_key_write_count;
+}
+
+/*===========================================================================*/
+/* Driver stand-in.                                                          */
+/*===========================================================================*/
+
+void m45_init()
+{
+}
+
+/**
+ * @brief   Page write of the settings page: written bytes are replaced, whatever was there before.
+ */
+void m45pe_write(uint8_t key, uint8_t* val, uint8_t len)
+{
+    check_range(key, len, FLASH_KEY_LENGTH_MAX, "write");
+
+    memcpy(&m_data[key], val, len);
+    m_key_write_count++;
+    m_erase_counts[0]++;
+}
+
+void m45pe_read(uint8_t key, uint8_t* val, uint8_t len)
+{
+    check_range(key, len, FLASH_KEY_LENGTH_MAX, "read");
+
+    memcpy(val, &m_data[key], len);
+}
+
+void m45pe_read_at(uint32_t address, uint8_t* val, uint8_t len)
+{
+    check_range(address, len, M45PE_BULK_LENGTH, "read");
+
+    memcpy(val, &m_data[address], len);
+}
+
+/**
+ * @brief   Page program: bits can only be cleared, and the address wraps within the page like in the chip.
+ */
+void m45pe_program(uint32_t address, uint8_t const* val, uint8_t len)
+{
+    uint32_t page = address & ~(uint32_t)(M45PE_PAGE_SIZE - 1);
+
+    check_range(address, len, M45PE_BULK_LENGTH, "program");
+
+    for (uint8_t i = 0; i < len; i++) {
+        m_data[page + ((address + i) & (M45PE_PAGE_SIZE - 1))] &= val[i];
+    }
+
+    m_program_count++;
+}
+
+void m45pe_erase_page(uint32_t address)
+{
+    uint32_t page = address / M45PE_PAGE_SIZE;
+
+    check_range(address, 0, 0, "erase");
+    memset(&m_data[page * M45PE_PAGE_SIZE], 0xFF, M45PE_PAGE_SIZE);
+    m_erase_counts[page]++;
+}
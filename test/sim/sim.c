@@ -0,0 +1,677 @@
+#include "sim.h"
+#include "app_timer.h"
+#include "bsp.h"
+#include "nrf_drv_adc.h"
+#include "nrf_drv_ppi.h"
+#include "nrf_drv_qdec.h"
+#include "nrf_drv_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*===========================================================================*/
+/* Simulator local definitions.                                              */
+/*===========================================================================*/
+
+#define SIM_RTC_MASK 0x00FFFFFF /* RTC1 counter is 24 bits wide */
+#define SIM_DEVICES_MAX 8
+#define SIM_TIMER_BURST_MAX 64 /* Timeouts fired in one step, more means a timer restarting itself with zero interval */
+#define SIM_PWM_CHANNELS 2
+#define SIM_QDEC_RESYNC_US 1000000 /* Idle gap after which the QDEC sampling is not replayed */
+
+static const uint16_t m_qdec_report_samples[] = { 10, 40, 80, 120, 160, 200, 240, 280 };
+
+/*===========================================================================*/
+/* Simulator local variables and types.                                      */
+/*===========================================================================*/
+
+static uint64_t m_ticks;
+static bool m_woken;
+static uint32_t m_errors;
+static void (*m_main_loop)(void);
+static sim_device_t const* m_devices[SIM_DEVICES_MAX];
+static uint8_t m_device_count;
+static app_timer_t* m_timers; /* Created timers, linked in order of creation */
+
+static bool m_pin_levels[SIM_PIN_COUNT];
+static nrf_drv_gpiote_evt_handler_t m_pin_handlers[SIM_PIN_COUNT];
+static bool m_pin_events[SIM_PIN_COUNT];
+static uint16_t m_pwm_duty[SIM_PWM_CHANNELS];
+
+static struct
+{
+    qdec_event_handler_t handler;
+    nrf_drv_qdec_config_t config;
+    bool enabled;
+    uint8_t phase; /* Position in the Gray code cycle of the last sample */
+    uint64_t next_sample_us;
+    uint16_t samples; /* Samples of the report period in progress */
+    int16_t acc;
+    uint16_t accdbl;
+    uint32_t doubles; /* All double transitions since reset */
+} m_qdec;
+
+static struct
+{
+    nrf_drv_adc_event_handler_t handler;
+    nrf_adc_value_t* p_buffer;
+    uint16_t size;
+    uint16_t index;
+    uint16_t (*source)(void);
+    uint32_t period_us;
+    bool timer_enabled;
+    bool ppi_enabled;
+    uint64_t next_sample_us;
+    uint32_t samples;
+} m_adc;
+
+/*===========================================================================*/
+/* Simulator local functions.                                                */
+/*===========================================================================*/
+
+static bool device_active(void)
+{
+    for (uint8_t i = 0; i < m_device_count; i++) {
+        if (m_devices[i]->active()) {
+            return true;
+        }
+    }
+
+    return (m_qdec.enabled && (m_qdec.acc != 0 || m_qdec.accdbl != 0))
+        || (m_adc.timer_enabled && m_adc.ppi_enabled);
+}
+
+static bool next_expiry(uint64_t* p_expiry)
+{
+    bool found = false;
+
+    for (app_timer_t* p_timer = m_timers; p_timer != NULL; p_timer = p_timer->p_next) {
+        if (p_timer->running && (!found || p_timer->expiry < *p_expiry)) {
+            *p_expiry = p_timer->expiry;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * @brief   Fires timeouts due at the current time, earliest first, and in order of creation for the same expiry.
+ */
+static void fire_timers(void)
+{
+    for (uint32_t burst = 0; burst < SIM_TIMER_BURST_MAX; burst++) {
+        app_timer_t* p_due = NULL;
+
+        for (app_timer_t* p_timer = m_timers; p_timer != NULL; p_timer = p_timer->p_next) {
+            if (p_timer->running && p_timer->expiry <= m_ticks && (p_due == NULL || p_timer->expiry < p_due->expiry)) {
+                p_due = p_timer;
+            }
+        }
+
+        if (p_due == NULL) {
+            return;
+        }
+
+        if (p_due->mode == APP_TIMER_MODE_REPEATED) {
+            p_due->expiry += p_due->interval;
+        } else {
+            p_due->running = false;
+        }
+
+        m_woken = true;
+        p_due->handler(p_due->p_context);
+    }
+
+    fprintf(stderr, "sim: timers keep expiring at %u ms\n", sim_time_ms());
+    m_errors++;
+}
+
+static uint8_t qdec_phase(void)
+{
+    static const uint8_t gray_to_phase[] = { 0, 3, 1, 2 }; /* Indexed by A << 1 | B, A leads while counting up */
+
+    return gray_to_phase[m_pin_levels[m_qdec.config.psela] << 1 | m_pin_levels[m_qdec.config.pselb]];
+}
+
+static void qdec_sample(void)
+{
+    uint8_t phase = qdec_phase();
+    uint8_t delta = (uint8_t)(phase - m_qdec.phase) & 0x03;
+
+    m_qdec.phase = phase;
+
+    if (delta == 1) {
+        m_qdec.acc++;
+    } else if (delta == 3) {
+        m_qdec.acc--;
+    } else if (delta == 2) {
+        m_qdec.accdbl++;
+        m_qdec.doubles++;
+    }
+
+    if (++m_qdec.samples < m_qdec_report_samples[m_qdec.config.reportper]) {
+        return;
+    }
+
+    m_qdec.samples = 0;
+
+    /* REPORTRDY only for reports with motion, cleared by the READCLRACC short */
+    if (m_qdec.acc != 0 || m_qdec.accdbl != 0) {
+        nrf_drv_qdec_event_t event;
+
+        event.type = NRF_QDEC_EVENT_REPORTRDY;
+        event.data.report.acc = m_qdec.acc;
+        event.data.report.accdbl = m_qdec.accdbl;
+        m_qdec.acc = 0;
+        m_qdec.accdbl = 0;
+
+        m_woken = true;
+        m_qdec.handler(event);
+    }
+}
+
+static void qdec_step(void)
+{
+    uint32_t sample_us = 128u << m_qdec.config.sampleper;
+    uint64_t now = sim_time_us();
+
+    if (!m_qdec.enabled) {
+        return;
+    }
+
+    if (now > m_qdec.next_sample_us + SIM_QDEC_RESYNC_US) {
+        /* Idle gap with no motion, only the position in the report period is kept */
+        uint64_t skipped = (now - m_qdec.next_sample_us) / sample_us;
+
+        m_qdec.samples = (uint16_t)((m_qdec.samples + skipped) % m_qdec_report_samples[m_qdec.config.reportper]);
+        m_qdec.next_sample_us += skipped * sample_us;
+    }
+
+    while (m_qdec.next_sample_us <= now) {
+        m_qdec.next_sample_us += sample_us;
+        qdec_sample();
+    }
+}
+
+static void adc_step(void)
+{
+    uint64_t now = sim_time_us();
+
+    if (!m_adc.timer_enabled || !m_adc.ppi_enabled) {
+        m_adc.next_sample_us = now + m_adc.period_us;
+        return;
+    }
+
+    while (m_adc.next_sample_us <= now) {
+        m_adc.next_sample_us += m_adc.period_us;
+
+        if (m_adc.p_buffer == NULL) {
+            continue; /* START task with no buffer queued is lost */
+        }
+
+        m_adc.samples++;
+        m_adc.p_buffer[m_adc.index++] = m_adc.source != NULL ? (nrf_adc_value_t)m_adc.source() : 0;
+
+        if (m_adc.index == m_adc.size) {
+            nrf_drv_adc_evt_t event;
+
+            event.type = NRF_DRV_ADC_EVT_DONE;
+            event.data.done.p_buffer = m_adc.p_buffer;
+            event.data.done.size = m_adc.size;
+            m_adc.p_buffer = NULL;
+
+            m_woken = true;
+            m_adc.handler(&event);
+        }
+    }
+}
+
+/*===========================================================================*/
+/* Simulator exported functions.                                             */
+/*===========================================================================*/
+
+void sim_reset(void)
+{
+    m_ticks = 0;
+    m_woken = false;
+    m_main_loop = NULL;
+    m_device_count = 0;
+    m_timers = NULL;
+
+    memset(m_pin_levels, 0, sizeof(m_pin_levels));
+    memset(m_pin_handlers, 0, sizeof(m_pin_handlers));
+    memset(m_pin_events, 0, sizeof(m_pin_events));
+    memset(m_pwm_duty, 0, sizeof(m_pwm_duty));
+    memset(&m_qdec, 0, sizeof(m_qdec));
+    memset(&m_adc, 0, sizeof(m_adc));
+
+    sim_ble_reset();
+}
+
+void sim_device_add(sim_device_t const* p_device)
+{
+    if (m_device_count < SIM_DEVICES_MAX) {
+        m_devices[m_device_count++] = p_device;
+    }
+}
+
+void sim_main_loop_set(void (*main_loop)(void))
+{
+    m_main_loop = main_loop;
+}
+
+uint64_t sim_time_ticks(void)
+{
+    return m_ticks;
+}
+
+uint64_t sim_time_us(void)
+{
+    return m_ticks * 1000000 / SIM_RTC_FREQ;
+}
+
+uint32_t sim_time_ms(void)
+{
+    return (uint32_t)(m_ticks * 1000 / SIM_RTC_FREQ);
+}
+
+void sim_wake(void)
+{
+    m_woken = true;
+}
+
+uint32_t sim_errors_get(void)
+{
+    return m_errors;
+}
+
+/**
+ * @brief   Advances the time by the given number of RTC ticks.
+ */
+void sim_run_ticks(uint64_t ticks)
+{
+    uint64_t end = m_ticks + ticks;
+
+    while (m_ticks < end) {
+        uint64_t next = end;
+        uint64_t expiry = end;
+
+        if (device_active()) {
+            next = m_ticks + 1;
+        } else if (next_expiry(&expiry) && expiry < end) {
+            next = expiry > m_ticks ? expiry : m_ticks + 1;
+        }
+
+        m_ticks = next;
+
+        for (uint8_t i = 0; i < m_device_count; i++) {
+            m_devices[i]->step();
+        }
+        qdec_step();
+        adc_step();
+        fire_timers();
+
+        if (m_woken) {
+            m_woken = false;
+            if (m_main_loop != NULL) {
+                m_main_loop();
+            }
+        }
+    }
+}
+
+void sim_run_ms(uint32_t ms)
+{
+    sim_run_ticks(SIM_MS_TO_TICKS(ms));
+}
+
+/**
+ * @brief   Runs until the condition holds, checked after each main loop pass and every millisecond.
+ *
+ * @return  True if the condition was met within the timeout.
+ */
+bool sim_run_until(bool (*condition)(void), uint32_t timeout_ms)
+{
+    uint64_t end = m_ticks + SIM_MS_TO_TICKS(timeout_ms);
+
+    while (m_ticks < end) {
+        if (condition()) {
+            return true;
+        }
+        sim_run_ticks(SIM_MS_TO_TICKS(1) < end - m_ticks ? SIM_MS_TO_TICKS(1) : end - m_ticks);
+    }
+
+    return condition();
+}
+
+void sim_pin_input_set(uint32_t pin, bool level)
+{
+    if (m_pin_levels[pin] == level) {
+        return;
+    }
+
+    m_pin_levels[pin] = level;
+
+    if (m_pin_events[pin] && m_pin_handlers[pin] != NULL) {
+        m_woken = true;
+        m_pin_handlers[pin](pin, NRF_GPIOTE_POLARITY_TOGGLE);
+    }
+}
+
+bool sim_pin_get(uint32_t pin)
+{
+    return m_pin_levels[pin];
+}
+
+uint16_t sim_pwm_duty_get(uint8_t channel)
+{
+    return m_pwm_duty[channel];
+}
+
+uint32_t sim_qdec_double_count_get(void)
+{
+    return m_qdec.doubles;
+}
+
+void sim_adc_source_set(uint16_t (*source)(void))
+{
+    m_adc.source = source;
+}
+
+uint32_t sim_adc_sample_count_get(void)
+{
+    return m_adc.samples;
+}
+
+/*===========================================================================*/
+/* SDK stand-in: errors and BSP.                                             */
+/*===========================================================================*/
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t* p_file_name)
+{
+    fprintf(stderr, "%s:%u: app error 0x%x\n", (const char*)p_file_name, line_num, error_code);
+    exit(2);
+}
+
+uint32_t bsp_event_to_button_action_assign(uint32_t button, bsp_button_action_t action, bsp_event_t event)
+{
+    return NRF_SUCCESS;
+}
+
+/*===========================================================================*/
+/* SDK stand-in: app_timer.                                                  */
+/*===========================================================================*/
+
+uint32_t app_timer_create(app_timer_id_t const* p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler)
+{
+    app_timer_t* p_timer = *p_timer_id;
+    app_timer_t* p_node;
+
+    p_timer->handler = timeout_handler;
+    p_timer->mode = mode;
+    p_timer->running = false;
+
+    for (p_node = m_timers; p_node != NULL; p_node = p_node->p_next) {
+        if (p_node == p_timer) {
+            return NRF_SUCCESS; /* Created again after a simulated reboot */
+        }
+    }
+
+    p_timer->p_next = NULL;
+    if (m_timers == NULL) {
+        m_timers = p_timer;
+    } else {
+        for (p_node = m_timers; p_node->p_next != NULL; p_node = p_node->p_next)
+            ;
+        p_node->p_next = p_timer;
+    }
+
+    return NRF_SUCCESS;
+}
+
+/**
+ * @brief   Starts the timer. Like the SDK 11 app_timer, start of a running timer is ignored.
+ */
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void* p_context)
+{
+    if (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS || timer_id->handler == NULL) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    if (timer_id->running) {
+        return NRF_SUCCESS;
+    }
+
+    timer_id->p_context = p_context;
+    timer_id->interval = timeout_ticks;
+    timer_id->expiry = m_ticks + timeout_ticks;
+    timer_id->running = true;
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop(app_timer_id_t timer_id)
+{
+    timer_id->running = false;
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(uint32_t* p_ticks)
+{
+    *p_ticks = (uint32_t)(m_ticks & SIM_RTC_MASK);
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t* p_ticks_diff)
+{
+    *p_ticks_diff = (ticks_to - ticks_from) & SIM_RTC_MASK;
+    return NRF_SUCCESS;
+}
+
+/*===========================================================================*/
+/* SDK stand-in: GPIO, GPIOTE and PWM.                                       */
+/*===========================================================================*/
+
+uint32_t nrf_drv_gpiote_init(void)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_gpiote_in_init(nrf_drv_gpiote_pin_t pin, nrf_drv_gpiote_in_config_t const* p_config, nrf_drv_gpiote_evt_handler_t evt_handler)
+{
+    m_pin_handlers[pin] = evt_handler;
+    return NRF_SUCCESS;
+}
+
+void nrf_drv_gpiote_in_event_enable(nrf_drv_gpiote_pin_t pin, bool int_enable)
+{
+    m_pin_events[pin] = int_enable;
+}
+
+void nrf_drv_gpiote_in_event_disable(nrf_drv_gpiote_pin_t pin)
+{
+    m_pin_events[pin] = false;
+}
+
+uint32_t nrf_drv_gpiote_out_init(nrf_drv_gpiote_pin_t pin, nrf_drv_gpiote_out_config_t const* p_config)
+{
+    m_pin_levels[pin] = p_config->init_state;
+    return NRF_SUCCESS;
+}
+
+void nrf_drv_gpiote_out_set(nrf_drv_gpiote_pin_t pin)
+{
+    m_pin_levels[pin] = true;
+}
+
+void nrf_drv_gpiote_out_clear(nrf_drv_gpiote_pin_t pin)
+{
+    m_pin_levels[pin] = false;
+}
+
+uint32_t nrf_gpio_pin_read(uint32_t pin_number)
+{
+    return m_pin_levels[pin_number];
+}
+
+void nrf_gpio_cfg_input(uint32_t pin_number, nrf_gpio_pin_pull_t pull_config)
+{
+}
+
+ret_code_t app_pwm_init(app_pwm_t const* p_instance, app_pwm_config_t const* p_config, app_pwm_callback_t p_ready_callback)
+{
+    memset(m_pwm_duty, 0, sizeof(m_pwm_duty));
+    return NRF_SUCCESS;
+}
+
+void app_pwm_enable(app_pwm_t const* p_instance)
+{
+}
+
+void app_pwm_disable(app_pwm_t const* p_instance)
+{
+}
+
+ret_code_t app_pwm_channel_duty_set(app_pwm_t const* p_instance, uint8_t channel, app_pwm_duty_t duty)
+{
+    if (channel >= SIM_PWM_CHANNELS || duty > 100) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    m_pwm_duty[channel] = duty;
+    return NRF_SUCCESS;
+}
+
+app_pwm_duty_t app_pwm_channel_duty_get(app_pwm_t const* p_instance, uint8_t channel)
+{
+    return m_pwm_duty[channel];
+}
+
+/*===========================================================================*/
+/* SDK stand-in: QDEC.                                                       */
+/*===========================================================================*/
+
+ret_code_t nrf_drv_qdec_init(nrf_drv_qdec_config_t const* p_config, qdec_event_handler_t event_handler)
+{
+    m_qdec.config = *p_config;
+    m_qdec.handler = event_handler;
+    m_qdec.enabled = false;
+    return NRF_SUCCESS;
+}
+
+void nrf_drv_qdec_enable(void)
+{
+    m_qdec.enabled = true;
+    m_qdec.phase = qdec_phase();
+    m_qdec.samples = 0;
+    m_qdec.acc = 0;
+    m_qdec.accdbl = 0;
+    m_qdec.next_sample_us = sim_time_us();
+}
+
+void nrf_drv_qdec_disable(void)
+{
+    m_qdec.enabled = false;
+}
+
+void nrf_drv_qdec_accumulators_read(int16_t* p_acc, int16_t* p_accdbl)
+{
+    *p_acc = m_qdec.acc;
+    *p_accdbl = (int16_t)m_qdec.accdbl;
+    m_qdec.acc = 0;
+    m_qdec.accdbl = 0;
+}
+
+/*===========================================================================*/
+/* SDK stand-in: ADC sampled by TIMER1 compare through PPI.                  */
+/*===========================================================================*/
+
+ret_code_t nrf_drv_adc_init(nrf_drv_adc_config_t const* p_config, nrf_drv_adc_event_handler_t event_handler)
+{
+    m_adc.handler = event_handler;
+    m_adc.p_buffer = NULL;
+    return NRF_SUCCESS;
+}
+
+void nrf_drv_adc_channel_enable(nrf_drv_adc_channel_t* const p_channel)
+{
+}
+
+ret_code_t nrf_drv_adc_buffer_convert(nrf_adc_value_t* buffer, uint16_t size)
+{
+    if (m_adc.p_buffer != NULL) {
+        return NRF_ERROR_BUSY;
+    }
+
+    m_adc.p_buffer = buffer;
+    m_adc.size = size;
+    m_adc.index = 0;
+    return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_adc_start_task_get(void)
+{
+    return 0;
+}
+
+ret_code_t nrf_drv_timer_init(nrf_drv_timer_t const* p_instance, nrf_drv_timer_config_t const* p_config, nrf_timer_event_handler_t timer_event_handler)
+{
+    return NRF_SUCCESS;
+}
+
+/* Timer runs at 1 MHz */
+uint32_t nrf_drv_timer_us_to_ticks(nrf_drv_timer_t const* p_instance, uint32_t time_us)
+{
+    return time_us;
+}
+
+void nrf_drv_timer_extended_compare(nrf_drv_timer_t const* p_instance, nrf_timer_cc_channel_t cc_channel, uint32_t cc_value, nrf_timer_short_mask_t timer_short_mask, bool enable_int)
+{
+    m_adc.period_us = cc_value;
+}
+
+uint32_t nrf_drv_timer_compare_event_address_get(nrf_drv_timer_t const* p_instance, nrf_timer_cc_channel_t channel)
+{
+    return 0;
+}
+
+void nrf_drv_timer_enable(nrf_drv_timer_t const* p_instance)
+{
+    if (!m_adc.timer_enabled) {
+        m_adc.timer_enabled = true;
+        m_adc.next_sample_us = sim_time_us() + m_adc.period_us;
+    }
+}
+
+void nrf_drv_timer_disable(nrf_drv_timer_t const* p_instance)
+{
+    m_adc.timer_enabled = false;
+}
+
+ret_code_t nrf_drv_ppi_init(void)
+{
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_drv_ppi_channel_alloc(nrf_ppi_channel_t* p_channel)
+{
+    *p_channel = 0;
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_drv_ppi_channel_assign(nrf_ppi_channel_t channel, uint32_t eep, uint32_t tep)
+{
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_drv_ppi_channel_enable(nrf_ppi_channel_t channel)
+{
+    m_adc.ppi_enabled = true;
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_drv_ppi_channel_disable(nrf_ppi_channel_t channel)
+{
+    m_adc.ppi_enabled = false;
+    return NRF_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#ifndef SIM_H__
+#define SIM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Host simulation of the nRF51 peripherals used by the firmware: RTC1 with app_timer, GPIO with GPIOTE, PWM, QDEC,
+ * ADC sampled by TIMER1 through PPI, the external flash and the SoftDevice GATT server. Time advances only in
+ * sim_run_*, in steps of one RTC tick while any device (desk plant, running sampling) is active, otherwise straight to
+ * the next timer expiry. Interrupt handlers run to completion, the main loop hook runs after each batch of them,
+ * like after the wake-up from sd_app_evt_wait.
+ */
+
+#define SIM_RTC_FREQ 32768
+#define SIM_PIN_COUNT 32
+#define SIM_MS_TO_TICKS(MS) ((uint64_t)(MS) * SIM_RTC_FREQ / 1000)
+
+typedef struct
+{
+    bool (*active)(void); /* Device needs stepping by single RTC ticks */
+    void (*step)(void); /* Called after each RTC tick while active, with sim_time_us updated */
+} sim_device_t;
+
+/*===========================================================================*/
+/* Time and event loop.                                                      */
+/*===========================================================================*/
+
+void sim_reset(void);
+void sim_device_add(sim_device_t const* p_device);
+void sim_main_loop_set(void (*main_loop)(void));
+
+uint64_t sim_time_ticks(void);
+uint64_t sim_time_us(void);
+uint32_t sim_time_ms(void);
+
+void sim_run_ticks(uint64_t ticks);
+void sim_run_ms(uint32_t ms);
+bool sim_run_until(bool (*condition)(void), uint32_t timeout_ms);
+
+/** Marks that an interrupt handler ran, so the main loop hook is called after the current step */
+void sim_wake(void);
+
+uint32_t sim_errors_get(void);
+
+/*===========================================================================*/
+/* Pins and PWM.                                                             */
+/*===========================================================================*/
+
+void sim_pin_input_set(uint32_t pin, bool level);
+bool sim_pin_get(uint32_t pin);
+uint16_t sim_pwm_duty_get(uint8_t channel);
+
+/*===========================================================================*/
+/* QDEC and ADC.                                                             */
+/*===========================================================================*/
+
+uint32_t sim_qdec_double_count_get(void);
+void sim_adc_source_set(uint16_t (*source)(void));
+uint32_t sim_adc_sample_count_get(void);
+
+/*===========================================================================*/
+/* External flash.                                                           */
+/*===========================================================================*/
+
+#define SIM_FLASH_SIZE (1024 * 1024)
+
+void sim_flash_reset(void);
+uint8_t* sim_flash_data(void);
+uint32_t sim_flash_erase_count_get(uint32_t page);
+uint32_t sim_flash_total_erase_count_get(void);
+uint32_t sim_flash_program_count_get(void);
+uint32_t sim_flash_key_write_count_get(void);
+
+/*===========================================================================*/
+/* SoftDevice.                                                               */
+/*===========================================================================*/
+
+typedef void (*sim_ble_notify_handler_t)(uint16_t handle, uint8_t const* p_data, uint16_t len);
+
+void sim_ble_reset(void);
+void sim_ble_notify_handler_set(sim_ble_notify_handler_t handler);
+void sim_ble_tx_buffers_set(uint8_t count);
+uint8_t sim_ble_tx_complete(void);
+uint32_t sim_ble_notification_count_get(void);
+uint16_t sim_ble_value_get(uint16_t handle, uint8_t* p_data, uint16_t max_len);
+
+#endif
@@ -0,0 +1,104 @@
+#include "app.h"
+#include "calibration.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+
+/**
+ * Gear backlash between the motor with the tick sensor and the column: the same target approached from below and from
+ * above, over repeated up and down cycles, with the plant backlash configured in the calibration and without it. The
+ * column has to land on the same height from both sides and must not drift over the cycles.
+ */
+
+#define BACKLASH 384 /* Plant backlash, one and a half tick, in subticks */
+#define CYCLES 10
+#define WARM_UP_MOVES 8
+
+typedef struct
+{
+    double from_below; /* Mean column height at rest on the target, relative to the middle of the target tick */
+    double from_above;
+    double drift; /* Change of the column height at rest from above, first to last cycle */
+} landing_t;
+
+static void setup(int16_t position, uint16_t backlash)
+{
+    calibration_t calibration;
+
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    desk_params(0)->backlash = BACKLASH;
+    app_boot_at(position);
+
+    calibration = *calibration_get();
+    calibration.backlash = backlash;
+    CHECK(calibration_set(&calibration));
+}
+
+static double move_to(int16_t position)
+{
+    controller_target_position_set(position);
+    CHECK(app_wait_rest(60000));
+
+    return desk_height(0) - (position * DESK_SUBTICKS_PER_TICK + DESK_SUBTICKS_PER_TICK / 2);
+}
+
+/**
+ * @brief   Approaches the target alternately from below and from above, returns where the column rests.
+ */
+static landing_t cycle(int16_t target, uint16_t backlash)
+{
+    landing_t landing = { 0 };
+    double first = 0;
+
+    setup(target, backlash);
+
+    /* Dynamics are learned first, so the desk rests on the target tick */
+    for (uint8_t i = 0; i < WARM_UP_MOVES; i++) {
+        move_to(i % 2 ? target - 100 : target + 100);
+    }
+
+    for (uint8_t i = 0; i < CYCLES; i++) {
+        move_to(target - 100);
+        landing.from_below += move_to(target);
+        move_to(target + 100);
+
+        double from_above = move_to(target);
+
+        first = i == 0 ? from_above : first;
+        landing.from_above += from_above;
+        landing.drift = from_above - first;
+    }
+
+    landing.from_below /= CYCLES;
+    landing.from_above /= CYCLES;
+
+    return landing;
+}
+
+static void test_cycles(void)
+{
+    landing_t ignored = cycle(300, 0);
+    landing_t compensated = cycle(300, BACKLASH);
+
+    REPORT("backlash %d subticks not calibrated: column rests %.0f from below, %.0f from above, drift %.0f subticks",
+        BACKLASH, ignored.from_below, ignored.from_above, ignored.drift);
+    REPORT("backlash %d subticks calibrated: column rests %.0f from below, %.0f from above, drift %.0f subticks", BACKLASH,
+        compensated.from_below, compensated.from_above, compensated.drift);
+
+    /* Uncompensated, the column stays short by the backlash when approached from below */
+    CHECK(ignored.from_above - ignored.from_below > BACKLASH / 2);
+    CHECK(fabs(compensated.from_above - compensated.from_below) < DESK_SUBTICKS_PER_TICK);
+    CHECK(fabs(compensated.from_below) < DESK_SUBTICKS_PER_TICK / 2);
+    CHECK(fabs(compensated.from_above) < DESK_SUBTICKS_PER_TICK / 2);
+    CHECK(fabs(compensated.drift) < DESK_SUBTICKS_PER_TICK / 2);
+}
+
+int main(void)
+{
+    test_cycles();
+
+    return check_result("test_backlash");
+}
@@ -0,0 +1,237 @@
+#include "app.h"
+#include "calibration.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "presets.h"
+#include "sim.h"
+
+/**
+ * Local buttons driven by simulated BSP events on the plant: single and double press preset recall with the time the
+ * gesture takes to be recognized, long press jog with its release, press which stops a movement, and buttons held at
+ * the desk limits, where the desk must stop once and not hunt around the limit.
+ */
+
+#define EVT_UP_PUSH BSP_EVENT_KEY_2
+#define EVT_DOWN_PUSH BSP_EVENT_KEY_3
+#define EVT_UP_RELEASE BSP_EVENT_KEY_4
+#define EVT_DOWN_RELEASE BSP_EVENT_KEY_5
+
+#define CLICK_MS 80 /* Time the button is held on a press */
+
+static const uint8_t m_up_pin = 16;
+static const uint8_t m_down_pin = 15;
+
+typedef struct
+{
+    uint32_t up_starts; /* Motor leg switched on */
+    uint32_t down_starts;
+    uint32_t first_start_ms; /* Time of the first start since the watch began */
+} motor_watch_t;
+
+static motor_watch_t m_watch;
+static bool m_up_driven;
+static bool m_down_driven;
+static uint32_t m_watch_start;
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+}
+
+static void watch_start(void)
+{
+    m_watch = (motor_watch_t){ 0 };
+    m_up_driven = sim_pin_get(m_up_pin);
+    m_down_driven = sim_pin_get(m_down_pin);
+    m_watch_start = sim_time_ms();
+}
+
+/**
+ * @brief   Runs the simulation and counts starts of the motor legs.
+ */
+static void run_watched(uint32_t duration_ms)
+{
+    for (uint32_t i = 0; i < duration_ms; i++) {
+        sim_run_ms(1);
+
+        bool up = sim_pin_get(m_up_pin);
+        bool down = sim_pin_get(m_down_pin);
+
+        if ((up && !m_up_driven) || (down && !m_down_driven)) {
+            if (m_watch.up_starts + m_watch.down_starts == 0) {
+                m_watch.first_start_ms = sim_time_ms() - m_watch_start;
+            }
+            m_watch.up_starts += up && !m_up_driven ? 1 : 0;
+            m_watch.down_starts += down && !m_down_driven ? 1 : 0;
+        }
+
+        m_up_driven = up;
+        m_down_driven = down;
+    }
+}
+
+static void click(bsp_event_t push, bsp_event_t release)
+{
+    app_button(push);
+    run_watched(CLICK_MS);
+    app_button(release);
+}
+
+static void hold(bsp_event_t push, bsp_event_t release, uint32_t duration_ms)
+{
+    app_button(push);
+    run_watched(duration_ms);
+    app_button(release);
+}
+
+static void test_single_press(void)
+{
+    setup(300);
+    presets_save(1, 400 * CTRL_SUBTICK_SCALE);
+    presets_save(0, 200 * CTRL_SUBTICK_SCALE);
+
+    watch_start();
+    click(EVT_UP_PUSH, EVT_UP_RELEASE);
+    run_watched(1000);
+
+    REPORT("single press up: motor started %u ms after the push", m_watch.first_start_ms);
+    /* Press is single once the double press time passed after the release */
+    CHECK(m_watch.first_start_ms >= CLICK_MS + BUTTON_CTRL_DOUBLE_PRESS_MS);
+    CHECK(m_watch.first_start_ms <= CLICK_MS + BUTTON_CTRL_DOUBLE_PRESS_MS + 50 + MOTOR_DEAD_TIME_MS);
+    CHECK(m_watch.up_starts == 1 && m_watch.down_starts == 0);
+    CHECK(app_wait_rest(60000));
+    CHECK_NEAR(app_state()->position, 400, 1);
+
+    click(EVT_DOWN_PUSH, EVT_DOWN_RELEASE);
+    sim_run_ms(1000);
+    CHECK(app_wait_rest(60000));
+    CHECK_NEAR(app_state()->position, 200, 1);
+}
+
+static void test_double_press(void)
+{
+    setup(300);
+    presets_save(0, 200 * CTRL_SUBTICK_SCALE);
+    presets_save(2, 350 * CTRL_SUBTICK_SCALE);
+
+    watch_start();
+    click(EVT_DOWN_PUSH, EVT_DOWN_RELEASE);
+    run_watched(100);
+    click(EVT_DOWN_PUSH, EVT_DOWN_RELEASE);
+    run_watched(1000);
+
+    REPORT("double press down: motor started %u ms after the first push", m_watch.first_start_ms);
+    CHECK(m_watch.up_starts == 1 && m_watch.down_starts == 0); /* Preset 2 is above, preset 0 would go down */
+    CHECK(app_wait_rest(60000));
+    CHECK_NEAR(app_state()->position, 350, 1);
+}
+
+static void test_long_press(void)
+{
+    setup(300);
+    watch_start();
+    hold(EVT_UP_PUSH, EVT_UP_RELEASE, 2000);
+
+    int16_t released = app_state()->position;
+
+    CHECK(sim_run_until(app_is_at_rest, 10000));
+    REPORT("held up for 2000 ms: motor started %u ms after the push, moved %d ticks, %d after the release",
+        m_watch.first_start_ms, app_state()->position - 300, app_state()->position - released);
+    CHECK(m_watch.first_start_ms >= BUTTON_CTRL_LONG_PRESS_MS);
+    CHECK(m_watch.first_start_ms <= BUTTON_CTRL_LONG_PRESS_MS + 50 + MOTOR_DEAD_TIME_MS);
+    CHECK(m_watch.up_starts == 1 && m_watch.down_starts == 0);
+    CHECK(app_state()->position > 300 + 40);
+    /* Release stops the motor at once, the desk only coasts */
+    CHECK(app_state()->position - released <= 20);
+}
+
+static void test_press_stops(void)
+{
+    setup(300);
+    presets_save(1, 600 * CTRL_SUBTICK_SCALE);
+    click(EVT_UP_PUSH, EVT_UP_RELEASE);
+    sim_run_ms(2000);
+    CHECK(desk_is_driven(0));
+
+    watch_start();
+    click(EVT_DOWN_PUSH, EVT_DOWN_RELEASE);
+    run_watched(2000);
+
+    CHECK(!desk_is_driven(0));
+    CHECK(m_watch.up_starts == 0 && m_watch.down_starts == 0);
+    CHECK(app_wait_rest(10000));
+    CHECK(app_state()->position < 500);
+}
+
+/**
+ * @brief   Holds the button towards the limit from near it, then again, and checks that the motor started only once
+ *          per hold, never in the other direction, and not at all once the desk rests at the limit.
+ */
+static void hold_at_limit(int16_t from, bsp_event_t push, bsp_event_t release, int16_t limit)
+{
+    bool up = push == EVT_UP_PUSH;
+
+    setup(from);
+    watch_start();
+    hold(push, release, 8000);
+    run_watched(2000);
+
+    REPORT("held %s for 8000 ms from %d: %u up and %u down starts, at %d (limit %d), %u end stop hits",
+        up ? "up" : "down", from, m_watch.up_starts, m_watch.down_starts, app_state()->position, limit,
+        desk_state(0)->stop_hits);
+    CHECK((up ? m_watch.up_starts : m_watch.down_starts) == 1);
+    CHECK((up ? m_watch.down_starts : m_watch.up_starts) == 0);
+    CHECK(app_is_at_rest());
+    CHECK_NEAR(app_state()->position, limit, 1);
+
+    int16_t position = app_state()->position;
+    uint32_t stop_hits = desk_state(0)->stop_hits;
+
+    /* Held again at the limit */
+    watch_start();
+    hold(push, release, 5000);
+    run_watched(2000);
+
+    REPORT("held again: %u up and %u down starts, at %d, %u end stop hits", m_watch.up_starts, m_watch.down_starts,
+        app_state()->position, desk_state(0)->stop_hits - stop_hits);
+    CHECK(m_watch.up_starts + m_watch.down_starts <= 1);
+    CHECK((up ? m_watch.down_starts : m_watch.up_starts) == 0);
+    CHECK(app_is_at_rest());
+    CHECK(up ? app_state()->position >= position : app_state()->position <= position);
+    CHECK(app_state()->position == limit);
+
+    /* Held at the limit, the motor does not start at all */
+    watch_start();
+    hold(push, release, 5000);
+    run_watched(2000);
+    REPORT("held at the limit: %u up and %u down starts, at %d", m_watch.up_starts, m_watch.down_starts,
+        app_state()->position);
+    CHECK(m_watch.up_starts + m_watch.down_starts == 0);
+    CHECK(app_state()->position == limit);
+}
+
+static void test_hold_at_limits(void)
+{
+    calibration_t const* p_calibration;
+
+    setup(0);
+    p_calibration = calibration_get();
+
+    hold_at_limit(p_calibration->ticks_lower_limit + 30, EVT_DOWN_PUSH, EVT_DOWN_RELEASE, p_calibration->ticks_lower_limit);
+    hold_at_limit(p_calibration->ticks_upper_limit - 30, EVT_UP_PUSH, EVT_UP_RELEASE, p_calibration->ticks_upper_limit);
+}
+
+int main(void)
+{
+    test_single_press();
+    test_double_press();
+    test_long_press();
+    test_press_stops();
+    test_hold_at_limits();
+
+    return check_result("test_buttons");
+}
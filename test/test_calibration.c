@@ -0,0 +1,132 @@
+#include "app.h"
+#include "calibration.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "presets.h"
+#include "sim.h"
+#include <string.h>
+
+/**
+ * Desk geometry written over the calibration characteristic: applied and read back value, invalid geometry rejected,
+ * geometry kept over a reboot, presets kept on a new base height and erased on a new tick height. Fixed point
+ * reciprocal conversions of BLE heights against the exact division, over the whole travel of several tick heights.
+ */
+
+#define CALIB_LENGTH 12 /* CALIB_CHAR_LENGTH */
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+}
+
+static void calib_write(int32_t base_height, uint16_t tick_to_height, int16_t upper, int16_t lower, uint16_t backlash)
+{
+    uint8_t data[CALIB_LENGTH];
+
+    memcpy(data, &base_height, sizeof(base_height));
+    memcpy(data + 4, &tick_to_height, sizeof(tick_to_height));
+    memcpy(data + 6, &upper, sizeof(upper));
+    memcpy(data + 8, &lower, sizeof(lower));
+    memcpy(data + 10, &backlash, sizeof(backlash));
+    app_calib_write(data, sizeof(data));
+}
+
+static bool calib_read_matches(void)
+{
+    calibration_t const* p_calibration = calibration_get();
+    uint8_t data[CALIB_LENGTH];
+
+    CHECK(sim_ble_value_get(app_calib_handle(), data, sizeof(data)) == CALIB_LENGTH);
+
+    return memcmp(data, &p_calibration->base_height, 4) == 0 && memcmp(data + 4, &p_calibration->tick_to_height, 2) == 0
+        && memcmp(data + 6, &p_calibration->ticks_upper_limit, 2) == 0
+        && memcmp(data + 8, &p_calibration->ticks_lower_limit, 2) == 0
+        && memcmp(data + 10, &p_calibration->backlash, 2) == 0;
+}
+
+static void test_characteristic(void)
+{
+    int32_t target;
+
+    setup(300);
+    presets_save(0, 250 * CTRL_SUBTICK_SCALE);
+
+    /* New base height and limits keep the presets */
+    calib_write(700000, TICK_TO_HEIGHT_MULTI, 900, 10, 0);
+    CHECK(calibration_get()->base_height == 700000);
+    CHECK(calibration_get()->ticks_upper_limit == 900);
+    CHECK(calibration_get()->ticks_lower_limit == 10);
+    CHECK(calib_read_matches());
+    CHECK(presets_target_get(0, &target) && target == 250 * CTRL_SUBTICK_SCALE);
+    CHECK(calibration_subtick_to_height(300 * CTRL_SUBTICK_SCALE) == 700000 + 300 * TICK_TO_HEIGHT_MULTI);
+
+    /* Invalid geometry is rejected, the value is restored */
+    calib_write(700000, 0, 900, 10, 0);
+    calib_write(700000, 500, 10, 900, 0);
+    CHECK(calibration_get()->tick_to_height == TICK_TO_HEIGHT_MULTI);
+    CHECK(calibration_get()->ticks_upper_limit == 900);
+    CHECK(calib_read_matches());
+
+    /* New tick height erases the presets */
+    calib_write(700000, 500, 900, 10, 32);
+    CHECK(calibration_get()->tick_to_height == 500);
+    CHECK(calibration_get()->backlash == 32);
+    CHECK(!presets_target_get(0, &target));
+
+    app_reboot(false);
+    CHECK(calibration_get()->base_height == 700000);
+    CHECK(calibration_get()->tick_to_height == 500);
+    CHECK(calibration_get()->ticks_upper_limit == 900);
+    CHECK(calibration_get()->backlash == 32);
+    CHECK(calib_read_matches());
+    CHECK(!presets_target_get(0, &target));
+}
+
+/**
+ * @brief   Compares conversions of heights with the exact division, returns the largest error in subticks.
+ */
+static double reciprocal_error(uint16_t tick_to_height)
+{
+    calibration_t calibration = *calibration_get();
+    double max_error = 0;
+
+    calibration.tick_to_height = tick_to_height;
+    CHECK(calibration_set(&calibration));
+
+    int32_t travel = (calibration.ticks_upper_limit - calibration.ticks_lower_limit) * tick_to_height;
+
+    for (int32_t distance = -travel; distance <= travel; distance += 7) {
+        double exact = (double)distance * CTRL_SUBTICK_SCALE / tick_to_height;
+        double error = fabs(calibration_distance_to_subtick(distance) - exact);
+
+        max_error = error > max_error ? error : max_error;
+    }
+
+    return max_error;
+}
+
+static void test_reciprocal(void)
+{
+    static const uint16_t tick_heights[] = { 300, 499, TICK_TO_HEIGHT_MULTI, 777, 1000, 2000 };
+
+    setup(300);
+
+    for (uint8_t i = 0; i < sizeof(tick_heights) / sizeof(tick_heights[0]); i++) {
+        double error = reciprocal_error(tick_heights[i]);
+
+        REPORT("tick height %4u um: largest error of the reciprocal over the travel %.2f subticks", tick_heights[i], error);
+        CHECK(error <= 1);
+    }
+}
+
+int main(void)
+{
+    test_characteristic();
+    test_reciprocal();
+
+    return check_result("test_calibration");
+}
@@ -0,0 +1,131 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "check.h"
+#include "clock.h"
+#include "desk.h"
+#include "sim.h"
+#include <stdlib.h>
+
+/**
+ * Wall clock kept from RTC1 against the time of the phone, when the crystal is off by tens of ppm: error after a week
+ * without sync, before and after the drift was measured, drift kept over a reboot, a sync with the phone time stepped by
+ * an hour, and the latency jitter of the syncs.
+ */
+
+#define EPOCH_START 1790208000UL
+#define DAY_MS 86400000ULL
+#define WEEK_MS (7 * DAY_MS)
+#define SYNC_JITTER_MS 100 /* Connection latency between the phone reading its clock and the write */
+
+static double m_ppm; /* Crystal error, the RTC runs fast with positive */
+static int32_t m_phone_step; /* Seconds the phone clock was changed by */
+static uint64_t m_reboot_us; /* Simulation time before the reboot, which starts it over */
+
+static void setup(double ppm)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(300);
+    m_ppm = ppm;
+    m_phone_step = 0;
+    m_reboot_us = 0;
+    sim_run_ms(1000);
+}
+
+/**
+ * @brief   Returns time of the phone, in ms since EPOCH_START. Simulation runs on RTC ticks, so the true time is
+ *          slower than the simulation time when the crystal is fast.
+ */
+static uint64_t phone_ms(void)
+{
+    return (uint64_t)((double)(m_reboot_us + sim_time_us()) / 1000 / (1 + m_ppm / 1e6)) + (int64_t)m_phone_step * 1000;
+}
+
+/**
+ * @brief   Writes the phone time, read up to SYNC_JITTER_MS before the write arrives.
+ */
+static void sync(void)
+{
+    uint64_t now = phone_ms() - rand() % SYNC_JITTER_MS;
+
+    app_connect();
+    app_time_write(EPOCH_START + (uint32_t)(now / 1000), (uint16_t)(now % 1000), 0);
+    app_disconnect();
+}
+
+/**
+ * @brief   Returns clock error against the phone, in seconds, positive when the clock is ahead.
+ */
+static int32_t clock_error(void)
+{
+    return (int32_t)(clock_get() - EPOCH_START) - (int32_t)(phone_ms() / 1000);
+}
+
+static void run_ms(uint64_t ms)
+{
+    while (ms > 0) {
+        uint32_t step = ms > DAY_MS ? DAY_MS : (uint32_t)ms;
+
+        sim_run_ms(step);
+        ms -= step;
+    }
+}
+
+static void drift(double ppm)
+{
+    setup(ppm);
+
+    /* Single sync, the rate is not corrected yet */
+    sync();
+    run_ms(WEEK_MS);
+
+    int32_t uncorrected = clock_error();
+
+    /* Second sync a week later measures the drift */
+    sync();
+    run_ms(WEEK_MS);
+
+    int32_t corrected = clock_error();
+
+    REPORT("crystal %+.0f ppm: week without sync %+d s uncorrected, %+d s after the drift was measured", ppm, uncorrected,
+        corrected);
+    CHECK(abs(uncorrected) >= abs((int32_t)(ppm * 0.6048)) - 1);
+    CHECK(abs(corrected) <= 1);
+
+    /* Drift is kept in flash, the clock is only set after the reboot */
+    m_reboot_us += sim_time_us();
+    app_reboot(false);
+    CHECK(!clock_is_synced());
+    sync();
+    run_ms(WEEK_MS);
+
+    int32_t rebooted = clock_error();
+
+    REPORT("  week after reboot and a single sync %+d s", rebooted);
+    CHECK(abs(rebooted) <= 1);
+
+    /* Phone clock stepped by an hour, the drift it would imply is implausible and not taken */
+    m_phone_step = 3600;
+    sync();
+    run_ms(WEEK_MS);
+
+    int32_t stepped = clock_error();
+
+    REPORT("  week after the phone clock stepped by an hour %+d s", stepped);
+    CHECK(abs(stepped) <= 1);
+}
+
+static void test_drift(void)
+{
+    drift(40);
+    drift(-25);
+    drift(150);
+}
+
+int main(void)
+{
+    test_drift();
+
+    return check_result("test_clock");
+}
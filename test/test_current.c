@@ -0,0 +1,128 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "current_sense.h"
+#include "desk.h"
+#include "sim.h"
+
+/**
+ * Motor current sensing with the ADC fed by the plant model: samples are taken only while the motor runs, the current
+ * measured at full speed, and an obstacle detected by the current alone, before any speed profile is learned, with
+ * the time from the contact to the motor release. Inrush and load variation must not be taken for an obstruction.
+ */
+
+#define RUNS 10
+
+static const uint8_t m_down_pin = 15;
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+}
+
+static void test_sampling(void)
+{
+    uint32_t samples;
+    uint32_t driven_ms = 0;
+    uint16_t cruise_ma = 0;
+
+    setup(100);
+    samples = sim_adc_sample_count_get();
+    controller_target_position_set(400);
+
+    while (!app_is_at_rest() || desk_is_driven(0)) {
+        sim_run_ms(1);
+        driven_ms += desk_is_driven(0) ? 1 : 0;
+        if (app_state()->position == 250) {
+            cruise_ma = current_sense_get();
+        }
+    }
+
+    samples = sim_adc_sample_count_get() - samples;
+    REPORT("motor driven for %u ms: %u ADC samples, %u mA at full speed", driven_ms, samples, cruise_ma);
+    /* Sampling stops with the stop command, the soft stop of the motor is not sampled */
+    CHECK(samples <= driven_ms * 1000 / CURRENT_SENSE_PERIOD_US);
+    CHECK(samples * 100 >= driven_ms * 1000 / CURRENT_SENSE_PERIOD_US * 95);
+    CHECK_NEAR(cruise_ma, 600, 60);
+    CHECK(!(app_state()->flags & CTRL_FLAG_OBSTRUCTED));
+
+    /* No sampling at rest */
+    samples = sim_adc_sample_count_get();
+    sim_run_ms(5000);
+    CHECK(sim_adc_sample_count_get() == samples);
+}
+
+static void test_obstacle(void)
+{
+    double position = 250 * DESK_SUBTICKS_PER_TICK;
+    uint32_t contact = 0;
+    uint32_t latency = 0;
+    double compression = 0;
+
+    /* Nothing learned, so only the current can detect the obstacle */
+    setup(400);
+    desk_params(0)->obstacle = position;
+    controller_target_position_set(100);
+
+    for (uint32_t elapsed = 0; elapsed < 30000 && latency == 0; elapsed++) {
+        sim_run_ms(1);
+
+        double depth = position - desk_height(0);
+
+        if (contact == 0 && depth > 0) {
+            contact = sim_time_ms();
+        }
+        compression = depth > compression ? depth : compression;
+        if (contact != 0 && !sim_pin_get(m_down_pin)) {
+            latency = sim_time_ms() - contact;
+        }
+    }
+
+    CHECK(app_wait_rest(60000));
+    REPORT("obstacle down: motor released %u ms after contact, obstacle compressed by %.0f subticks", latency, compression);
+    CHECK(app_state()->flags & CTRL_FLAG_OBSTRUCTED);
+    CHECK(latency != 0 && latency <= 40);
+    CHECK(compression < DESK_SUBTICKS_PER_TICK);
+}
+
+/**
+ * @brief   Runs movements without obstacle under the load, returns how many were taken for obstructed.
+ */
+static uint32_t false_positives(double load, double load_noise)
+{
+    uint32_t obstructed = 0;
+
+    setup(150);
+    desk_params(0)->load = load;
+    desk_params(0)->load_noise = load_noise;
+
+    for (uint32_t i = 0; i < RUNS; i++) {
+        controller_target_position_set(i % 2 ? 150 : 450);
+        CHECK(app_wait_rest(60000));
+        obstructed += app_state()->flags & CTRL_FLAG_OBSTRUCTED ? 1 : 0;
+    }
+
+    REPORT("load %2.0f%% varying by %2.0f%%: %u of %u movements obstructed", load * 100, load_noise * 100, obstructed, RUNS);
+    return obstructed;
+}
+
+static void test_false_positives(void)
+{
+    /* Load draws current, CURRENT_SENSE_LIMIT_MA has to be over the heaviest load with its variation */
+    CHECK(false_positives(0, 0.2) == 0);
+    CHECK(false_positives(0.1, 0.1) == 0);
+    CHECK(false_positives(0.2, 0.05) == 0);
+}
+
+int main(void)
+{
+    test_sampling();
+    test_obstacle();
+    test_false_positives();
+
+    return check_result("test_current");
+}
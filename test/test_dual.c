@@ -0,0 +1,57 @@
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+
+/**
+ * Two synchronized columns on two plants with mismatched motor speeds: level difference of the columns during and
+ * after moves, against the difference an unsynchronized drive would reach, and the level error reported.
+ */
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    desk_params(1)->speed_up *= 0.88;
+    desk_params(1)->speed_down *= 0.92;
+    app_boot_at(position);
+}
+
+static void test_move(int16_t to)
+{
+    double max_level = 0;
+    int16_t from = app_state()->position;
+
+    controller_target_position_set(to);
+
+    while (!app_is_at_rest() && sim_time_ms() < 600000) {
+        sim_run_ms(1);
+
+        double level = fabs(desk_state(0)->motor - desk_state(1)->motor);
+
+        max_level = level > max_level ? level : max_level;
+    }
+
+    uint32_t distance = to > from ? to - from : from - to;
+    double mismatch = to > from ? 1 - 0.88 : 1 - 0.92;
+    double final_level = desk_state(0)->motor - desk_state(1)->motor;
+
+    REPORT("%d -> %d: level difference max %.0f, final %.0f subticks (%.0f unsynchronized), reported %d", from, to,
+        max_level, final_level, distance * DESK_SUBTICKS_PER_TICK * mismatch, app_state()->level_error);
+    CHECK(max_level <= CTRL_SYNC_TOLERANCE + DESK_SUBTICKS_PER_TICK);
+    CHECK(fabs(final_level) <= CTRL_SYNC_TOLERANCE + DESK_SUBTICKS_PER_TICK);
+    CHECK_NEAR(app_state()->level_error, fabs(final_level), DESK_SUBTICKS_PER_TICK);
+    CHECK(app_state()->position == (app_state()->channel_position[0] + app_state()->channel_position[1]) / 2);
+}
+
+int main(void)
+{
+    setup(100);
+    test_move(500);
+    test_move(150);
+    test_move(160);
+
+    return check_result("test_dual");
+}
@@ -0,0 +1,119 @@
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+
+/**
+ * Tick input glitch filter against spurious pulses injected on the sensor output while the desk moves: false counts
+ * left in the position after a move, and the latency the filter adds to real ticks.
+ */
+
+#define LATENCY_WINDOW_MS 2000
+
+typedef struct
+{
+    double rate; /* Pulses per second */
+    uint32_t width_us;
+} glitch_pattern_t;
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+}
+
+/**
+ * @brief   Moves up through the noise, returns the position error in ticks. Moving up, position N is counted at the
+ *          edge of tick N.
+ */
+static int32_t move_with_glitches(glitch_pattern_t const* p_pattern)
+{
+    setup(100);
+    desk_params(0)->glitch_rate = p_pattern->rate;
+    desk_params(0)->glitch_us = p_pattern->width_us;
+
+    controller_target_position_set(500);
+    CHECK(app_wait_rest(60000));
+
+    int32_t actual = (int32_t)floor(desk_state(0)->motor / DESK_SUBTICKS_PER_TICK);
+    int32_t error = app_state()->position - actual;
+
+    REPORT("%4.0f pulses/s of %5u us: %u injected, %u rejected, position error %d ticks", p_pattern->rate,
+        p_pattern->width_us, desk_state(0)->glitches, controller_rejected_ticks_get(), error);
+
+    return error;
+}
+
+static void test_false_counts(void)
+{
+    /* Shorter than TICK_FILTER_MIN_PULSE_MS, caught by the pulse width */
+    static const glitch_pattern_t short_patterns[] = { { 20, 50 }, { 20, 500 }, { 10, 3000 } };
+    /* Longer pulses pass the width check, most are caught by the tick period, the error depends on where they fall */
+    static const glitch_pattern_t long_pattern = { 5, 7000 };
+
+    for (uint8_t i = 0; i < sizeof(short_patterns) / sizeof(short_patterns[0]); i++) {
+        CHECK(move_with_glitches(&short_patterns[i]) == 0);
+    }
+
+    int32_t error = move_with_glitches(&long_pattern);
+
+    CHECK(error >= -2 && error <= 2);
+}
+
+/**
+ * @brief   Measures time from the plant edge to the tick counted by the controller, while moving at full speed.
+ */
+static void test_latency(void)
+{
+    uint32_t edges = 0;
+    uint64_t total_us = 0;
+    uint64_t max_us = 0;
+
+    setup(100);
+    controller_target_position_set(500);
+    sim_run_ms(1000);
+
+    uint32_t plant_edges = desk_state(0)->edges;
+    int16_t position = app_state()->position;
+    uint64_t edge_us = 0;
+    uint64_t end_us = sim_time_us() + LATENCY_WINDOW_MS * 1000ull;
+
+    while (sim_time_us() < end_us) {
+        sim_run_ticks(1);
+
+        if (desk_state(0)->edges != plant_edges) {
+            plant_edges = desk_state(0)->edges;
+            edge_us = sim_time_us();
+        }
+
+        if (app_state()->position != position) {
+            position = app_state()->position;
+
+            if (edge_us == 0) {
+                continue; /* Tick of an edge before the window */
+            }
+
+            uint64_t latency = sim_time_us() - edge_us;
+
+            total_us += latency;
+            max_us = latency > max_us ? latency : max_us;
+            edges++;
+        }
+    }
+
+    REPORT("tick latency mean %.1f ms, max %.1f ms over %u ticks", total_us / 1000.0 / edges, max_us / 1000.0, edges);
+    CHECK(edges > 50);
+    /* Edge is confirmed by the first poll, which comes at least TICK_FILTER_MIN_PULSE_MS after it */
+    CHECK(max_us <= (TICK_FILTER_MIN_PULSE_MS + 10 + 1) * 1000ull);
+}
+
+int main(void)
+{
+    test_false_counts();
+    test_latency();
+
+    return check_result("test_glitch");
+}
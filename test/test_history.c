@@ -0,0 +1,191 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+#include <string.h>
+
+/**
+ * Movement history over a simulated month of sit and stand usage: records decoded from the download stream match the
+ * movements, bytes per record and flash pages the month takes, and throughput of the download through the stand-in
+ * SoftDevice, which has to fill every TX buffer in each connection event.
+ */
+
+#define DAYS 30
+#define MOVES_PER_DAY 8 /* Every hour from 9:00 */
+#define SITTING 190
+#define STANDING 500
+#define EPOCH_START 1790208000UL
+#define DAY_MS 86400000UL
+#define HOUR_MS 3600000UL
+
+#define CONN_INTERVAL_MS 8 /* 7.5 ms, the shortest connection interval */
+#define TX_BUFFERS 6
+#define NOTIFICATION_LENGTH 20 /* Default ATT_MTU - 3 */
+#define STREAM_MAX 16384
+#define EVENTS_MAX 1000
+#define PAGE_PAYLOAD 252 /* Page of 256 bytes less its sequence number */
+
+#define HEADER_REASON_MASK 0x07
+#define HEADER_ABSOLUTE 0x20
+#define HEADER_END 0xFF
+#define CMD_DOWNLOAD 0x01
+#define STOP_TARGET 1 /* CTRL_STOP_TARGET */
+
+typedef struct
+{
+    int16_t start;
+    int16_t end;
+} move_t;
+
+static move_t m_moves[DAYS * MOVES_PER_DAY];
+static uint32_t m_move_count;
+
+static uint8_t m_stream[STREAM_MAX];
+static uint32_t m_stream_length;
+static uint32_t m_notifications; /* In the current connection event */
+
+static void on_notify(uint16_t handle, uint8_t const* p_data, uint16_t len)
+{
+    if (handle != app_history_handle() || m_stream_length + len > STREAM_MAX) {
+        return;
+    }
+
+    memcpy(m_stream + m_stream_length, p_data, len);
+    m_stream_length += len;
+    m_notifications++;
+}
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+    app_connect();
+    app_time_write(EPOCH_START, 0, 0);
+    app_disconnect();
+    m_move_count = 0;
+}
+
+static void move_to(int16_t position)
+{
+    int16_t from = app_state()->position;
+
+    controller_target_position_set(position);
+    CHECK(app_wait_rest(60000));
+    m_moves[m_move_count].start = from;
+    m_moves[m_move_count].end = app_state()->position;
+    m_move_count++;
+}
+
+static uint32_t varint_decode(uint32_t* p_offset)
+{
+    uint32_t value = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+
+    do {
+        byte = m_stream[(*p_offset)++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return value;
+}
+
+static int32_t zigzag_decode(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * @brief   Decodes records of the stream and compares them with the movements. Returns number of decoded records.
+ */
+static uint32_t decode(void)
+{
+    uint32_t offset = 0;
+    uint32_t records = 0;
+    int16_t end = 0;
+
+    varint_decode(&offset); /* Age of the last record */
+
+    while (offset < m_stream_length && m_stream[offset] != HEADER_END) {
+        uint8_t header = m_stream[offset++];
+
+        varint_decode(&offset); /* Start time */
+        int32_t start = zigzag_decode(varint_decode(&offset)) + (header & HEADER_ABSOLUTE ? 0 : end);
+        end = (int16_t)(start + zigzag_decode(varint_decode(&offset)));
+        varint_decode(&offset); /* Duration */
+        varint_decode(&offset); /* Overshoot */
+
+        if (records < m_move_count) {
+            CHECK((header & HEADER_REASON_MASK) == STOP_TARGET);
+            CHECK(start == m_moves[records].start);
+            CHECK(end == m_moves[records].end);
+        }
+        records++;
+    }
+
+    CHECK(offset == m_stream_length - 1);
+    return records;
+}
+
+static void test_month(void)
+{
+    uint32_t events = 0;
+    uint32_t full_events = 0;
+
+    setup(SITTING);
+
+    for (uint32_t day = 0; day < DAYS; day++) {
+        uint32_t midnight = sim_time_ms();
+
+        sim_run_ms(9 * HOUR_MS);
+        for (uint8_t i = 0; i < MOVES_PER_DAY; i++) {
+            move_to(i % 2 ? SITTING : STANDING);
+            sim_run_ms(HOUR_MS - 20000);
+        }
+        sim_run_ms(midnight + DAY_MS - sim_time_ms());
+    }
+
+    /* Download in connection events, the notifications queued in one are sent in the next */
+    app_connect();
+    sim_ble_tx_buffers_set(TX_BUFFERS);
+    sim_ble_notify_handler_set(on_notify);
+    m_stream_length = 0;
+    app_history_write(CMD_DOWNLOAD);
+
+    uint32_t start = sim_time_ms();
+
+    while ((m_stream_length == 0 || m_stream[m_stream_length - 1] != HEADER_END || m_notifications > 0) && events < EVENTS_MAX) {
+        m_notifications = 0;
+        sim_run_ms(CONN_INTERVAL_MS);
+        app_tx_complete();
+        events++;
+        full_events += m_notifications == TX_BUFFERS ? 1 : 0;
+    }
+
+    uint32_t elapsed = sim_time_ms() - start;
+    uint32_t records = decode();
+    uint32_t pages = (m_stream_length + PAGE_PAYLOAD - 1) / PAGE_PAYLOAD;
+
+    REPORT("month of %u movements: %u records in %u bytes, %.1f bytes per record, %u of %u pages", m_move_count, records,
+        m_stream_length, (double)m_stream_length / records, pages, HISTORY_PAGE_COUNT);
+    REPORT("download: %u connection events, %u with all %u TX buffers filled, %u ms, %u bytes/s", events, full_events,
+        TX_BUFFERS, elapsed, (m_stream_length * 1000) / elapsed);
+    CHECK(records == m_move_count);
+    CHECK(m_stream_length <= m_move_count * 10);
+    CHECK(pages <= HISTORY_PAGE_COUNT / 16);
+    /* Only the events at the start and the end of the stream are not full */
+    CHECK(full_events + 3 >= events);
+    CHECK((m_stream_length * 1000) / elapsed >= (TX_BUFFERS * NOTIFICATION_LENGTH * 1000 * 9) / (CONN_INTERVAL_MS * 10));
+}
+
+int main(void)
+{
+    test_month();
+
+    return check_result("test_history");
+}
@@ -0,0 +1,152 @@
+#include "app.h"
+#include "calibration.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+
+/**
+ * Hold-to-move jog and relative moves over the control characteristic on the plant: time from the last heartbeat to
+ * the motor release when heartbeats are lost, release by the stop direction, jog held at the limit, which must not
+ * restart the motor, and accumulated relative moves.
+ */
+
+#define HEARTBEAT_MS 100
+#define WARM_UP_MOVES 8
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+}
+
+static bool is_released(void)
+{
+    return !desk_is_driven(0);
+}
+
+/**
+ * @brief   Sends heartbeats for the time, returns the number of motor starts seen.
+ */
+static uint32_t hold(uint8_t direction, uint32_t duration_ms)
+{
+    uint32_t starts = 0;
+    bool driven = desk_is_driven(0);
+
+    for (uint32_t elapsed = 0; elapsed < duration_ms; elapsed += HEARTBEAT_MS) {
+        app_command_jog(direction);
+
+        for (uint32_t i = 0; i < HEARTBEAT_MS; i++) {
+            sim_run_ms(1);
+            starts += !driven && desk_is_driven(0) ? 1 : 0;
+            driven = desk_is_driven(0);
+        }
+    }
+
+    return starts;
+}
+
+static void test_heartbeat_loss(void)
+{
+    setup(300);
+
+    uint32_t starts = hold(MOVE_DIRECTION_UP, 2000);
+    int16_t position = app_state()->position;
+    uint32_t last_heartbeat = sim_time_ms() - HEARTBEAT_MS;
+
+    CHECK(starts == 1);
+    CHECK(desk_is_driven(0));
+    CHECK(sim_run_until(is_released, 2000));
+
+    uint32_t latency = sim_time_ms() - last_heartbeat;
+
+    CHECK(app_wait_rest(10000));
+    REPORT("heartbeat lost: motor released %u ms after the last heartbeat, coasted %d ticks", latency,
+        app_state()->position - position);
+    /* Timeout is checked by the 10 ms controller poll */
+    CHECK(latency >= CTRL_JOG_TIMEOUT_MS && latency <= CTRL_JOG_TIMEOUT_MS + 2 * 10);
+    CHECK(app_state()->position > 300);
+}
+
+static void test_release(void)
+{
+    setup(300);
+    hold(MOVE_DIRECTION_DOWN, 1000);
+    app_command_jog(MOVE_DIRECTION_NONE);
+
+    uint32_t release = sim_time_ms();
+
+    CHECK(sim_run_until(is_released, 2000));
+    REPORT("jog released, motor released after %u ms", sim_time_ms() - release);
+    CHECK(sim_time_ms() - release <= 2 * 10);
+    CHECK(app_wait_rest(10000));
+    CHECK(app_state()->position < 300);
+}
+
+static void test_hold_at_limit(void)
+{
+    setup(30);
+
+    uint32_t starts = hold(MOVE_DIRECTION_DOWN, 8000);
+
+    REPORT("held down for 8000 ms from tick 30: %u motor starts, at %d ticks, %u end stop hits", starts,
+        app_state()->position, desk_state(0)->stop_hits);
+    /* Jog is an exact target at the limit, the end stop is not hit */
+    CHECK(starts == 1);
+    CHECK(!desk_is_driven(0));
+    CHECK_NEAR(app_state()->position, calibration_get()->ticks_lower_limit, 1);
+
+    int16_t position = app_state()->position;
+
+    /* Released and held again, the desk stays at the limit */
+    app_command_jog(MOVE_DIRECTION_NONE);
+    sim_run_ms(500);
+    starts = hold(MOVE_DIRECTION_DOWN, 2000);
+    CHECK(starts <= 1);
+    CHECK(app_wait_rest(10000));
+    CHECK(app_state()->position <= position);
+}
+
+static void test_move_by(void)
+{
+    setup(300);
+
+    /* Dynamics are learned first, so the desk rests on the target tick */
+    for (uint8_t i = 0; i < WARM_UP_MOVES; i++) {
+        controller_target_position_set(i % 2 ? 200 : 400);
+        CHECK(app_wait_rest(60000));
+    }
+    controller_target_position_set(300);
+    CHECK(app_wait_rest(60000));
+
+    int32_t start = calibration_subtick_to_height(300 * CTRL_SUBTICK_SCALE);
+
+    /* Repeated commands accumulate from the target */
+    app_command_move_by_mm(50);
+    sim_run_ms(200);
+    app_command_move_by_mm(50);
+    CHECK(app_wait_rest(60000));
+
+    int32_t up = calibration_subtick_to_height(controller_position_get()) - start;
+
+    app_command_move_by_mm(-30);
+    CHECK(app_wait_rest(60000));
+
+    int32_t down = calibration_subtick_to_height(controller_position_get()) - start;
+
+    REPORT("moved by 50 + 50 mm: %.1f mm, then by -30 mm: %.1f mm", up / 1000.0, down / 1000.0);
+    CHECK_NEAR(up, 100000, calibration_get()->tick_to_height);
+    CHECK_NEAR(down, 70000, calibration_get()->tick_to_height);
+}
+
+int main(void)
+{
+    test_heartbeat_loss();
+    test_release();
+    test_hold_at_limit();
+    test_move_by();
+
+    return check_result("test_jog");
+}
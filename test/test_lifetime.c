@@ -0,0 +1,135 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "lifetime.h"
+#include "m45pe_drv.h"
+#include "sim.h"
+#include <stdlib.h>
+
+/**
+ * Lifetime counters on the flash emulator, which only clears bits when programming: increments per page erase, counts
+ * kept over reboots and around the ring of pages, fold interrupted by power loss, and the counters of real movements.
+ */
+
+#define PAGE_BITS ((M45PE_PAGE_SIZE - 8) * 8) /* Unary bits after the header of the base and its complement */
+#define COUNT_TARGET 100000
+#define CMD_RESET 0x88 /* CTRL_COMMAND_RESET */
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+}
+
+static uint32_t counter_erases(uint8_t counter)
+{
+    uint32_t erases = 0;
+
+    for (uint32_t i = 0; i < LIFETIME_PAGES_PER_COUNTER; i++) {
+        erases += sim_flash_erase_count_get(LIFETIME_FIRST_PAGE + counter * LIFETIME_PAGES_PER_COUNTER + i);
+    }
+
+    return erases;
+}
+
+static void test_counting(void)
+{
+    uint32_t counted = 0;
+
+    setup(300);
+
+    uint32_t programs = sim_flash_program_count_get();
+
+    /* Small amounts like the travel of single movements, around the ring of pages three times */
+    while (counted < COUNT_TARGET) {
+        uint32_t amount = 1 + rand() % 400;
+
+        lifetime_count(LIFETIME_TRAVEL, amount);
+        lifetime_flush();
+        counted += amount;
+    }
+
+    uint32_t erases = counter_erases(LIFETIME_TRAVEL);
+
+    programs = sim_flash_program_count_get() - programs;
+    REPORT("%u counted in %u programs and %u erases, %u per erase, ring of %u pages passed %u times", counted, programs,
+        erases, counted / erases, LIFETIME_PAGES_PER_COUNTER, counted / (PAGE_BITS * LIFETIME_PAGES_PER_COUNTER));
+    CHECK(lifetime_get(LIFETIME_TRAVEL) == counted);
+    /* Page is erased only when the previous one is full, and once for the first page */
+    CHECK(erases <= counted / PAGE_BITS + 1);
+    CHECK(counted > 2 * PAGE_BITS * LIFETIME_PAGES_PER_COUNTER);
+    CHECK(lifetime_get(LIFETIME_MOTOR_STARTS) == 0);
+
+    app_reboot(false);
+    CHECK(lifetime_get(LIFETIME_TRAVEL) == counted);
+    CHECK(lifetime_get(LIFETIME_MOTOR_STARTS) == 0);
+}
+
+static void test_power_loss(void)
+{
+    setup(300);
+
+    lifetime_count(LIFETIME_END_STOPS, 2 * PAGE_BITS + 1);
+    lifetime_flush();
+    CHECK(lifetime_get(LIFETIME_END_STOPS) == 2 * PAGE_BITS + 1);
+
+    /* Power was lost while the header of the third page was programmed, its complement stayed erased */
+    uint32_t address = (LIFETIME_FIRST_PAGE + LIFETIME_END_STOPS * LIFETIME_PAGES_PER_COUNTER + 2) * M45PE_PAGE_SIZE;
+
+    for (uint8_t i = 4; i < 8; i++) {
+        sim_flash_data()[address + i] = 0xFF;
+    }
+
+    /* Full second page is valid, only the increment being written is lost */
+    app_reboot(false);
+    REPORT("fold interrupted at %u: %u after reboot", 2 * PAGE_BITS + 1, lifetime_get(LIFETIME_END_STOPS));
+    CHECK(lifetime_get(LIFETIME_END_STOPS) == 2 * PAGE_BITS);
+
+    lifetime_count(LIFETIME_END_STOPS, 5);
+    lifetime_flush();
+    app_reboot(false);
+    CHECK(lifetime_get(LIFETIME_END_STOPS) == 2 * PAGE_BITS + 5);
+}
+
+static void test_movements(void)
+{
+    static const int16_t targets[] = { 500, 200, 450, 150 };
+    uint8_t data[] = { CMD_RESET, CTRL_EXTREMUM_POS_BOTTOM };
+    uint32_t travel = 0;
+
+    setup(300);
+
+    for (uint8_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        int16_t from = app_state()->position;
+
+        controller_target_position_set(targets[i]);
+        CHECK(app_wait_rest(60000));
+        travel += abs(app_state()->position - from);
+    }
+
+    int16_t from = app_state()->position;
+
+    app_command(data, sizeof(data));
+    CHECK(app_wait_rest(60000));
+    travel += abs(app_state()->position - from);
+    app_reboot(false);
+
+    REPORT("%u movements: %u motor starts, travel %u of %u ticks, %u end stops", 5, lifetime_get(LIFETIME_MOTOR_STARTS),
+        lifetime_get(LIFETIME_TRAVEL), travel, lifetime_get(LIFETIME_END_STOPS));
+    CHECK(lifetime_get(LIFETIME_MOTOR_STARTS) == 5);
+    CHECK(lifetime_get(LIFETIME_TRAVEL) == travel);
+    CHECK(lifetime_get(LIFETIME_END_STOPS) == 1);
+}
+
+int main(void)
+{
+    test_counting();
+    test_power_loss();
+    test_movements();
+
+    return check_result("test_lifetime");
+}
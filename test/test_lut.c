@@ -0,0 +1,202 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "calibration.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "height_lut.h"
+#include "sim.h"
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Height lookup table generated from config/lut/height_lut.csv, a column with non-linear sensor spacing, against the
+ * linear formula the firmware used before (ticks times TICK_TO_HEIGHT_MULTI plus BASE_HEIGHT, inverse by ROUNDED_DIV):
+ * error of heights reported for every tick and of ticks targeted for every measured height, and the cost of both
+ * conversions. Cost is measured on the host, so only the ratio means something; Cortex-M0 has no divide instruction,
+ * so there the division of the linear inverse is relatively even more expensive.
+ */
+
+#define MEASUREMENTS_PATH "config/lut/height_lut.csv"
+#define MEASUREMENTS_MAX 128
+#define COST_ITERATIONS 2000000
+
+typedef struct
+{
+    int32_t tick;
+    int32_t height;
+} measurement_t;
+
+typedef struct
+{
+    double max;
+    double mean;
+} error_t;
+
+static measurement_t m_measurements[MEASUREMENTS_MAX];
+static uint32_t m_measurement_count;
+
+static volatile int32_t m_sink; /* Keeps results of the cost loops */
+
+static void load_measurements(void)
+{
+    FILE* p_file = fopen(MEASUREMENTS_PATH, "r");
+    char line[128];
+
+    CHECK(p_file != NULL);
+    if (p_file == NULL) {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), p_file) != NULL && m_measurement_count < MEASUREMENTS_MAX) {
+        measurement_t* p_measurement = &m_measurements[m_measurement_count];
+
+        if (line[0] != '#' && sscanf(line, "%d,%d", &p_measurement->tick, &p_measurement->height) == 2) {
+            m_measurement_count++;
+        }
+    }
+
+    fclose(p_file);
+}
+
+/**
+ * @brief   Returns measured height at the tick, linearly interpolated between the measurements.
+ */
+static double measured_height(int32_t tick)
+{
+    for (uint32_t i = 1; i < m_measurement_count; i++) {
+        measurement_t const* p_low = &m_measurements[i - 1];
+        measurement_t const* p_high = &m_measurements[i];
+
+        if (tick <= p_high->tick) {
+            return p_low->height + (double)(p_high->height - p_low->height) * (tick - p_low->tick) / (p_high->tick - p_low->tick);
+        }
+    }
+
+    return m_measurements[m_measurement_count - 1].height;
+}
+
+static __attribute__((noinline)) int32_t linear_height(int16_t ticks)
+{
+    return ((int32_t)ticks * TICK_TO_HEIGHT_MULTI) + BASE_HEIGHT;
+}
+
+static __attribute__((noinline)) int16_t linear_ticks(int32_t height)
+{
+    return ROUNDED_DIV(height - BASE_HEIGHT, TICK_TO_HEIGHT_MULTI);
+}
+
+static void error_add(error_t* p_error, double error)
+{
+    p_error->max = fabs(error) > p_error->max ? fabs(error) : p_error->max;
+    p_error->mean += fabs(error);
+}
+
+static void test_accuracy(void)
+{
+    calibration_t const* p_calibration = calibration_get();
+    error_t linear = { 0 };
+    error_t table = { 0 };
+    uint32_t count = 0;
+
+    /* Height reported for every tick */
+    for (int16_t tick = p_calibration->ticks_lower_limit; tick <= p_calibration->ticks_upper_limit; tick++) {
+        double truth = measured_height(tick);
+
+        error_add(&linear, linear_height(tick) - truth);
+        error_add(&table, calibration_subtick_to_height(tick * CTRL_SUBTICK_SCALE) - truth);
+        count++;
+    }
+
+    REPORT("height of %u ticks: linear error max %.0f mean %.0f um, table error max %.0f mean %.0f um", count,
+        linear.max, linear.mean / count, table.max, table.mean / count);
+    /* Nodes are 2^HEIGHT_LUT_SHIFT ticks apart, the table only misses the curvature between them */
+    CHECK(table.max <= 100);
+    CHECK(table.max * 10 < linear.max);
+
+    /* Target ticks of every measured height, in ticks */
+    linear = (error_t){ 0 };
+    table = (error_t){ 0 };
+    count = 0;
+
+    for (uint32_t i = 0; i < m_measurement_count; i++) {
+        measurement_t const* p_measurement = &m_measurements[i];
+
+        error_add(&linear, linear_ticks(p_measurement->height) - p_measurement->tick);
+        error_add(&table, (double)calibration_height_to_subtick(p_measurement->height) / CTRL_SUBTICK_SCALE - p_measurement->tick);
+        count++;
+    }
+
+    REPORT("target of %u heights: linear error max %.2f mean %.2f ticks, table error max %.2f mean %.2f ticks", count,
+        linear.max, linear.mean / count, table.max, table.mean / count);
+    CHECK(table.max <= 0.25);
+    CHECK(linear.max >= 1);
+}
+
+static double elapsed_ns(struct timespec const* p_start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - p_start->tv_sec) * 1e9 + (now.tv_nsec - p_start->tv_nsec);
+}
+
+static void test_cost(void)
+{
+    struct timespec start;
+    double costs[4];
+    int32_t sum;
+
+    sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < COST_ITERATIONS; i++) {
+        sum += linear_height((int16_t)(i & 0x1FF));
+    }
+    costs[0] = elapsed_ns(&start) / COST_ITERATIONS;
+    m_sink = sum;
+
+    sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < COST_ITERATIONS; i++) {
+        sum += calibration_subtick_to_height((int32_t)(i & 0x1FFFF));
+    }
+    costs[1] = elapsed_ns(&start) / COST_ITERATIONS;
+    m_sink = sum;
+
+    sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < COST_ITERATIONS; i++) {
+        sum += linear_ticks(BASE_HEIGHT + (int32_t)(i & 0x3FFFF));
+    }
+    costs[2] = elapsed_ns(&start) / COST_ITERATIONS;
+    m_sink = sum;
+
+    sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < COST_ITERATIONS; i++) {
+        sum += calibration_height_to_subtick(BASE_HEIGHT + (int32_t)(i & 0x3FFFF));
+    }
+    costs[3] = elapsed_ns(&start) / COST_ITERATIONS;
+    m_sink = sum;
+
+    REPORT("height: linear %.1f ns, table %.1f ns (x%.1f); target: linear %.1f ns, table %.1f ns (x%.1f)", costs[0],
+        costs[1], costs[1] / costs[0], costs[2], costs[3], costs[3] / costs[2]);
+    /* Table lookups take a shift and a multiply, the inverse iterates LUT_INVERSE_ITERATIONS times */
+    CHECK(costs[1] < 10 * costs[0]);
+    CHECK(costs[3] < 20 * costs[2]);
+}
+
+int main(void)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(0);
+    load_measurements();
+    CHECK(m_measurement_count > 2);
+
+    test_accuracy();
+    test_cost();
+
+    return check_result("test_lut");
+}
@@ -0,0 +1,123 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+
+/**
+ * Obstruction detection from the tick period against the learned speed profile, on the plant: time from the contact
+ * with an obstacle to the motor release, how far the obstacle is compressed and the back-off, moving down and up.
+ * False positives over movements without obstacle, with the load and its random variation changed after learning.
+ */
+
+#define WARM_UP_MOVES 8
+#define RUNS 20 /* Movements without obstacle per load */
+
+static const uint8_t m_up_pin = 16;
+static const uint8_t m_down_pin = 15;
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+
+    /* Speed profile is learned first */
+    for (uint8_t i = 0; i < WARM_UP_MOVES; i++) {
+        controller_target_position_set(i % 2 ? 150 : 450);
+        CHECK(app_wait_rest(60000));
+    }
+    controller_target_position_set(position);
+    CHECK(app_wait_rest(60000));
+}
+
+/**
+ * @brief   Moves towards the target through an obstacle, checks the detection and back-off.
+ */
+static void obstacle(int16_t from, int16_t to, int16_t at)
+{
+    int8_t direction = to > from ? 1 : -1;
+    uint8_t pin = direction > 0 ? m_up_pin : m_down_pin;
+    double position = at * DESK_SUBTICKS_PER_TICK;
+    uint32_t contact = 0;
+    uint32_t latency = 0;
+    double compression = 0;
+
+    setup(from);
+    desk_params(0)->obstacle = position;
+    desk_params(0)->obstacle_dir = direction;
+    controller_target_position_set(to);
+
+    for (uint32_t elapsed = 0; elapsed < 30000 && latency == 0; elapsed++) {
+        sim_run_ms(1);
+
+        double depth = (desk_height(0) - position) * direction;
+
+        if (contact == 0 && depth > 0) {
+            contact = sim_time_ms();
+        }
+        compression = depth > compression ? depth : compression;
+        if (contact != 0 && !sim_pin_get(pin)) {
+            latency = sim_time_ms() - contact;
+        }
+    }
+
+    CHECK(app_wait_rest(60000));
+    desk_params(0)->obstacle = NAN;
+
+    int32_t backed_off = (int32_t)((position - desk_height(0)) * direction);
+
+    REPORT("obstacle %s at %d: motor released %u ms after contact, obstacle compressed by %.0f subticks, backed off %d",
+        direction > 0 ? "up" : "down", at, latency, compression, backed_off);
+    CHECK(contact != 0 && latency != 0);
+    CHECK(app_state()->flags & CTRL_FLAG_OBSTRUCTED);
+    /* Tick period at full speed is 20 ms, stall detection would take CTR_TIMER_TICKS_STOP_THRESHOLD, 1.2 s */
+    CHECK(latency <= 150);
+    CHECK(compression < DESK_SUBTICKS_PER_TICK);
+    CHECK_NEAR(backed_off, CTRL_OBSTRUCTION_BACKOFF, 2 * DESK_SUBTICKS_PER_TICK);
+}
+
+static void test_detection(void)
+{
+    obstacle(400, 100, 250);
+    obstacle(200, 500, 350);
+}
+
+/**
+ * @brief   Runs movements without obstacle under the load, returns how many were taken for obstructed.
+ */
+static uint32_t false_positives(double load, double load_noise)
+{
+    uint32_t obstructed = 0;
+
+    setup(150);
+    desk_params(0)->load = load;
+    desk_params(0)->load_noise = load_noise;
+
+    for (uint32_t i = 0; i < RUNS; i++) {
+        controller_target_position_set(i % 2 ? 150 : 450);
+        CHECK(app_wait_rest(60000));
+        obstructed += app_state()->flags & CTRL_FLAG_OBSTRUCTED ? 1 : 0;
+    }
+
+    REPORT("load %2.0f%% varying by %2.0f%%: %u of %u movements obstructed", load * 100, load_noise * 100, obstructed, RUNS);
+    return obstructed;
+}
+
+static void test_false_positives(void)
+{
+    CHECK(false_positives(0, 0.1) == 0);
+    CHECK(false_positives(0, 0.3) == 0);
+    CHECK(false_positives(0.3, 0.1) == 0);
+    CHECK(false_positives(0.3, 0.3) == 0);
+}
+
+int main(void)
+{
+    test_detection();
+    test_false_positives();
+
+    return check_result("test_obstruction");
+}
@@ -0,0 +1,173 @@
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "device_manager_cnfg.h"
+#include "desk.h"
+#include "sim.h"
+
+/**
+ * Preset slots over the control characteristic: single byte save and recall commands on the plant, presets kept over
+ * a reboot, recalls of empty or out of range slots, which must not move the desk, and separate tables of bonded peers. Desk dynamics are learned by a
+ * few moves first, as on a desk in use, so recalls land on the saved tick.
+ */
+
+#define CMD_PRESET_SAVE 0x50 /* CTRL_COMMAND_PRESET_SAVE */
+#define CMD_PRESET_RECALL 0x70 /* CTRL_COMMAND_PRESET_RECALL */
+
+#define WARM_UP_MOVES 8
+
+static void command(uint8_t command)
+{
+    app_command(&command, sizeof(command));
+}
+
+static void move_to(int16_t position)
+{
+    controller_target_position_set(position);
+    CHECK(app_wait_rest(60000));
+}
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+
+    for (uint8_t i = 0; i < WARM_UP_MOVES; i++) {
+        move_to(i % 2 ? position - 100 : position + 100);
+    }
+    move_to(position);
+}
+
+/**
+ * @brief   Recalls the slot and returns the position the desk settled at, in ticks.
+ */
+static int16_t recall(uint8_t slot)
+{
+    command(CMD_PRESET_RECALL | slot);
+    CHECK(app_wait_rest(60000));
+
+    return app_state()->position;
+}
+
+static void test_save_recall(void)
+{
+    setup(300);
+    move_to(250);
+    command(CMD_PRESET_SAVE | 0);
+
+    int16_t sitting = app_state()->position;
+
+    move_to(420);
+    command(CMD_PRESET_SAVE | 1);
+
+    int16_t standing = app_state()->position;
+
+    move_to(100);
+
+    int16_t recalled_sitting = recall(0);
+    int16_t recalled_standing = recall(1);
+
+    REPORT("recalled slot 0 at %d (saved at %d), slot 1 at %d (saved at %d)", recalled_sitting, sitting,
+        recalled_standing, standing);
+    CHECK(recalled_sitting == sitting);
+    CHECK(recalled_standing == standing);
+    CHECK_NEAR(desk_height(0) / DESK_SUBTICKS_PER_TICK, standing + 0.5, 0.5);
+}
+
+static void test_reboot(void)
+{
+    setup(300);
+    move_to(200);
+    command(CMD_PRESET_SAVE | 2);
+
+    int16_t saved = app_state()->position;
+
+    move_to(350);
+    app_reboot(false);
+
+    int16_t position = recall(2);
+
+    REPORT("after reboot slot 2 recalled at %d (saved at %d)", position, saved);
+    CHECK(position == saved);
+}
+
+static void test_empty_slot(void)
+{
+    setup(300);
+    command(CMD_PRESET_SAVE | 0x0F);
+
+    uint32_t states = app_state_count();
+
+    command(CMD_PRESET_RECALL | 3);
+    sim_run_ms(1000);
+    command(CMD_PRESET_RECALL | 0x0F);
+    sim_run_ms(1000);
+
+    CHECK(app_state_count() == states);
+    CHECK(!desk_is_driven(0));
+    CHECK(app_state()->position == 300);
+}
+
+static void save_as_peer(uint8_t device_id, int16_t position)
+{
+    app_connect();
+    app_peer_select(device_id);
+    move_to(position);
+    command(CMD_PRESET_SAVE | 0);
+    app_disconnect();
+}
+
+static int16_t recall_as_peer(uint8_t device_id)
+{
+    app_connect();
+    app_peer_select(device_id);
+
+    int16_t position = recall(0);
+
+    app_disconnect();
+    return position;
+}
+
+static void test_peers(void)
+{
+    setup(300);
+    save_as_peer(0, 250);
+    save_as_peer(1, 400);
+    save_as_peer(DEVICE_MANAGER_MAX_BONDS, 200); /* Peer without bond */
+
+    int16_t first = recall_as_peer(0);
+    int16_t unbonded = recall_as_peer(DEVICE_MANAGER_MAX_BONDS);
+    int16_t second = recall_as_peer(1);
+
+    REPORT("slot 0 of peer 0 recalled at %d, of peer 1 at %d, without bond at %d", first, second, unbonded);
+    CHECK(first == 250);
+    CHECK(second == 400);
+    CHECK(unbonded == 200);
+
+    /* Tables of other peers are kept over a reboot, erased with the bonds */
+    app_reboot(false);
+    CHECK(recall_as_peer(1) == 400);
+    app_reboot(true);
+    move_to(300);
+
+    uint32_t states = app_state_count();
+
+    app_connect();
+    app_peer_select(0);
+    command(CMD_PRESET_RECALL | 0);
+    sim_run_ms(1000);
+    CHECK(app_state_count() == states);
+    CHECK(recall_as_peer(DEVICE_MANAGER_MAX_BONDS) == 200);
+}
+
+int main(void)
+{
+    test_save_recall();
+    test_reboot();
+    test_empty_slot();
+    test_peers();
+
+    return check_result("test_presets");
+}
@@ -0,0 +1,118 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+#include <stdlib.h>
+
+/**
+ * Position decoded by the QDEC peripheral from both phases of the tick sensor, on the plant with the QDEC emulator:
+ * error after movements, including the run-down after the motor stop and reversals at full speed, which coast against
+ * the new direction, and the desk backdriven by hand while the motor is released.
+ */
+
+#define WARM_UP_MOVES 4
+#define BACKDRIVE_SPEED 4000.0 /* Subticks per second, slower than driven */
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+
+    for (uint8_t i = 0; i < WARM_UP_MOVES; i++) {
+        controller_target_position_set(i % 2 ? 200 : 400);
+        CHECK(app_wait_rest(60000));
+    }
+}
+
+/**
+ * @brief   Returns counted position less the tick the motor is on.
+ */
+static int32_t position_error(void)
+{
+    return app_state()->position - (int32_t)floor(desk_state(0)->motor / DESK_SUBTICKS_PER_TICK);
+}
+
+static void test_movements(void)
+{
+    static const int16_t targets[] = { 500, 100, 110, 105, 600, 590, 300 };
+    int32_t max_error = 0;
+
+    setup(300);
+
+    for (uint8_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        controller_target_position_set(targets[i]);
+        CHECK(app_wait_rest(60000));
+        max_error = abs(position_error()) > max_error ? abs(position_error()) : max_error;
+    }
+
+    REPORT("%u movements: largest position error %d ticks", (uint32_t)(sizeof(targets) / sizeof(targets[0])), max_error);
+    CHECK(max_error == 0);
+}
+
+static void test_reversals(void)
+{
+    static const int16_t targets[] = { 200, 500, 150, 450 };
+
+    setup(300);
+
+    /* Target is reversed at full speed, the desk coasts against the new direction */
+    for (uint8_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        int16_t reversed = targets[i] > 300 ? 150 : 450;
+
+        controller_target_position_set(targets[i]);
+        sim_run_ms(1500);
+        controller_target_position_set(reversed);
+        CHECK(app_wait_rest(60000));
+
+        REPORT("reversed towards %d: at %d, position error %d", reversed, app_state()->position, position_error());
+        CHECK(position_error() == 0);
+    }
+}
+
+/**
+ * @brief   Pushes the released desk by the distance, at BACKDRIVE_SPEED.
+ */
+static void backdrive(double distance)
+{
+    double step = (distance > 0 ? BACKDRIVE_SPEED : -BACKDRIVE_SPEED) / 1000;
+    double target = desk_state(0)->motor + distance;
+
+    while ((target - desk_state(0)->motor) * distance > 0) {
+        double next = desk_state(0)->motor + step;
+
+        desk_place(0, (next - target) * distance > 0 ? target : next);
+        sim_run_ms(1);
+    }
+    sim_run_ms(100);
+}
+
+static void test_backdriving(void)
+{
+    setup(300);
+
+    backdrive(-40 * DESK_SUBTICKS_PER_TICK);
+    REPORT("backdriven down by 40 ticks: at %d, position error %d", app_state()->position, position_error());
+    CHECK(position_error() == 0);
+
+    backdrive(25.5 * DESK_SUBTICKS_PER_TICK);
+    REPORT("backdriven up by 25.5 ticks: at %d, position error %d", app_state()->position, position_error());
+    CHECK(position_error() == 0);
+
+    /* Next movement starts from the decoded position */
+    controller_target_position_set(400);
+    CHECK(app_wait_rest(60000));
+    CHECK(position_error() == 0);
+}
+
+int main(void)
+{
+    test_movements();
+    test_reversals();
+    test_backdriving();
+
+    return check_result("test_qdec");
+}
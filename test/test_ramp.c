@@ -0,0 +1,132 @@
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "motor.h"
+#include "sim.h"
+
+/**
+ * Motor soft-start and soft-stop on the plant: starting current against the one of a start at full duty, duty slope,
+ * duty left at the motor cut, stop error, and the dead time between the legs on reversal.
+ */
+
+#define START_WINDOW_MS 300
+
+static const uint8_t m_up_pin = 16;
+static const uint8_t m_down_pin = 15;
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+}
+
+static void test_soft_start(void)
+{
+    double peak_ma = 0;
+    uint16_t duty = 0;
+    uint16_t max_step = 0;
+
+    setup(100);
+    controller_target_position_set(400);
+
+    for (uint32_t i = 0; i < START_WINDOW_MS; i++) {
+        sim_run_ms(1);
+
+        if (desk_current_ma(0) > peak_ma) {
+            peak_ma = desk_current_ma(0);
+        }
+        if (duty >= MOTOR_DUTY_MIN && sim_pwm_duty_get(0) > duty + max_step) {
+            max_step = sim_pwm_duty_get(0) - duty;
+        }
+        duty = sim_pwm_duty_get(0);
+    }
+
+    /* Full duty start from standstill draws the stall current */
+    REPORT("start current peak %.0f mA, %.0f mA at full duty", peak_ma, desk_current_ma(0) > 0 ? 5000.0 : 0);
+    CHECK(peak_ma < 0.6 * 5000.0);
+    CHECK(max_step <= MOTOR_RAMP_ACCEL_STEP);
+    CHECK(duty == MOTOR_DUTY_MAX);
+}
+
+/**
+ * @brief   Moves to the target and returns the distance of the desk from the middle of the target tick, which is what
+ *          whole tick position can tell, and the duty left at the motor cut.
+ */
+static double move(int16_t to, uint16_t* p_cut_duty)
+{
+    *p_cut_duty = 0;
+    controller_target_position_set(to);
+
+    while (!app_is_at_rest() && sim_time_ms() < 600000) {
+        uint16_t duty = sim_pwm_duty_get(0);
+
+        sim_run_ms(1);
+
+        if (duty > 0 && !desk_is_driven(0) && *p_cut_duty == 0) {
+            *p_cut_duty = duty;
+        }
+    }
+
+    return desk_height(0) - (to * DESK_SUBTICKS_PER_TICK + DESK_SUBTICKS_PER_TICK / 2);
+}
+
+/**
+ * @brief   Repeats moves up and down, coasting distance is learned from the first ones.
+ */
+static void test_soft_stop(void)
+{
+    static const int16_t targets[] = { 400, 150, 380, 120, 420, 160, 440, 140, 170, 130 };
+    uint16_t cut_duty;
+
+    setup(100);
+
+    for (uint8_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        double error = move(targets[i], &cut_duty);
+
+        REPORT("move to %d: duty %u%% at cut, stop error %.0f subticks", targets[i], cut_duty, error);
+        CHECK(cut_duty > 0 && cut_duty < MOTOR_DUTY_MAX);
+
+        if (i >= 4) {
+            CHECK_NEAR(error, 0, DESK_SUBTICKS_PER_TICK);
+        }
+    }
+}
+
+static void test_reversal_dead_time(void)
+{
+    uint32_t up_released = 0;
+    uint32_t down_set = 0;
+
+    setup(300);
+    controller_target_position_set(500);
+    sim_run_ms(500);
+    controller_target_position_set(200);
+
+    for (uint32_t i = 0; i < 500 && down_set == 0; i++) {
+        if (up_released == 0 && !sim_pin_get(m_up_pin)) {
+            up_released = sim_time_ms();
+        }
+        if (sim_pin_get(m_down_pin)) {
+            down_set = sim_time_ms();
+            CHECK(!sim_pin_get(m_up_pin));
+        }
+        sim_run_ms(1);
+    }
+
+    REPORT("reversal: down leg set %u ms after the up leg release", down_set - up_released);
+    CHECK(down_set > 0);
+    CHECK(down_set - up_released >= MOTOR_DEAD_TIME_MS);
+    CHECK(app_wait_rest(30000));
+}
+
+int main(void)
+{
+    test_soft_start();
+    test_soft_stop();
+    test_reversal_dead_time();
+
+    return check_result("test_ramp");
+}
@@ -0,0 +1,115 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+#include <stdlib.h>
+
+/**
+ * Dead reckoning on a plant whose tick sensor drops out: movements until the failure is recognized, error of the
+ * position estimated from motor on-time over movements of several lengths, homing by extremum movement without ticks,
+ * and return to tick counting when the sensor works again.
+ */
+
+#define WARM_UP_MOVES 8
+#define ERROR_PERCENT 3 /* Largest estimate error, in percents of the travel since homing */
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+
+    /* Speed is learned while the sensor works */
+    for (uint8_t i = 0; i < WARM_UP_MOVES; i++) {
+        controller_target_position_set(i % 2 ? 200 : 500);
+        CHECK(app_wait_rest(60000));
+    }
+    controller_target_position_set(position);
+    CHECK(app_wait_rest(60000));
+}
+
+/**
+ * @brief   Returns estimated position less the tick the motor is on.
+ */
+static int32_t position_error(void)
+{
+    return app_state()->position - (int32_t)floor(desk_state(0)->motor / DESK_SUBTICKS_PER_TICK);
+}
+
+static void move_to(int16_t position)
+{
+    controller_target_position_set(position);
+    CHECK(app_wait_rest(60000));
+}
+
+static void test_dropout(void)
+{
+    static const int16_t targets[] = { 400, 380, 200, 230, 600, 300, 310, 150 };
+    uint8_t failures = 0;
+    int32_t max_error = 0;
+    int32_t travel = 0;
+
+    setup(300);
+    desk_params(0)->sensor_dead = true;
+
+    /* Movements without ticks, until the sensor is considered failed */
+    while (!(app_state()->flags & CTRL_FLAG_DEAD_RECKONING) && failures < 10) {
+        move_to(350);
+        failures++;
+    }
+
+    REPORT("sensor failure recognized after %u movements, position error %d ticks", failures, position_error());
+    CHECK(failures == CTRL_DEAD_RECKONING_FAILURES);
+    CHECK(app_state()->flags & CTRL_FLAG_DEAD_RECKONING);
+
+    /* Homing without ticks drives past the limit, so the estimate starts from the end stop */
+    uint8_t data[] = { 0x88, CTRL_EXTREMUM_POS_BOTTOM };
+
+    app_command(data, sizeof(data));
+    CHECK(app_wait_rest(60000));
+    REPORT("homed without ticks: position error %d ticks, end stop %s", position_error(),
+        desk_state(0)->stop_hits > 0 ? "reached" : "not reached");
+    CHECK(desk_state(0)->stop_hits > 0);
+    CHECK(position_error() == 0);
+
+    for (uint8_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        int32_t from = app_state()->position;
+
+        move_to(targets[i]);
+
+        int32_t error = position_error();
+
+        REPORT("estimated %4d -> %4d: error %3d ticks, uncertainty %u subticks", from, targets[i], error,
+            app_state()->uncertainty);
+        max_error = abs(error) > max_error ? abs(error) : max_error;
+        travel += abs(targets[i] - from);
+        CHECK(app_state()->flags & CTRL_FLAG_DEAD_RECKONING);
+        /* Estimate is within its own uncertainty */
+        CHECK(abs(error) * CTRL_SUBTICK_SCALE <= app_state()->uncertainty);
+    }
+
+    REPORT("largest error %d ticks over %d ticks of travel", max_error, travel);
+    CHECK(max_error * 100 <= travel * ERROR_PERCENT);
+
+    /* Sensor works again, the first edge returns to tick counting */
+    desk_params(0)->sensor_dead = false;
+    move_to(300);
+    CHECK(!(app_state()->flags & CTRL_FLAG_DEAD_RECKONING));
+
+    int32_t error = position_error();
+
+    move_to(400);
+    move_to(300);
+    REPORT("sensor restored: error %d ticks, then %d after two movements", error, position_error());
+    CHECK(position_error() == error);
+}
+
+int main(void)
+{
+    test_dropout();
+
+    return check_result("test_reckoning");
+}
@@ -0,0 +1,162 @@
+#include "app.h"
+#include "calibration.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sequencer.h"
+#include "sim.h"
+
+/**
+ * Motion sequences queued over the control characteristic: an "up, wait, back down" routine on the plant with the time
+ * between the settled desk and the start of the next step, sequence cleared during a dwell or replaced by a direct
+ * target, and the queue bound.
+ */
+
+#define CMD_SEQ_TARGET 0x61 /* CTRL_COMMAND_SEQ_TARGET */
+#define CMD_SEQ_DWELL 0x62 /* CTRL_COMMAND_SEQ_DWELL */
+#define CMD_SEQ_CLEAR 0x6F /* CTRL_COMMAND_SEQ_CLEAR */
+#define DWELL_UNIT_MS 100 /* CTRL_DWELL_UNIT_MS */
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+}
+
+static void queue_target(uint16_t millimeters)
+{
+    uint8_t data[] = { CMD_SEQ_TARGET, (uint8_t)millimeters, (uint8_t)(millimeters >> 8) };
+
+    app_command(data, sizeof(data));
+}
+
+static void queue_dwell(uint16_t units)
+{
+    uint8_t data[] = { CMD_SEQ_DWELL, (uint8_t)units, (uint8_t)(units >> 8) };
+
+    app_command(data, sizeof(data));
+}
+
+static uint16_t height_mm(int16_t position)
+{
+    return (uint16_t)(calibration_subtick_to_height(position * CTRL_SUBTICK_SCALE) / 1000);
+}
+
+static int16_t mm_to_ticks(uint16_t millimeters)
+{
+    return (int16_t)(calibration_height_to_subtick(millimeters * 1000) / CTRL_SUBTICK_SCALE);
+}
+
+static bool is_driven(void)
+{
+    return desk_is_driven(0);
+}
+
+/**
+ * @brief   Waits until the desk rests, then until the motor starts again, and returns the time in between.
+ */
+static uint32_t idle_time(uint32_t timeout_ms)
+{
+    CHECK(sim_run_until(app_is_at_rest, timeout_ms));
+
+    uint32_t rest = sim_time_ms();
+
+    CHECK(sim_run_until(is_driven, timeout_ms));
+    return sim_time_ms() - rest;
+}
+
+static void test_routine(void)
+{
+    setup(200);
+
+    uint16_t sitting = height_mm(200);
+    uint16_t standing = sitting + 100;
+
+    queue_target(standing);
+    queue_dwell(5000 / DWELL_UNIT_MS);
+    queue_target(sitting);
+    CHECK(sequencer_is_running());
+
+    uint32_t dwell = idle_time(60000);
+    int16_t top = app_state()->position;
+
+    CHECK(app_wait_rest(60000));
+    REPORT("up to %d mm (%d ticks, reached %d), next step %u ms after rest with 5000 ms dwell, back at %d ticks", standing,
+        mm_to_ticks(standing), top, dwell, app_state()->position);
+    CHECK(dwell >= 5000 && dwell <= 5000 + 50);
+    CHECK_NEAR(top, mm_to_ticks(standing), SEQUENCER_TARGET_TOLERANCE);
+    CHECK_NEAR(app_state()->position, 200, SEQUENCER_TARGET_TOLERANCE);
+
+    sim_run_ms(1000);
+    CHECK(!sequencer_is_running());
+}
+
+static void test_back_to_back(void)
+{
+    setup(200);
+    queue_target(height_mm(250));
+    queue_target(height_mm(300));
+
+    uint32_t gap = idle_time(60000);
+
+    CHECK(app_wait_rest(60000));
+    REPORT("next target started %u ms after rest", gap);
+    CHECK(gap <= 50);
+    CHECK_NEAR(app_state()->position, 300, SEQUENCER_TARGET_TOLERANCE);
+}
+
+static void test_clear(void)
+{
+    uint8_t clear = CMD_SEQ_CLEAR;
+
+    setup(200);
+    queue_target(height_mm(260));
+    queue_dwell(20);
+    queue_target(height_mm(200));
+    CHECK(app_wait_rest(60000));
+    sim_run_ms(1000);
+    app_command(&clear, sizeof(clear));
+    sim_run_ms(5000);
+    CHECK(!desk_is_driven(0));
+    CHECK(!sequencer_is_running());
+    CHECK_NEAR(app_state()->position, 260, SEQUENCER_TARGET_TOLERANCE);
+
+    /* Direct target replaces the sequence */
+    queue_target(height_mm(300));
+    queue_dwell(10);
+    queue_target(height_mm(200));
+    sim_run_ms(500);
+    app_command_target_mm(height_mm(240));
+    CHECK(app_wait_rest(60000));
+    sim_run_ms(5000);
+    CHECK(!sequencer_is_running());
+    CHECK_NEAR(app_state()->position, 240, 1);
+}
+
+static void test_queue_bound(void)
+{
+    uint8_t accepted = 0;
+
+    setup(200);
+
+    /* First step is started immediately, so it does not take a queue slot */
+    for (uint8_t i = 0; i < SEQUENCER_QUEUE_SIZE + 2; i++) {
+        accepted += sequencer_enqueue(SEQUENCER_STEP_DWELL, 1000) ? 1 : 0;
+    }
+
+    CHECK(accepted == SEQUENCER_QUEUE_SIZE + 1);
+    CHECK(!sequencer_enqueue(SEQUENCER_STEP_DWELL, -1));
+    sequencer_clear();
+}
+
+int main(void)
+{
+    test_routine();
+    test_back_to_back();
+    test_clear();
+    test_queue_bound();
+
+    return check_result("test_sequencer");
+}
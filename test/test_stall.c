@@ -0,0 +1,91 @@
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+
+/**
+ * Stall detection against the end stop model: the desk is stopped soon after the column hits a stop before the
+ * target, from the measured tick period, and is not stopped by a slow loaded start.
+ */
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    desk_params(0)->upper = 600 * DESK_SUBTICKS_PER_TICK; /* Stop lower than the configured limit */
+    app_boot_at(position);
+}
+
+/**
+ * @brief   Runs until the column hits an end stop, then measures time until the motor is released.
+ */
+static uint32_t stall_latency_ms(uint32_t timeout_ms)
+{
+    uint32_t hits = desk_state(0)->stop_hits;
+    uint32_t deadline = sim_time_ms() + timeout_ms;
+
+    while (desk_state(0)->stop_hits == hits && sim_time_ms() < deadline) {
+        sim_run_ms(1);
+    }
+
+    uint32_t hit_time = sim_time_ms();
+
+    while (desk_is_driven(0) && sim_time_ms() < deadline) {
+        sim_run_ms(1);
+    }
+
+    return sim_time_ms() - hit_time;
+}
+
+static void test_stop_before_target(void)
+{
+    setup(400);
+
+    controller_target_position_set(700);
+    uint32_t latency = stall_latency_ms(30000);
+
+    REPORT("stall detected %u ms after the end stop hit", latency);
+    CHECK(latency < 150);
+    CHECK(app_wait_rest(2000));
+    CHECK_NEAR(controller_position_get(), desk_height(0), DESK_SUBTICKS_PER_TICK);
+    CHECK(app_state()->target_type == CTRL_TARGET_TYPE_NONE);
+}
+
+static void test_loaded_start_is_not_stall(void)
+{
+    setup(100);
+    desk_params(0)->load = 0.6;
+
+    controller_target_position_set(300);
+    CHECK(app_wait_rest(60000));
+    CHECK(desk_state(0)->stop_hits == 0);
+    CHECK(app_state()->target_type == CTRL_TARGET_TYPE_NONE);
+    CHECK_NEAR(controller_position_get(), desk_height(0), DESK_SUBTICKS_PER_TICK);
+    /* Load shortens the coast below the not yet learned stop lead */
+    CHECK_NEAR(desk_height(0), 300 * DESK_SUBTICKS_PER_TICK, 2 * DESK_SUBTICKS_PER_TICK);
+}
+
+static void test_start_at_stop(void)
+{
+    setup(0);
+
+    uint32_t start = sim_time_ms();
+    controller_extremum_position_set(CTRL_EXTREMUM_POS_BOTTOM);
+    CHECK(app_wait_rest(3000));
+
+    uint32_t duration = sim_time_ms() - start;
+    REPORT("drive into the stop with no tick released after %u ms", duration);
+    CHECK(duration <= 1300);
+    CHECK(controller_position_get() == 0);
+}
+
+int main(void)
+{
+    test_stop_before_target();
+    test_loaded_start_is_not_stall();
+    test_start_at_stop();
+
+    return check_result("test_stall");
+}
@@ -0,0 +1,102 @@
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+
+/**
+ * Sub-tick interpolation against the plant position: error of the interpolated position when the controller poll
+ * updates it, and as read every millisecond of a driven movement (it ages until the next poll), compared with the
+ * error of the whole tick position.
+ */
+
+typedef struct
+{
+    double updated_mean; /* Error at the poll, which updated the estimate */
+    double updated_max;
+    double read_mean; /* Error of the estimate read at any time */
+    double whole_mean;
+} estimate_error_t;
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+}
+
+/**
+ * @brief   Moves to the target and compares the estimate with the motor position, in the middle of the travel.
+ * @note    Single phase sensor counts the tick on the edge it passes, so while moving down position N is reported
+ *          from the edge of tick N + 1 on, the plant position is shifted by this tick.
+ */
+static estimate_error_t measure(int16_t from, int16_t to)
+{
+    estimate_error_t error = { 0 };
+    uint32_t samples = 0;
+    uint32_t updates = 0;
+    double shift = to < from ? DESK_SUBTICKS_PER_TICK : 0;
+    double low = (from < to ? from : to) + 20;
+    double high = (from < to ? to : from) - 20;
+
+    setup(from);
+    controller_target_position_set(to);
+
+    int32_t estimate = controller_position_get();
+
+    for (uint32_t i = 0; i < 60000 && !app_is_at_rest(); i++) {
+        sim_run_ms(1);
+
+        double truth = desk_state(0)->motor - shift;
+        bool updated = controller_position_get() != estimate;
+
+        estimate = controller_position_get();
+
+        if (truth < low * DESK_SUBTICKS_PER_TICK || truth > high * DESK_SUBTICKS_PER_TICK) {
+            continue;
+        }
+
+        double interpolated = fabs(estimate - truth);
+
+        error.read_mean += interpolated;
+        error.whole_mean += fabs(app_state()->position * DESK_SUBTICKS_PER_TICK - truth);
+        samples++;
+
+        if (updated) {
+            error.updated_mean += interpolated;
+            if (interpolated > error.updated_max) {
+                error.updated_max = interpolated;
+            }
+            updates++;
+        }
+    }
+
+    CHECK(samples > 1000);
+    CHECK(updates > samples / 20);
+    error.updated_mean /= updates;
+    error.read_mean /= samples;
+    error.whole_mean /= samples;
+
+    return error;
+}
+
+static void test_direction(int16_t from, int16_t to)
+{
+    estimate_error_t error = measure(from, to);
+
+    REPORT("%d -> %d: interpolated error at update mean %.1f max %.1f, as read mean %.1f, whole tick error mean %.1f subticks",
+        from, to, error.updated_mean, error.updated_max, error.read_mean, error.whole_mean);
+    CHECK(error.updated_mean < DESK_SUBTICKS_PER_TICK / 8);
+    CHECK(error.updated_max < DESK_SUBTICKS_PER_TICK / 2);
+    /* Poll runs every 10 ms, the desk moves about half a tick in that time */
+    CHECK(error.read_mean < DESK_SUBTICKS_PER_TICK / 2);
+}
+
+int main(void)
+{
+    test_direction(100, 500);
+    test_direction(500, 100);
+
+    return check_result("test_subtick");
+}
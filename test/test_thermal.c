@@ -0,0 +1,151 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+#include "thermal.h"
+
+/**
+ * Motor thermal budget under a heavy usage script, a client moving the desk between the limits with short pauses:
+ * motor run time until the first refused movement, the budget reported in status, refusal kept over a reboot, and the
+ * duty cycle the script gets over an hour, which has to stay at the rated THERMAL_DUTY_PERCENT.
+ */
+
+#define STATUS_LENGTH 10 /* STATUS_CHAR_LENGTH */
+#define PAUSE_MS 2000 /* Time between the rest and the next movement of the script */
+#define HOUR_MS 3600000UL
+
+static uint32_t m_driven_ms; /* Motor run time of the script, weighted by the duty */
+static uint32_t m_refused;
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+    app_connect();
+    m_driven_ms = 0;
+    m_refused = 0;
+}
+
+static uint8_t status_budget(void)
+{
+    uint8_t value[STATUS_LENGTH];
+
+    CHECK(sim_ble_value_get(app_status_handle(), value, sizeof(value)) == STATUS_LENGTH);
+    return value[9];
+}
+
+/**
+ * @brief   Runs the simulation for the time and integrates motor run time weighted by the duty, like the thermal model.
+ *          Notifications are sent every 10 ms, like on connection events.
+ */
+static void run(uint32_t duration_ms)
+{
+    static uint32_t m_duty_us;
+
+    for (uint32_t i = 0; i < duration_ms; i++) {
+        sim_run_ms(1);
+        m_duty_us += desk_is_driven(0) ? 10 * sim_pwm_duty_get(0) : 0;
+        m_driven_ms += m_duty_us / 1000;
+        m_duty_us %= 1000;
+
+        if (sim_time_ms() % 10 == 0) {
+            app_tx_complete();
+        }
+    }
+}
+
+/**
+ * @brief   Sends the script's next movement, returns false if it was refused.
+ */
+static bool step(int16_t target)
+{
+    controller_target_position_set(target);
+    run(10);
+
+    if (!desk_is_driven(0) && (app_state()->flags & CTRL_FLAG_THERMAL_LIMIT)) {
+        m_refused++;
+        run(PAUSE_MS);
+        return false;
+    }
+
+    while (!app_is_at_rest()) {
+        run(10);
+    }
+    run(PAUSE_MS);
+    return true;
+}
+
+static void test_exhaustion(void)
+{
+    uint32_t moves = 0;
+    int16_t target = 700;
+
+    setup(100);
+    CHECK(status_budget() == 100);
+
+    while (step(target)) {
+        target = target == 700 ? 100 : 700;
+        moves++;
+    }
+
+    REPORT("budget exhausted after %u movements, %u s of motor run at full duty, %u s of script", moves,
+        m_driven_ms / 1000, sim_time_ms() / 1000);
+    CHECK(m_driven_ms >= THERMAL_BUDGET_S * 1000);
+    CHECK(m_driven_ms <= (THERMAL_BUDGET_S + THERMAL_GRACE_S) * 1000);
+    CHECK(status_budget() == 0);
+    CHECK(thermal_is_exhausted());
+
+    /* Heat is kept over a reboot, no cooling is assumed while without power */
+    app_reboot(false);
+    app_connect();
+    controller_target_position_set(target);
+    run(1000);
+    CHECK(!desk_is_driven(0));
+    CHECK(app_state()->flags & CTRL_FLAG_THERMAL_LIMIT);
+}
+
+static void test_hour(void)
+{
+    uint32_t moves = 0;
+    uint32_t start_ms;
+    uint32_t start_driven_ms;
+    int16_t target = 700;
+
+    setup(100);
+
+    /* Budget is used up first, then the script runs at the pace the motor cools down */
+    while (step(target)) {
+        target = target == 700 ? 100 : 700;
+    }
+
+    start_ms = sim_time_ms();
+    start_driven_ms = m_driven_ms;
+    m_refused = 0;
+
+    while (sim_time_ms() - start_ms < HOUR_MS) {
+        if (step(target)) {
+            target = target == 700 ? 100 : 700;
+            moves++;
+        }
+    }
+
+    uint32_t duty = ((m_driven_ms - start_driven_ms) * 100) / (sim_time_ms() - start_ms);
+
+    REPORT("hour of the script on exhausted budget: %u movements, %u refused, motor duty %u%%", moves, m_refused, duty);
+    CHECK(moves > 0);
+    CHECK(m_refused > 0);
+    CHECK(duty <= THERMAL_DUTY_PERCENT);
+    CHECK(duty >= THERMAL_DUTY_PERCENT / 2);
+}
+
+int main(void)
+{
+    test_exhaustion();
+    test_hour();
+
+    return check_result("test_thermal");
+}
@@ -0,0 +1,90 @@
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+
+/**
+ * Trajectory planner benchmark on the plant: time from the command to the motor cut and to the settled desk (which
+ * includes the no-tick timeout, after which the position is final), and the final error, for short and long moves in
+ * both directions, after the dynamics were learned by a few moves.
+ */
+
+#define WARM_UP_MOVES 8
+
+typedef struct
+{
+    int16_t from;
+    int16_t to;
+} move_t;
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+}
+
+static bool is_released(void)
+{
+    return !desk_is_driven(0);
+}
+
+static void move(int16_t from, int16_t to, uint32_t* p_cut_ms, uint32_t* p_duration_ms, double* p_error)
+{
+    controller_target_position_set(from);
+    CHECK(app_wait_rest(120000));
+
+    uint32_t start = sim_time_ms();
+
+    controller_target_position_set(to);
+    sim_run_ms(1);
+    CHECK(sim_run_until(is_released, 120000));
+    *p_cut_ms = sim_time_ms() - start;
+    CHECK(app_wait_rest(120000));
+
+    /* Desk should rest in the middle of the target tick */
+    double target = to * DESK_SUBTICKS_PER_TICK + DESK_SUBTICKS_PER_TICK / 2;
+
+    *p_duration_ms = sim_time_ms() - start;
+    *p_error = desk_height(0) - target;
+}
+
+static void test_benchmark(void)
+{
+    static const move_t moves[] = { { 300, 305 }, { 305, 300 }, { 300, 330 }, { 330, 300 }, { 200, 300 }, { 300, 200 },
+        { 100, 500 }, { 500, 100 } };
+    uint32_t cut;
+    uint32_t duration;
+    double error;
+    double error_sum = 0;
+
+    setup(300);
+
+    for (uint8_t i = 0; i < WARM_UP_MOVES; i++) {
+        move(300, i % 2 ? 200 : 400, &cut, &duration, &error);
+    }
+
+    for (uint8_t i = 0; i < sizeof(moves) / sizeof(moves[0]); i++) {
+        move(moves[i].from, moves[i].to, &cut, &duration, &error);
+
+        uint32_t distance = moves[i].to > moves[i].from ? moves[i].to - moves[i].from : moves[i].from - moves[i].to;
+        double cruise_ms = distance * DESK_SUBTICKS_PER_TICK * 1000.0 / desk_params(0)->speed_up;
+
+        REPORT("%3d -> %3d: motor cut after %5u ms (%5.0f ms at full speed), rest after %5u ms, error %4.0f subticks",
+            moves[i].from, moves[i].to, cut, cruise_ms, duration, error);
+        CHECK(cut < cruise_ms * 1.1 + 500);
+        CHECK(fabs(error) < DESK_SUBTICKS_PER_TICK / 2);
+        error_sum += fabs(error);
+    }
+
+    REPORT("mean error %.0f subticks", error_sum / (sizeof(moves) / sizeof(moves[0])));
+}
+
+int main(void)
+{
+    test_benchmark();
+
+    return check_result("test_trajectory");
+}
@@ -0,0 +1,196 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A week of office usage replayed on the plant with the synced clock: sit and stand cycles on workdays, a long standing
+ * meeting, an idle weekend and a power loss. Statistics read from the usage characteristic are compared with the
+ * script: time in each height band, moves today and yesterday across the midnight rollover, total travel, the standing
+ * streaks, and what is lost with the power, which may be only the time since the last checkpoint.
+ */
+
+#define USAGE_LENGTH (USAGE_BAND_COUNT * 4 + 16 + 12 + 4) /* Bands, statistics, lifetime counters and rejected ticks */
+#define EPOCH_MONDAY 1790208000UL /* Monday 2026-09-28 00:00 UTC */
+#define UTC_OFFSET_MIN 120
+#define DAY_S 86400UL
+#define HOUR_S 3600UL
+
+#define SITTING 190 /* Band 0, below USAGE_STAND_HEIGHT_UM */
+#define STANDING 500 /* Band 2 */
+#define WORKDAYS 5
+
+typedef struct
+{
+    uint32_t band_minutes[USAGE_BAND_COUNT];
+    uint16_t moves_today;
+    uint16_t moves_yesterday;
+    uint32_t moves;
+    uint32_t travel_mm;
+    uint16_t streak_min;
+    uint16_t streak_max_min;
+} usage_value_t;
+
+static uint32_t m_local_s; /* Local time of the script, seconds since Monday midnight */
+static uint32_t m_moves;
+static uint32_t m_travel; /* Ticks */
+static uint32_t m_last_travel[2]; /* Of the last two movements, the latest second */
+
+static void sync_clock(void)
+{
+    uint32_t epoch = EPOCH_MONDAY - UTC_OFFSET_MIN * 60 + m_local_s;
+
+    app_connect();
+    app_time_write(epoch, 0, UTC_OFFSET_MIN);
+    app_disconnect();
+}
+
+static void setup(int16_t position)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    app_boot_at(position);
+    m_local_s = 0;
+    m_moves = 0;
+    m_travel = 0;
+    sync_clock();
+}
+
+static void read_usage(usage_value_t* p_usage)
+{
+    uint8_t value[USAGE_LENGTH];
+    uint8_t offset = USAGE_BAND_COUNT * 4;
+
+    CHECK(sim_ble_value_get(app_usage_handle(), value, sizeof(value)) == USAGE_LENGTH);
+    memcpy(p_usage->band_minutes, value, sizeof(p_usage->band_minutes));
+    memcpy(&p_usage->moves_today, value + offset, sizeof(uint16_t));
+    memcpy(&p_usage->moves_yesterday, value + offset + 2, sizeof(uint16_t));
+    memcpy(&p_usage->moves, value + offset + 4, sizeof(uint32_t));
+    memcpy(&p_usage->travel_mm, value + offset + 8, sizeof(uint32_t));
+    memcpy(&p_usage->streak_min, value + offset + 12, sizeof(uint16_t));
+    memcpy(&p_usage->streak_max_min, value + offset + 14, sizeof(uint16_t));
+}
+
+/**
+ * @brief   Advances the script to the local time of the week, the desk stays where it is.
+ */
+static void wait_until(uint32_t local_s)
+{
+    sim_run_ms((local_s - m_local_s) * 1000);
+    m_local_s = local_s;
+}
+
+/**
+ * @brief   Moves the desk at the local time, the movement takes part of the following time.
+ */
+static void move_at(uint32_t local_s, int16_t position)
+{
+    int16_t from = app_state()->position;
+
+    wait_until(local_s);
+    controller_target_position_set(position);
+    CHECK(app_wait_rest(60000));
+    m_moves++;
+    m_last_travel[0] = m_last_travel[1];
+    m_last_travel[1] = abs(app_state()->position - from);
+    m_travel += m_last_travel[1];
+}
+
+/**
+ * @brief   Sits and stands the workday: standing 45 minutes of four hours, and for the meeting, if given.
+ */
+static void workday(uint32_t day, uint32_t meeting_hours)
+{
+    static const uint8_t hours[] = { 9, 10, 11, 14 };
+    uint32_t midnight = day * DAY_S;
+
+    for (uint8_t i = 0; i < sizeof(hours) / sizeof(hours[0]); i++) {
+        move_at(midnight + hours[i] * HOUR_S, STANDING);
+        move_at(midnight + hours[i] * HOUR_S + 45 * 60, SITTING);
+    }
+
+    if (meeting_hours > 0) {
+        move_at(midnight + 15 * HOUR_S, STANDING);
+        move_at(midnight + (15 + meeting_hours) * HOUR_S, SITTING);
+    }
+}
+
+static void test_week(void)
+{
+    usage_value_t usage;
+    uint32_t standing_min = 0;
+
+    setup(SITTING);
+
+    for (uint32_t day = 0; day < WORKDAYS; day++) {
+        workday(day, day == 2 ? 2 : 0);
+        standing_min += 4 * 45 + (day == 2 ? 120 : 0);
+
+        if (day == 3) {
+            /* Power is lost right after the last movement, checkpoints are at full hours of uptime */
+            uint32_t moves_before;
+            uint32_t moves_lost;
+
+            wait_until(day * DAY_S + 14 * HOUR_S + 50 * 60);
+            read_usage(&usage);
+            moves_before = usage.moves;
+            app_reboot(false);
+            sync_clock();
+            read_usage(&usage);
+            moves_lost = moves_before - usage.moves;
+            REPORT("power lost at 14:50: %u of %u moves lost", moves_lost, moves_before);
+            /* Movements at 14:00 and 14:45 and the standing between them are after the checkpoint */
+            CHECK(moves_lost == 2);
+            CHECK(usage.moves_today == 6);
+            m_moves -= moves_lost;
+            m_travel -= m_last_travel[0] + m_last_travel[1];
+            standing_min -= 45;
+        }
+
+        wait_until((day + 1) * DAY_S);
+        read_usage(&usage);
+        REPORT("day %u over midnight: %u moves today, %u yesterday", day, usage.moves_today, usage.moves_yesterday);
+        CHECK(usage.moves_today == 0);
+        CHECK(usage.moves_yesterday == (day == 2 ? 10 : (day == 3 ? 6 : 8)));
+    }
+
+    /* Weekend without movement */
+    wait_until(7 * DAY_S);
+    read_usage(&usage);
+
+    uint32_t total_min = 0;
+    uint32_t travel_mm = (m_travel * TICK_TO_HEIGHT_MULTI) / 1000;
+
+    for (uint8_t i = 0; i < USAGE_BAND_COUNT; i++) {
+        total_min += usage.band_minutes[i];
+    }
+
+    REPORT("week: bands %u %u %u %u min of %u, %u moves, travel %u mm, longest streak %u min", usage.band_minutes[0],
+        usage.band_minutes[1], usage.band_minutes[2], usage.band_minutes[3], 7 * 24 * 60, usage.moves, usage.travel_mm,
+        usage.streak_max_min);
+    CHECK(usage.moves == m_moves);
+    CHECK(usage.moves_today == 0 && usage.moves_yesterday == 0);
+    /* Position reported while the desk settles may step back by a tick */
+    CHECK_NEAR(usage.travel_mm, travel_mm, (m_moves * TICK_TO_HEIGHT_MULTI) / 1000);
+    /* Time is lost only between the last checkpoint and the power loss */
+    CHECK(total_min <= 7 * 24 * 60);
+    CHECK(total_min + USAGE_CHECKPOINT_S / 60 >= 7 * 24 * 60);
+    /* Movements take under a minute each */
+    CHECK_NEAR(usage.band_minutes[2], standing_min, m_moves);
+    CHECK(usage.band_minutes[1] <= m_moves);
+    CHECK(usage.band_minutes[3] == 0);
+    CHECK(usage.streak_max_min == 120);
+    CHECK(usage.streak_min == 0);
+}
+
+int main(void)
+{
+    test_week();
+
+    return check_result("test_usage");
+}
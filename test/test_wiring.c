@@ -0,0 +1,98 @@
+#include "acromegaly_config.h"
+#include "app.h"
+#include "check.h"
+#include "controller.h"
+#include "desk.h"
+#include "sim.h"
+#include <stdlib.h>
+
+/**
+ * Tick direction decoded from phase B, on a plant with swapped motor leads: how far the desk runs opposite to the
+ * driven direction before it is stopped, and that the end stop is never reached. On correct wiring, movements with
+ * reversals in the middle, which coast against the new direction, must not be taken for miswiring.
+ */
+
+#define WARM_UP_MOVES 4
+
+static void setup(int16_t position, bool swapped)
+{
+    sim_reset();
+    sim_flash_reset();
+    desk_init(CTRL_CHANNEL_COUNT);
+    desk_params(0)->swapped = swapped;
+    app_boot_at(position);
+}
+
+/**
+ * @brief   Returns counted position less the tick the motor is on.
+ */
+static int32_t position_error(void)
+{
+    return app_state()->position - (int32_t)floor(desk_state(0)->motor / DESK_SUBTICKS_PER_TICK);
+}
+
+/**
+ * @brief   Drives towards the target on swapped wiring, checks the desk is stopped before it runs away.
+ */
+static void swapped(int16_t from, int16_t to)
+{
+    setup(from, true);
+
+    uint32_t start = sim_time_ms();
+
+    controller_target_position_set(to);
+    CHECK(app_wait_rest(60000));
+
+    int32_t actual = (int32_t)floor(desk_state(0)->motor / DESK_SUBTICKS_PER_TICK);
+
+    REPORT("swapped leads, %d -> %d: stopped at %d after running %d ticks the wrong way, at rest after %u ms, position error %d",
+        from, to, actual, abs(actual - from), sim_time_ms() - start, position_error());
+    CHECK(app_state()->flags & CTRL_FLAG_MISWIRED);
+    CHECK(desk_state(0)->stop_hits == 0);
+    /* Stopped after CTRL_MISWIRING_TICKS, the rest is coasting */
+    CHECK(abs(actual - from) <= 2 * CTRL_MISWIRING_TICKS);
+    CHECK((actual - from) * (to - from) < 0);
+    /* Ticks are counted in the direction the desk really moved */
+    CHECK(position_error() == 0);
+}
+
+static void test_swapped(void)
+{
+    swapped(300, 500);
+    swapped(300, 100);
+    /* Next to the end stop, which it would hit within a few ticks of counting the wrong way */
+    swapped(TICK_LOWER_LIMIT + 20, 300);
+}
+
+static void test_reversals(void)
+{
+    static const int16_t targets[] = { 200, 500, 150, 450 };
+
+    setup(300, false);
+
+    for (uint8_t i = 0; i < WARM_UP_MOVES; i++) {
+        controller_target_position_set(i % 2 ? 200 : 400);
+        CHECK(app_wait_rest(60000));
+    }
+
+    /* Target is reversed at full speed, the desk coasts against the new direction */
+    for (uint8_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        controller_target_position_set(targets[i]);
+        sim_run_ms(1500);
+        controller_target_position_set(targets[i] > 300 ? 150 : 450);
+        CHECK(app_wait_rest(60000));
+
+        REPORT("reversed towards %d: at %d, position error %d, %s", targets[i] > 300 ? 150 : 450,
+            app_state()->position, position_error(), app_state()->flags & CTRL_FLAG_MISWIRED ? "miswired" : "ok");
+        CHECK(!(app_state()->flags & CTRL_FLAG_MISWIRED));
+        CHECK(abs(position_error()) <= 1);
+    }
+}
+
+int main(void)
+{
+    test_swapped();
+    test_reversals();
+
+    return check_result("test_wiring");
+}
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""
+Generates config/height_lut.h from measurements of the countertop height.
+
+Input CSV has `tick,height_um` rows (header and # comments are skipped), measured along the whole travel.
+Measurements are fitted with a line through the lowest and the highest sample. The line is the linear part
+of the conversion, to be written to the calibration characteristic. Header keeps the line, so the firmware ignores
+the table under a different calibration, and deviations from it,
+resampled to nodes uniformly spaced every 2^shift ticks, so the firmware finds a node with a shift.
+
+Usage: gen_height_lut.py measurements.csv height_lut.h [--shift 6] [--upper 816]
+"""
+
+import argparse
+import csv
+import sys
+
+
+def load(path):
+    points = []
+    with open(path, newline="") as f:
+        for row in csv.reader(f):
+            if not row or row[0].strip().startswith("#"):
+                continue
+            try:
+                points.append((int(row[0]), int(row[1])))
+            except ValueError:
+                continue  # Header
+    points.sort()
+    if len(points) < 2:
+        sys.exit("At least two measurements are required")
+    return points
+
+
+def interpolate(points, tick):
+    if tick <= points[0][0]:
+        (t0, h0), (t1, h1) = points[0], points[1]
+    elif tick >= points[-1][0]:
+        (t0, h0), (t1, h1) = points[-2], points[-1]
+    else:
+        i = next(i for i in range(1, len(points)) if points[i][0] >= tick)
+        (t0, h0), (t1, h1) = points[i - 1], points[i]
+    return h0 + (h1 - h0) * (tick - t0) / (t1 - t0)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("csv")
+    parser.add_argument("header")
+    parser.add_argument("--shift", type=int, default=6, help="log2 of node spacing, in ticks")
+    parser.add_argument("--upper", type=int, default=816, help="upper limit, in ticks")
+    args = parser.parse_args()
+
+    points = load(args.csv)
+    (t_lo, h_lo), (t_hi, h_hi) = points[0], points[-1]
+
+    tick_height = round((h_hi - h_lo) / (t_hi - t_lo))
+    base_height = round(h_lo - t_lo * tick_height)
+
+    count = (args.upper >> args.shift) + 2  # Node past the upper limit keeps interpolation in bounds
+    nodes = []
+    for i in range(count):
+        tick = i << args.shift
+        deviation = round(interpolate(points, tick) - (base_height + tick * tick_height))
+        if not -32768 <= deviation <= 32767:
+            sys.exit("Deviation at tick %d out of int16 range" % tick)
+        nodes.append(deviation)
+
+    rows = []
+    for i in range(0, count, 8):
+        rows.append("    " + ", ".join("%d" % n for n in nodes[i:i + 8]) + ",")
+
+    with open(args.header, "w") as f:
+        f.write("""#ifndef HEIGHT_LUT_H__
+#define HEIGHT_LUT_H__
+
+/*
+ * Generated by tools/gen_height_lut.py from %s, do not edit.
+ * Linear part: base height %d um, tick height %d um.
+ */
+
+#include <stdint.h>
+
+#define HEIGHT_LUT_BASE_HEIGHT %d /* Linear part the deviations are measured against, in um */
+#define HEIGHT_LUT_TICK_HEIGHT %d
+#define HEIGHT_LUT_SHIFT %d /* Nodes are spaced every 2^HEIGHT_LUT_SHIFT ticks */
+#define HEIGHT_LUT_COUNT %d
+
+/* Deviation of the measured height from the linear part at each node, in um */
+static const int16_t m_height_lut[HEIGHT_LUT_COUNT] = {
+%s
+};
+
+#endif
+""" % (args.csv.split("/")[-1], base_height, tick_height, base_height, tick_height, args.shift, count, "\n".join(rows)))
+
+    print("Calibration: base height %d um, tick height %d um" % (base_height, tick_height))
+
+
+if __name__ == "__main__":
+    main()